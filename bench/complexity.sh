@@ -0,0 +1,156 @@
+#!/bin/bash
+# Usage: ./complexity.sh [size|imports|locals]...
+#
+# Complexity regression detector.  Generates programs at doubling sizes
+# with bcgen, compiles each with `bcc -c --time-report` under the
+# allocation counting shim, and fits the growth exponent of time and
+# allocation count of every phase against the number of source lines.
+#
+# Each phase has a declared bound in bench/complexity_bounds.txt.  The fit
+# is done on measurement / bound(n) in log-log space; a slope above
+# COMPLEXITY_TOLERANCE (default 0.25) means the phase grows faster than its
+# bound and the run fails.  The tolerance absorbs timing noise and the log
+# factor between neighbouring bounds: it catches a phase moving up a whole
+# class (n to n2), not n to nlogn.  Phases whose largest time is below
+# COMPLEXITY_MIN_SECONDS (default 0.005) are too fast to fit and are skipped.
+# COMPLEXITY_BOUNDS selects another bounds file.
+#
+# Dimensions:
+#   size     one module grown to doubling byte sizes (default)
+#   imports  doubling number of imported modules
+#   locals   one function with a doubling number of locals (up to 32768)
+
+ROOT_DIR="$(cd "$(dirname "$0")/.." && pwd)"
+OUT_DIR="$ROOT_DIR/bench/out/complexity"
+BOUNDS="${COMPLEXITY_BOUNDS:-$ROOT_DIR/bench/complexity_bounds.txt}"
+BCC="$ROOT_DIR/build/bcc"
+BCGEN="$ROOT_DIR/build/bcgen"
+SHIM="$ROOT_DIR/build/liballoc_counter.so"
+TOLERANCE=${COMPLEXITY_TOLERANCE:-0.25}
+MIN_SECONDS=${COMPLEXITY_MIN_SECONDS:-0.005}
+REPEAT=${COMPLEXITY_REPEAT:-3}
+
+if [ ! -x "$BCC" ] || [ ! -x "$BCGEN" ] || [ ! -f "$SHIM" ]; then
+    echo "Compiler, generator or allocation shim missing, run 'make' first."
+    exit 1
+fi
+
+DIMENSIONS=("$@")
+if [ ${#DIMENSIONS[@]} -eq 0 ]; then
+    DIMENSIONS=(size)
+fi
+
+sweep_args() {
+    case "$1" in
+        size)    for v in 65536 131072 262144 524288 1048576 2097152; do echo "--size $v"; done ;;
+        imports) for v in 4 8 16 32 64 128; do echo "--imports $v"; done ;;
+        locals)  for v in 1024 2048 4096 8192 16384 32768; do echo "--functions 1 --locals $v"; done ;;
+        *)       return 1 ;;
+    esac
+}
+
+rm -rf "$OUT_DIR"
+mkdir -p "$OUT_DIR"
+FAILED=0
+
+for dim in "${DIMENSIONS[@]}"; do
+    sweep=$(sweep_args "$dim") || { echo "Unknown dimension: $dim"; exit 1; }
+    samples="$OUT_DIR/$dim.samples"
+    : > "$samples"
+
+    while read -r args; do
+        dir="$OUT_DIR/$dim-${args##* }"
+        mkdir -p "$dir"
+        # shellcheck disable=SC2086
+        "$BCGEN" --seed 1 --functions 16 --locals 8 --expr-depth 2 $args --output-dir "$dir"
+
+        # One sample line per run: "<phase> <lines> <seconds> <allocations>"
+        for ((i = 0; i < REPEAT; i++)); do
+            start=$(date +%s%N)
+            (cd "$dir" && LD_PRELOAD="$SHIM" "$BCC" -c --module-cache= --time-report main.bc > /dev/null 2> report.txt) 2> /dev/null
+            rc=$?
+            end=$(date +%s%N)
+            if [ $rc -ne 0 ]; then
+                echo "bcc failed with exit code $rc on $dir"
+                exit 1
+            fi
+            awk -v process="$(( end - start ))" '
+                /^Time report for/ { split($0, f, "("); split(f[2], g, " "); lines += g[1]; next }
+                /^  [a-z]+ / { secs[$1] += $2; allocs[$1] += $6; if (!($1 in seen)) { order[++n] = $1; seen[$1] = 1 } }
+                END {
+                    for (i = 1; i <= n; i++) printf "%s %d %.6f %d\n", order[i], lines, secs[order[i]], allocs[order[i]]
+                    printf "process %d %.6f -\n", lines, process / 1e9
+                }' "$dir/report.txt" >> "$samples"
+        done
+    done <<< "$sweep"
+
+    echo
+    echo "== $dim =="
+    awk -v tol="$TOLERANCE" -v min_secs="$MIN_SECONDS" '
+        function bound_value(b, n) {
+            if (b == "1") return 1
+            if (b == "logn") return log(n) / log(2)
+            if (b == "n") return n
+            if (b == "nlogn") return n * log(n) / log(2)
+            if (b == "n2") return n * n
+            return -1
+        }
+        # Least-squares slope of log(y / bound(n)) against log(n)
+        function fit(xs, ys, count, b,    i, x, y, sx, sy, sxx, sxy) {
+            sx = sy = sxx = sxy = 0
+            for (i = 1; i <= count; i++) {
+                x = log(xs[i])
+                y = log((ys[i] > 0 ? ys[i] : 1e-9) / (b == "" ? 1 : bound_value(b, xs[i])))
+                sx += x; sy += y; sxx += x * x; sxy += x * y
+            }
+            return (count * sxy - sx * sy) / (count * sxx - sx * sx)
+        }
+        # Keep the fastest time of every (phase, size) and its allocation count
+        function verdict(kind, phase, b, values,    i, excess) {
+            if (b == "" || b == "-") return sprintf("%-8s %8s  %-6s %s", kind, "-", "-", "unchecked")
+            if (bound_value(b, 2) < 0) { bad_bound[phase] = b; return sprintf("%-8s %8s  %-6s %s", kind, "-", b, "BAD BOUND") }
+            for (i = 1; i <= npoints[phase]; i++) { xs[i] = size[phase, i]; ys[i] = values[phase, i] }
+            excess = fit(xs, ys, npoints[phase], b)
+            if (excess > tol) { failed++; status = "EXCEEDS BOUND" } else status = "ok"
+            return sprintf("%-8s %8.2f  %-6s %s", kind, fit(xs, ys, npoints[phase], ""), b, status)
+        }
+        FILENAME == ARGV[1] {
+            if ($0 ~ /^#/ || NF < 3) next
+            time_bound[$1] = $2; alloc_bound[$1] = $3; next
+        }
+        {
+            phase = $1; lines = $2
+            if (!((phase, lines) in best)) {
+                if (!(phase in npoints)) order[++nphases] = phase
+                size[phase, ++npoints[phase]] = lines
+                point[phase, lines] = npoints[phase]
+                best[phase, lines] = $3
+                allocs[phase, npoints[phase]] = $4
+                if ($4 == "-") no_allocs[phase] = 1
+            } else if ($3 < best[phase, lines]) best[phase, lines] = $3
+            if (best[phase, lines] > max_secs[phase]) max_secs[phase] = best[phase, lines]
+        }
+        END {
+            printf "%-10s %-8s %8s  %-6s %s\n", "phase", "metric", "exponent", "bound", "status"
+            for (p = 1; p <= nphases; p++) {
+                phase = order[p]
+                for (i = 1; i <= npoints[phase]; i++) secs[phase, i] = best[phase, size[phase, i]]
+                tb = time_bound[phase]
+                if (tb != "" && tb != "-" && max_secs[phase] < min_secs) {
+                    printf "%-10s %-8s %8s  %-6s %s\n", phase, "time", "-", tb, "too fast to measure"
+                } else {
+                    printf "%-10s %s\n", phase, verdict("time", phase, tb, secs)
+                }
+                if (!(phase in no_allocs)) printf "%-10s %s\n", phase, verdict("allocs", phase, alloc_bound[phase], allocs)
+            }
+            exit failed > 0
+        }' "$BOUNDS" "$samples" || FAILED=1
+done
+
+echo
+if [ $FAILED -ne 0 ]; then
+    echo "Complexity regression: a phase grows faster than its declared bound."
+else
+    echo "All phases within their declared bounds."
+fi
+exit $FAILED
@@ -0,0 +1,40 @@
+#!/bin/bash
+# Usage: ./gen_program.sh <lines>
+# Emits a straight-line .bc program of roughly <lines> lines on stdout.
+# Each generated function has two parameters and a chain of 20 locals,
+# and main calls a sample of them.
+
+if [ $# -ne 1 ]; then
+    echo "Usage: $0 <lines>"
+    exit 1
+fi
+
+awk -v target="$1" 'BEGIN {
+    lines_per_function = 24
+    functions = int((target - 12) / lines_per_function)
+    if (functions < 1) functions = 1
+
+    print "import <stdio.s>"
+    print ""
+    for (f = 0; f < functions; f++) {
+        printf "fun f%d<p0: int, p1: int>(): int {\n", f
+        printf "    let v0<int> = p0 + %d;\n", f
+        for (i = 1; i < 20; i++) {
+            printf "    let v%d<int> = v%d + p1 + %d;\n", i, i - 1, i
+        }
+        print "    return v19;"
+        print "}"
+        print ""
+    }
+
+    print "fun main(): int {"
+    print "    let r<int> = 0;"
+    step = int(functions / 4)
+    if (step < 1) step = 1
+    for (f = 0; f < functions; f += step) {
+        printf "    r = r + f%d(r, %d);\n", f, f
+    }
+    print "    print(r);"
+    print "    return 0;"
+    print "}"
+}'
@@ -0,0 +1,139 @@
+#!/bin/bash
+# Usage: ./run_bench.sh [--update-baseline]
+#
+# Compiles every benchmark program with `bcc -c --time-report`, records the
+# best lines/sec of each compiler phase over at least BENCH_REPEAT runs, the number
+# of instructions in the generated assembly and the register allocator's spills
+# and reloads (from `--stats=json`), and compares them against baseline.txt.
+# Throughput more than BENCH_TOLERANCE percent below the baseline, or any growth
+# in instructions, spills or reloads, is reported as a regression.
+
+ROOT_DIR="$(cd "$(dirname "$0")/.." && pwd)"
+BENCH_DIR="$ROOT_DIR/bench"
+OUT_DIR="$BENCH_DIR/out"
+BCC="$ROOT_DIR/build/bcc"
+BASELINE="$BENCH_DIR/baseline.txt"
+RESULTS="$OUT_DIR/results.txt"
+REPEAT=${BENCH_REPEAT:-3}
+TOLERANCE=${BENCH_TOLERANCE:-30}
+
+UPDATE_BASELINE=0
+if [ "$1" == "--update-baseline" ]; then
+    UPDATE_BASELINE=1
+fi
+
+if [ ! -x "$BCC" ]; then
+    echo "Compiler not found at $BCC, run 'make' first."
+    exit 1
+fi
+
+mkdir -p "$OUT_DIR/programs"
+rm -f "$RESULTS"
+
+# Generated straight-line programs of increasing size
+for spec in gen_1k:1000 gen_100k:100000 gen_1m:1000000; do
+    name="${spec%%:*}"
+    lines="${spec##*:}"
+    if [ ! -f "$OUT_DIR/programs/$name.bc" ]; then
+        "$BENCH_DIR/gen_program.sh" "$lines" > "$OUT_DIR/programs/$name.bc"
+    fi
+done
+
+# Hand-written kernels
+cp "$BENCH_DIR"/programs/*.bc "$OUT_DIR/programs/"
+
+# measure <name> <file>: append "<name> <metric> <value>" rows to $RESULTS
+measure() {
+    local name="$1"
+    local file="$2"
+    local reports="$OUT_DIR/$name.report"
+
+    # Small programs finish in microseconds: take the best of more runs
+    local lines runs
+    lines=$(wc -l < "$file")
+    runs=$((200000 / (lines + 1)))
+    [ $runs -gt 200 ] && runs=200
+    [ $runs -lt "$REPEAT" ] && runs=$REPEAT
+
+    cd "$OUT_DIR"
+    rm -f "$reports"
+    for ((i = 0; i < runs; i++)); do
+        if ! "$BCC" -c --module-cache= --time-report "$file" 2>> "$reports" > /dev/null; then
+            echo "[FAIL] $name (compilation failed)"
+            return 1
+        fi
+    done
+
+    # Best throughput per phase of the entry module over all runs
+    awk -v name="$name" '
+        /^Time report for/ { entry = ($4 == name ".bc"); next }
+        entry && /^  [a-z]+ / {
+            if (!($1 in best)) { phases[++n] = $1; best[$1] = 0 }
+            if ($4 > best[$1]) best[$1] = $4
+        }
+        END { for (i = 1; i <= n; i++) printf "%s %s %.0f\n", name, phases[i], best[phases[i]] }
+    ' "$reports" >> "$RESULTS"
+
+    local asm
+    asm=$(ls tmp/*_"$name".s 2>/dev/null | head -n 1)
+    local count=0
+    if [ -n "$asm" ]; then
+        count=$(grep -c '^    [a-z]' "$asm")
+    fi
+    echo "$name instructions $count" >> "$RESULTS"
+
+    # Spills and reloads of the entry module, from the total of its statistics
+    "$BCC" -c --module-cache= --stats=json "$file" 2>&1 > /dev/null |
+        grep -F "\"module\":\"$name.bc\"" |
+        sed -n 's/.*"total":{.*"spills":\([0-9]*\),"reloads":\([0-9]*\).*/\1 \2/p' |
+        awk -v name="$name" '{ print name " spills " $1; print name " reloads " $2 }' >> "$RESULTS"
+    cd "$ROOT_DIR"
+}
+
+for bcfile in "$OUT_DIR"/programs/*.bc; do
+    name=$(basename "$bcfile" .bc)
+    echo "Benchmarking $name..."
+    measure "$name" "$bcfile"
+done
+
+if [ $UPDATE_BASELINE -eq 1 ]; then
+    {
+        echo "# bcc benchmark baseline: <program> <metric> <value>"
+        echo "# Phase metrics are lines/sec (higher is better), instructions is the"
+        echo "# instruction count of the generated assembly, spills and reloads are"
+        echo "# the register allocator's totals for the program (lower is better)."
+        cat "$RESULTS"
+    } > "$BASELINE"
+    echo "Baseline updated: $BASELINE"
+    exit 0
+fi
+
+if [ ! -f "$BASELINE" ]; then
+    echo "No baseline found, run with --update-baseline to create one."
+    cat "$RESULTS"
+    exit 0
+fi
+
+awk -v tolerance="$TOLERANCE" '
+    FNR == NR { if ($0 !~ /^#/ && NF == 3) base[$1 " " $2] = $3; next }
+    {
+        key = $1 " " $2
+        status = "ok"
+        if (!(key in base)) {
+            status = "new"
+        } else if ($2 == "instructions" || $2 == "spills" || $2 == "reloads") {
+            if ($3 > base[key]) status = "REGRESSION"
+        } else if ($3 < base[key] * (100 - tolerance) / 100) {
+            status = "REGRESSION"
+        }
+        change = (key in base && base[key] > 0) ? sprintf("%+.1f%%", ($3 - base[key]) * 100 / base[key]) : "-"
+        printf "%-14s %-13s %14s %14s %9s  %s\n", $1, $2, (key in base) ? base[key] : "-", $3, change, status
+        if (status == "REGRESSION") failed++
+    }
+    BEGIN { printf "%-14s %-13s %14s %14s %9s  %s\n", "program", "metric", "baseline", "current", "change", "status" }
+    END {
+        print "=============================="
+        printf "Regressions: %d\n", failed
+        exit failed > 0
+    }
+' "$BASELINE" "$RESULTS"
@@ -0,0 +1,112 @@
+#!/bin/bash
+# Usage: ./scaling.sh [functions|locals|expr-depth|imports|size]...
+#
+# Scaling report: for each bcgen dimension (all of them by default), generate
+# programs over doubling values of that dimension, compile them with
+# `bcc -c --time-report`, and plot compile time and peak memory against the
+# value.  The local growth exponent log(time ratio) / log(input size ratio)
+# is shown for every step; steps above SCALING_MAX_EXPONENT (default 1.3)
+# are flagged as superlinear, as are compiler crashes.  Results are also
+# written to bench/out/scaling.csv.
+
+ROOT_DIR="$(cd "$(dirname "$0")/.." && pwd)"
+OUT_DIR="$ROOT_DIR/bench/out/scaling"
+CSV="$ROOT_DIR/bench/out/scaling.csv"
+BCC="$ROOT_DIR/build/bcc"
+BCGEN="$ROOT_DIR/build/bcgen"
+MAX_EXPONENT=${SCALING_MAX_EXPONENT:-1.3}
+REPEAT=${SCALING_REPEAT:-3}
+BASE_ARGS="--seed 1 --functions 16 --locals 8 --expr-depth 2"
+
+if [ ! -x "$BCC" ] || [ ! -x "$BCGEN" ]; then
+    echo "Compiler or generator missing, run 'make' first."
+    exit 1
+fi
+
+DIMENSIONS=("$@")
+if [ ${#DIMENSIONS[@]} -eq 0 ]; then
+    DIMENSIONS=(functions locals expr-depth imports size)
+fi
+
+sweep_values() {
+    case "$1" in
+        functions)  echo "64 128 256 512 1024 2048 4096" ;;
+        locals)     echo "8 16 32 64 128 256 512" ;;
+        expr-depth) echo "1 2 3 4 5" ;;
+        imports)    echo "1 2 4 8 16 32 64" ;;
+        size)       echo "131072 262144 524288 1048576 2097152 4194304 8388608" ;;
+        *)          return 1 ;;
+    esac
+}
+
+rm -rf "$OUT_DIR"
+mkdir -p "$OUT_DIR"
+echo "dimension,value,bytes,seconds,peak_kib,exponent,status" > "$CSV"
+FLAGGED=0
+
+for dim in "${DIMENSIONS[@]}"; do
+    values=$(sweep_values "$dim") || { echo "Unknown dimension: $dim"; exit 1; }
+    rows=()
+
+    for value in $values; do
+        dir="$OUT_DIR/$dim-$value"
+        mkdir -p "$dir"
+        # shellcheck disable=SC2086
+        "$BCGEN" $BASE_ARGS "--$dim" "$value" --output-dir "$dir"
+        bytes=$(cat "$dir"/*.bc | wc -c)
+
+        best=""
+        peak=0
+        status="ok"
+        for ((i = 0; i < REPEAT; i++)); do
+            (cd "$dir" && "$BCC" -c --module-cache= --time-report main.bc > /dev/null 2> report.txt) 2> /dev/null
+            rc=$?
+            if [ $rc -ne 0 ]; then
+                status="FAIL:exit-$rc"
+                break
+            fi
+            # Sum the totals of all modules, keep the largest peak RSS
+            read -r seconds kib < <(awk '
+                /^Time report for/ { gsub(/[^0-9 ]/, "", $0); n = split($0, f, " "); if (f[n] > peak) peak = f[n] }
+                /^  total / { total += $2 }
+                END { printf "%.6f %d\n", total, peak }' "$dir/report.txt")
+            if [ -z "$best" ] || awk -v a="$seconds" -v b="$best" 'BEGIN { exit !(a < b) }'; then
+                best=$seconds
+            fi
+            [ "$kib" -gt "$peak" ] && peak=$kib
+        done
+        rows+=("$value $bytes ${best:-0} $peak $status")
+    done
+
+    echo
+    echo "== $dim =="
+    printf "%s\n" "${rows[@]}" | awk -v dim="$dim" -v max_exp="$MAX_EXPONENT" -v csv="$CSV" '
+        { value[NR] = $1; bytes[NR] = $2; secs[NR] = $3; kib[NR] = $4; status[NR] = $5; ran[NR] = ($5 == "ok")
+          if ($3 > max_secs) max_secs = $3; if ($4 > max_kib) max_kib = $4 }
+        END {
+            printf "%10s %10s %10s %10s %8s  %-24s %-24s %s\n", dim, "bytes", "seconds", "peak KiB", "exponent", "time", "memory", "status"
+            for (i = 1; i <= NR; i++) {
+                exponent = "-"
+                if (i > 1 && ran[i] && ran[i-1] && secs[i-1] > 0 && secs[i] > 0 && bytes[i] > bytes[i-1]) {
+                    e = log(secs[i] / secs[i-1]) / log(bytes[i] / bytes[i-1])
+                    exponent = sprintf("%.2f", e)
+                    # Steps below ten milliseconds are dominated by noise
+                    if (e > max_exp && secs[i] > 0.01) status[i] = "SUPERLINEAR"
+                }
+                tbar = max_secs > 0 ? int(24 * secs[i] / max_secs) : 0
+                mbar = max_kib > 0 ? int(24 * kib[i] / max_kib) : 0
+                t = ""; m = ""
+                for (j = 0; j < tbar; j++) t = t "#"
+                for (j = 0; j < mbar; j++) m = m "="
+                printf "%10s %10d %10.4f %10d %8s  %-24s %-24s %s\n", value[i], bytes[i], secs[i], kib[i], exponent, t, m, status[i]
+                printf "%s,%s,%d,%.6f,%d,%s,%s\n", dim, value[i], bytes[i], secs[i], kib[i], exponent, status[i] >> csv
+                if (status[i] != "ok") flagged++
+            }
+            exit flagged > 0
+        }'
+    [ $? -ne 0 ] && FLAGGED=1
+done
+
+echo
+echo "CSV written to $CSV"
+exit $FLAGGED
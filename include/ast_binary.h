@@ -0,0 +1,119 @@
+/**
+* @file ast_binary.h
+ * @brief Memory-mappable binary AST format (.bast) for BasicCodeCompiler.
+ *
+ * A .bast file holds one module's post-parse AST in a form that can be used
+ * straight from an mmap of the file: no per-node allocation and no pointer
+ * fixups.  Nodes are stored breadth-first, so the children of every node
+ * are a contiguous index range, and every string (identifiers, import paths,
+ * keywords) is interned once in a string table referenced by byte offset.
+ *
+ * File layout (host byte order, recorded in the header; readers reject a
+ * file written with the other byte order):
+ *
+ *   AstBinHeader                        at offset 0
+ *   AstBinNode[node_count]              at nodes_offset (8-byte aligned), root first
+ *   char[string_size]                   at strings_offset, NUL-terminated strings
+ */
+
+#ifndef AST_BINARY_H
+#define AST_BINARY_H
+
+#include "parser.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define AST_BIN_VERSION 1                ///< Bumped whenever the layout or its meaning changes
+#define AST_BIN_BYTE_ORDER 0x01020304u   ///< Reads back differently on a host of the other byte order
+#define AST_BIN_NO_STRING UINT32_MAX     ///< String offset of a token without lexeme
+
+/**
+ * @brief File header.
+ */
+typedef struct {
+    char magic[4];            ///< "BAST"
+    uint32_t version;         ///< AST_BIN_VERSION
+    uint32_t byte_order;      ///< AST_BIN_BYTE_ORDER as written by the producer
+    uint32_t node_count;
+    uint32_t string_size;     ///< Size of the string table in bytes
+    uint32_t line_count;      ///< Number of source lines
+    uint32_t source_path;     ///< String offset of the canonical source path
+    uint32_t reserved;
+    uint64_t nodes_offset;
+    uint64_t strings_offset;
+} AstBinHeader;
+
+/**
+ * @brief One AST node.
+ *
+ * The children of the node are nodes first_child .. first_child + child_count - 1.
+ */
+typedef struct {
+    uint16_t type;            ///< NodeType
+    uint16_t token_type;      ///< TokenType of the node's token
+    uint32_t line;            ///< Source line of the token
+    uint32_t lexeme;          ///< String offset of the token text, or AST_BIN_NO_STRING
+    uint32_t first_child;
+    uint32_t child_count;
+    uint32_t reserved;
+    int64_t int_value;        ///< Value of integer literals
+} AstBinNode;
+
+/**
+ * @brief A mapped .bast file.
+ */
+typedef struct {
+    void *base;                   ///< Start of the mapping
+    size_t size;                  ///< Size of the mapping
+    const AstBinHeader *header;
+    const AstBinNode *nodes;      ///< nodes[0] is the root
+    const char *strings;
+} AstBinView;
+
+/**
+ * @brief Serialize an AST.
+ *
+ * @param root        Root of the AST (NODE_COMPILATION_UNIT).
+ * @param source_path Canonical path of the source file, recorded for import resolution.
+ * @param line_count  Number of source lines.
+ * @param path        File to write.
+ * @return            true on success.
+ */
+bool ast_binary_write(const ASTNode *root, const char *source_path, int line_count, const char *path);
+
+/**
+ * @brief Map a .bast file read-only and validate it.
+ *
+ * Validation checks every offset, string reference and child range, and
+ * that every node has the children and names the parser gives its kind, so
+ * a successful view can be walked and compiled without further checks.
+ * Problems are reported on stderr.
+ *
+ * @param path File to map.
+ * @param view Receives the mapping.
+ * @return     true on success.
+ */
+bool ast_binary_map(const char *path, AstBinView *view);
+
+/**
+ * @brief String at a string table offset, or NULL for AST_BIN_NO_STRING.
+ */
+const char *ast_binary_string(const AstBinView *view, uint32_t offset);
+
+/**
+ * @brief Rebuild ASTNodes from a mapped file so the compiler can restart from it.
+ *
+ * Lexemes point into the mapping, which must outlive the returned AST.
+ *
+ * @param view Mapped file.
+ * @return     Root of the AST, to be released with free_ast().
+ */
+ASTNode *ast_binary_to_ast(const AstBinView *view);
+
+/**
+ * @brief Unmap a file mapped by ast_binary_map().
+ */
+void ast_binary_unmap(AstBinView *view);
+
+#endif // AST_BINARY_H
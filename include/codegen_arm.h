@@ -7,11 +7,56 @@
 #define CODEGEN_ARM_H
 
 #include "parser.h"
+#include "codegen_stats.h"
+#include "profile_report.h"
+
+/**
+ * @brief Function-level profiling instrumentation (-finstrument-functions).
+ *
+ * Instrumented functions count their entries in a per-module table in .bss.
+ * The cycle modes also accumulate the cycles spent in each call, read from
+ * the given hardware counter.  runtime/bcc_profile.c dumps the tables at exit.
+ */
+typedef enum {
+    INSTRUMENT_NONE,    ///< No instrumentation
+    INSTRUMENT_CALLS,   ///< Entry counters only
+    INSTRUMENT_PMCCNTR, ///< Entry counters and cycles from the ARMv7-A PMU cycle counter
+    INSTRUMENT_DWT      ///< Entry counters and cycles from the Cortex-M DWT_CYCCNT register
+} InstrumentMode;
+
+/**
+ * @brief Settings for one module's code generation.
+ */
+typedef struct {
+    InstrumentMode instrument; ///< Profiling instrumentation to emit
+    const char *module_path;   ///< Source path recorded in the profile table
+    ModuleStats *stats;        ///< Receives per-function statistics, or NULL
+    bool function_sections;    ///< Emit every function in its own .text.<name> section
+    const FunctionHeat *heat;  ///< Per function in AST order, from -fprofile-use, or NULL
+    const size_t *order;       ///< Emission order as indices of functions in AST order, or NULL for source order
+    int jobs;                  ///< Threads generating functions in parallel (1 or less: serial)
+} CodegenOptions;
+
+/**
+ * @brief Name of the section a function is emitted in.
+ *
+ * @param options Code generation settings.
+ * @param name    Function name.
+ * @param heat    Heat of the function (HEAT_UNKNOWN without a profile).
+ * @param buf     Receives the name.
+ * @param size    Size of buf.
+ */
+void codegen_section_name(const CodegenOptions *options, const char *name, FunctionHeat heat, char *buf, size_t size);
 
 /**
  * @brief Generate ARM assembly code from the given AST.
- * @param root Root node of the AST.
+ *
+ * The assembly is written to stdout.  Functions may be generated on several
+ * threads; the output is the same for any number of jobs.
+ *
+ * @param root    Root node of the AST.
+ * @param options Code generation settings.
  */
-void codegen_arm(const ASTNode *root);
+void codegen_arm(const ASTNode *root, const CodegenOptions *options);
 
 #endif // CODEGEN_ARM_H
@@ -0,0 +1,87 @@
+/**
+* @file codegen_stats.h
+ * @brief Per-function code size and instruction-mix statistics (bcc --stats).
+ */
+
+#ifndef CODEGEN_STATS_H
+#define CODEGEN_STATS_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * @brief Instruction classes counted by the code generator.
+ */
+typedef enum {
+    INSTR_ALU,        ///< Arithmetic (add, sub, adc, ...)
+    INSTR_LOAD_STORE, ///< Memory access (ldr, str, push)
+    INSTR_BRANCH,     ///< Control transfer (bl, return pop)
+    INSTR_MOVE,       ///< Register and immediate moves (mov, mrc)
+    INSTR_CLASS_COUNT
+} InstrClass;
+
+/**
+ * @brief Statistics of one emitted function.
+ */
+typedef struct {
+    char *name;                          ///< Function name (owned)
+    int instructions;                    ///< Total instructions emitted
+    int by_class[INSTR_CLASS_COUNT];     ///< Instructions per class
+    int spills;                          ///< Stores of variables to their stack slot
+    int reloads;                         ///< Loads of variables from their stack slot
+    int frame_size;                      ///< Bytes reserved below fp
+    unsigned registers_used;             ///< Bit n set if rn appears in the function
+} FunctionStats;
+
+/**
+ * @brief Statistics of every function of a module, in emission order.
+ */
+typedef struct {
+    FunctionStats *functions;
+    size_t count;
+    size_t cap;
+} ModuleStats;
+
+/**
+ * @brief Output formats of --stats.
+ */
+typedef enum {
+    STATS_NONE,
+    STATS_TEXT, ///< Human-readable table
+    STATS_JSON  ///< One JSON object per module and line (JSON Lines)
+} StatsFormat;
+
+/**
+ * @brief Append a zeroed entry for a function about to be emitted.
+ * @param stats Module statistics.
+ * @param name  Function name, copied.
+ * @return      The new entry.
+ */
+FunctionStats *module_stats_add(ModuleStats *stats, const char *name);
+
+/**
+ * @brief Sum the functions of a module into one entry.
+ *
+ * Counts are added, registers are united and the frame size is the largest.
+ *
+ * @param stats Module statistics.
+ * @param total Receives the aggregate; its name is left NULL.
+ */
+void module_stats_total(const ModuleStats *stats, FunctionStats *total);
+
+/**
+ * @brief Print the statistics of a module followed by its aggregate.
+ * @param stats  Module statistics.
+ * @param module Module file name.
+ * @param format STATS_TEXT or STATS_JSON.
+ * @param out    Output stream.
+ */
+void module_stats_print(const ModuleStats *stats, const char *module, StatsFormat format, FILE *out);
+
+/**
+ * @brief Free the entries of a module's statistics.
+ * @param stats Module statistics.
+ */
+void module_stats_free(ModuleStats *stats);
+
+#endif // CODEGEN_STATS_H
@@ -2,6 +2,7 @@
 #define COMPILE_H
 
 #include <stdbool.h>
+#include "codegen_arm.h"
 
 /**
  * @enum ErrorCode
@@ -19,7 +20,9 @@ typedef enum {
     ERR_SYNTAX, /**< Syntax errors encountered */
     ERR_UNKNOWN_OPTION,
     ERR_NO_INPUT_FILE,
-    ERR_INVALID_ARCH
+    ERR_INVALID_ARCH,
+    ERR_RUNTIME, /**< Link or runtime error while interpreting */
+    ERR_SEMANTIC /**< Calls that do not match an imported interface */
 } ErrorCode;
 
 /**
@@ -40,6 +43,22 @@ typedef struct {
     bool show_ast; /**< If true, dump AST */
     bool show_registers; /**< If true, print register allocation details */
     bool save_asm; /**< If true, keep the .s file after linking */
+    bool run; /**< If true, interpret the program instead of compiling it */
+    bool time_report; /**< If true, print per-phase timings on stderr */
+    InstrumentMode instrument; /**< Function-level profiling instrumentation */
+    StatsFormat stats; /**< Print per-function code statistics on stderr */
+    const char *regalloc_report; /**< File receiving the JSON register allocation report */
+    const char *profile_report; /**< Profile dump to summarize instead of compiling */
+    const char *profile_use; /**< Profile dump guiding optimization (-fprofile-use), or NULL */
+    const ProfileData *profile; /**< The profile_use dump, loaded once for the module and its imports */
+    const char *module_cache; /**< Directory of .bci module interfaces, NULL to disable */
+    bool no_inline_imports; /**< If true, never inline bodies from imported interfaces */
+    bool no_ipa; /**< If true, skip interprocedural constant propagation and dead statement deletion */
+    bool gc_sections; /**< If true, emit one section per function and let the linker drop unreferenced ones */
+    bool order_functions; /**< If true, place functions along the program's call graph (Pettis-Hansen) */
+    const char *emit_ast_bin; /**< File receiving the binary AST instead of compiling, or NULL */
+    bool lsp; /**< If true, serve the Language Server Protocol on stdin/stdout */
+    int jobs; /**< Threads allocating registers and generating code for a module's functions */
     Architecture target_arch; /**< Target architecture (e.g. ARCH_ARM) */
     const char *filename; /**< Path to the input source file */
     const char *file_directory_path; /**< Directory path for the input file */
@@ -61,4 +80,28 @@ typedef struct {
  */
 ErrorCode compile_file(const CompilerOptions *opts);
 
+/**
+ * @brief Interpret a source file on the host instead of compiling it.
+ *
+ * The entry file and every .bc module it imports are parsed and executed
+ * by the bytecode interpreter.  Imported .s libraries are replaced by
+ * host-side shims.  Nothing is written to tmp/.
+ *
+ * @param opts         Pointer to a CompilerOptions struct describing inputs and flags.
+ * @param exit_status  Receives the value returned by the program's main.
+ * @return             ErrorCode (ERR_OK if the program ran, non-zero on failure).
+ */
+ErrorCode run_file(const CompilerOptions *opts, int *exit_status);
+
+/**
+ * @brief Parse a source file and write its binary AST (.bast) to opts->emit_ast_bin.
+ *
+ * A .bast file can be passed back to bcc in place of the source; imports
+ * are then resolved relative to the original source file.
+ *
+ * @param opts  Pointer to a CompilerOptions struct describing inputs and flags.
+ * @return      ErrorCode (ERR_OK on success, non-zero on failure).
+ */
+ErrorCode emit_ast_binary(const CompilerOptions *opts);
+
 #endif /* COMPILE_H */
@@ -0,0 +1,101 @@
+/**
+* @file function_order.h
+ * @brief Call-graph-driven function placement (Pettis-Hansen) for BasicCodeCompiler.
+ *
+ * Functions are the nodes of an undirected call graph whose edge weights are
+ * how often one calls the other: the number of call sites, times the
+ * caller's entry count when a profile gives it (a body has no branches, so
+ * each call site runs once per entry).  Placement starts with one chain per
+ * function and merges the chains of the two ends of every edge, heaviest
+ * edge first, joining them in the orientation that puts the two functions
+ * closest.  The chains are then laid out hottest first, so that callers and
+ * their callees share cache lines and pages.
+ */
+
+#ifndef FUNCTION_ORDER_H
+#define FUNCTION_ORDER_H
+
+#include "parser.h"
+#include "profile_report.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief One function of the graph.
+ */
+typedef struct {
+    char *name;                ///< Symbol name, unique in the program
+    char *section;             ///< Section the function is emitted in
+    unsigned long long calls;  ///< Entry count from the profile, 0 without one
+} CallGraphNode;
+
+/**
+ * @brief Calls from one function to another, by name until the graph is ordered.
+ */
+typedef struct {
+    size_t caller;             ///< Node index
+    char *callee;              ///< Symbol name, possibly in a module added later
+    unsigned long long weight;
+} CallGraphEdge;
+
+/**
+ * @brief Functions and calls of one module or of a whole program.
+ */
+typedef struct {
+    CallGraphNode *nodes;
+    size_t node_count;
+    size_t node_cap;
+    CallGraphEdge *edges;
+    size_t edge_count;
+    size_t edge_cap;
+} CallGraph;
+
+/**
+ * @brief Add the functions of a module and their calls.
+ *
+ * @param graph    Graph to extend.
+ * @param root     Root of the module's AST, after every AST transformation.
+ * @param sections Section of each function in AST order, or NULL for .text.
+ * @param profile  Profile given with -fprofile-use, or NULL.
+ * @param module   Canonical path of the module, as recorded in the profile.
+ */
+void call_graph_add_module(CallGraph *graph, const ASTNode *root, const char *const *sections,
+                           const ProfileData *profile, const char *module);
+
+/**
+ * @brief Compute the placement of the functions.
+ *
+ * Calls to functions outside the graph (libraries, unknown imports) are ignored.
+ *
+ * @param graph Graph to order.
+ * @return      Node indices in placement order; the caller frees it.
+ */
+size_t *call_graph_order(const CallGraph *graph);
+
+/**
+ * @brief Write the placement as a linker section ordering file.
+ *
+ * The file maps the section of every function, in placement order, to .text
+ * (for ld --section-ordering-file), so every function needs its own section.
+ *
+ * @param graph Ordered graph.
+ * @param order Placement from call_graph_order().
+ * @param path  File to write.
+ * @return      false if the file cannot be written.
+ */
+bool call_graph_write_order(const CallGraph *graph, const size_t *order, const char *path);
+
+/**
+ * @brief Move the nodes and edges of a graph to the end of another.
+ *
+ * @param into Graph receiving them.
+ * @param from Graph left empty.
+ */
+void call_graph_append(CallGraph *into, CallGraph *from);
+
+/**
+ * @brief Free the nodes and edges of a graph.
+ */
+void call_graph_free(CallGraph *graph);
+
+#endif // FUNCTION_ORDER_H
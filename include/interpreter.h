@@ -0,0 +1,61 @@
+/**
+* @file interpreter.h
+ * @brief Host-side bytecode interpreter for BasicCodeCompiler (bcc --run).
+ *
+ * The interpreter lowers parsed compilation units to a compact stack
+ * bytecode and executes it directly on the build host.  Imported assembly
+ * libraries (e.g. lib/stdio.s) are replaced by host-side shims so programs
+ * behave like their ARM counterparts without a cross toolchain.
+ */
+
+#ifndef INTERPRETER_H
+#define INTERPRETER_H
+
+#include "parser.h"
+#include "symbol_table.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief Supplies the body of a function that was parsed lazily.
+ *
+ * @param context Loader state passed to interpret().
+ * @param unit    Index of the unit defining the function.
+ * @param index   Index of the function among the unit's declarations.
+ * @return        true once the body is parsed and its names resolved.
+ */
+typedef bool (*FunctionBodyLoader)(void *context, size_t unit, size_t index);
+
+/**
+ * @brief Execute a program made of one or more compilation units.
+ *
+ * All functions of all units share one global namespace.  Calls that do not
+ * resolve to a user function are bound to the shims of the imported
+ * libraries.  Execution starts at `main`, whose parameters are zero.
+ * Only the functions `main` reaches through calls are lowered; a function
+ * whose body_start is set gets its body from the loader first, so bodies of
+ * functions that are never called are neither parsed nor checked.
+ *
+ * With a profile output, the entry count of every function is appended to
+ * that file at exit, in the format written by the target profiling runtime
+ * (runtime/bcc_profile.c), so `bcc --profile-report` reads both.
+ *
+ * @param units          Compilation units (NODE_COMPILATION_UNIT roots).
+ * @param unit_symbols   Symbol table each unit's names were resolved with.
+ * @param unit_paths     Source path of each unit, or NULL.
+ * @param unit_count     Number of entries in units.
+ * @param libraries      Base names of imported assembly libraries (e.g. "stdio.s").
+ * @param library_count  Number of entries in libraries.
+ * @param load_body      Parses lazily skipped bodies; unused if every body is parsed.
+ * @param loader_context Passed to load_body.
+ * @param profile_output File receiving function entry counts, or NULL.
+ * @param exit_status    Receives the return value of main.
+ * @return               0 on success, non-zero on a link or runtime error.
+ */
+int interpret(const ASTNode *const *units, const SymbolTable *const *unit_symbols,
+              const char *const *unit_paths, size_t unit_count,
+              const char *const *libraries, size_t library_count,
+              FunctionBodyLoader load_body, void *loader_context,
+              const char *profile_output, int *exit_status);
+
+#endif // INTERPRETER_H
@@ -0,0 +1,62 @@
+/**
+* @file ipa.h
+ * @brief Interprocedural constant propagation and purity analysis for BasicCodeCompiler.
+ *
+ * The analysis looks at every function of a module and the interfaces of
+ * its imports:
+ *
+ *  - purity: a function is pure if it only calls pure functions, none of them
+ *    recursively.  Calls into assembly libraries and unknown functions have
+ *    side effects; functions of imported modules are pure if their interface
+ *    says so.
+ *  - argument constancy: a parameter is constant if every call in the module
+ *    passes the same integer literal for it.
+ *
+ * Calls of a function with constant parameters are redirected to a clone,
+ * `<name>.constprop.0`, that takes only the other parameters and declares the
+ * constant ones as locals.  The original stays for importers (and is dropped
+ * by --gc-sections when nothing else calls it).  Expression statements
+ * without side effects, and declarations and assignments of variables that
+ * are never read whose value has none, are deleted.
+ */
+
+#ifndef IPA_H
+#define IPA_H
+
+#include "module_interface.h"
+#include "parser.h"
+#include "symbol_table.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+#define IPA_CLONE_SUFFIX ".constprop.0" ///< Same naming as GCC's constant propagation clones
+
+/**
+ * @brief Results of the analysis of one module.
+ */
+typedef struct {
+    bool *pure;            ///< Per function of the module (clones included), in AST order
+    size_t function_count; ///< Number of entries in pure
+    size_t clones;         ///< Functions specialized on constant arguments
+    size_t removed;        ///< Statements deleted
+} IpaSummary;
+
+/**
+ * @brief Analyze a resolved module and, if asked, optimize it.
+ *
+ * @param root         Root of the module's AST, names resolved and imports applied.
+ * @param symbols      Symbols of the module; clones and their variables are added.
+ * @param imports      Interfaces of the imported modules (entries may be NULL).
+ * @param import_count Number of entries in imports.
+ * @param transform    Clone callees and delete dead statements; false only analyzes.
+ * @param summary      Receives the results; release with ipa_summary_free().
+ */
+void ipa_optimize(ASTNode *root, SymbolTable *symbols, const ModuleInterface *const *imports,
+                  size_t import_count, bool transform, IpaSummary *summary);
+
+/**
+ * @brief Free the arrays of a summary.
+ */
+void ipa_summary_free(IpaSummary *summary);
+
+#endif // IPA_H
@@ -0,0 +1,34 @@
+/**
+* @file lsp.h
+ * @brief Language server for BasicCodeCompiler (bcc --lsp).
+ *
+ * Speaks the Language Server Protocol (JSON-RPC with Content-Length framing)
+ * over a pair of streams.  Open documents are kept in memory with their
+ * token stream, the byte span of every token and one AST per top-level
+ * declaration.  An edit relexes only from the token before the changed range
+ * up to the first token that lines up again with the old stream, and
+ * reparses only the declarations covering the replaced tokens; the other
+ * declarations are kept as they are.  Names are then resolved with the
+ * symbol table, which backs diagnostics, go-to-definition and hover.
+ *
+ * Supported: initialize, shutdown, exit, textDocument/didOpen, didChange
+ * (full and incremental), didClose, definition, hover; diagnostics are
+ * published after every change.
+ */
+
+#ifndef LSP_H
+#define LSP_H
+
+#include <stdio.h>
+
+/**
+ * @brief Serve requests until the client sends 'exit' or closes the input.
+ *
+ * @param in  Stream of client messages.
+ * @param out Stream receiving responses and notifications.
+ * @param log If not NULL, receives the time spent on every message.
+ * @return    Exit status: 0 if 'shutdown' preceded 'exit', 1 otherwise.
+ */
+int lsp_serve(FILE *in, FILE *out, FILE *log);
+
+#endif // LSP_H
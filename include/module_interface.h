@@ -0,0 +1,164 @@
+/**
+* @file module_interface.h
+ * @brief Precompiled module interfaces (.bci) for BasicCodeCompiler.
+ *
+ * A module interface records what importers need from a compiled module
+ * without touching its source: the exported function signatures (name and
+ * generic parameter list), the bodies of functions small enough to inline,
+ * and the module's generated assembly.  It also fingerprints everything the
+ * assembly depends on (the compiler build, source size and mtime, code
+ * generation flags and the interfaces of the module's own imports), so a
+ * stale file is never reused.
+ *
+ * File layout, all integers little-endian:
+ *
+ *   header     "BCI\0", version, compiler id, flags, interface hash, source size (u64),
+ *              source mtime in ns (i64), then the sizes of the sections below
+ *   strings    NUL-terminated strings, referenced by byte offset
+ *   imports    {path, interface hash} per import
+ *   functions  {name, line, parameter count, inline body length, flags}
+ *   params     parameter names of all functions, in order
+ *   nodes      inline bodies of all functions, in order, as preorder
+ *              {type (u16), child count (u16), value (i32)}
+ *   assembly   the module's generated assembly text
+ */
+
+#ifndef MODULE_INTERFACE_H
+#define MODULE_INTERFACE_H
+
+#include "parser.h"
+#include "profile_report.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define BCI_VERSION 3                ///< Bumped whenever the layout or its meaning changes
+#define BCI_MAX_INLINE_NODES 16      ///< Largest expression recorded as an inline body
+#define BCI_FUNCTION_PURE 1u         ///< Function flag: no side effects, always returns (see ipa.h)
+
+/**
+ * @brief One node of an inline body in preorder.
+ *
+ * NODE_ADD has two children, NODE_IDENTIFIER refers to parameter `value`
+ * and NODE_INT_LITERAL carries its value.
+ */
+typedef struct {
+    uint16_t type;
+    uint16_t child_count;
+    int32_t value;
+} InlineNode;
+
+/**
+ * @brief Exported signature of one function.
+ */
+typedef struct {
+    char *name;
+    int line;             ///< Source line of the definition
+    size_t param_count;
+    char **params;        ///< Generic parameter names, in order (all of type int)
+    InlineNode *body;     ///< Returned expression if the function is `return <expr>;`, else NULL
+    size_t body_length;
+    bool pure;            ///< Calls can be deleted when their result is unused
+} FunctionSignature;
+
+/**
+ * @brief A module imported by the interface's module.
+ */
+typedef struct {
+    char *path;              ///< Canonical path of the import (.bc or .s)
+    uint32_t interface_hash; ///< Hash of the imported interface compiled against, 0 for .s
+} InterfaceImport;
+
+/**
+ * @brief In-memory form of a .bci file.
+ */
+typedef struct {
+    uint32_t flags;             ///< Code generation flags the assembly was produced with
+    uint32_t interface_hash;    ///< Hash of the signatures and inline bodies
+    uint64_t source_size;
+    int64_t source_mtime_ns;
+
+    InterfaceImport *imports;
+    size_t import_count;
+    size_t import_cap;
+
+    FunctionSignature *functions;
+    size_t function_count;
+
+    char *assembly;
+    size_t assembly_size;
+} ModuleInterface;
+
+/**
+ * @brief Build the interface of a parsed module.
+ *
+ * Only the signatures, inline bodies and interface hash are filled in; the
+ * caller sets the fingerprint, imports and assembly.
+ *
+ * @param root Root of the module's AST (NODE_COMPILATION_UNIT).
+ * @param pure Purity of each function in AST order (see ipa.h), or NULL if unknown.
+ * @return Newly allocated interface.
+ */
+ModuleInterface *module_interface_from_ast(const ASTNode *root, const bool *pure);
+
+/**
+ * @brief Record an import of the module.
+ * @param iface Interface to update.
+ * @param path  Canonical path of the import, copied.
+ * @param hash  Interface hash of the import, 0 for assembly libraries.
+ */
+void module_interface_add_import(ModuleInterface *iface, const char *path, uint32_t hash);
+
+/**
+ * @brief Identify the compiler build that writes and reads interfaces.
+ *
+ * A hash of the compiler executable, so interfaces written by any other
+ * build of bcc are treated as stale.
+ */
+uint32_t module_interface_compiler_id(void);
+
+/**
+ * @brief Write an interface to disk.
+ * @return true on success.
+ */
+bool module_interface_write(const ModuleInterface *iface, const char *path);
+
+/**
+ * @brief Read an interface from disk.
+ * @return The interface, or NULL if the file is missing, truncated, malformed, or
+ *         of another version or compiler build.
+ */
+ModuleInterface *module_interface_read(const char *path);
+
+/**
+ * @brief Look up an exported function by name.
+ * @return The signature, or NULL.
+ */
+const FunctionSignature *module_interface_find(const ModuleInterface *iface, const char *name);
+
+/**
+ * @brief Check and optimize calls into imported modules.
+ *
+ * Every call to a function exported by one of the interfaces (and not
+ * defined in the module itself) must pass as many arguments as the function
+ * has parameters.  When inlining is enabled, calls to functions with an
+ * inline body whose arguments are all variables or literals are replaced by
+ * the body, with the arguments substituted for the parameters, except in
+ * functions a profile shows never ran.
+ *
+ * @param root          Root of the importing module's AST.
+ * @param imports       Interfaces of the imported modules.
+ * @param import_count  Number of entries in imports.
+ * @param inline_bodies Inline eligible calls.
+ * @param heat          Per function of the module in AST order (-fprofile-use), or NULL.
+ * @return              Number of errors reported on stderr.
+ */
+size_t module_interface_apply(ASTNode *root, const ModuleInterface *const *imports,
+                              size_t import_count, bool inline_bodies, const FunctionHeat *heat);
+
+/**
+ * @brief Free an interface and everything it owns.
+ */
+void module_interface_free(ModuleInterface *iface);
+
+#endif // MODULE_INTERFACE_H
@@ -36,15 +36,18 @@ typedef enum {
  */
 typedef struct ASTNode {
     NodeType type;
+    int body_start; // Functions parsed lazily: token index of the unparsed body, 0 once parsed
     Token token;
     struct ASTNode **children;
     size_t child_count;
     int register_assigned; // Assigned register index or -1 if none
     int source_register; // Source register for the value (if applicable)
-    int scope_depth; // Optional: scope depth for future use
+    int scope_depth; // Depth of the scope the node appears in (0 = global), set by name resolution
+    int symbol_id; // Symbol named by an identifier, declaration or call, -1 if none (see symbol_table.h)
     bool requires_load; // Load from stack into register before use
     bool requires_store; // Store to stack from register after assignment
-    int stack_slot; // If spilled, where in the stack it lives
+    int stack_slot; // If spilled, where in the stack it lives; for a function, the words in its frame
+    const struct ASTNode *rematerialize; // Literal whose value an identifier recomputes instead of loading, or NULL
 } ASTNode;
 
 /**
@@ -60,6 +63,14 @@ typedef struct {
     char **import_paths; // Array of dynamically allocated strings
     size_t import_count; // Number of imports
     size_t import_capacity; // Allocated capacity
+
+    // Error recovery
+    bool recover; // Record syntax errors and resume at the next declaration instead of exiting
+    size_t error_token; // Token of the first syntax error (when recovering)
+    const char *error_message; // Message of the first syntax error (when recovering)
+
+    // Lazy bodies
+    bool lazy_bodies; // Skip function bodies by brace matching; see parse_function_body()
 } Parser;
 
 /**
@@ -82,6 +93,35 @@ void parser_cleanup(Parser *parser);
  */
 size_t parse(Parser *parser);
 
+/**
+ * @brief Parse the body of a function skipped by a lazy parser.
+ *
+ * Does nothing if the body is already parsed.  The statements are appended
+ * to the function after its signature, exactly as an eager parse would.
+ *
+ * @param tokens Token stream the function was parsed from.
+ * @param fn     NODE_FUNCTION whose body_start is set.
+ * @return Number of syntax errors found (0 if successful).
+ */
+size_t parse_function_body(TokenStream *tokens, ASTNode *fn);
+
+/**
+ * @brief Parse one top-level declaration (function or import).
+ *
+ * A recovering parser that meets a syntax error skips to the next 'fun' or
+ * 'import' token, so repeated calls always make progress.
+ *
+ * @param parser Parser positioned at the declaration.
+ * @return The declaration, or NULL after a syntax error.
+ */
+ASTNode *parse_declaration(Parser *parser);
+
+/**
+ * @brief Free a declaration returned by parse_declaration().
+ * @param node Declaration to free; imports also free their path.
+ */
+void free_declaration(ASTNode *node);
+
 /**
  * @brief Print the AST for debugging.
  * @param node AST node to print.
@@ -89,6 +129,21 @@ size_t parse(Parser *parser);
  */
 void print_ast(const ASTNode *node, int depth);
 
+/**
+ * @brief Create a detached AST node, for passes that rewrite the tree.
+ * @param type  Node type.
+ * @param token Token copied into the node (its lexeme stays owned by the token stream).
+ * @return Newly allocated node without children.
+ */
+ASTNode *ast_create_node(NodeType type, Token token);
+
+/**
+ * @brief Append a child to an AST node.
+ * @param parent Node receiving the child.
+ * @param child  Node to append; ignored if NULL.
+ */
+void ast_add_child(ASTNode *parent, ASTNode *child);
+
 /**
  * @brief Recursively free an AST node and its children.
  * @param node AST node to free.
@@ -0,0 +1,65 @@
+/**
+* @file phase_timer.h
+ * @brief Per-phase wall-clock timing for BasicCodeCompiler (bcc --time-report).
+ *
+ * When the allocation counting shim (build/liballoc_counter.so) is preloaded,
+ * the number of allocations made by each phase is recorded as well.
+ */
+
+#ifndef PHASE_TIMER_H
+#define PHASE_TIMER_H
+
+#include <stdio.h>
+#include <time.h>
+
+/**
+ * @brief Compiler phases measured by the timer.
+ */
+typedef enum {
+    PHASE_READ,
+    PHASE_LEX,
+    PHASE_PARSE,
+    PHASE_REGALLOC,
+    PHASE_CODEGEN,
+    PHASE_COUNT
+} CompilerPhase;
+
+/**
+ * @brief Accumulated time and allocations per phase for one compilation unit.
+ */
+typedef struct {
+    double seconds[PHASE_COUNT];             ///< Total time spent in each phase
+    unsigned long allocations[PHASE_COUNT];  ///< Allocations made in each phase (with the shim)
+    struct timespec started;                 ///< Start of the phase currently running
+    unsigned long allocations_started;       ///< Allocation count at the start of the phase
+    CompilerPhase current;                   ///< Phase currently running
+} PhaseTimer;
+
+/**
+ * @brief Start timing a phase.
+ * @param timer Timer to update.
+ * @param phase Phase about to run.
+ */
+void phase_timer_start(PhaseTimer *timer, CompilerPhase phase);
+
+/**
+ * @brief Stop timing the current phase and add its duration.
+ * @param timer Timer to update.
+ */
+void phase_timer_stop(PhaseTimer *timer);
+
+/**
+ * @brief Print time and throughput of every phase.
+ *
+ * A header with the peak resident set size of the process, then one line
+ * per phase and a total line, in the form "  <phase> <seconds> s <lines/sec> lines/s".
+ * With the allocation counting shim loaded, each line ends with "<count> allocs".
+ *
+ * @param timer    Timer holding the measurements.
+ * @param filename Name of the compiled file.
+ * @param lines    Number of source lines in the file.
+ * @param out      Output stream.
+ */
+void phase_timer_report(const PhaseTimer *timer, const char *filename, int lines, FILE *out);
+
+#endif // PHASE_TIMER_H
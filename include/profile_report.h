@@ -0,0 +1,102 @@
+/**
+* @file profile_report.h
+ * @brief Function-level profiles: reading (bcc -fprofile-use) and summary
+ *        (bcc --profile-report).
+ *
+ * A dump holds one tab-separated line per function and run:
+ * "<module path> <function> <line> <calls> <cycles or ->".  Lines of the
+ * same function are summed, so a file appended to by several runs holds
+ * their total.
+ */
+
+#ifndef PROFILE_REPORT_H
+#define PROFILE_REPORT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/** File appended to by instrumented programs and by `bcc --run -finstrument-functions` */
+#define PROFILE_OUTPUT "bcc-profile.out"
+
+/**
+ * @brief Totals of one function over all runs in a dump.
+ */
+typedef struct {
+    char *module;
+    char *name;
+    int line;
+    unsigned long long calls;
+    unsigned long long cycles;
+} ProfileEntry;
+
+/**
+ * @brief All functions read from a dump.
+ */
+typedef struct {
+    ProfileEntry *entries;
+    size_t count;
+    size_t cap;
+    bool has_cycles;       ///< At least one line carried a cycle count
+    ProfileEntry **index;  ///< Entries sorted by module and function, for profile_find()
+} ProfileData;
+
+/**
+ * @brief How often a function ran in the profile used to compile it (-fprofile-use).
+ */
+typedef enum {
+    HEAT_UNKNOWN, ///< No profile, or the profile does not know the function
+    HEAT_HOT,     ///< Called at least once
+    HEAT_COLD     ///< Known to the profile but never called
+} FunctionHeat;
+
+/**
+ * @brief Read a profile dump.
+ *
+ * @param path    Profile dump to read.
+ * @param profile Receives the functions; release with profile_free().
+ * @return        0 on success, non-zero if the dump cannot be read or is malformed.
+ */
+int profile_load(const char *path, ProfileData *profile);
+
+/**
+ * @brief Look up the totals of a function.
+ *
+ * A constant propagation clone the profile does not know takes the totals
+ * of the function it was cloned from, as in a profile from `bcc --run`.
+ *
+ * @param profile Loaded profile, or NULL.
+ * @param module  Canonical path of the module defining the function.
+ * @param name    Function name.
+ * @return        The entry, or NULL if the profile does not know the function.
+ */
+const ProfileEntry *profile_find(const ProfileData *profile, const char *module, const char *name);
+
+/**
+ * @brief Classify a function by its entry count in a profile.
+ *
+ * @param profile Loaded profile, or NULL.
+ * @param module  Canonical path of the module defining the function.
+ * @param name    Function name.
+ */
+FunctionHeat profile_function_heat(const ProfileData *profile, const char *module, const char *name);
+
+/**
+ * @brief Free the functions of a profile.
+ */
+void profile_free(ProfileData *profile);
+
+/**
+ * @brief Print the functions of a profile dump, hottest first.
+ *
+ * Functions are ranked by cycles when the profile has them and by calls
+ * otherwise; each is shown with its source location and the source line
+ * when the module is still readable.
+ *
+ * @param path Profile dump to read.
+ * @param out  Output stream.
+ * @return     0 on success, non-zero if the dump cannot be read or is malformed.
+ */
+int profile_report(const char *path, FILE *out);
+
+#endif // PROFILE_REPORT_H
@@ -11,11 +11,13 @@
 #define REGISTER_ALLOCATOR_H
 
 #include "parser.h"
+#include "symbol_table.h"
 #include <stdbool.h>
+#include <stdio.h>
 
 #define FIRST_VAR_REGISTER   4    ///< First general-purpose register available for variables (r4)
+#define LAST_VAR_REGISTER   10    ///< Last register available for variables (r10); r11 is the frame pointer
 #define MAX_REGISTERS       12    ///< Total number of available registers (r0–r11)
-#define MAX_VARIABLES      128    ///< Maximum number of tracked variables per function
 
 /**
  * @brief Metadata about register allocation for a single variable.
@@ -28,18 +30,37 @@ typedef struct {
     bool is_spilled;    ///< True if variable was spilled to the stack
 } RegisterAllocationInfo;
 
+/**
+ * @brief Settings of one allocation pass.
+ */
+typedef struct {
+    bool show_registers; ///< Print assignments as they are made (debugging)
+    FILE *report;        ///< Receives the JSON allocation report, or NULL
+    const char *module;  ///< Module name recorded in the report
+    SymbolTable *symbols; ///< Symbols the AST's identifiers were resolved to; owns folded literals' lexemes
+    int jobs;            ///< Threads allocating functions in parallel (1 or less: serial)
+} RegallocOptions;
+
 /**
  * @brief Perform register allocation on the given AST.
  *
  * This will partition registers per function, assign r0–r3 to parameters
- * (always loaded from stack on use), assign r4–r11 to locals, and spill
- * when more than eight locals are live.  All contexts are isolated per
- * function to prevent cross-function interference.
+ * (always loaded from stack on use), assign r4–r10 to locals, and spill
+ * when more than seven locals are live.  All contexts are isolated per
+ * function to prevent cross-function interference, so functions are
+ * allocated on up to options->jobs threads (one with show_registers).
+ *
+ * With a report stream, one JSON object per module is written on a single
+ * line (JSON Lines).  For every function it lists each variable's live
+ * interval, register, spill state and the reason it lives in memory, every
+ * spill decision with the register it freed, and the register pressure at
+ * each statement.  Program points are preorder indices of the function's
+ * AST nodes, the numbering used for live intervals.
  *
- * @param root           Root of the AST (COMPILATION_UNIT node).
- * @param show_registers If true, prints detailed mapping (for debugging).
+ * @param root    Root of the AST (COMPILATION_UNIT node).
+ * @param options Allocation settings.
  */
-void register_allocate_ast(ASTNode *root, bool show_registers);
+void register_allocate_ast(ASTNode *root, const RegallocOptions *options);
 
 /**
  * @brief Reset any global allocator state.
@@ -0,0 +1,169 @@
+/**
+* @file symbol_table.h
+ * @brief Scoped symbol table and name resolution for BasicCodeCompiler.
+ *
+ * Names are interned once, so equal identifiers share one pointer and scopes
+ * compare pointers instead of strings.  Each scope is an open-addressing hash
+ * of symbol IDs keyed on the interned name, linked to its parent; lookups walk
+ * the chain from the innermost scope.
+ *
+ * symbol_resolve_ast() runs right after parsing and stores in every
+ * NODE_IDENTIFIER (and declaring node) the ID of the symbol it names, and in
+ * scope_depth the depth of the scope it appears in, so later phases never
+ * look names up again.  Parameters and locals of a function get consecutive
+ * IDs in declaration order; their slot (ID minus the function's first_local)
+ * is a dense index usable for per-function arrays.
+ */
+
+#ifndef SYMBOL_TABLE_H
+#define SYMBOL_TABLE_H
+
+#include "parser.h"
+#include <stddef.h>
+
+#define SYMBOL_NONE (-1)   ///< symbol_id of a node that names no symbol
+
+/**
+ * @brief What a symbol names.
+ */
+typedef enum {
+    SYMBOL_FUNCTION,
+    SYMBOL_PARAMETER,
+    SYMBOL_LOCAL
+} SymbolKind;
+
+/**
+ * @brief One declared name.
+ */
+typedef struct {
+    const char *name;   ///< Interned name
+    SymbolKind kind;
+    int line;           ///< Line of the declaration
+    int scope;          ///< Scope declaring the symbol
+    int slot;           ///< Parameters and locals: index within the function (parameters first)
+    int first_local;    ///< Functions: ID of the first parameter or local
+    int local_count;    ///< Functions: number of parameters and locals
+} Symbol;
+
+/**
+ * @brief A lexical scope: a hash of the symbols it declares.
+ */
+typedef struct {
+    int parent;         ///< Enclosing scope, -1 for the global scope
+    int depth;          ///< 0 for the global scope
+    int owner;          ///< Function symbol owning the scope, SYMBOL_NONE for the global scope
+    int *slots;         ///< Symbol IDs, SYMBOL_NONE if empty; size is a power of two
+    size_t slot_count;
+    size_t used;
+} Scope;
+
+/**
+ * @brief Interned strings, owned by the table.
+ */
+typedef struct {
+    char **slots;       ///< NULL if empty; size is a power of two
+    size_t slot_count;
+    size_t used;
+} InternTable;
+
+/**
+ * @brief Receives a name resolution error in place of stderr.
+ * @param context  SymbolTable.error_context.
+ * @param function Function being resolved.
+ * @param node     Node the error is about.
+ * @param message  Error message, without position.
+ */
+typedef void (*SymbolErrorHandler)(void *context, const ASTNode *function, const ASTNode *node,
+                                   const char *message);
+
+/**
+ * @brief Symbols and scopes of one module.
+ */
+typedef struct {
+    InternTable names;
+    Symbol *symbols;
+    size_t symbol_count;
+    size_t symbol_cap;
+    Scope *scopes;
+    size_t scope_count;
+    size_t scope_cap;
+    int current_scope;  ///< Innermost open scope, -1 if none
+    SymbolErrorHandler on_error; ///< Receives resolution errors, NULL to print them on stderr
+    void *error_context;
+} SymbolTable;
+
+/**
+ * @brief Initialize an empty table.
+ */
+void symbol_table_init(SymbolTable *table);
+
+/**
+ * @brief Free everything owned by a table.
+ */
+void symbol_table_free(SymbolTable *table);
+
+/**
+ * @brief Return the canonical copy of a name, adding it the first time.
+ */
+const char *symbol_intern(SymbolTable *table, const char *name);
+
+/**
+ * @brief Open a scope nested in the current one.
+ * @param owner Function symbol owning the scope, or SYMBOL_NONE.
+ * @return      Index of the new scope.
+ */
+int symbol_scope_push(SymbolTable *table, int owner);
+
+/**
+ * @brief Close the current scope (its symbols stay valid).
+ */
+void symbol_scope_pop(SymbolTable *table);
+
+/**
+ * @brief Declare a name in the current scope.
+ * @return The new symbol ID, or SYMBOL_NONE if the scope already declares the name.
+ */
+int symbol_declare(SymbolTable *table, const char *name, SymbolKind kind, int line);
+
+/**
+ * @brief Find the innermost visible symbol of a name.
+ * @return Its ID, or SYMBOL_NONE.
+ */
+int symbol_lookup(const SymbolTable *table, const char *name);
+
+/**
+ * @brief Symbol of an ID.
+ */
+const Symbol *symbol_get(const SymbolTable *table, int id);
+
+/**
+ * @brief Resolve every name of a module.
+ *
+ * Declares the module's functions in the global scope and each function's
+ * parameters and locals in a scope of its own, in source order, then sets
+ * symbol_id and scope_depth on every identifier, declaration and call.
+ * Calls to functions not defined in the module keep SYMBOL_NONE.
+ * Undeclared variables and redeclarations are reported on stderr, or to
+ * the table's error handler.
+ *
+ * @param table Empty table receiving the module's symbols.
+ * @param root  Root of the module's AST.
+ * @return      Number of errors.
+ */
+size_t symbol_resolve_ast(SymbolTable *table, ASTNode *root);
+
+/**
+ * @brief Resolve the names of one function again.
+ *
+ * The function's symbol must already be declared and stored in the node's
+ * symbol_id (as done by symbol_resolve_ast()).  Its parameters and locals are
+ * declared anew in a fresh scope nested in the one declaring the function;
+ * symbols of an earlier resolution stay allocated but are no longer found.
+ *
+ * @param table Table holding the function's symbol.
+ * @param fn    NODE_FUNCTION to resolve.
+ * @return      Number of errors.
+ */
+size_t symbol_resolve_function(SymbolTable *table, ASTNode *fn);
+
+#endif // SYMBOL_TABLE_H
@@ -0,0 +1,45 @@
+/**
+* @file work_queue.h
+ * @brief Ordered parallel work queue for BasicCodeCompiler.
+ *
+ * Runs independent work items (e.g. the functions of a module) on a pool of
+ * threads.  Every item writes into its own buffer, and the buffers are
+ * copied to the output in item order as soon as all earlier items are
+ * done, so the output is the same as a serial run whatever the schedule.
+ */
+
+#ifndef WORK_QUEUE_H
+#define WORK_QUEUE_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * @brief Process one work item.
+ *
+ * @param context Shared state passed to work_queue_run().
+ * @param index   Index of the item, in [0, count).
+ * @param out     Stream receiving the item's output, or NULL if there is no output.
+ */
+typedef void (*WorkItemFn)(void *context, size_t index, FILE *out);
+
+/**
+ * @brief Number of threads to use by default: the online cores of the host.
+ */
+int work_queue_default_jobs(void);
+
+/**
+ * @brief Process items 0 to count-1 on up to `jobs` threads, the caller included.
+ *
+ * With one job or one item, the items run on the calling thread and write
+ * straight to the output.  Returns once every item is done and written.
+ *
+ * @param count   Number of items.
+ * @param jobs    Maximum number of threads; values below 1 mean 1.
+ * @param work    Called once per item, from any thread.
+ * @param context Passed to work.
+ * @param out     Stream receiving the outputs in item order, or NULL.
+ */
+void work_queue_run(size_t count, int jobs, WorkItemFn work, void *context, FILE *out);
+
+#endif // WORK_QUEUE_H
@@ -0,0 +1,103 @@
+/**
+ * @file bcc_profile.c
+ * @brief Target runtime for programs built with -finstrument-functions.
+ *
+ * Linked into instrumented executables by scripts/generate_executable.sh.
+ * Every instrumented module contributes one descriptor to the `bcc_prof`
+ * section (see codegen_arm.c); at exit the counters of all modules are
+ * appended to PROFILE_OUTPUT, which `bcc --profile-report` summarizes.
+ *
+ * Output format, one line per function, tab separated:
+ *   <module path> <function> <line> <calls> <cycles or ->
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define PROFILE_OUTPUT "bcc-profile.out"
+
+/* Must match InstrumentMode in include/codegen_arm.h */
+enum {
+    INSTRUMENT_NONE,
+    INSTRUMENT_CALLS,
+    INSTRUMENT_PMCCNTR,
+    INSTRUMENT_DWT
+};
+
+typedef struct {
+    uint32_t calls;
+    uint32_t cycles_lo;
+    uint32_t cycles_hi;
+} BccProfCounter;
+
+typedef struct {
+    const char *name;
+    uint32_t line;
+} BccProfFunction;
+
+typedef struct {
+    const char *module;
+    uint32_t function_count;
+    BccProfCounter *counters;
+    const BccProfFunction *functions;
+    uint32_t mode;
+} BccProfModule;
+
+/* Provided by the linker for the bcc_prof section */
+extern const BccProfModule __start_bcc_prof[] __attribute__((weak));
+extern const BccProfModule __stop_bcc_prof[] __attribute__((weak));
+
+/**
+ * @brief Start the cycle counter selected by the instrumented modules.
+ *
+ * Needs privileged execution (bare metal or a kernel that grants PMU access).
+ */
+__attribute__((constructor))
+static void bcc_profile_start(void) {
+    uint32_t mode = INSTRUMENT_NONE;
+    for (const BccProfModule *m = __start_bcc_prof; m && m < __stop_bcc_prof; ++m) {
+        if (m->mode > mode) mode = m->mode;
+    }
+
+#if defined(__ARM_ARCH_PROFILE) && __ARM_ARCH_PROFILE == 'M'
+    if (mode == INSTRUMENT_DWT) {
+        volatile uint32_t *const demcr = (uint32_t *) 0xE000EDFC;
+        volatile uint32_t *const dwt_ctrl = (uint32_t *) 0xE0001000;
+        volatile uint32_t *const dwt_cyccnt = (uint32_t *) 0xE0001004;
+        *demcr |= 1u << 24;  // TRCENA
+        *dwt_cyccnt = 0;
+        *dwt_ctrl |= 1u;     // CYCCNTENA
+    }
+#else
+    if (mode == INSTRUMENT_PMCCNTR) {
+        uint32_t pmcr;
+        __asm__ volatile("mrc p15, 0, %0, c9, c12, 0" : "=r"(pmcr));
+        __asm__ volatile("mcr p15, 0, %0, c9, c12, 0" :: "r"(pmcr | 1u));          // PMCR.E
+        __asm__ volatile("mcr p15, 0, %0, c9, c12, 1" :: "r"(1u << 31));           // PMCNTENSET.C
+    }
+#endif
+}
+
+/**
+ * @brief Append the counters of every instrumented module to the profile.
+ */
+__attribute__((destructor))
+static void bcc_profile_dump(void) {
+    if (!__start_bcc_prof) return;
+
+    FILE *out = fopen(PROFILE_OUTPUT, "a");
+    if (!out) return;
+    for (const BccProfModule *m = __start_bcc_prof; m < __stop_bcc_prof; ++m) {
+        for (uint32_t i = 0; i < m->function_count; ++i) {
+            const BccProfCounter *c = &m->counters[i];
+            fprintf(out, "%s\t%s\t%lu\t%lu\t", m->module, m->functions[i].name,
+                    (unsigned long) m->functions[i].line, (unsigned long) c->calls);
+            if (m->mode >= INSTRUMENT_PMCCNTR) {
+                fprintf(out, "%llu\n", ((unsigned long long) c->cycles_hi << 32) | c->cycles_lo);
+            } else {
+                fprintf(out, "-\n");
+            }
+        }
+    }
+    fclose(out);
+}
@@ -1,16 +1,29 @@
 #!/bin/bash
-# Usage: ./generate_executable.sh <output_executable> [-s]
+# Usage: ./generate_executable.sh <output_executable> [-s] [--gc-sections] [--order-functions]
+#   -s                 keep tmp/ (assembly and objects)
+#   --gc-sections      drop the sections nothing reachable from the entry point references
+#   --order-functions  lay out .text in the order of tmp/functions.order (needs ld 2.43 or later)
 
-if [ $# -lt 1 ] || [ $# -gt 2 ]; then
-    echo "Usage: $0 <output_executable> [-s]"
+if [ $# -lt 1 ] || [ $# -gt 4 ]; then
+    echo "Usage: $0 <output_executable> [-s] [--gc-sections] [--order-functions]"
     exit 1
 fi
 
 EXE_NAME="$1"
 KEEP_TMP=0
-if [ "$2" == "-s" ]; then
-    KEEP_TMP=1
-fi
+LINK_FLAGS=""
+shift
+for ARG in "$@"; do
+    case "$ARG" in
+        -s) KEEP_TMP=1 ;;
+        --gc-sections) LINK_FLAGS="$LINK_FLAGS -Wl,--gc-sections" ;;
+        --order-functions) LINK_FLAGS="$LINK_FLAGS -Wl,--section-ordering-file=tmp/functions.order" ;;
+        *)
+            echo "Usage: $0 <output_executable> [-s] [--gc-sections] [--order-functions]"
+            exit 1
+            ;;
+    esac
+done
 
 # Assemble all .s files in tmp/ to .o
 for SFILE in tmp/*.s; do
@@ -23,13 +36,24 @@ for SFILE in tmp/*.s; do
     fi
 done
 
-# Collect all object files in tmp/
-TMP_OBJS=$(find tmp -name '*.o' 2>/dev/null | tr '\n' ' ')
+# Compile C runtime support copied into tmp/ (e.g. the profiling runtime)
+for CFILE in tmp/*.c; do
+    [ -e "$CFILE" ] || continue
+    OFILE="${CFILE%.c}.o"
+    arm-none-eabi-gcc -O2 -c -o "$OFILE" "$CFILE"
+    if [ $? -ne 0 ]; then
+        echo "Compilation failed for $CFILE."
+        exit 2
+    fi
+done
+
+# Collect all object files in tmp/, in a stable order
+TMP_OBJS=$(find tmp -name '*.o' 2>/dev/null | sort | tr '\n' ' ')
 
 ELF="tmp/${EXE_NAME}.elf"
 
 # Link
-arm-none-eabi-gcc -specs=rdimon.specs -lc -lrdimon -o "$ELF" $TMP_OBJS
+arm-none-eabi-gcc -specs=rdimon.specs $LINK_FLAGS -lc -lrdimon -o "$ELF" $TMP_OBJS
 if [ $? -ne 0 ]; then
     echo "Linking failed."
     [ $KEEP_TMP -eq 0 ] && rm -f $TMP_OBJS
@@ -0,0 +1,49 @@
+#!/bin/bash
+# Usage: ./run_lsp_tests.sh [bcc]
+#   Replays every tests/lsp/<name>.jsonl session, one JSON-RPC message per
+#   line, through `bcc --lsp` and compares the server's messages, one per
+#   line, with tests/lsp/<name>.expected.
+
+export LC_ALL=C
+
+ROOT_DIR="$(cd "$(dirname "$0")/.." && pwd)"
+BCC="${1:-$ROOT_DIR/build/bcc}"
+PASS=0
+FAIL=0
+
+# Frame each line of a session with its Content-Length header
+frame() {
+    while IFS= read -r message; do
+        [ -z "$message" ] && continue
+        printf 'Content-Length: %d\r\n\r\n%s' "${#message}" "$message"
+    done < "$1"
+}
+
+# Drop the headers of the server's messages, leaving one message per line
+unframe() {
+    sed -e 's/Content-Length: [0-9]*\r$//' -e 's/\r$//' -e '/^$/d'
+    echo
+}
+
+shopt -s nullglob
+for session in "$ROOT_DIR"/tests/lsp/*.jsonl; do
+    base=$(basename "$session" .jsonl)
+    expected_file="$ROOT_DIR/tests/lsp/$base.expected"
+    output=$(frame "$session" | "$BCC" --lsp 2>&1 | unframe)
+
+    if [ "$output" == "$(cat "$expected_file")" ]; then
+        echo "[PASS] lsp/$base"
+        PASS=$((PASS+1))
+    else
+        echo "[FAIL] lsp/$base"
+        echo "Expected:"
+        cat "$expected_file"
+        echo "Actual:"
+        echo "$output"
+        FAIL=$((FAIL+1))
+    fi
+done
+
+echo "=============================="
+echo "Total: $((PASS+FAIL)), Passed: $PASS, Failed: $FAIL"
+exit $FAIL
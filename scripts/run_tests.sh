@@ -1,4 +1,12 @@
 #!/bin/bash
+# Usage: ./run_tests.sh [-i|--interpreter]
+#   -i, --interpreter  Run each test with `bcc --run` instead of the ARM toolchain
+
+INTERPRETER=0
+if [ "$1" == "-i" ] || [ "$1" == "--interpreter" ]; then
+    INTERPRETER=1
+fi
+
 ROOT_DIR="$(cd "$(dirname "$0")/.." && pwd)"
 TEST_FILES="$ROOT_DIR/tests/test_files"
 EXPECTED="$ROOT_DIR/tests/expected_results"
@@ -28,13 +36,22 @@ for bcfile in "${bcfiles[@]}"; do
     exec_file="$ROOT_DIR/$base"
     exec_file_elf="$ROOT_DIR/$base.elf"
     asm_file="$ROOT_DIR/$base.s"
+    flags_file="$TEST_FILES/$base.flags"
+    flags=()
+    [ -f "$flags_file" ] && read -r -a flags < "$flags_file"
 
     # Compile from project root, always with -s to keep .s file
     cd "$ROOT_DIR"
-    "$BCC" -s "tests/test_files/$base.bc" > /dev/null 2>&1
+    if [ $INTERPRETER -eq 1 ]; then
+        "$BCC" "${flags[@]}" --run "tests/test_files/$base.bc" > "$output_file" 2>&1
+    else
+        "$BCC" "${flags[@]}" -s "tests/test_files/$base.bc" > /dev/null 2>&1
+    fi
 
     # Check for either executable
-    if [ -x "$exec_file" ]; then
+    if [ $INTERPRETER -eq 1 ]; then
+        :
+    elif [ -x "$exec_file" ]; then
         exec_to_run="$exec_file"
     elif [ -x "$exec_file_elf" ]; then
         exec_to_run="$exec_file_elf"
@@ -47,7 +64,9 @@ for bcfile in "${bcfiles[@]}"; do
     fi
 
     # Run and capture output
-    "$exec_to_run" > "$output_file" 2>&1
+    if [ $INTERPRETER -eq 0 ]; then
+        "$exec_to_run" > "$output_file" 2>&1
+    fi
 
     if diff -q "$output_file" "$expected_file" > /dev/null; then
         echo "[PASS] $base"
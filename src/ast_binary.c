@@ -0,0 +1,331 @@
+/**
+ * @file ast_binary.c
+ * @brief Writing, mapping and rebuilding the binary AST format (.bast).
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "../include/ast_binary.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+_Static_assert(sizeof(AstBinHeader) == 48, "AstBinHeader layout changed");
+_Static_assert(sizeof(AstBinNode) == 32, "AstBinNode layout changed");
+
+static const char ast_bin_magic[4] = {'B', 'A', 'S', 'T'};
+
+/**
+ * @brief String table being built, with an open-addressing index for interning.
+ */
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+    uint32_t *slots;     ///< Offsets of interned strings, UINT32_MAX if empty
+    size_t slot_count;   ///< Power of two
+    size_t used;
+} StringTable;
+
+static void *checked_realloc(void *p, const size_t size) {
+    void *grown = realloc(p, size ? size : 1);
+    if (!grown) {
+        fprintf(stderr, "Memory allocation failed in binary AST\n");
+        exit(EXIT_FAILURE);
+    }
+    return grown;
+}
+
+static uint32_t hash_string(const char *s) {
+    uint32_t hash = 2166136261u;
+    for (; *s; s++) {
+        hash ^= (unsigned char) *s;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void table_rehash(StringTable *table, const size_t slot_count) {
+    free(table->slots);
+    table->slots = checked_realloc(NULL, slot_count * sizeof(uint32_t));
+    memset(table->slots, 0xff, slot_count * sizeof(uint32_t));
+    table->slot_count = slot_count;
+    for (size_t offset = 0; offset < table->len; offset += strlen(table->data + offset) + 1) {
+        size_t slot = hash_string(table->data + offset) & (slot_count - 1);
+        while (table->slots[slot] != UINT32_MAX) slot = (slot + 1) & (slot_count - 1);
+        table->slots[slot] = (uint32_t) offset;
+    }
+}
+
+/* Return the offset of s in the table, adding it the first time it is seen */
+static uint32_t intern(StringTable *table, const char *s) {
+    if (!s) return AST_BIN_NO_STRING;
+    if ((table->used + 1) * 2 > table->slot_count) {
+        table_rehash(table, table->slot_count ? table->slot_count * 2 : 256);
+    }
+    size_t slot = hash_string(s) & (table->slot_count - 1);
+    while (table->slots[slot] != UINT32_MAX) {
+        if (strcmp(table->data + table->slots[slot], s) == 0) return table->slots[slot];
+        slot = (slot + 1) & (table->slot_count - 1);
+    }
+
+    const size_t n = strlen(s) + 1;
+    if (table->len + n > table->cap) {
+        table->cap = table->cap ? table->cap : 4096;
+        while (table->len + n > table->cap) table->cap *= 2;
+        table->data = checked_realloc(table->data, table->cap);
+    }
+    const uint32_t offset = (uint32_t) table->len;
+    memcpy(table->data + table->len, s, n);
+    table->len += n;
+    table->slots[slot] = offset;
+    table->used++;
+    return offset;
+}
+
+static size_t count_nodes(const ASTNode *node) {
+    size_t count = 1;
+    for (size_t i = 0; i < node->child_count; i++) count += count_nodes(node->children[i]);
+    return count;
+}
+
+bool ast_binary_write(const ASTNode *root, const char *source_path, const int line_count, const char *path) {
+    const size_t node_count = count_nodes(root);
+    const ASTNode **queue = checked_realloc(NULL, node_count * sizeof(ASTNode *));
+    AstBinNode *nodes = checked_realloc(NULL, node_count * sizeof(AstBinNode));
+    StringTable strings = {0};
+
+    AstBinHeader header = {
+        .version = AST_BIN_VERSION,
+        .byte_order = AST_BIN_BYTE_ORDER,
+        .node_count = (uint32_t) node_count,
+        .line_count = (uint32_t) line_count,
+        .source_path = intern(&strings, source_path),
+        .nodes_offset = sizeof(AstBinHeader),
+        .strings_offset = sizeof(AstBinHeader) + node_count * sizeof(AstBinNode)
+    };
+    memcpy(header.magic, ast_bin_magic, sizeof(header.magic));
+
+    // Breadth-first, so the children of each node are enqueued next to each other
+    size_t head = 0, tail = 0;
+    queue[tail++] = root;
+    while (head < tail) {
+        const ASTNode *node = queue[head];
+        nodes[head] = (AstBinNode){
+            .type = (uint16_t) node->type,
+            .token_type = (uint16_t) node->token.type,
+            .line = (uint32_t) node->token.line,
+            .lexeme = intern(&strings, node->token.lexeme),
+            .first_child = (uint32_t) tail,
+            .child_count = (uint32_t) node->child_count,
+            .int_value = node->token.type == TOKEN_INTEGER ? node->token.literal.int_value : 0
+        };
+        for (size_t i = 0; i < node->child_count; i++) queue[tail++] = node->children[i];
+        head++;
+    }
+    header.string_size = (uint32_t) strings.len;
+
+    FILE *out = fopen(path, "wb");
+    bool ok = out != NULL;
+    if (ok) {
+        ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+             fwrite(nodes, sizeof(AstBinNode), node_count, out) == node_count &&
+             (strings.len == 0 || fwrite(strings.data, 1, strings.len, out) == strings.len);
+        if (fclose(out) != 0) ok = false;
+    }
+
+    free(queue);
+    free(nodes);
+    free(strings.data);
+    free(strings.slots);
+    return ok;
+}
+
+static bool map_error(AstBinView *view, const char *path, const char *reason) {
+    fprintf(stderr, "Invalid binary AST '%s': %s\n", path, reason);
+    ast_binary_unmap(view);
+    return false;
+}
+
+/* Child i of a node whose child range was validated */
+static const AstBinNode *child_node(const AstBinView *view, const AstBinNode *node, const uint32_t i) {
+    return &view->nodes[node->first_child + i];
+}
+
+/* A childless node of the given kind; names must have their lexeme */
+static bool valid_leaf(const AstBinNode *node, const NodeType type) {
+    if (node->type != type || node->child_count != 0) return false;
+    return type != NODE_IDENTIFIER || node->lexeme != AST_BIN_NO_STRING;
+}
+
+static bool valid_expression(const AstBinView *view, const AstBinNode *node) {
+    switch (node->type) {
+        case NODE_INT_LITERAL:
+        case NODE_IDENTIFIER:
+            return valid_leaf(node, (NodeType) node->type);
+        case NODE_ADD:
+            return node->child_count == 2 && valid_expression(view, child_node(view, node, 0)) &&
+                   valid_expression(view, child_node(view, node, 1));
+        case NODE_FUNCTION_CALL:
+            if (node->lexeme == AST_BIN_NO_STRING) return false;
+            for (uint32_t i = 0; i < node->child_count; i++) {
+                if (!valid_expression(view, child_node(view, node, i))) return false;
+            }
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool valid_statement(const AstBinView *view, const AstBinNode *node) {
+    switch (node->type) {
+        case NODE_VAR_DECL:
+            return node->child_count == 3 && valid_leaf(child_node(view, node, 0), NODE_IDENTIFIER) &&
+                   valid_leaf(child_node(view, node, 1), NODE_VAR_INT_TYPE) &&
+                   valid_expression(view, child_node(view, node, 2));
+        case NODE_ASSIGNMENT:
+            return node->child_count == 2 && valid_leaf(child_node(view, node, 0), NODE_IDENTIFIER) &&
+                   valid_expression(view, child_node(view, node, 1));
+        case NODE_RETURN:
+        case NODE_EXPRESSION:
+            return node->child_count == 1 && valid_expression(view, child_node(view, node, 0));
+        default:
+            return false;
+    }
+}
+
+/* name, parameters, optional return type, then statements, as parse_function builds them */
+static bool valid_function(const AstBinView *view, const AstBinNode *node) {
+    if (node->child_count == 0 || !valid_leaf(child_node(view, node, 0), NODE_IDENTIFIER)) return false;
+    uint32_t i = 1;
+    for (; i < node->child_count && child_node(view, node, i)->type == NODE_TYPE_PARAM; i++) {
+        const AstBinNode *param = child_node(view, node, i);
+        if (param->lexeme == AST_BIN_NO_STRING || param->child_count != 1 ||
+            !valid_leaf(child_node(view, param, 0), NODE_VAR_INT_TYPE)) {
+            return false;
+        }
+    }
+    if (i < node->child_count && child_node(view, node, i)->type == NODE_RETURN_INT_TYPE) {
+        if (!valid_leaf(child_node(view, node, i++), NODE_RETURN_INT_TYPE)) return false;
+    }
+    for (; i < node->child_count; i++) {
+        if (!valid_statement(view, child_node(view, node, i))) return false;
+    }
+    return true;
+}
+
+/* Whether the tree has the shape the parser gives it, which the compiler relies on */
+static bool valid_tree(const AstBinView *view) {
+    const AstBinNode *root = &view->nodes[0];
+    if (root->type != NODE_COMPILATION_UNIT) return false;
+    for (uint32_t i = 0; i < root->child_count; i++) {
+        const AstBinNode *decl = child_node(view, root, i);
+        const bool valid = decl->type == NODE_IMPORT
+                               ? decl->child_count == 1 && valid_leaf(child_node(view, decl, 0), NODE_IDENTIFIER)
+                               : decl->type == NODE_FUNCTION && valid_function(view, decl);
+        if (!valid) return false;
+    }
+    return true;
+}
+
+bool ast_binary_map(const char *path, AstBinView *view) {
+    memset(view, 0, sizeof(*view));
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot open binary AST '%s'\n", path);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(AstBinHeader)) {
+        close(fd);
+        fprintf(stderr, "Invalid binary AST '%s': file too small\n", path);
+        return false;
+    }
+    view->size = (size_t) st.st_size;
+    view->base = mmap(NULL, view->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (view->base == MAP_FAILED) {
+        view->base = NULL;
+        fprintf(stderr, "Cannot map binary AST '%s'\n", path);
+        return false;
+    }
+
+    const AstBinHeader *header = view->base;
+    view->header = header;
+    if (memcmp(header->magic, ast_bin_magic, sizeof(ast_bin_magic)) != 0) return map_error(view, path, "bad magic");
+    if (header->byte_order != AST_BIN_BYTE_ORDER) return map_error(view, path, "written with another byte order");
+    if (header->version != AST_BIN_VERSION) return map_error(view, path, "unsupported version");
+
+    const uint64_t nodes_size = (uint64_t) header->node_count * sizeof(AstBinNode);
+    if (header->node_count == 0 || header->nodes_offset % _Alignof(AstBinNode) != 0 ||
+        header->nodes_offset > view->size || nodes_size > view->size - header->nodes_offset ||
+        header->strings_offset > view->size || header->string_size > view->size - header->strings_offset) {
+        return map_error(view, path, "section out of bounds");
+    }
+    view->nodes = (const AstBinNode *) ((const char *) view->base + header->nodes_offset);
+    view->strings = (const char *) view->base + header->strings_offset;
+
+    // The last string is terminated, so every in-bounds offset reads a terminated string
+    if (header->string_size > 0 && view->strings[header->string_size - 1] != '\0') {
+        return map_error(view, path, "unterminated string table");
+    }
+    if (header->source_path != AST_BIN_NO_STRING && header->source_path >= header->string_size) {
+        return map_error(view, path, "string offset out of bounds");
+    }
+
+    // Breadth-first order: child ranges follow each other with no gap or overlap
+    uint64_t next_child = 1;
+    for (uint32_t i = 0; i < header->node_count; i++) {
+        const AstBinNode *node = &view->nodes[i];
+        if (node->lexeme != AST_BIN_NO_STRING && node->lexeme >= header->string_size) {
+            return map_error(view, path, "string offset out of bounds");
+        }
+        if (node->type > NODE_ASSIGNMENT || node->token_type > TOKEN_ERROR) {
+            return map_error(view, path, "unknown node or token type");
+        }
+        if (node->child_count > 0 && node->first_child != next_child) {
+            return map_error(view, path, "child ranges are not breadth-first");
+        }
+        next_child += node->child_count;
+    }
+    if (next_child != header->node_count) return map_error(view, path, "child ranges do not cover the nodes");
+    if (!valid_tree(view)) return map_error(view, path, "malformed tree");
+    return true;
+}
+
+const char *ast_binary_string(const AstBinView *view, const uint32_t offset) {
+    return offset == AST_BIN_NO_STRING ? NULL : view->strings + offset;
+}
+
+static ASTNode *rebuild_node(const AstBinView *view, const uint32_t index) {
+    const AstBinNode *bin = &view->nodes[index];
+    Token token = {
+        .type = (TokenType) bin->token_type,
+        .lexeme = (char *) ast_binary_string(view, bin->lexeme),
+        .line = (int) bin->line
+    };
+    if (token.type == TOKEN_INTEGER) token.literal.int_value = bin->int_value;
+
+    ASTNode *node = ast_create_node((NodeType) bin->type, token);
+    if (bin->child_count == 0) return node;
+
+    // The child count is known, so size the array once instead of growing it per child
+    node->children = checked_realloc(NULL, bin->child_count * sizeof(ASTNode *));
+    for (uint32_t i = 0; i < bin->child_count; i++) {
+        node->children[i] = rebuild_node(view, bin->first_child + i);
+    }
+    node->child_count = bin->child_count;
+    return node;
+}
+
+ASTNode *ast_binary_to_ast(const AstBinView *view) {
+    return rebuild_node(view, 0);
+}
+
+void ast_binary_unmap(AstBinView *view) {
+    if (view->base) munmap(view->base, view->size);
+    memset(view, 0, sizeof(*view));
+}
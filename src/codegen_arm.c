@@ -5,16 +5,303 @@
  * This file emits ARM assembly for the compiled program.
  * It assumes stack-based variable storage and register allocation
  * has already been performed.
+ *
+ * With -finstrument-functions, every function also updates its entry of
+ * the module's profile table:
+ *
+ *   .bss       .Lbcc_prof_counters   {calls, cycles_lo, cycles_hi} per function
+ *   .rodata    module path, function names and their source lines
+ *   bcc_prof   one descriptor per module, found by the runtime through the
+ *              linker-generated __start_bcc_prof / __stop_bcc_prof symbols
+ *
+ * The instrumentation only uses ip and lr on entry (lr is already saved by
+ * the prologue) and r1 on exit, so arguments and the return value survive.
+ *
+ * With function sections, every function goes to its own .text.<name>
+ * section so that the linker's --gc-sections can drop the functions no
+ * other section references.  With a profile (-fprofile-use), functions
+ * that ran go to .text.hot and functions that never ran to .text.unlikely
+ * (suffixed with .<name> under function sections); the default linker
+ * script gathers each group, keeping hot code together across modules.
+ * CodegenOptions.order changes the order functions are emitted in (see
+ * function_order.h).
+ *
+ * Constants that are not ARM immediates, and the addresses of the profile
+ * table, are loaded pc-relative from a literal pool holding each word once.
+ * The pool is emitted after the function's return, or earlier, behind a
+ * branch, when the distance from its first load nears the 4 KB reach of ldr.
+ *
+ * The prologue saves the callee-saved registers r4-r10 the function's
+ * values were allocated to, as AAPCS requires, together with fp and lr; r3
+ * pads the list to an even count so sp stays 8-byte aligned.  fp points at
+ * the lowest saved word and the stack slots lie below it.
+ *
+ * Every instruction goes through emit_instr(), which also classifies and
+ * counts it for --stats.
+ *
+ * Functions are generated independently, on several threads when
+ * CodegenOptions.jobs allows it (see work_queue.h): the state of the
+ * function being generated is thread-local, and each function's text is
+ * written to the output in source order.
  */
 
+#define _POSIX_C_SOURCE 200809L
 #include "../include/codegen_arm.h"
+#include "../include/register_allocator.h"
+#include "../include/work_queue.h"
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROFILE_ENTRY_SIZE 12     ///< Bytes per function in the profile table
+#define DWT_CYCCNT 0xE0001004     ///< Cortex-M cycle counter register
+#define REG_FP 11
+#define REG_IP 12                 ///< Scratch register for constants that are not immediates
+#define REG_SP 13
+#define REG_LR 14
+#define MAX_MEMORY_OFFSET 4095    ///< Largest immediate offset of ldr and str
+#define POOL_REACH_WORDS 1000     ///< Words from a pc-relative ldr to its entry, inside the 4 KB reach
+#define POOL_CHECK_SLACK 24       ///< Most instructions emitted between two pool checks
+
+/**
+ * @brief Settings of the module being generated.
+ */
+static const CodegenOptions *codegen_options;
+
+/**
+ * @brief Stream receiving the function being generated (stdout outside functions).
+ */
+static _Thread_local FILE *asm_out;
+
+/**
+ * @brief Index of the function being generated, in the profile table and CodegenOptions.heat.
+ */
+static _Thread_local int profile_index;
+
+/**
+ * @brief Statistics of the function being generated.
+ *
+ * Points into the module's statistics with --stats, and to a scratch entry
+ * otherwise, so emission never has to check.
+ */
+static _Thread_local FunctionStats *function_stats;
+static _Thread_local FunctionStats scratch_stats;
+
+/**
+ * @brief Literal pool of the function being generated, not emitted yet.
+ *
+ * Entries are the operands of .word directives (numbers or symbol
+ * expressions), loaded with pc-relative ldr; equal operands share an entry.
+ */
+typedef struct {
+    char **words;
+    size_t count;
+    size_t cap;
+    int first_use;  ///< Instruction count at the first load from the pool
+    int pools;      ///< Pools emitted in the function so far, numbering their labels
+} LiteralPool;
+
+static _Thread_local LiteralPool literal_pool;
+
+/**
+ * @brief Record the registers named in an instruction's operands.
+ */
+static void note_registers(const char *operands) {
+    static const char *aliases[] = {"fp", "ip", "sp", "lr", "pc"};
+    const char *p = operands;
+    while (*p) {
+        if (!isalpha((unsigned char) *p) && *p != '_' && *p != '.') {
+            p++;
+            continue;
+        }
+        const char *word = p;
+        while (isalnum((unsigned char) *p) || *p == '_' || *p == '.') p++;
+        const size_t len = (size_t) (p - word);
+
+        if (word[0] == 'r' && len >= 2 && len <= 3 && isdigit((unsigned char) word[1])) {
+            const int reg = atoi(word + 1);
+            if (reg < 16 && (len == 2 || isdigit((unsigned char) word[2]))) {
+                function_stats->registers_used |= 1u << reg;
+            }
+            continue;
+        }
+        for (int i = 0; i < 5; i++) {
+            if (len == 2 && strncmp(word, aliases[i], 2) == 0) {
+                function_stats->registers_used |= 1u << (11 + i);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Emit one instruction and count it in the function's statistics.
+ *
+ * @param cls Instruction class.
+ * @param fmt printf-style format of the instruction, without indentation or newline.
+ */
+static void emit_instr(const InstrClass cls, const char *fmt, ...) {
+    char text[256];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(text, sizeof(text), fmt, args);
+    va_end(args);
+
+    fprintf(asm_out, "    %s\n", text);
+    function_stats->instructions++;
+    function_stats->by_class[cls]++;
+    const char *operands = strchr(text, ' ');
+    if (operands) note_registers(operands);
+}
+
+/* Name of a register in operands */
+static const char *register_name(const int reg, char buf[8]) {
+    if (reg == REG_FP) return "fp";
+    if (reg == REG_IP) return "ip";
+    if (reg == REG_SP) return "sp";
+    if (reg == REG_LR) return "lr";
+    snprintf(buf, 8, "r%d", reg);
+    return buf;
+}
+
+/* True if v is an ARM data-processing immediate: 8 bits rotated right by an even amount */
+static bool is_arm_immediate(const uint32_t v) {
+    for (unsigned rot = 0; rot < 32; rot += 2) {
+        const uint32_t rotated = rot ? (v << rot) | (v >> (32 - rot)) : v;
+        if (rotated <= 0xff) return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Emit the pending literal pool.
+ *
+ * @param after_branch The last instruction was an unconditional branch, so
+ *                     the pool can follow it; otherwise a branch around it is emitted.
+ */
+static void flush_literal_pool(const bool after_branch) {
+    LiteralPool *pool = &literal_pool;
+    if (pool->count == 0) return;
+
+    if (!after_branch) emit_instr(INSTR_BRANCH, "b .Lpool%d_%d_end", profile_index, pool->pools);
+    fprintf(asm_out, "    .align 2\n");
+    for (size_t i = 0; i < pool->count; i++) {
+        fprintf(asm_out, ".Lpool%d_%d_%zu:\n    .word %s\n", profile_index, pool->pools, i, pool->words[i]);
+        free(pool->words[i]);
+    }
+    if (!after_branch) fprintf(asm_out, ".Lpool%d_%d_end:\n", profile_index, pool->pools);
+    pool->count = 0;
+    pool->pools++;
+}
+
+/* Emit the pool before its first entry can fall out of reach of its load */
+static void check_literal_pool(void) {
+    const LiteralPool *pool = &literal_pool;
+    if (pool->count == 0) return;
+    const size_t distance = (size_t) (function_stats->instructions - pool->first_use) + pool->count;
+    if (distance + POOL_CHECK_SLACK >= POOL_REACH_WORDS) flush_literal_pool(false);
+}
+
+/**
+ * @brief Load a word from the function's literal pool.
+ *
+ * @param reg  Destination register.
+ * @param word Operand of the .word directive (number or symbol expression).
+ */
+static void emit_pool_load(const int reg, const char *word) {
+    LiteralPool *pool = &literal_pool;
+    size_t index = 0;
+    while (index < pool->count && strcmp(pool->words[index], word) != 0) index++;
+    if (index == pool->count) {
+        if (pool->count >= pool->cap) {
+            pool->cap = pool->cap ? pool->cap * 2 : 8;
+            pool->words = realloc(pool->words, pool->cap * sizeof(char *));
+            if (!pool->words) {
+                fprintf(stderr, "Memory allocation failed in emit_pool_load\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        pool->words[pool->count++] = strdup(word);
+    }
+    if (pool->count == 1 && index == 0) pool->first_use = function_stats->instructions;
+
+    char name[8];
+    emit_instr(INSTR_LOAD_STORE, "ldr %s, .Lpool%d_%d_%zu", register_name(reg, name), profile_index, pool->pools,
+               index);
+}
+
+/**
+ * @brief Put a constant in a register: mov or mvn when it is an immediate, else a pool load.
+ */
+static void emit_constant(const int reg, const int64_t value) {
+    const uint32_t v = (uint32_t) value; // int is 32 bits on the target
+    char name[8];
+    if (is_arm_immediate(v)) {
+        emit_instr(INSTR_MOVE, "mov %s, #%" PRIu32, register_name(reg, name), v);
+    } else if (is_arm_immediate(~v)) {
+        emit_instr(INSTR_MOVE, "mvn %s, #%" PRIu32, register_name(reg, name), ~v);
+    } else {
+        char word[16];
+        snprintf(word, sizeof(word), "%" PRIu32, v);
+        emit_pool_load(reg, word);
+    }
+}
+
+/**
+ * @brief Emit dst = src + value, through ip when neither value nor -value is an immediate.
+ */
+static void emit_add_constant(const int dst, const int src, const int64_t value) {
+    const uint32_t v = (uint32_t) value;
+    char d[8], s[8];
+    if (is_arm_immediate(v)) {
+        emit_instr(INSTR_ALU, "add %s, %s, #%" PRIu32, register_name(dst, d), register_name(src, s), v);
+    } else if (is_arm_immediate(-v)) {
+        emit_instr(INSTR_ALU, "sub %s, %s, #%" PRIu32, register_name(dst, d), register_name(src, s), -v);
+    } else {
+        emit_constant(REG_IP, value);
+        emit_instr(INSTR_ALU, "add %s, %s, ip", register_name(dst, d), register_name(src, s));
+    }
+}
+
+static _Thread_local int frame_bytes; ///< Frame size of the function being generated
+
+/**
+ * @brief Emit "ldr" or "str" of reg at offset bytes below fp.
+ *
+ * Offsets past the 4095 bytes an immediate reaches are computed into ip first,
+ * so reg must not be ip for a store.
+ */
+static void emit_frame_access(const char *op, const int reg, const int offset) {
+    char name[8];
+    if (offset <= MAX_MEMORY_OFFSET) {
+        emit_instr(INSTR_LOAD_STORE, "%s %s, [fp, #-%d]", op, register_name(reg, name), offset);
+    } else {
+        emit_add_constant(REG_IP, REG_FP, -offset);
+        emit_instr(INSTR_LOAD_STORE, "%s %s, [ip]", op, register_name(reg, name));
+    }
+}
+
+/* Offset below fp of a stack slot: the stack grows downward */
+static int slot_offset(const int slot) {
+    return (slot + 1) * 4;
+}
+
+/* Bytes below fp for the function's stack slots, keeping sp 8-byte aligned */
+static int compute_frame_size(const ASTNode *fn) {
+    int bytes = fn->stack_slot > 0 ? fn->stack_slot * 4 : 0;
+    // Cycle instrumentation keeps the entry timestamp below the slots
+    if (codegen_options->instrument >= INSTRUMENT_PMCCNTR) bytes += 4;
+    return (bytes + 7) & ~7;
+}
 
 /**
  * @brief Emit the .text section directive.
  */
 static void emit_text_section(void) {
-    printf(".text\n");
+    fprintf(asm_out, ".text\n");
 }
 
 /**
@@ -29,7 +316,7 @@ static void emit_global_directives(const ASTNode *root) {
         const ASTNode *fn = root->children[i];
         if (fn && fn->type == NODE_FUNCTION) {
             const char *name = fn->children[0]->token.lexeme;
-            printf(".global %s\n", name);
+            fprintf(asm_out, ".global %s\n", name);
         }
     }
 }
@@ -41,11 +328,23 @@ static void emit_global_directives(const ASTNode *root) {
  */
 static void emit_load_if_needed(const ASTNode *node) {
     if (node->requires_load) {
-        // Stack grows downward; stack slots are at negative offsets from FP
-        printf("    ldr r%d, [fp, #%d]\n", node->register_assigned, -(node->stack_slot + 1) * 4);
+        function_stats->reloads++;
+        emit_frame_access("ldr", node->register_assigned, slot_offset(node->stack_slot));
     }
 }
 
+/* Whether an operand was moved to the stack by the allocator, to be reloaded by its user */
+static bool is_stored_operand(const ASTNode *node) {
+    return node->requires_store &&
+           (node->type == NODE_ADD || node->type == NODE_FUNCTION_CALL || node->type == NODE_IDENTIFIER);
+}
+
+/* Load a stored operand from its stack slot into reg, where its user reads it */
+static void emit_reload(const int reg, const ASTNode *node) {
+    function_stats->reloads++;
+    emit_frame_access("ldr", reg, slot_offset(node->stack_slot));
+}
+
 /**
  * @brief Emit a store instruction if the node is marked as requiring one
  *
@@ -53,7 +352,8 @@ static void emit_load_if_needed(const ASTNode *node) {
  */
 static void emit_store_if_needed(const ASTNode *node) {
     if (node->requires_store) {
-        printf("    str r%d, [fp, #%d]\n", node->register_assigned, -(node->stack_slot + 1) * 4);
+        function_stats->spills++;
+        emit_frame_access("str", node->register_assigned, slot_offset(node->stack_slot));
     }
 }
 
@@ -64,34 +364,53 @@ static void emit_store_if_needed(const ASTNode *node) {
  */
 static void codegen_expr(const ASTNode *node) {
     if (!node) return;
+    check_literal_pool();
 
     switch (node->type) {
         case NODE_INT_LITERAL:
-            if (node->register_assigned >= 0) {
-                printf("    mov r%d, #%ld\n", node->register_assigned, node->token.literal.int_value);
-            }
+            // Operands of additions and calls are materialized by their user
+            if (node->register_assigned >= 0) emit_constant(node->register_assigned, node->token.literal.int_value);
             break;
 
         case NODE_IDENTIFIER:
-            if (node->requires_load) {
+            if (node->rematerialize) {
+                emit_constant(node->register_assigned, node->rematerialize->token.literal.int_value);
+            } else if (node->requires_load) {
                 emit_load_if_needed(node);
             } else if (node->source_register != node->register_assigned) {
-                printf("    mov r%d, r%d\n", node->register_assigned, node->source_register);
+                emit_instr(INSTR_MOVE, "mov r%d, r%d", node->register_assigned, node->source_register);
             }
             break;
 
         case NODE_ADD: {
-            codegen_expr(node->children[0]);
-            emit_load_if_needed(node->children[0]);
-
-            codegen_expr(node->children[1]);
-            emit_load_if_needed(node->children[1]);
-
+            // Addition commutes, so a literal operand always goes on the right
+            const ASTNode *left = node->children[0];
+            const ASTNode *right = node->children[1];
+            if (left->type == NODE_INT_LITERAL && right->type != NODE_INT_LITERAL) {
+                left = node->children[1];
+                right = node->children[0];
+            }
             const int dst = node->register_assigned;
-            const int lhs = node->children[0]->register_assigned;
-            const int rhs = node->children[1]->register_assigned;
 
-            printf("    add r%d, r%d, r%d\n", dst, lhs, rhs);
+            int lhs = dst;
+            if (left->type == NODE_INT_LITERAL) {
+                emit_constant(dst, left->token.literal.int_value);
+            } else {
+                codegen_expr(left);
+                lhs = left->register_assigned;
+            }
+
+            if (right->type == NODE_INT_LITERAL) {
+                // dst is free until the sum is written, and emit_add_constant may need ip
+                if (is_stored_operand(left)) emit_reload(lhs = dst, left);
+                emit_add_constant(dst, lhs, right->token.literal.int_value);
+            } else {
+                codegen_expr(right);
+                // dst may be the register of the right operand
+                if (is_stored_operand(left)) emit_reload(lhs = REG_IP, left);
+                emit_instr(INSTR_ALU, "add r%d, r%d, r%d", dst, lhs, right->register_assigned);
+            }
+            emit_store_if_needed(node);
             break;
         }
 
@@ -99,10 +418,9 @@ static void codegen_expr(const ASTNode *node) {
             const ASTNode *rhs = node->children[1];
 
             codegen_expr(rhs);
-            emit_load_if_needed(rhs);
 
             if (rhs->register_assigned != node->register_assigned) {
-                printf("    mov r%d, r%d\n", node->register_assigned, rhs->register_assigned);
+                emit_instr(INSTR_MOVE, "mov r%d, r%d", node->register_assigned, rhs->register_assigned);
             }
 
             emit_store_if_needed(node);
@@ -110,22 +428,31 @@ static void codegen_expr(const ASTNode *node) {
         }
 
         case NODE_FUNCTION_CALL: {
+            // Evaluate every argument first: a call among them overwrites r0-r3
             for (size_t i = 0; i < node->child_count; i++) {
                 codegen_expr(node->children[i]);
+            }
 
-                // Assign function parameters to registers r0, r1, r2 and r3
-                if (node->children[i]->register_assigned != (int) i) {
-                    printf("    mov r%zu, r%d\n", i, node->children[i]->register_assigned);
+            // Assign function parameters to registers r0, r1, r2 and r3
+            for (size_t i = 0; i < node->child_count; i++) {
+                const ASTNode *arg = node->children[i];
+                if (arg->type == NODE_INT_LITERAL) {
+                    emit_constant((int) i, arg->token.literal.int_value);
+                } else if (is_stored_operand(arg)) {
+                    emit_reload((int) i, arg);
+                } else if (arg->register_assigned != (int) i) {
+                    emit_instr(INSTR_MOVE, "mov r%zu, r%d", i, arg->register_assigned);
                 }
             }
 
             // Call the function
-            printf("    bl %s\n", node->token.lexeme);
+            emit_instr(INSTR_BRANCH, "bl %s", node->token.lexeme);
 
             // Move return value from r0 if needed
             if (node->register_assigned != 0 && node->register_assigned >= 0) {
-                printf("    mov r%d, r0\n", node->register_assigned);
+                emit_instr(INSTR_MOVE, "mov r%d, r0", node->register_assigned);
             }
+            emit_store_if_needed(node);
             break;
         }
 
@@ -141,29 +468,37 @@ static void codegen_expr(const ASTNode *node) {
  */
 static void codegen_stmt(const ASTNode *node) {
     if (!node) return;
+    check_literal_pool();
 
     switch (node->type) {
-        case NODE_VAR_DECL:
-            codegen_expr(node->children[2]);
+        case NODE_VAR_DECL: {
+            const ASTNode *init = node->children[2];
+            codegen_expr(init);
+            if (init->register_assigned != node->register_assigned) {
+                emit_instr(INSTR_MOVE, "mov r%d, r%d", node->register_assigned, init->register_assigned);
+            }
             emit_store_if_needed(node);
             break;
+        }
+
+        case NODE_ASSIGNMENT:
+            codegen_expr(node);
+            break;
 
         case NODE_RETURN: {
             const ASTNode *retval = node->children[0];
             codegen_expr(retval);
 
             if (retval->type == NODE_INT_LITERAL) {
-                printf("    mov r0, #%ld\n", retval->token.literal.int_value);
+                emit_constant(0, retval->token.literal.int_value);
             } else {
-                emit_load_if_needed(retval);
-                printf("    mov r0, r%d\n", retval->register_assigned);
+                emit_instr(INSTR_MOVE, "mov r0, r%d", retval->register_assigned);
             }
             break;
         }
 
         case NODE_EXPRESSION:
             codegen_expr(node->children[0]);
-            emit_load_if_needed(node->children[0]);
             break;
 
         default:
@@ -172,29 +507,183 @@ static void codegen_stmt(const ASTNode *node) {
 }
 
 /**
- * @brief Emit ARM instructions for a function definition
+ * @brief Read the selected cycle counter into lr (clobbers ip).
+ */
+static void emit_read_cycle_counter(void) {
+    if (codegen_options->instrument == INSTRUMENT_PMCCNTR) {
+        emit_instr(INSTR_MOVE, "mrc p15, 0, lr, c9, c13, 0");
+    } else {
+        char address[16];
+        snprintf(address, sizeof(address), "%#x", DWT_CYCCNT);
+        emit_pool_load(REG_IP, address);
+        emit_instr(INSTR_LOAD_STORE, "ldr lr, [ip]");
+    }
+}
+
+/**
+ * @brief Count a call of the current function and sample the cycle counter.
+ */
+static void emit_profile_entry(void) {
+    char counter[64];
+    snprintf(counter, sizeof(counter), ".Lbcc_prof_counters+%d", profile_index * PROFILE_ENTRY_SIZE);
+    emit_pool_load(REG_IP, counter);
+    emit_instr(INSTR_LOAD_STORE, "ldr lr, [ip]");
+    emit_instr(INSTR_ALU, "add lr, lr, #1");
+    emit_instr(INSTR_LOAD_STORE, "str lr, [ip]");
+
+    if (codegen_options->instrument >= INSTRUMENT_PMCCNTR) {
+        emit_read_cycle_counter();
+        emit_frame_access("str", REG_LR, frame_bytes);
+    }
+}
+
+/**
+ * @brief Add the cycles spent since function entry to the 64-bit total.
+ */
+static void emit_profile_exit(void) {
+    if (codegen_options->instrument < INSTRUMENT_PMCCNTR) return;
+
+    emit_read_cycle_counter();
+    emit_frame_access("ldr", REG_IP, frame_bytes);
+    emit_instr(INSTR_ALU, "sub lr, lr, ip");
+    char cycles[64];
+    snprintf(cycles, sizeof(cycles), ".Lbcc_prof_counters+%d", profile_index * PROFILE_ENTRY_SIZE + 4);
+    emit_pool_load(REG_IP, cycles);
+    emit_instr(INSTR_LOAD_STORE, "ldr r1, [ip]");
+    emit_instr(INSTR_ALU, "adds r1, r1, lr");
+    emit_instr(INSTR_LOAD_STORE, "str r1, [ip]");
+    emit_instr(INSTR_LOAD_STORE, "ldr r1, [ip, #4]");
+    emit_instr(INSTR_ALU, "adc r1, r1, #0");
+    emit_instr(INSTR_LOAD_STORE, "str r1, [ip, #4]");
+}
+
+/**
+ * @brief Emit a string literal, escaping quotes and backslashes.
+ */
+static void emit_asciz(const char *label, const char *text) {
+    fprintf(asm_out, "%s:\n    .asciz \"", label);
+    for (const char *c = text; *c; ++c) {
+        if (*c == '"' || *c == '\\') fputc('\\', asm_out);
+        fputc(*c, asm_out);
+    }
+    fprintf(asm_out, "\"\n");
+}
+
+/**
+ * @brief Emit the module's profile counters, names and descriptor.
  *
- * @param node The AST node representing a function
+ * @param root           The AST root (NODE_COMPILATION_UNIT).
+ * @param function_count Number of instrumented functions.
  */
-static void codegen_function(const ASTNode *node) {
-    if (!node || node->type != NODE_FUNCTION) return;
+static void emit_profile_table(const ASTNode *root, const int function_count) {
+    fprintf(asm_out, "\n.bss\n");
+    fprintf(asm_out, "    .align 2\n");
+    fprintf(asm_out, ".Lbcc_prof_counters:\n");
+    fprintf(asm_out, "    .space %d\n", function_count * PROFILE_ENTRY_SIZE);
+
+    fprintf(asm_out, "\n.section .rodata\n");
+    emit_asciz(".Lbcc_prof_module", codegen_options->module_path ? codegen_options->module_path : "");
+    int index = 0;
+    for (size_t i = 0; i < root->child_count; ++i) {
+        const ASTNode *fn = root->children[i];
+        if (!fn || fn->type != NODE_FUNCTION) continue;
+        char label[32];
+        snprintf(label, sizeof(label), ".Lbcc_prof_name%d", index++);
+        emit_asciz(label, fn->children[0]->token.lexeme);
+    }
+
+    // {name, line} for every function, in table order
+    fprintf(asm_out, "    .align 2\n");
+    fprintf(asm_out, ".Lbcc_prof_functions:\n");
+    index = 0;
+    for (size_t i = 0; i < root->child_count; ++i) {
+        const ASTNode *fn = root->children[i];
+        if (!fn || fn->type != NODE_FUNCTION) continue;
+        fprintf(asm_out, "    .word .Lbcc_prof_name%d, %d\n", index++, fn->children[0]->token.line);
+    }
 
+    // Descriptor layout must match BccProfModule in runtime/bcc_profile.c
+    fprintf(asm_out, "\n.section bcc_prof, \"a\"\n");
+    fprintf(asm_out, "    .align 2\n");
+    fprintf(asm_out, "    .word .Lbcc_prof_module, %d, .Lbcc_prof_counters, .Lbcc_prof_functions, %d\n",
+           function_count, (int) codegen_options->instrument);
+}
+
+/* Callee-saved registers (r4-r10) holding values of a function, as a bit mask */
+static unsigned saved_registers(const ASTNode *node) {
+    unsigned mask = 0;
+    if (node->register_assigned >= FIRST_VAR_REGISTER && node->register_assigned <= LAST_VAR_REGISTER) {
+        mask |= 1u << node->register_assigned;
+    }
+    for (size_t i = 0; i < node->child_count; i++) {
+        if (node->children[i]->type != NODE_FUNCTION) mask |= saved_registers(node->children[i]);
+    }
+    return mask;
+}
+
+/* "{r4, r5, fp, lr}"-style list of the saved registers, padded with r3 to an even count */
+static void format_saved_registers(unsigned mask, const char *last, char *buf, const size_t size) {
+    int count = 2;
+    for (int r = FIRST_VAR_REGISTER; r <= LAST_VAR_REGISTER; r++) count += (mask >> r) & 1u;
+    if (count % 2) mask |= 1u << 3;
+
+    size_t len = (size_t) snprintf(buf, size, "{");
+    for (int r = 0; r <= LAST_VAR_REGISTER && len < size; r++) {
+        if (mask & (1u << r)) len += (size_t) snprintf(buf + len, size - len, "r%d, ", r);
+    }
+    if (len < size) snprintf(buf + len, size - len, "fp, %s}", last);
+}
+
+/**
+ * @brief Emit ARM instructions for a function definition
+ *
+ * @param node  The AST node representing a function
+ * @param stats Entry receiving the function's statistics, or NULL
+ */
+static void codegen_function(const ASTNode *node, FunctionStats *stats) {
     const char *func_name = node->children[0]->token.lexeme;
 
-    printf("\n%s:\n", func_name);
+    // The linker can drop the section of a function nothing calls (--gc-sections)
+    if (codegen_options->function_sections || codegen_options->heat) {
+        const FunctionHeat heat = codegen_options->heat ? codegen_options->heat[profile_index] : HEAT_UNKNOWN;
+        char section[512];
+        codegen_section_name(codegen_options, func_name, heat, section, sizeof(section));
+        fprintf(asm_out, "\n.section %s, \"ax\", %%progbits\n", section);
+        fprintf(asm_out, "    .align 2");
+    }
+    fprintf(asm_out, "\n%s:\n", func_name);
 
-    // Function prologue: preserve FP & LR, set up new frame
-    printf("    push {fp, lr}\n");
-    printf("    mov fp, sp\n");
-    printf("    sub sp, sp, #512\n"); // Fixed frame size for now
+    if (stats) {
+        function_stats = stats;
+    } else {
+        scratch_stats = (FunctionStats){0};
+        function_stats = &scratch_stats;
+    }
+    frame_bytes = compute_frame_size(node);
+    function_stats->frame_size = frame_bytes;
+    literal_pool.pools = 0;
+
+    // Function prologue: preserve the callee-saved registers, FP & LR, set up new frame
+    const unsigned saved = saved_registers(node);
+    char saved_list[64];
+    format_saved_registers(saved, "lr", saved_list, sizeof(saved_list));
+    emit_instr(INSTR_LOAD_STORE, "push %s", saved_list);
+    emit_instr(INSTR_MOVE, "mov fp, sp");
+    if (frame_bytes > 0) emit_add_constant(REG_SP, REG_SP, -frame_bytes);
+
+    if (codegen_options->instrument != INSTRUMENT_NONE) {
+        emit_profile_entry();
+    }
 
-    // Store function parameters in their assigned stack slots
-    int stack_slot = 0;
+    // Store function parameters in their assigned stack slots (unread ones have none)
+    int param_index = 0;
     for (size_t i = 0; i < node->child_count; ++i) {
         const ASTNode *child = node->children[i];
         if (child->type == NODE_TYPE_PARAM) {
-            printf("    str r%d, [fp, #%d]\n", stack_slot, -(stack_slot + 1) * 4);
-            stack_slot++;
+            if (child->stack_slot >= 0) {
+                emit_frame_access("str", param_index, slot_offset(child->stack_slot));
+            }
+            param_index++;
         }
     }
 
@@ -213,24 +702,86 @@ static void codegen_function(const ASTNode *node) {
         }
     }
 
+    if (codegen_options->instrument != INSTRUMENT_NONE) {
+        emit_profile_exit();
+    }
+
     // Function epilogue: restore frame and return
-    printf("    add sp, fp, #0\n");
-    printf("    pop {fp, pc}\n");
+    emit_instr(INSTR_ALU, "add sp, fp, #0");
+    format_saved_registers(saved, "pc", saved_list, sizeof(saved_list));
+    emit_instr(INSTR_BRANCH, "pop %s", saved_list);
+    flush_literal_pool(true);
+    free(literal_pool.words);
+    literal_pool = (LiteralPool){0};
+}
+
+/**
+ * @brief The functions of a module, generated as the items of a work queue.
+ */
+typedef struct {
+    const ASTNode **functions;
+    FunctionStats *stats; ///< Entries of the functions in the module's statistics, or NULL
+} ModuleFunctions;
+
+static void codegen_function_item(void *context, const size_t index, FILE *out) {
+    const ModuleFunctions *module = context;
+    const size_t function = codegen_options->order ? codegen_options->order[index] : index;
+    asm_out = out;
+    profile_index = (int) function;
+    codegen_function(module->functions[function], module->stats ? &module->stats[function] : NULL);
+}
+
+void codegen_section_name(const CodegenOptions *options, const char *name, const FunctionHeat heat,
+                          char *buf, const size_t size) {
+    const char *group = heat == HEAT_HOT ? ".hot" : heat == HEAT_COLD ? ".unlikely" : "";
+    if (options->function_sections) {
+        snprintf(buf, size, ".text%s.%s", group, name);
+    } else {
+        snprintf(buf, size, ".text%s", group);
+    }
 }
 
 /**
  * @brief Entry point for ARM code generation
  *
- * @param root The root of the AST (should be NODE_COMPILATION_UNIT)
+ * @param root    The root of the AST (should be NODE_COMPILATION_UNIT)
+ * @param options Code generation settings
  */
-void codegen_arm(const ASTNode *root) {
+void codegen_arm(const ASTNode *root, const CodegenOptions *options) {
     if (!root || root->type != NODE_COMPILATION_UNIT) return;
 
+    codegen_options = options;
+    asm_out = stdout;
+
     emit_text_section();
     emit_global_directives(root);
 
+    ModuleFunctions module = {.functions = malloc((root->child_count ? root->child_count : 1) * sizeof(ASTNode *))};
+    if (!module.functions) {
+        fprintf(stderr, "Memory allocation failed in codegen_arm\n");
+        exit(EXIT_FAILURE);
+    }
+    size_t function_count = 0;
     for (size_t i = 0; i < root->child_count; ++i) {
-        codegen_function(root->children[i]);
+        const ASTNode *fn = root->children[i];
+        if (fn && fn->type == NODE_FUNCTION) module.functions[function_count++] = fn;
+    }
+
+    // Entries are added up front so they stay in source order and do not move while functions run
+    if (options->stats) {
+        const size_t first = options->stats->count;
+        for (size_t i = 0; i < function_count; ++i) {
+            module_stats_add(options->stats, module.functions[i]->children[0]->token.lexeme);
+        }
+        module.stats = &options->stats->functions[first];
+    }
+
+    work_queue_run(function_count, options->jobs, codegen_function_item, &module, stdout);
+    asm_out = stdout;
+    free(module.functions);
+
+    if (options->instrument != INSTRUMENT_NONE && function_count > 0) {
+        emit_profile_table(root, (int) function_count);
     }
 }
 
@@ -0,0 +1,122 @@
+/**
+ * @file codegen_stats.c
+ * @brief Per-function code size and instruction-mix statistics for BasicCodeCompiler.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "../include/codegen_stats.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define REGISTER_COUNT 16
+
+static const char *class_names[INSTR_CLASS_COUNT] = {
+    [INSTR_ALU] = "alu",
+    [INSTR_LOAD_STORE] = "load_store",
+    [INSTR_BRANCH] = "branch",
+    [INSTR_MOVE] = "mov"
+};
+
+FunctionStats *module_stats_add(ModuleStats *stats, const char *name) {
+    if (stats->count >= stats->cap) {
+        stats->cap = stats->cap ? stats->cap * 2 : 16;
+        stats->functions = realloc(stats->functions, stats->cap * sizeof(FunctionStats));
+        if (!stats->functions) {
+            fprintf(stderr, "Memory allocation failed in module_stats_add\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    FunctionStats *fs = &stats->functions[stats->count++];
+    *fs = (FunctionStats){.name = strdup(name)};
+    return fs;
+}
+
+void module_stats_total(const ModuleStats *stats, FunctionStats *total) {
+    *total = (FunctionStats){0};
+    for (size_t i = 0; i < stats->count; i++) {
+        const FunctionStats *fs = &stats->functions[i];
+        total->instructions += fs->instructions;
+        for (int c = 0; c < INSTR_CLASS_COUNT; c++) total->by_class[c] += fs->by_class[c];
+        total->spills += fs->spills;
+        total->reloads += fs->reloads;
+        if (fs->frame_size > total->frame_size) total->frame_size = fs->frame_size;
+        total->registers_used |= fs->registers_used;
+    }
+}
+
+/* Registers as "r0 r4 fp" (text) or "\"r0\",\"r4\",\"fp\"" (JSON) */
+static void print_registers(const unsigned mask, const StatsFormat format, FILE *out) {
+    static const char *names[REGISTER_COUNT] = {
+        "r0", "r1", "r2", "r3", "r4", "r5", "r6", "r7",
+        "r8", "r9", "r10", "fp", "ip", "sp", "lr", "pc"
+    };
+    bool first = true;
+    for (int r = 0; r < REGISTER_COUNT; r++) {
+        if (!(mask & (1u << r))) continue;
+        if (format == STATS_JSON) {
+            fprintf(out, "%s\"%s\"", first ? "" : ",", names[r]);
+        } else {
+            fprintf(out, "%s%s", first ? "" : " ", names[r]);
+        }
+        first = false;
+    }
+}
+
+static void print_json_entry(const FunctionStats *fs, FILE *out) {
+    fprintf(out, "{");
+    if (fs->name) fprintf(out, "\"name\":\"%s\",", fs->name);
+    fprintf(out, "\"instructions\":%d,\"mix\":{", fs->instructions);
+    for (int c = 0; c < INSTR_CLASS_COUNT; c++) {
+        fprintf(out, "%s\"%s\":%d", c ? "," : "", class_names[c], fs->by_class[c]);
+    }
+    fprintf(out, "},\"spills\":%d,\"reloads\":%d,\"frame_size\":%d,\"registers\":[",
+            fs->spills, fs->reloads, fs->frame_size);
+    print_registers(fs->registers_used, STATS_JSON, out);
+    fprintf(out, "]}");
+}
+
+static void print_text_row(const char *name, const FunctionStats *fs, FILE *out) {
+    fprintf(out, "  %-20s %6d %6d %6d %6d %6d %6d %7d %6d  ", name, fs->instructions,
+            fs->by_class[INSTR_ALU], fs->by_class[INSTR_LOAD_STORE], fs->by_class[INSTR_BRANCH],
+            fs->by_class[INSTR_MOVE], fs->spills, fs->reloads, fs->frame_size);
+    print_registers(fs->registers_used, STATS_TEXT, out);
+    fprintf(out, "\n");
+}
+
+void module_stats_print(const ModuleStats *stats, const char *module, const StatsFormat format, FILE *out) {
+    FunctionStats total;
+    module_stats_total(stats, &total);
+
+    if (format == STATS_JSON) {
+        // Module names are paths from the command line; escape the JSON specials
+        fprintf(out, "{\"module\":\"");
+        for (const char *c = module; *c; c++) {
+            if (*c == '"' || *c == '\\') fputc('\\', out);
+            fputc(*c, out);
+        }
+        fprintf(out, "\",\"functions\":[");
+        for (size_t i = 0; i < stats->count; i++) {
+            if (i > 0) fprintf(out, ",");
+            print_json_entry(&stats->functions[i], out);
+        }
+        fprintf(out, "],\"total\":");
+        print_json_entry(&total, out);
+        fprintf(out, "}\n");
+        return;
+    }
+
+    fprintf(out, "Code statistics for %s (%zu functions):\n", module, stats->count);
+    fprintf(out, "  %-20s %6s %6s %6s %6s %6s %6s %7s %6s  %s\n", "function", "instr", "alu",
+            "ldst", "branch", "mov", "spill", "reload", "frame", "registers");
+    for (size_t i = 0; i < stats->count; i++) {
+        print_text_row(stats->functions[i].name, &stats->functions[i], out);
+    }
+    print_text_row("total", &total, out);
+}
+
+void module_stats_free(ModuleStats *stats) {
+    for (size_t i = 0; i < stats->count; i++) free(stats->functions[i].name);
+    free(stats->functions);
+    *stats = (ModuleStats){0};
+}
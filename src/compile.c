@@ -3,6 +3,7 @@
  * @brief Implementation of compile_file() for BasicCodeCompiler (bcc).
  */
 
+#define _XOPEN_SOURCE 700
 #define _POSIX_C_SOURCE 200809L
 
 #include <stdio.h>
@@ -23,9 +24,23 @@
 #include "../include/parser.h"
 #include "../include/register_allocator.h"
 #include "../include/codegen_arm.h"
+#include "../include/interpreter.h"
+#include "../include/phase_timer.h"
+#include "../include/profile_report.h"
+#include "../include/module_interface.h"
+#include "../include/ast_binary.h"
+#include "../include/symbol_table.h"
+#include "../include/ipa.h"
+#include "../include/function_order.h"
 
-/** Maximum input file size (1 MiB) */
-static const size_t MAX_FILE_SIZE = 1024 * 1024;
+/** Maximum input file size (64 MiB) */
+static const size_t MAX_FILE_SIZE = 64 * 1024 * 1024;
+
+/** Profiling runtime linked into instrumented executables (relative to the working directory, like lib/) */
+#define PROFILE_RUNTIME "runtime/bcc_profile.c"
+
+/** Linker section ordering file written with --order-functions, next to the assembly */
+#define FUNCTION_ORDER_FILE "tmp/functions.order"
 
 /**
  * @struct CompilationContext
@@ -35,6 +50,10 @@ typedef struct {
     TokenStream *token_stream; /**< Pointer to token stream */
     ASTNode *ast_root; /**< Root of the AST */
     Architecture target_arch; /**< Target architecture */
+    PhaseTimer timer; /**< Time spent in each phase */
+    int line_count; /**< Number of source lines */
+    AstBinView ast_view; /**< Mapped binary AST the lexemes point into, when restarting from one */
+    SymbolTable symbols; /**< Symbols the AST's identifiers are resolved to */
 } CompilationContext;
 
 /**
@@ -141,6 +160,8 @@ static void cleanup_context(CompilationContext *ctx) {
         cleanup_token_stream(ctx->token_stream);
         ctx->token_stream = NULL;
     }
+    ast_binary_unmap(&ctx->ast_view);
+    symbol_table_free(&ctx->symbols);
 }
 
 /**
@@ -165,12 +186,16 @@ static int lex_phase(const char *source, TokenStream *ts) {
 /**
  * @brief Perform parsing: build AST from tokens.
  *
+ * Function bodies are only brace-matched and left for body_phase() or the
+ * interpreter to parse, unless the AST is printed.
+ *
  * @param ctx       CompilationContext holding tokens.
- * @param show_ast  If true, print the AST to stdout.
+ * @param show_ast  If true, parse every body and print the AST to stdout.
  * @return          Number of syntax errors found.
  */
 static int parse_phase(CompilationContext *ctx, bool show_ast) {
     Parser p = parser_create(ctx->token_stream);
+    p.lazy_bodies = !show_ast;
     const int errors = parse(&p);
     if (errors == 0) {
         ctx->ast_root = p.ast_root;
@@ -217,11 +242,580 @@ static void collect_imports(const ASTNode *node, char ***imports, size_t *count,
     }
 }
 
+/**
+ * @brief Check whether a path ends with the given extension.
+ */
+static bool has_extension(const char *path, const char *ext) {
+    const size_t len = strlen(path);
+    const size_t ext_len = strlen(ext);
+    return len > ext_len && strcmp(path + len - ext_len, ext) == 0;
+}
+
+/**
+ * @brief Resolve every name of the parsed module to a symbol.
+ *
+ * Part of the parse phase: it runs once, right after the AST is built.
+ * Of a function whose body was skipped, only the signature is resolved here;
+ * materialize_body() resolves the rest once the body is parsed.
+ *
+ * @param ctx  CompilationContext holding the AST.
+ * @return     ERR_OK, or ERR_SEMANTIC after reporting undeclared or redeclared names.
+ */
+static ErrorCode resolve_phase(CompilationContext *ctx) {
+    symbol_table_init(&ctx->symbols);
+    phase_timer_start(&ctx->timer, PHASE_PARSE);
+    const size_t errors = symbol_resolve_ast(&ctx->symbols, ctx->ast_root);
+    phase_timer_stop(&ctx->timer);
+    if (errors > 0) {
+        fprintf(stderr, "Semantic errors detected.\n");
+        cleanup_context(ctx);
+        return ERR_SEMANTIC;
+    }
+    return ERR_OK;
+}
+
+/**
+ * @brief Parse a function body skipped by parse_phase() and resolve its names.
+ *
+ * @param ctx  CompilationContext holding the tokens and symbols of the function.
+ * @param fn   Declaration of the module; anything but a lazy function is left as is.
+ * @return     false after reporting undeclared or redeclared names.
+ */
+static bool materialize_body(CompilationContext *ctx, ASTNode *fn) {
+    if (fn->type != NODE_FUNCTION || fn->body_start == 0) return true;
+    parse_function_body(ctx->token_stream, fn);
+    return symbol_resolve_function(&ctx->symbols, fn) == 0;
+}
+
+/**
+ * @brief Parse every function body the parse phase skipped.
+ *
+ * Runs once the module's imports are compiled, so the bodies are not held
+ * in memory meanwhile.  Timed as part of the parse phase.
+ *
+ * @param ctx  CompilationContext holding the AST.
+ * @return     ERR_OK, or ERR_SEMANTIC after reporting undeclared or redeclared names.
+ */
+static ErrorCode body_phase(CompilationContext *ctx) {
+    size_t errors = 0;
+    phase_timer_start(&ctx->timer, PHASE_PARSE);
+    for (size_t i = 0; i < ctx->ast_root->child_count; i++) {
+        if (!materialize_body(ctx, ctx->ast_root->children[i])) errors++;
+    }
+    phase_timer_stop(&ctx->timer);
+    if (errors > 0) {
+        fprintf(stderr, "Semantic errors detected.\n");
+        return ERR_SEMANTIC;
+    }
+    return ERR_OK;
+}
+
+/**
+ * @brief Restart from a binary AST (.bast) instead of lexing and parsing.
+ *
+ * The file is mapped for the lifetime of ctx; mapping and validation are
+ * timed as the read phase and rebuilding the nodes as the parse phase.
+ *
+ * @param path  Path of the .bast file.
+ * @param opts  CompilerOptions (AST dump, target).
+ * @param ctx   CompilationContext receiving the AST and the mapping.
+ * @return      ERR_OK on success or an ErrorCode on failure.
+ */
+static ErrorCode binary_frontend_phase(const char *path, const CompilerOptions *opts, CompilationContext *ctx) {
+    phase_timer_start(&ctx->timer, PHASE_READ);
+    const bool mapped = ast_binary_map(path, &ctx->ast_view);
+    phase_timer_stop(&ctx->timer);
+    if (!mapped) return ERR_FILE_READ;
+
+    ctx->target_arch = opts->target_arch;
+    ctx->line_count = (int) ctx->ast_view.header->line_count;
+
+    phase_timer_start(&ctx->timer, PHASE_PARSE);
+    ctx->ast_root = ast_binary_to_ast(&ctx->ast_view);
+    phase_timer_stop(&ctx->timer);
+    if (opts->show_ast) {
+        printf("\nAST:\n-------------------------------\n");
+        print_ast(ctx->ast_root, 0);
+        printf("-------------------------------\n");
+    }
+    return resolve_phase(ctx);
+}
+
+/**
+ * @brief Directory the imports of a module are resolved against.
+ *
+ * That is the module's own directory, except for a binary AST, whose imports
+ * are relative to the source it was produced from.
+ *
+ * @param ctx          CompilationContext holding the module.
+ * @param module_dir   Directory of the module file.
+ * @param out          Receives the directory.
+ * @param out_size     Size of out.
+ */
+static void import_base_dir(const CompilationContext *ctx, const char *module_dir, char *out, const size_t out_size) {
+    const char *source = ctx->ast_view.header ? ast_binary_string(&ctx->ast_view, ctx->ast_view.header->source_path) : NULL;
+    if (!source) {
+        snprintf(out, out_size, "%s", module_dir);
+        return;
+    }
+    char source_copy[PATH_MAX];
+    snprintf(source_copy, sizeof(source_copy), "%s", source);
+    snprintf(out, out_size, "%s", dirname(source_copy));
+}
+
+/**
+ * @brief Read, lex and parse one source file.
+ *
+ * Lexical and syntax errors are reported on stderr.  On success the caller
+ * owns the AST in ctx and the tokens in ts and must release both with
+ * cleanup_context().  A .bast file is mapped instead (see binary_frontend_phase()).
+ *
+ * @param path  Path of the source file.
+ * @param opts  CompilerOptions (token and AST dumps, target).
+ * @param ctx   CompilationContext receiving the AST.
+ * @param ts    TokenStream receiving the tokens.
+ * @return      ERR_OK on success or an ErrorCode on failure.
+ */
+static ErrorCode frontend_phase(const char *path, const CompilerOptions *opts,
+                                CompilationContext *ctx, TokenStream *ts) {
+    if (has_extension(path, ".bast")) {
+        return binary_frontend_phase(path, opts, ctx);
+    }
+
+    char *source = NULL;
+    size_t src_len = 0;
+    phase_timer_start(&ctx->timer, PHASE_READ);
+    const ErrorCode er = read_file(path, &source, &src_len);
+    phase_timer_stop(&ctx->timer);
+    if (er != ERR_OK) {
+        fprintf(stderr, "Error reading '%s'\n", path);
+        return er;
+    }
+
+    phase_timer_start(&ctx->timer, PHASE_LEX);
+    const int lex_errs = lex_phase(source, ts);
+    phase_timer_stop(&ctx->timer);
+    free(source);
+    if (lex_errs > 0) {
+        for (size_t i = 0; i < ts->count; i++) {
+            const Token *t = &ts->tokens[i];
+            if (t->type == TOKEN_ERROR) {
+                fprintf(stderr, "Lexical error at line %d: %s\n", t->line, t->literal.error_message);
+            }
+        }
+        fprintf(stderr, "Lexical errors: %d\n", lex_errs);
+        cleanup_token_stream(ts);
+        return ERR_LEXICAL;
+    }
+
+    if (opts->show_tokens) {
+        print_tokens(ts);
+    }
+
+    ctx->token_stream = ts;
+    ctx->target_arch = opts->target_arch;
+    ctx->line_count = ts->tokens[ts->count - 1].line;
+
+    phase_timer_start(&ctx->timer, PHASE_PARSE);
+    const int parse_errs = parse_phase(ctx, opts->show_ast);
+    phase_timer_stop(&ctx->timer);
+    if (parse_errs > 0) {
+        fprintf(stderr, "Syntax errors detected.\n");
+        cleanup_context(ctx);
+        return ERR_SYNTAX;
+    }
+    return resolve_phase(ctx);
+}
+
+/**
+ * @brief Resolve an import path relative to the importing file.
+ *
+ * Paths starting with "lib/" and absolute paths are used as is; anything
+ * else is relative to the directory of the importing file.
+ *
+ * @param base_dir     Directory of the importing file.
+ * @param import_file  Import path as written in the source.
+ * @param out          Receives the resolved path.
+ * @param out_size     Size of out.
+ */
+static void resolve_import_path(const char *base_dir, const char *import_file, char *out, const size_t out_size) {
+    if (strncmp(import_file, "lib/", 4) == 0 || import_file[0] == '/') {
+        snprintf(out, out_size, "%s", import_file);
+    } else {
+        snprintf(out, out_size, "%s/%s", base_dir, import_file);
+    }
+}
+
+/**
+ * @brief Turn a canonical path into a flat file name for tmp/ or the module cache.
+ *
+ * Every '/' becomes '_' and a trailing .bc, .bast or .s extension is dropped.
+ *
+ * @param canonical  Canonical path of a module or library.
+ * @param out        Receives the mangled name.
+ * @param out_size   Size of out.
+ */
+static void mangle_path(const char *canonical, char *out, const size_t out_size) {
+    snprintf(out, out_size, "%s", canonical);
+    for (char *p = out; *p; ++p) {
+        if (*p == '/') *p = '_';
+    }
+    const size_t len = strlen(out);
+    if (len > 3 && strcmp(out + len - 3, ".bc") == 0) {
+        out[len - 3] = '\0';
+    } else if (len > 5 && strcmp(out + len - 5, ".bast") == 0) {
+        out[len - 5] = '\0';
+    } else if (len > 2 && strcmp(out + len - 2, ".s") == 0) {
+        out[len - 2] = '\0';
+    }
+}
+
+/**
+ * @brief Copy an imported assembly library into tmp/ unless it is already there.
+ *
+ * @param resolved_import  Resolved path of the library.
+ * @param canonical        Receives its canonical path (PATH_MAX bytes).
+ * @return                 true if the library exists.
+ */
+static bool copy_library(const char *resolved_import, char *canonical) {
+    if (!file_exists(resolved_import) || !realpath(resolved_import, canonical)) {
+        return false;
+    }
+    char import_safe[PATH_MAX];
+    mangle_path(canonical, import_safe, sizeof(import_safe));
+    char import_tmp[PATH_MAX + 50];
+    snprintf(import_tmp, sizeof(import_tmp), "tmp/%s.s", import_safe);
+    struct stat st = {0};
+    if (stat(import_tmp, &st) != 0) {
+        char copy_cmd[PATH_MAX * 4 + 32];
+        snprintf(copy_cmd, sizeof(copy_cmd), "cp '%s' '%s'", resolved_import, import_tmp);
+        run_command(copy_cmd);
+    }
+    return true;
+}
+
+/**
+ * @brief Size and modification time of a source file, used to detect stale interfaces.
+ */
+static bool source_fingerprint(const char *path, uint64_t *size, int64_t *mtime_ns) {
+    struct stat st = {0};
+    if (stat(path, &st) != 0) return false;
+    *size = (uint64_t) st.st_size;
+    *mtime_ns = (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    return true;
+}
+
+/**
+ * @brief Code generation flags an interface's assembly depends on.
+ */
+static uint32_t interface_flags(const CompilerOptions *opts) {
+    return (uint32_t) opts->instrument | (opts->no_inline_imports ? 0u : 1u << 8) |
+           (opts->gc_sections ? 1u << 9 : 0u) | (opts->no_ipa ? 0u : 1u << 10) | (opts->profile ? 1u << 11 : 0u) |
+           (opts->order_functions ? 1u << 12 : 0u);
+}
+
+/**
+ * @brief Path of a module's interface in the module cache.
+ */
+static void interface_path(const char *cache_dir, const char *canonical, char *out, const size_t out_size) {
+    char safe[PATH_MAX];
+    mangle_path(canonical, safe, sizeof(safe));
+    snprintf(out, out_size, "%s/%s.bci", cache_dir, safe);
+}
+
+/**
+ * @struct KnownModule
+ * @brief Interface of a module compiled or loaded by this process.
+ */
+typedef struct {
+    char *path; /**< Canonical path of the module source */
+    ModuleInterface *iface;
+} KnownModule;
+
+static KnownModule *known_modules = NULL;
+static size_t known_count = 0, known_cap = 0;
+
+/** Canonical paths of the modules being compiled or loaded, to cut import cycles */
+static const char **in_progress = NULL;
+static size_t in_progress_count = 0, in_progress_cap = 0;
+
+static const ModuleInterface *find_known_module(const char *canonical) {
+    for (size_t i = 0; i < known_count; ++i) {
+        if (strcmp(known_modules[i].path, canonical) == 0) return known_modules[i].iface;
+    }
+    return NULL;
+}
+
+static void remember_module(const char *canonical, ModuleInterface *iface) {
+    if (known_count >= known_cap) {
+        known_cap = known_cap ? known_cap * 2 : 8;
+        known_modules = realloc(known_modules, known_cap * sizeof(KnownModule));
+        assert(known_modules);
+    }
+    known_modules[known_count++] = (KnownModule){.path = strdup(canonical), .iface = iface};
+}
+
+static bool is_in_progress(const char *canonical) {
+    for (size_t i = 0; i < in_progress_count; ++i) {
+        if (strcmp(in_progress[i], canonical) == 0) return true;
+    }
+    return false;
+}
+
+static void push_in_progress(const char *canonical) {
+    if (in_progress_count >= in_progress_cap) {
+        in_progress_cap = in_progress_cap ? in_progress_cap * 2 : 8;
+        in_progress = realloc(in_progress, in_progress_cap * sizeof(char *));
+        assert(in_progress);
+    }
+    in_progress[in_progress_count++] = canonical;
+}
+
+static ErrorCode ensure_module(const char *resolved_import, const CompilerOptions *opts,
+                               const ModuleInterface **out);
+
+/**
+ * @brief Load a module from its cached interface instead of compiling it.
+ *
+ * The interface is used only if it was produced with the same flags from
+ * the current source, and every .bc module it imports still has the
+ * interface it was compiled against (imports are brought up to date
+ * first).  On success the module's assembly and libraries are in tmp/.
+ *
+ * @param canonical  Canonical path of the module source.
+ * @param opts       CompilerOptions of the importer.
+ * @return           The interface, or NULL if it is missing or stale.
+ */
+static ModuleInterface *load_cached_interface(const char *canonical, const CompilerOptions *opts) {
+    char bci_path[PATH_MAX + 64];
+    interface_path(opts->module_cache, canonical, bci_path, sizeof(bci_path));
+    ModuleInterface *iface = module_interface_read(bci_path);
+    if (!iface) return NULL;
+
+    uint64_t size = 0;
+    int64_t mtime_ns = 0;
+    bool fresh = source_fingerprint(canonical, &size, &mtime_ns) &&
+                 size == iface->source_size && mtime_ns == iface->source_mtime_ns &&
+                 iface->flags == interface_flags(opts);
+
+    push_in_progress(canonical);
+    for (size_t i = 0; i < iface->import_count && fresh; ++i) {
+        const InterfaceImport *imp = &iface->imports[i];
+        const size_t len = strlen(imp->path);
+        if (len > 2 && strcmp(imp->path + len - 2, ".s") == 0) {
+            char library[PATH_MAX];
+            fresh = copy_library(imp->path, library);
+        } else {
+            const ModuleInterface *dep = NULL;
+            fresh = ensure_module(imp->path, opts, &dep) == ERR_OK && dep &&
+                    dep->interface_hash == imp->interface_hash;
+        }
+    }
+    in_progress_count--;
+
+    if (fresh) {
+        char safe[PATH_MAX];
+        mangle_path(canonical, safe, sizeof(safe));
+        char asm_path[PATH_MAX + 50];
+        snprintf(asm_path, sizeof(asm_path), "tmp/%s.s", safe);
+        struct stat st = {0};
+        if (stat(asm_path, &st) != 0) {
+            FILE *asm_out = fopen(asm_path, "w");
+            fresh = asm_out && fwrite(iface->assembly, 1, iface->assembly_size, asm_out) == iface->assembly_size;
+            if (asm_out && fclose(asm_out) != 0) fresh = false;
+        }
+    }
+    if (!fresh) {
+        module_interface_free(iface);
+        return NULL;
+    }
+    return iface;
+}
+
+/**
+ * @brief Make sure an imported .bc module is compiled and return its interface.
+ *
+ * The module is taken from this process's earlier work, then from the
+ * module cache, and is compiled only if both miss.  A module that is
+ * already being compiled (an import cycle) or does not exist yields no
+ * interface; its calls are then left unchecked, as before interfaces.
+ *
+ * @param resolved_import  Resolved path of the import.
+ * @param opts             CompilerOptions of the importer.
+ * @param out              Receives the interface, or NULL.
+ * @return                 ERR_OK unless compiling the module failed.
+ */
+static ErrorCode ensure_module(const char *resolved_import, const CompilerOptions *opts,
+                               const ModuleInterface **out) {
+    *out = NULL;
+    char canonical[PATH_MAX];
+    if (!file_exists(resolved_import) || !realpath(resolved_import, canonical)) {
+        fprintf(stderr, "Failed to resolve path for import '%s'\n", resolved_import);
+        return ERR_OK;
+    }
+    if (is_in_progress(canonical)) return ERR_OK;
+
+    *out = find_known_module(canonical);
+    if (*out) return ERR_OK;
+
+    // Reports describe the work done, a profile may have changed since, and the program's call graph
+    // needs every module's calls, so they always compile from source
+    if (opts->module_cache && opts->stats == STATS_NONE && !opts->regalloc_report && !opts->profile &&
+        !opts->order_functions) {
+        ModuleInterface *iface = load_cached_interface(canonical, opts);
+        if (iface) {
+            remember_module(canonical, iface);
+            *out = iface;
+            return ERR_OK;
+        }
+    }
+
+    char import_dir[PATH_MAX];
+    char import_base[PATH_MAX];
+    strncpy(import_dir, canonical, sizeof(import_dir) - 1);
+    import_dir[sizeof(import_dir) - 1] = '\0';
+    strncpy(import_base, canonical, sizeof(import_base) - 1);
+    import_base[sizeof(import_base) - 1] = '\0';
+
+    CompilerOptions import_opts = {0};
+    import_opts.file_directory_path = dirname(import_dir);
+    import_opts.filename = basename(import_base);
+    import_opts.is_executable = false;
+    import_opts.time_report = opts->time_report;
+    import_opts.instrument = opts->instrument;
+    import_opts.stats = opts->stats;
+    import_opts.regalloc_report = opts->regalloc_report;
+    import_opts.module_cache = opts->module_cache;
+    import_opts.no_inline_imports = opts->no_inline_imports;
+    import_opts.no_ipa = opts->no_ipa;
+    import_opts.gc_sections = opts->gc_sections;
+    import_opts.jobs = opts->jobs;
+    import_opts.profile = opts->profile;
+    import_opts.order_functions = opts->order_functions;
+
+    const ErrorCode er = compile_file(&import_opts);
+    *out = find_known_module(canonical);
+    return er;
+}
+
+/**
+ * @brief Look up every function of a module in a profile.
+ *
+ * @param root      Root of the module's AST.
+ * @param profile   Profile given with -fprofile-use.
+ * @param canonical Canonical path of the module, as recorded in the profile.
+ * @return          Heat of each function in AST order; the caller frees it.
+ */
+static FunctionHeat *function_heat(const ASTNode *root, const ProfileData *profile, const char *canonical) {
+    FunctionHeat *heat = calloc(root->child_count ? root->child_count : 1, sizeof(FunctionHeat));
+    assert(heat);
+    size_t count = 0;
+    for (size_t i = 0; i < root->child_count; ++i) {
+        const ASTNode *fn = root->children[i];
+        if (fn->type != NODE_FUNCTION) continue;
+        heat[count++] = profile_function_heat(profile, canonical, fn->children[0]->token.lexeme);
+    }
+    return heat;
+}
+
+/**
+ * @brief Functions of every module compiled so far, for --order-functions.
+ */
+static CallGraph program_graph;
+
+/**
+ * @brief Place the functions of a module and add them to the program's call graph.
+ *
+ * @param root      Root of the module's AST, ready for code generation.
+ * @param canonical Canonical path of the module.
+ * @param codegen   Code generation settings, which decide the section names.
+ * @param profile   Profile given with -fprofile-use, or NULL.
+ * @return          Emission order of the module's functions; the caller frees it.
+ */
+static size_t *place_functions(const ASTNode *root, const char *canonical, const CodegenOptions *codegen,
+                               const ProfileData *profile) {
+    char **sections = calloc(root->child_count ? root->child_count : 1, sizeof(char *));
+    assert(sections);
+    size_t count = 0;
+    for (size_t i = 0; i < root->child_count; ++i) {
+        const ASTNode *fn = root->children[i];
+        if (fn->type != NODE_FUNCTION) continue;
+        const char *name = fn->children[0]->token.lexeme;
+        char section[512];
+        codegen_section_name(codegen, name, codegen->heat ? codegen->heat[count] : HEAT_UNKNOWN,
+                             section, sizeof(section));
+        sections[count++] = strdup(section);
+    }
+
+    CallGraph module_graph = {0};
+    call_graph_add_module(&module_graph, root, (const char *const *) sections, profile, canonical);
+    size_t *order = call_graph_order(&module_graph);
+    call_graph_append(&program_graph, &module_graph);
+
+    for (size_t i = 0; i < count; ++i) free(sections[i]);
+    free(sections);
+    return order;
+}
+
+/**
+ * @brief Place the functions of the whole program and write the linker ordering file.
+ */
+static void write_function_order(const char *path) {
+    size_t *order = call_graph_order(&program_graph);
+    if (!call_graph_write_order(&program_graph, order, path)) {
+        fprintf(stderr, "Failed to write function order '%s'\n", path);
+    }
+    free(order);
+    call_graph_free(&program_graph);
+}
+
+/**
+ * @brief Build a module's interface after code generation and write it to the cache.
+ *
+ * @param ctx           CompilationContext holding the module's AST.
+ * @param canonical     Canonical path of the module source.
+ * @param asm_path      Assembly generated for the module.
+ * @param import_paths  Canonical path of each import, NULL if it was not found.
+ * @param imports       Interface of each .bc import, NULL otherwise.
+ * @param import_count  Number of imports.
+ * @param pure          Purity of each function of the module, in AST order.
+ * @param opts          CompilerOptions of the module.
+ */
+static void record_interface(const CompilationContext *ctx, const char *canonical, const char *asm_path,
+                             char **import_paths, const ModuleInterface **imports, const size_t import_count,
+                             const bool *pure, const CompilerOptions *opts) {
+    ModuleInterface *iface = module_interface_from_ast(ctx->ast_root, pure);
+    iface->flags = interface_flags(opts);
+    source_fingerprint(canonical, &iface->source_size, &iface->source_mtime_ns);
+    for (size_t i = 0; i < import_count; ++i) {
+        if (import_paths[i]) {
+            module_interface_add_import(iface, import_paths[i], imports[i] ? imports[i]->interface_hash : 0);
+        }
+    }
+    remember_module(canonical, iface);
+
+    if (!opts->module_cache) return;
+    if (read_file(asm_path, &iface->assembly, &iface->assembly_size) != ERR_OK) return;
+
+    struct stat st = {0};
+    if (stat(opts->module_cache, &st) == -1 && mkdir(opts->module_cache, 0700) != 0) {
+        fprintf(stderr, "Failed to create module cache '%s'\n", opts->module_cache);
+        return;
+    }
+    char bci_path[PATH_MAX + 64];
+    interface_path(opts->module_cache, canonical, bci_path, sizeof(bci_path));
+    if (!module_interface_write(iface, bci_path)) {
+        fprintf(stderr, "Failed to write module interface '%s'\n", bci_path);
+    }
+}
+
 /**
  * @brief Top-level compilation function.
  *
- * Reads source from disk, lexes, parses, allocates registers,
- * emits assembly, and invokes the linker script.
+ * Reads source from disk, lexes, parses, brings imported modules up to
+ * date (from their cached interfaces when possible), checks and inlines
+ * calls into them, allocates registers, emits assembly, writes the module's
+ * own interface, and invokes the linker script.
  * The generated .s file is placed in the tmp directory, using the full
  * absolute path of the input file (with '/' replaced by '_', and without .bc extension).
  * The generated executable is named after the input file (without path or .bc).
@@ -243,16 +837,10 @@ ErrorCode compile_file(const CompilerOptions *opts) {
     }
 
     // Convert absolute path to a safe filename for tmp/
+    char canonical_path[PATH_MAX];
+    assert(realpath(abs_path, canonical_path));
     char safe_path[PATH_MAX];
-    assert(realpath(abs_path, safe_path));
-    for (char *p = safe_path; *p; ++p) {
-        if (*p == '/') *p = '_';
-    }
-    // Remove .bc extension if present (for .s file)
-    size_t len = strlen(safe_path);
-    if (len > 3 && strcmp(safe_path + len - 3, ".bc") == 0) {
-        safe_path[len - 3] = '\0';
-    }
+    mangle_path(canonical_path, safe_path, sizeof(safe_path));
 
     // Write .s file in tmp directory with full path-based name (no .bc)
     char asm_path[PATH_MAX + 50];
@@ -274,133 +862,150 @@ ErrorCode compile_file(const CompilerOptions *opts) {
         return ERR_OK;
     }
 
-    char *source = NULL;
-    size_t src_len = 0;
-    const ErrorCode er = read_file(abs_path, &source, &src_len);
+    CompilationContext ctx = {0};
+    TokenStream ts = {0};
+    const ErrorCode er = frontend_phase(abs_path, opts, &ctx, &ts);
     if (er != ERR_OK) {
-        fprintf(stderr, "Error reading '%s'\n", opts->filename);
         return er;
     }
 
-    CompilationContext ctx = {0};
-    TokenStream ts = {0};
+    // --- Collect imports after parsing ---
+    char **import_files = NULL;
+    size_t import_count = 0, import_cap = 0;
+    collect_imports(ctx.ast_root, &import_files, &import_count, &import_cap);
 
-    const int lex_errs = lex_phase(source, &ts);
-    free(source);
-    if (lex_errs > 0) {
-        for (size_t i = 0; i < ts.count; i++) {
-            const Token *t = &ts.tokens[i];
-            if (t->type == TOKEN_ERROR) {
-                fprintf(stderr, "Lexical error at line %d: %s\n", t->line, t->literal.error_message);
+    // --- Bring imports up to date first: their interfaces check and inline our calls ---
+    char **import_paths = calloc(import_count ? import_count : 1, sizeof(char *));
+    const ModuleInterface **import_ifaces = calloc(import_count ? import_count : 1, sizeof(ModuleInterface *));
+    assert(import_paths && import_ifaces);
+    char base_dir[PATH_MAX];
+    import_base_dir(&ctx, opts->file_directory_path, base_dir, sizeof(base_dir));
+    ErrorCode result = ERR_OK;
+    push_in_progress(canonical_path);
+    for (size_t i = 0; i < import_count && result == ERR_OK; ++i) {
+        const char *import_file = import_files[i];
+        char resolved_import[PATH_MAX];
+        resolve_import_path(base_dir, import_file, resolved_import, sizeof(resolved_import));
+
+        char import_canonical[PATH_MAX];
+        const size_t import_len = strlen(resolved_import);
+        if (import_len > 2 && strcmp(resolved_import + import_len - 2, ".s") == 0) {
+            if (!copy_library(resolved_import, import_canonical)) {
+                fprintf(stderr, "Failed to resolve path for import '%s'\n", import_file);
+                continue;
+            }
+        } else {
+            if (!file_exists(resolved_import) || !realpath(resolved_import, import_canonical)) {
+                fprintf(stderr, "Failed to resolve path for import '%s'\n", import_file);
+                continue;
             }
+            result = ensure_module(import_canonical, opts, &import_ifaces[i]);
         }
-        fprintf(stderr, "Lexical errors: %d\n", lex_errs);
-        cleanup_token_stream(&ts);
-        return ERR_LEXICAL;
+        import_paths[i] = strdup(import_canonical);
     }
+    in_progress_count--;
 
-    if (opts->show_tokens) {
-        print_tokens(&ts);
+    if (result == ERR_OK) {
+        result = body_phase(&ctx);
     }
 
-    ctx.token_stream = &ts;
-    ctx.target_arch = opts->target_arch;
+    FunctionHeat *heat = opts->profile ? function_heat(ctx.ast_root, opts->profile, canonical_path) : NULL;
+    if (result == ERR_OK &&
+        module_interface_apply(ctx.ast_root, import_ifaces, import_count, !opts->no_inline_imports, heat) > 0) {
+        fprintf(stderr, "Semantic errors detected.\n");
+        result = ERR_SEMANTIC;
+    }
 
-    if (parse_phase(&ctx, opts->show_ast) > 0) {
-        fprintf(stderr, "Syntax errors detected.\n");
-        cleanup_context(&ctx);
-        return ERR_SYNTAX;
+    IpaSummary ipa = {0};
+    if (result == ERR_OK) {
+        ipa_optimize(ctx.ast_root, &ctx.symbols, import_ifaces, import_count, !opts->no_ipa, &ipa);
     }
 
-    // --- Collect imports after parsing ---
-    char **import_files = NULL;
-    size_t import_count = 0, import_cap = 0;
-    collect_imports(ctx.ast_root, &import_files, &import_count, &import_cap);
+    // Clones are now part of the module
+    free(heat);
+    heat = opts->profile ? function_heat(ctx.ast_root, opts->profile, canonical_path) : NULL;
 
-    /* Register allocation and backend codegen */
-    register_allocate_ast(ctx.ast_root, opts->show_registers);
+    FILE *asm_out = NULL;
+    if (result == ERR_OK) {
+        /* Register allocation and backend codegen */
+        RegallocOptions regalloc_opts = {
+            .show_registers = opts->show_registers,
+            .module = opts->filename,
+            .symbols = &ctx.symbols,
+            .jobs = opts->jobs
+        };
+        if (opts->regalloc_report) {
+            // Imports append their module to the entry file's report
+            regalloc_opts.report = fopen(opts->regalloc_report, "a");
+            if (!regalloc_opts.report) {
+                fprintf(stderr, "Cannot write register allocation report '%s'\n", opts->regalloc_report);
+            }
+        }
+        phase_timer_start(&ctx.timer, PHASE_REGALLOC);
+        register_allocate_ast(ctx.ast_root, &regalloc_opts);
+        phase_timer_stop(&ctx.timer);
+        if (regalloc_opts.report) fclose(regalloc_opts.report);
 
-    FILE *asm_out = fopen(asm_path, "w");
-    if (!asm_out) {
-        cleanup_context(&ctx);
-        for (size_t i = 0; i < import_count; ++i) free(import_files[i]);
-        free(import_files);
-        return ERR_FILE_OPEN;
+        asm_out = fopen(asm_path, "w");
+        if (!asm_out) result = ERR_FILE_OPEN;
     }
 
-    /* Temporarily redirect stdout to assembly file */
-    const int saved_stdout = dup(fileno(stdout));
-    fflush(stdout);
-    dup2(fileno(asm_out), fileno(stdout));
-    codegen_arm(ctx.ast_root);
-    fflush(stdout);
-    dup2(saved_stdout, fileno(stdout));
-    close(saved_stdout);
-    fclose(asm_out);
-
-    printf("Compilation succeeded for file : %s\n", opts->filename);
-
-    // --- Recursively compile all imports ---
-    for (size_t i = 0; i < import_count; ++i) {
-        const char *import_file = import_files[i];
-        char resolved_import[PATH_MAX];
+    if (result == ERR_OK) {
+        /* Temporarily redirect stdout to assembly file */
+        const int saved_stdout = dup(fileno(stdout));
+        fflush(stdout);
+        dup2(fileno(asm_out), fileno(stdout));
+        phase_timer_start(&ctx.timer, PHASE_CODEGEN);
+        ModuleStats stats = {0};
+        CodegenOptions codegen_opts = {
+            .instrument = opts->instrument,
+            .module_path = canonical_path,
+            .stats = opts->stats != STATS_NONE ? &stats : NULL,
+            .function_sections = opts->gc_sections || opts->order_functions,
+            .heat = heat,
+            .jobs = opts->jobs
+        };
+        size_t *order = NULL;
+        if (opts->order_functions) {
+            order = place_functions(ctx.ast_root, canonical_path, &codegen_opts, opts->profile);
+            codegen_opts.order = order;
+        }
+        codegen_arm(ctx.ast_root, &codegen_opts);
+        free(order);
+        fflush(stdout);
+        phase_timer_stop(&ctx.timer);
+        dup2(saved_stdout, fileno(stdout));
+        close(saved_stdout);
+        fclose(asm_out);
 
-        // If import path starts with "lib/" or import path is absolute, use as is.
-        if (strncmp(import_file, "lib/", 4) == 0 || import_file[0] == '/') {
-            snprintf(resolved_import, sizeof(resolved_import), "%s", import_file);
+        printf("Compilation succeeded for file : %s\n", opts->filename);
+        if (opts->time_report) {
+            phase_timer_report(&ctx.timer, opts->filename, ctx.line_count, stderr);
         }
-        // Otherwise, prepend file_directory_path.
-        else {
-            snprintf(resolved_import, sizeof(resolved_import), "%s/%s", opts->file_directory_path, import_file);
+        if (opts->stats != STATS_NONE) {
+            module_stats_print(&stats, opts->filename, opts->stats, stderr);
+            module_stats_free(&stats);
         }
 
-        size_t import_len = strlen(resolved_import);
-        if (import_len > 2 && strcmp(resolved_import + import_len - 2, ".s") == 0) {
-            if (!file_exists(resolved_import)) {
-                fprintf(stderr, "Failed to resolve path for import '%s'\n", import_file);
-                free(import_files[i]);
-                continue;
-            }
-            char import_safe[PATH_MAX];
-            assert(realpath(resolved_import, import_safe));
-            for (char *p = import_safe; *p; ++p) {
-                if (*p == '/') *p = '_';
-            }
-            size_t safe_len = strlen(import_safe);
-            if (safe_len > 2 && strcmp(import_safe + safe_len - 2, ".s") == 0) {
-                import_safe[safe_len - 2] = '\0';
-            }
-            char import_tmp[PATH_MAX + 50];
-            snprintf(import_tmp, sizeof(import_tmp), "tmp/%s.s", import_safe);
-            struct stat st = {0};
-            if (stat(import_tmp, &st) != 0) {
-                char copy_cmd[PATH_MAX * 4 + 32];
-                snprintf(copy_cmd, sizeof(copy_cmd), "cp '%s' '%s'", resolved_import, import_tmp);
-                run_command(copy_cmd);
-            }
-        } else {
-            if (!file_exists(resolved_import)) {
-                fprintf(stderr, "Failed to resolve path for import '%s'\n", import_file);
-                free(import_files[i]);
-                continue;
-            }
-            char import_dir[PATH_MAX];
-            char import_base[PATH_MAX];
-            strncpy(import_dir, resolved_import, sizeof(import_dir) - 1);
-            import_dir[sizeof(import_dir) - 1] = '\0';
-            strncpy(import_base, resolved_import, sizeof(import_base) - 1);
-            import_base[sizeof(import_base) - 1] = '\0';
-
-            CompilerOptions import_opts = {0};
-            import_opts.file_directory_path = dirname(import_dir);
-            import_opts.filename = basename(import_base);
-            import_opts.is_executable = false;
-
-            compile_file(&import_opts);
-        }
+        record_interface(&ctx, canonical_path, asm_path, import_paths, import_ifaces, import_count, ipa.pure, opts);
+
+        // Every module of the program is in the graph once the entry module is done
+        if (opts->order_functions && in_progress_count == 0) write_function_order(FUNCTION_ORDER_FILE);
+    }
+    ipa_summary_free(&ipa);
+    free(heat);
+
+    for (size_t i = 0; i < import_count; ++i) {
         free(import_files[i]);
+        free(import_paths[i]);
     }
     free(import_files);
+    free(import_paths);
+    free(import_ifaces);
+    if (result != ERR_OK) {
+        cleanup_context(&ctx);
+        return result;
+    }
 
     // Get base filename (no path, no .bc)
     const char *base = strrchr(opts->filename, '/');
@@ -408,21 +1013,28 @@ ErrorCode compile_file(const CompilerOptions *opts) {
     char exe_name[PATH_MAX];
     strncpy(exe_name, base, sizeof(exe_name));
     exe_name[sizeof(exe_name) - 1] = '\0';
-    len = strlen(exe_name);
+    const size_t len = strlen(exe_name);
     if (len > 3 && strcmp(exe_name + len - 3, ".bc") == 0) {
         exe_name[len - 3] = '\0';
+    } else if (len > 5 && strcmp(exe_name + len - 5, ".bast") == 0) {
+        exe_name[len - 5] = '\0';
+    }
+
+    // Instrumented programs link the runtime that dumps the profile at exit
+    if (opts->is_executable && opts->instrument != INSTRUMENT_NONE) {
+        if (!file_exists(PROFILE_RUNTIME)) {
+            fprintf(stderr, "Profiling runtime '%s' not found\n", PROFILE_RUNTIME);
+        } else {
+            run_command("cp '" PROFILE_RUNTIME "' tmp/");
+        }
     }
 
     // Build command for generate_executable.sh
     if (opts->is_executable) {
         char cmd[PATH_MAX * 2 + 32];
-        if (opts->save_asm) {
-            snprintf(cmd, sizeof(cmd),
-                     "./scripts/generate_executable.sh %s -s", exe_name);
-        } else {
-            snprintf(cmd, sizeof(cmd),
-                     "./scripts/generate_executable.sh %s", exe_name);
-        }
+        snprintf(cmd, sizeof(cmd), "./scripts/generate_executable.sh %s%s%s%s", exe_name,
+                 opts->save_asm ? " -s" : "", opts->gc_sections ? " --gc-sections" : "",
+                 opts->order_functions ? " --order-functions" : "");
         run_command("chmod +x ./scripts/generate_executable.sh");
         run_command(cmd);
 
@@ -432,3 +1044,222 @@ ErrorCode compile_file(const CompilerOptions *opts) {
     cleanup_context(&ctx);
     return ERR_OK;
 }
+
+/**
+ * @struct LoadedModule
+ * @brief A parsed module kept alive while the interpreter runs.
+ */
+typedef struct {
+    char path[PATH_MAX]; /**< Canonical path of the source file */
+    TokenStream tokens; /**< Tokens backing the AST's lexemes */
+    CompilationContext ctx; /**< Holds the module's AST */
+} LoadedModule;
+
+/**
+ * @struct ModuleSet
+ * @brief All modules and assembly libraries reachable from the entry file.
+ */
+typedef struct {
+    LoadedModule **modules;
+    size_t module_count;
+    size_t module_cap;
+    char **libraries; /**< Base names of imported .s libraries */
+    size_t library_count;
+    size_t library_cap;
+    bool body_errors; /**< A body parsed on demand had semantic errors */
+} ModuleSet;
+
+/**
+ * @brief Parse the body of a function the interpreter is about to lower.
+ *
+ * @param context  ModuleSet whose modules are the interpreted units.
+ * @param unit     Index of the module.
+ * @param index    Index of the function among the module's declarations.
+ * @return         false after reporting undeclared or redeclared names.
+ */
+static bool load_function_body(void *context, const size_t unit, const size_t index) {
+    ModuleSet *set = context;
+    CompilationContext *ctx = &set->modules[unit]->ctx;
+    if (materialize_body(ctx, ctx->ast_root->children[index])) return true;
+    set->body_errors = true;
+    return false;
+}
+
+/**
+ * @brief Record an imported assembly library once.
+ */
+static void add_library(ModuleSet *set, const char *resolved_import) {
+    const char *base = strrchr(resolved_import, '/');
+    base = base ? base + 1 : resolved_import;
+    for (size_t i = 0; i < set->library_count; ++i) {
+        if (strcmp(set->libraries[i], base) == 0) return;
+    }
+    if (set->library_count >= set->library_cap) {
+        set->library_cap = set->library_cap ? set->library_cap * 2 : 8;
+        set->libraries = realloc(set->libraries, set->library_cap * sizeof(char *));
+        assert(set->libraries);
+    }
+    set->libraries[set->library_count++] = strdup(base);
+}
+
+/**
+ * @brief Parse a module and, recursively, every .bc module it imports.
+ *
+ * Modules are identified by canonical path so diamond and cyclic imports
+ * are loaded once.
+ *
+ * @param path  Path of the module source.
+ * @param opts  CompilerOptions used for the entry module's dumps.
+ * @param set   ModuleSet receiving the modules and libraries.
+ * @return      ERR_OK on success or the first ErrorCode encountered.
+ */
+static ErrorCode load_module(const char *path, const CompilerOptions *opts, ModuleSet *set) {
+    char canonical[PATH_MAX];
+    if (!realpath(path, canonical)) {
+        fprintf(stderr, "Failed to resolve path for import '%s'\n", path);
+        return ERR_FILE_OPEN;
+    }
+    for (size_t i = 0; i < set->module_count; ++i) {
+        if (strcmp(set->modules[i]->path, canonical) == 0) return ERR_OK;
+    }
+
+    LoadedModule *mod = calloc(1, sizeof(LoadedModule));
+    assert(mod);
+    strncpy(mod->path, canonical, sizeof(mod->path) - 1);
+
+    const ErrorCode er = frontend_phase(canonical, opts, &mod->ctx, &mod->tokens);
+    if (er != ERR_OK) {
+        free(mod);
+        return er;
+    }
+
+    if (set->module_count >= set->module_cap) {
+        set->module_cap = set->module_cap ? set->module_cap * 2 : 8;
+        set->modules = realloc(set->modules, set->module_cap * sizeof(LoadedModule *));
+        assert(set->modules);
+    }
+    set->modules[set->module_count++] = mod;
+
+    char **import_files = NULL;
+    size_t import_count = 0, import_cap = 0;
+    collect_imports(mod->ctx.ast_root, &import_files, &import_count, &import_cap);
+
+    char module_dir[PATH_MAX];
+    strncpy(module_dir, canonical, sizeof(module_dir) - 1);
+    module_dir[sizeof(module_dir) - 1] = '\0';
+    char base_dir[PATH_MAX];
+    import_base_dir(&mod->ctx, dirname(module_dir), base_dir, sizeof(base_dir));
+
+    // Imports never dump their tokens or AST
+    CompilerOptions import_opts = *opts;
+    import_opts.show_tokens = false;
+    import_opts.show_ast = false;
+
+    ErrorCode result = ERR_OK;
+    for (size_t i = 0; i < import_count; ++i) {
+        char resolved_import[PATH_MAX];
+        resolve_import_path(base_dir, import_files[i], resolved_import, sizeof(resolved_import));
+
+        const size_t import_len = strlen(resolved_import);
+        if (import_len > 2 && strcmp(resolved_import + import_len - 2, ".s") == 0) {
+            add_library(set, resolved_import);
+        } else if (result == ERR_OK) {
+            result = load_module(resolved_import, &import_opts, set);
+        }
+        free(import_files[i]);
+    }
+    free(import_files);
+    return result;
+}
+
+/**
+ * @brief Interpret a source file on the host (bcc --run).
+ *
+ * Parses the entry file and all .bc modules it imports, binds imported .s
+ * libraries to host shims and executes main.  No assembly is produced.
+ *
+ * @param opts         CompilerOptions describing flags and file names.
+ * @param exit_status  Receives the value returned by main.
+ * @return             ERR_OK if the program ran, or an ErrorCode on failure.
+ */
+ErrorCode run_file(const CompilerOptions *opts, int *exit_status) {
+    char abs_path[PATH_MAX];
+    snprintf(abs_path, sizeof(abs_path), "%s/%s", opts->file_directory_path, opts->filename);
+
+    ModuleSet set = {0};
+    ErrorCode result = load_module(abs_path, opts, &set);
+
+    if (result == ERR_OK) {
+        const ASTNode **units = malloc(set.module_count * sizeof(ASTNode *));
+        const SymbolTable **unit_symbols = malloc(set.module_count * sizeof(SymbolTable *));
+        const char **unit_paths = malloc(set.module_count * sizeof(char *));
+        assert(units && unit_symbols && unit_paths);
+        for (size_t i = 0; i < set.module_count; ++i) {
+            units[i] = set.modules[i]->ctx.ast_root;
+            unit_symbols[i] = &set.modules[i]->ctx.symbols;
+            unit_paths[i] = set.modules[i]->path;
+        }
+        if (interpret(units, unit_symbols, unit_paths, set.module_count,
+                      (const char *const *) set.libraries, set.library_count,
+                      load_function_body, &set,
+                      opts->instrument != INSTRUMENT_NONE ? PROFILE_OUTPUT : NULL,
+                      exit_status) != 0) {
+            result = ERR_RUNTIME;
+            if (set.body_errors) {
+                fprintf(stderr, "Semantic errors detected.\n");
+                result = ERR_SEMANTIC;
+            }
+        }
+        free(unit_paths);
+        free(unit_symbols);
+        free(units);
+    }
+
+    for (size_t i = 0; i < set.module_count; ++i) {
+        cleanup_context(&set.modules[i]->ctx);
+        free(set.modules[i]);
+    }
+    free(set.modules);
+    for (size_t i = 0; i < set.library_count; ++i) free(set.libraries[i]);
+    free(set.libraries);
+    return result;
+}
+
+/**
+ * @brief Parse a source file and write its AST in the binary format (bcc --emit-ast-bin).
+ *
+ * @param opts  CompilerOptions describing the input and the output file.
+ * @return      ERR_OK on success or an ErrorCode on failure.
+ */
+ErrorCode emit_ast_binary(const CompilerOptions *opts) {
+    char abs_path[PATH_MAX];
+    snprintf(abs_path, sizeof(abs_path), "%s/%s", opts->file_directory_path, opts->filename);
+    char canonical[PATH_MAX];
+    if (!file_exists(abs_path) || !realpath(abs_path, canonical)) {
+        fprintf(stderr, "Failed to resolve absolute path for '%s'\n", opts->filename);
+        return ERR_FILE_OPEN;
+    }
+
+    CompilationContext ctx = {0};
+    TokenStream ts = {0};
+    const ErrorCode er = frontend_phase(canonical, opts, &ctx, &ts);
+    if (er != ERR_OK) return er;
+    if (body_phase(&ctx) != ERR_OK) {
+        cleanup_context(&ctx);
+        return ERR_SEMANTIC;
+    }
+
+    // A .bast restarted from keeps pointing at the original source
+    const char *source = ctx.ast_view.header
+                             ? ast_binary_string(&ctx.ast_view, ctx.ast_view.header->source_path)
+                             : canonical;
+    ErrorCode result = ERR_OK;
+    if (!ast_binary_write(ctx.ast_root, source ? source : canonical, ctx.line_count, opts->emit_ast_bin)) {
+        fprintf(stderr, "Failed to write binary AST '%s'\n", opts->emit_ast_bin);
+        result = ERR_FILE_OPEN;
+    } else {
+        printf("Binary AST written to '%s'\n", opts->emit_ast_bin);
+    }
+    cleanup_context(&ctx);
+    return result;
+}
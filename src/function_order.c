@@ -0,0 +1,355 @@
+/**
+ * @file function_order.c
+ * @brief Call-graph-driven function placement (Pettis-Hansen) for BasicCodeCompiler.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "../include/function_order.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief A resolved, undirected edge.
+ */
+typedef struct {
+    size_t a;
+    size_t b;
+    unsigned long long weight;
+} Affinity;
+
+/**
+ * @brief Functions placed together, in order.
+ */
+typedef struct {
+    size_t *members;            ///< Nodes of the chain, in no particular order
+    size_t length;
+    size_t cap;
+    long lo;                    ///< Slots of the members span [lo, hi)
+    long hi;
+    bool reversed;              ///< Placement reads the slots downwards
+    size_t first;               ///< Lowest node index, for stable ordering
+    unsigned long long calls;   ///< Sum of the entry counts of the nodes
+    unsigned long long weight;  ///< Sum of the edges merged into the chain
+} Chain;
+
+static void *grow_array(void *items, size_t *cap, const size_t item_size) {
+    *cap = *cap ? *cap * 2 : 16;
+    void *grown = realloc(items, *cap * item_size);
+    if (!grown) {
+        fprintf(stderr, "Memory allocation failed in call graph\n");
+        exit(EXIT_FAILURE);
+    }
+    return grown;
+}
+
+/* Grow an array to hold needed items; an empty one stays as it is, possibly NULL */
+static void *reserve_array(void *items, size_t *cap, const size_t needed, const size_t item_size) {
+    if (needed <= *cap) return items;
+    void *grown = realloc(items, needed * item_size);
+    if (!grown) {
+        fprintf(stderr, "Memory allocation failed in call graph\n");
+        exit(EXIT_FAILURE);
+    }
+    *cap = needed;
+    return grown;
+}
+
+static void *checked_calloc(const size_t count, const size_t size) {
+    void *p = calloc(count ? count : 1, size);
+    if (!p) {
+        fprintf(stderr, "Memory allocation failed in call graph\n");
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+static void add_calls(CallGraph *graph, const size_t caller, const ASTNode *node, const unsigned long long weight) {
+    for (size_t i = 0; i < node->child_count; i++) add_calls(graph, caller, node->children[i], weight);
+    if (node->type != NODE_FUNCTION_CALL || weight == 0) return;
+    if (graph->edge_count >= graph->edge_cap) {
+        graph->edges = grow_array(graph->edges, &graph->edge_cap, sizeof(CallGraphEdge));
+    }
+    graph->edges[graph->edge_count++] = (CallGraphEdge){
+        .caller = caller, .callee = node->token.lexeme, .weight = weight // Copied by merge_calls
+    };
+}
+
+static int compare_callees(const void *a, const void *b) {
+    return strcmp(((const CallGraphEdge *) a)->callee, ((const CallGraphEdge *) b)->callee);
+}
+
+/* Merge the edges from one caller to the same callee, which start at `first`, and copy the callee names */
+static void merge_calls(CallGraph *graph, const size_t first) {
+    CallGraphEdge *edges = graph->edges + first;
+    const size_t count = graph->edge_count - first;
+    qsort(edges, count, sizeof(CallGraphEdge), compare_callees);
+    size_t merged = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (merged > 0 && strcmp(edges[merged - 1].callee, edges[i].callee) == 0) {
+            edges[merged - 1].weight += edges[i].weight;
+        } else {
+            edges[merged++] = edges[i];
+        }
+    }
+    for (size_t i = 0; i < merged; i++) edges[i].callee = strdup(edges[i].callee);
+    graph->edge_count = first + merged;
+}
+
+void call_graph_add_module(CallGraph *graph, const ASTNode *root, const char *const *sections,
+                           const ProfileData *profile, const char *module) {
+    size_t f = 0;
+    for (size_t i = 0; i < root->child_count; i++) {
+        const ASTNode *fn = root->children[i];
+        if (fn->type != NODE_FUNCTION) continue;
+        const char *name = fn->children[0]->token.lexeme;
+        const char *section = sections ? sections[f] : ".text";
+        f++;
+
+        if (graph->node_count >= graph->node_cap) {
+            graph->nodes = grow_array(graph->nodes, &graph->node_cap, sizeof(CallGraphNode));
+        }
+        const ProfileEntry *entry = profile_find(profile, module, name);
+        graph->nodes[graph->node_count] = (CallGraphNode){
+            .name = strdup(name), .section = strdup(section), .calls = entry ? entry->calls : 0
+        };
+        // Each call site runs once per entry; without a count, every site weighs the same
+        const size_t first = graph->edge_count;
+        add_calls(graph, graph->node_count, fn, entry ? entry->calls : 1);
+        merge_calls(graph, first);
+        graph->node_count++;
+    }
+}
+
+static const CallGraph *sorting_graph;
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(sorting_graph->nodes[*(const size_t *) a].name, sorting_graph->nodes[*(const size_t *) b].name);
+}
+
+static int compare_pairs(const void *a, const void *b) {
+    const Affinity *x = a;
+    const Affinity *y = b;
+    if (x->a != y->a) return x->a < y->a ? -1 : 1;
+    if (x->b != y->b) return x->b < y->b ? -1 : 1;
+    return 0;
+}
+
+/* Heaviest first; ties keep the edges of earlier functions first */
+static int compare_weights(const void *a, const void *b) {
+    const Affinity *x = a;
+    const Affinity *y = b;
+    if (x->weight != y->weight) return x->weight > y->weight ? -1 : 1;
+    return compare_pairs(a, b);
+}
+
+static int compare_chains(const void *a, const void *b) {
+    const Chain *x = a;
+    const Chain *y = b;
+    if (x->calls != y->calls) return x->calls > y->calls ? -1 : 1;
+    if (x->weight != y->weight) return x->weight > y->weight ? -1 : 1;
+    return x->first < y->first ? -1 : x->first > y->first;
+}
+
+/* Resolve callee names and sum the weights of each pair of functions */
+static Affinity *resolve_edges(const CallGraph *graph, size_t *count) {
+    size_t *by_name = checked_calloc(graph->node_count, sizeof(size_t));
+    for (size_t i = 0; i < graph->node_count; i++) by_name[i] = i;
+    sorting_graph = graph;
+    qsort(by_name, graph->node_count, sizeof(size_t), compare_names);
+
+    Affinity *pairs = checked_calloc(graph->edge_count, sizeof(Affinity));
+    size_t n = 0;
+    for (size_t e = 0; e < graph->edge_count; e++) {
+        const CallGraphEdge *edge = &graph->edges[e];
+        size_t lo = 0, hi = graph->node_count;
+        while (lo < hi) {
+            const size_t mid = lo + (hi - lo) / 2;
+            if (strcmp(graph->nodes[by_name[mid]].name, edge->callee) < 0) lo = mid + 1; else hi = mid;
+        }
+        if (lo == graph->node_count || strcmp(graph->nodes[by_name[lo]].name, edge->callee) != 0) continue;
+        const size_t callee = by_name[lo];
+        if (callee == edge->caller) continue;
+        pairs[n++] = (Affinity){
+            .a = edge->caller < callee ? edge->caller : callee,
+            .b = edge->caller < callee ? callee : edge->caller,
+            .weight = edge->weight
+        };
+    }
+    free(by_name);
+
+    qsort(pairs, n, sizeof(Affinity), compare_pairs);
+    size_t merged = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (merged > 0 && pairs[merged - 1].a == pairs[i].a && pairs[merged - 1].b == pairs[i].b) {
+            pairs[merged - 1].weight += pairs[i].weight;
+        } else {
+            pairs[merged++] = pairs[i];
+        }
+    }
+    *count = merged;
+    return pairs;
+}
+
+/* Slot order, ascending */
+static const long *sorting_slots;
+
+static int compare_slots(const void *a, const void *b) {
+    const long x = sorting_slots[*(const size_t *) a];
+    const long y = sorting_slots[*(const size_t *) b];
+    return x < y ? -1 : x > y;
+}
+
+/* Members of a chain in placement order */
+static void chain_sequence(const Chain *chain, const long *slot, size_t *out) {
+    memcpy(out, chain->members, chain->length * sizeof(size_t));
+    sorting_slots = slot;
+    qsort(out, chain->length, sizeof(size_t), compare_slots);
+    if (!chain->reversed) return;
+    for (size_t i = 0; i < chain->length / 2; i++) {
+        const size_t t = out[i];
+        out[i] = out[chain->length - 1 - i];
+        out[chain->length - 1 - i] = t;
+    }
+}
+
+/* Distance of a node from the head of its chain */
+static long from_head(const Chain *chain, const long slot) {
+    return chain->reversed ? chain->hi - 1 - slot : slot - chain->lo;
+}
+
+/*
+ * Move the nodes of `from` to the head (at_head) or tail of `into`, keeping
+ * their order, which is the order the joined chain reads them in.
+ */
+static void move_nodes(Chain *into, Chain *from, const bool at_head, long *slot, size_t *chain_of,
+                       const size_t into_id, size_t *scratch) {
+    chain_sequence(from, slot, scratch);
+    // Slots grow at the tail of an upright chain and at the head of a reversed one
+    const bool grow_up = at_head == into->reversed;
+    for (size_t k = 0; k < from->length; k++) {
+        const size_t node = scratch[at_head ? from->length - 1 - k : k];
+        slot[node] = grow_up ? into->hi++ : --into->lo;
+        chain_of[node] = into_id;
+    }
+    if (into->length + from->length > into->cap) {
+        into->cap = (into->length + from->length) * 2;
+        into->members = realloc(into->members, into->cap * sizeof(size_t));
+        if (!into->members) {
+            fprintf(stderr, "Memory allocation failed in call graph\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    memcpy(into->members + into->length, from->members, from->length * sizeof(size_t));
+    into->length += from->length;
+    into->calls += from->calls;
+    into->weight += from->weight;
+    if (from->first < into->first) into->first = from->first;
+    free(from->members);
+    *from = (Chain){0};
+}
+
+size_t *call_graph_order(const CallGraph *graph) {
+    const size_t n = graph->node_count;
+    Chain *chains = checked_calloc(n, sizeof(Chain));
+    size_t *chain_of = checked_calloc(n, sizeof(size_t));
+    long *slot = checked_calloc(n, sizeof(long));
+    size_t *scratch = checked_calloc(n, sizeof(size_t));
+    for (size_t i = 0; i < n; i++) {
+        chains[i] = (Chain){
+            .members = checked_calloc(1, sizeof(size_t)), .length = 1, .cap = 1,
+            .lo = 0, .hi = 1, .first = i, .calls = graph->nodes[i].calls
+        };
+        chains[i].members[0] = i;
+        chain_of[i] = i;
+    }
+
+    size_t pair_count = 0;
+    Affinity *pairs = resolve_edges(graph, &pair_count);
+    qsort(pairs, pair_count, sizeof(Affinity), compare_weights);
+
+    for (size_t e = 0; e < pair_count; e++) {
+        const size_t u = pairs[e].a, v = pairs[e].b;
+        const size_t a_id = chain_of[u], b_id = chain_of[v];
+        Chain *a = &chains[a_id];
+        Chain *b = &chains[b_id];
+        if (a == b) {
+            a->weight += pairs[e].weight;
+            continue;
+        }
+
+        // Join as a...u v...b: u to the tail of its chain and v to the head of its own
+        const long u_pos = from_head(a, slot[u]);
+        if (u_pos < (long) a->length - 1 - u_pos) a->reversed = !a->reversed;
+        const long v_pos = from_head(b, slot[v]);
+        if (v_pos > (long) b->length - 1 - v_pos) b->reversed = !b->reversed;
+
+        // The shorter chain moves, so every node moves O(log n) times
+        if (a->length >= b->length) {
+            move_nodes(a, b, false, slot, chain_of, a_id, scratch);
+            a->weight += pairs[e].weight;
+        } else {
+            move_nodes(b, a, true, slot, chain_of, b_id, scratch);
+            b->weight += pairs[e].weight;
+        }
+    }
+    free(pairs);
+
+    size_t live = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (chains[i].length > 0) chains[live++] = chains[i];
+    }
+    qsort(chains, live, sizeof(Chain), compare_chains);
+
+    size_t *order = checked_calloc(n, sizeof(size_t));
+    size_t placed = 0;
+    for (size_t c = 0; c < live; c++) {
+        chain_sequence(&chains[c], slot, order + placed);
+        placed += chains[c].length;
+        free(chains[c].members);
+    }
+    free(chains);
+    free(chain_of);
+    free(slot);
+    free(scratch);
+    return order;
+}
+
+bool call_graph_write_order(const CallGraph *graph, const size_t *order, const char *path) {
+    FILE *out = fopen(path, "w");
+    if (!out) return false;
+    fprintf(out, ".text : {\n");
+    for (size_t i = 0; i < graph->node_count; i++) {
+        fprintf(out, "    *(%s)\n", graph->nodes[order[i]].section);
+    }
+    fprintf(out, "}\n");
+    return fclose(out) == 0;
+}
+
+void call_graph_append(CallGraph *into, CallGraph *from) {
+    into->nodes = reserve_array(into->nodes, &into->node_cap, into->node_count + from->node_count,
+                                sizeof(CallGraphNode));
+    into->edges = reserve_array(into->edges, &into->edge_cap, into->edge_count + from->edge_count,
+                                sizeof(CallGraphEdge));
+    memcpy(into->nodes + into->node_count, from->nodes, from->node_count * sizeof(CallGraphNode));
+    for (size_t i = 0; i < from->edge_count; i++) {
+        into->edges[into->edge_count + i] = from->edges[i];
+        into->edges[into->edge_count + i].caller += into->node_count;
+    }
+    into->node_count += from->node_count;
+    into->edge_count += from->edge_count;
+    free(from->nodes);
+    free(from->edges);
+    *from = (CallGraph){0};
+}
+
+void call_graph_free(CallGraph *graph) {
+    for (size_t i = 0; i < graph->node_count; i++) {
+        free(graph->nodes[i].name);
+        free(graph->nodes[i].section);
+    }
+    for (size_t i = 0; i < graph->edge_count; i++) free(graph->edges[i].callee);
+    free(graph->nodes);
+    free(graph->edges);
+    *graph = (CallGraph){0};
+}
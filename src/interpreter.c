@@ -0,0 +1,542 @@
+/**
+ * @file interpreter.c
+ * @brief Bytecode compiler and threaded interpreter behind `bcc --run`.
+ *
+ * Every function is lowered to a sequence of 32-bit words stored in one
+ * code array shared by the whole program; operands follow their opcode
+ * inline.  Locals (parameters first) live in the value stack frame of the
+ * call, so a call is a single jump with no per-call allocation.  The
+ * dispatch loop uses computed goto when the host compiler supports it and
+ * falls back to a plain switch otherwise.
+ *
+ * Arithmetic wraps at 32 bits to match the ARM backend.
+ */
+
+#include "../include/interpreter.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define USE_COMPUTED_GOTO 1
+#endif
+
+#define VALUE_STACK_SIZE (1 << 20)  ///< Value stack capacity in words
+#define CALL_STACK_SIZE  (1 << 16)  ///< Maximum call depth
+
+/**
+ * @brief Bytecode instruction set.  Operands are listed in brackets.
+ */
+typedef enum {
+    OP_CONST,   ///< [value]  push value
+    OP_LOAD,    ///< [slot]   push local slot
+    OP_STORE,   ///< [slot]   pop into local slot
+    OP_ADD,     ///<          pop b, pop a, push a + b
+    OP_CALL,    ///< [func]   call user function, arguments on the stack
+    OP_CALL_PROFILED, ///< [func] count the call, then OP_CALL (-finstrument-functions)
+    OP_NATIVE,  ///< [shim]   call host shim, arguments on the stack
+    OP_POP,     ///<          discard top of stack
+    OP_RET,     ///<          return top of stack to the caller
+    OP_COUNT
+} Opcode;
+
+/**
+ * @brief Host-side replacement for a function of an assembly library.
+ */
+typedef struct {
+    const char *library; ///< Base name of the library providing the function
+    const char *name;    ///< Function name
+    int arity;           ///< Number of arguments
+    int32_t (*fn)(const int32_t *args);
+} NativeShim;
+
+static int32_t shim_print(const int32_t *args) {
+    printf("%d\n", args[0]);
+    return 0;
+}
+
+static const NativeShim native_shims[] = {
+    {"stdio.s", "print", 1, shim_print},
+};
+
+#define NATIVE_SHIM_COUNT (sizeof(native_shims) / sizeof(native_shims[0]))
+
+/**
+ * @brief A user function lowered to bytecode.
+ */
+typedef struct {
+    const char *name;
+    const char *module; ///< Source path of the defining unit
+    const ASTNode *node;
+    const SymbolTable *symbols; ///< Symbols of the defining unit
+    size_t unit;     ///< Index of the defining unit
+    size_t index;    ///< Index among the unit's declarations
+    bool queued;     ///< Referenced, so lowered (or about to be)
+    uint64_t calls;  ///< Entry count when profiling
+    size_t entry;    ///< Offset of the first instruction in Program.code
+    int param_count;
+    int local_count; ///< Parameters plus `let` declarations
+    int max_stack;   ///< Maximum operand stack depth above the locals
+} BytecodeFunction;
+
+/**
+ * @brief A whole program: shared code array plus function table.
+ */
+typedef struct {
+    int32_t *code;
+    size_t code_len;
+    size_t code_cap;
+
+    BytecodeFunction *functions;
+    size_t function_count;
+    int *function_slots;     ///< Open-addressing hash of function names, -1 when empty
+    size_t function_slot_count; ///< Power of two, at least twice function_count
+    size_t *pending;         ///< Functions in the order they were referenced
+    size_t pending_count;
+
+    FunctionBodyLoader load_body;
+    void *loader_context;
+
+    const char *const *libraries;
+    size_t library_count;
+
+    bool profile;    ///< Count function entries
+    int error_count;
+} Program;
+
+/**
+ * @brief Per-function lowering state.
+ */
+typedef struct {
+    Program *prog;
+    BytecodeFunction *func;
+    int depth;           ///< Current operand stack depth
+} FunctionLowering;
+
+/**
+ * @brief Saved caller state for a call in progress.
+ */
+typedef struct {
+    const int32_t *return_ip;
+    int32_t *base;
+} Frame;
+
+static void lowering_error(Program *prog, const ASTNode *node, const char *fmt, const char *name) {
+    fprintf(stderr, "Error (Line %d): ", node ? node->token.line : 0);
+    fprintf(stderr, fmt, name);
+    fprintf(stderr, "\n");
+    prog->error_count++;
+}
+
+static void emit_word(Program *prog, const int32_t word) {
+    if (prog->code_len >= prog->code_cap) {
+        const size_t new_cap = prog->code_cap ? prog->code_cap * 2 : 256;
+        int32_t *new_code = realloc(prog->code, new_cap * sizeof(int32_t));
+        if (!new_code) {
+            fprintf(stderr, "Memory allocation failed in emit_word\n");
+            exit(EXIT_FAILURE);
+        }
+        prog->code = new_code;
+        prog->code_cap = new_cap;
+    }
+    prog->code[prog->code_len++] = word;
+}
+
+/* Emit an instruction and track its effect on the operand stack depth */
+static void emit_op(FunctionLowering *fl, const Opcode op, const int32_t operand, const int stack_effect) {
+    emit_word(fl->prog, op);
+    if (op == OP_CONST || op == OP_LOAD || op == OP_STORE || op == OP_CALL || op == OP_CALL_PROFILED || op == OP_NATIVE) {
+        emit_word(fl->prog, operand);
+    }
+    fl->depth += stack_effect;
+    if (fl->depth > fl->func->max_stack) {
+        fl->func->max_stack = fl->depth;
+    }
+}
+
+/* Local slot of a resolved variable: its symbol's slot, parameters first */
+static int local_slot(const FunctionLowering *fl, const ASTNode *node, const char *error) {
+    const Symbol *symbol = symbol_get(fl->func->symbols, node->symbol_id);
+    if (!symbol || symbol->kind == SYMBOL_FUNCTION) {
+        lowering_error(fl->prog, node, error, node->token.lexeme);
+        return -1;
+    }
+    return symbol->slot;
+}
+
+static size_t hash_name(const char *s) {
+    uint32_t hash = 2166136261u;
+    for (; *s; s++) {
+        hash ^= (unsigned char) *s;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* Hash slot holding name, or the empty slot where it would go */
+static size_t function_slot(const Program *prog, const char *name) {
+    const size_t mask = prog->function_slot_count - 1;
+    size_t slot = hash_name(name) & mask;
+    while (prog->function_slots[slot] != -1 &&
+           strcmp(prog->functions[prog->function_slots[slot]].name, name) != 0) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static int find_function(const Program *prog, const char *name) {
+    return prog->function_slots[function_slot(prog, name)];
+}
+
+static int find_native(const Program *prog, const char *name) {
+    for (size_t i = 0; i < NATIVE_SHIM_COUNT; i++) {
+        if (strcmp(native_shims[i].name, name) != 0) continue;
+        for (size_t l = 0; l < prog->library_count; l++) {
+            if (strcmp(native_shims[i].library, prog->libraries[l]) == 0) return (int) i;
+        }
+    }
+    return -1;
+}
+
+/* Queue a function for lowering the first time it is referenced */
+static void request_lowering(Program *prog, const int func) {
+    if (prog->functions[func].queued) return;
+    prog->functions[func].queued = true;
+    prog->pending[prog->pending_count++] = (size_t) func;
+}
+
+static void lower_expr(FunctionLowering *fl, const ASTNode *node);
+
+static void lower_call(FunctionLowering *fl, const ASTNode *node) {
+    const char *name = node->token.lexeme;
+    const int argc = (int) node->child_count;
+
+    for (size_t i = 0; i < node->child_count; i++) {
+        lower_expr(fl, node->children[i]);
+    }
+
+    const int func = find_function(fl->prog, name);
+    if (func != -1) {
+        if (fl->prog->functions[func].param_count != argc) {
+            lowering_error(fl->prog, node, "Wrong number of arguments in call to '%s'", name);
+        }
+        request_lowering(fl->prog, func);
+        emit_op(fl, fl->prog->profile ? OP_CALL_PROFILED : OP_CALL, func, 1 - argc);
+        return;
+    }
+
+    const int shim = find_native(fl->prog, name);
+    if (shim != -1) {
+        if (native_shims[shim].arity != argc) {
+            lowering_error(fl->prog, node, "Wrong number of arguments in call to '%s'", name);
+        }
+        emit_op(fl, OP_NATIVE, shim, 1 - argc);
+        return;
+    }
+
+    lowering_error(fl->prog, node, "Undefined reference to function '%s'", name);
+}
+
+static void lower_expr(FunctionLowering *fl, const ASTNode *node) {
+    switch (node->type) {
+        case NODE_INT_LITERAL:
+            emit_op(fl, OP_CONST, (int32_t) node->token.literal.int_value, 1);
+            break;
+        case NODE_IDENTIFIER: {
+            const int slot = local_slot(fl, node, "Use of undeclared variable '%s'");
+            emit_op(fl, OP_LOAD, slot, 1);
+            break;
+        }
+        case NODE_ADD:
+            lower_expr(fl, node->children[0]);
+            lower_expr(fl, node->children[1]);
+            emit_op(fl, OP_ADD, 0, -1);
+            break;
+        case NODE_FUNCTION_CALL:
+            lower_call(fl, node);
+            break;
+        default:
+            lowering_error(fl->prog, node, "Unsupported expression%s", "");
+            break;
+    }
+}
+
+static void lower_stmt(FunctionLowering *fl, const ASTNode *node) {
+    switch (node->type) {
+        case NODE_VAR_DECL: {
+            lower_expr(fl, node->children[2]);
+            const int slot = local_slot(fl, node->children[0], "Undeclared variable '%s'");
+            emit_op(fl, OP_STORE, slot, -1);
+            break;
+        }
+        case NODE_ASSIGNMENT: {
+            lower_expr(fl, node->children[1]);
+            const int slot = local_slot(fl, node->children[0], "Assignment to undeclared variable '%s'");
+            emit_op(fl, OP_STORE, slot, -1);
+            break;
+        }
+        case NODE_EXPRESSION:
+            lower_expr(fl, node->children[0]);
+            emit_op(fl, OP_POP, 0, -1);
+            break;
+        case NODE_RETURN:
+            if (node->child_count > 0) {
+                lower_expr(fl, node->children[0]);
+            } else {
+                emit_op(fl, OP_CONST, 0, 1);
+            }
+            emit_op(fl, OP_RET, 0, -1);
+            break;
+        default:
+            break;
+    }
+}
+
+static void lower_function(Program *prog, BytecodeFunction *func) {
+    FunctionLowering fl = {.prog = prog, .func = func};
+    const ASTNode *node = func->node;
+
+    if (node->body_start != 0 && !prog->load_body(prog->loader_context, func->unit, func->index)) {
+        prog->error_count++;
+        return;
+    }
+
+    func->entry = prog->code_len;
+    func->local_count = symbol_get(func->symbols, node->symbol_id)->local_count;
+    for (size_t i = 1; i < node->child_count; i++) {
+        lower_stmt(&fl, node->children[i]);
+    }
+
+    // Falling off the end of a function returns 0
+    emit_op(&fl, OP_CONST, 0, 1);
+    emit_op(&fl, OP_RET, 0, -1);
+}
+
+/* Register every function of every unit so calls can be bound in one pass */
+static void declare_functions(Program *prog, const ASTNode *const *units, const SymbolTable *const *unit_symbols,
+                              const char *const *unit_paths, const size_t unit_count) {
+    size_t total = 0;
+    for (size_t u = 0; u < unit_count; u++) {
+        for (size_t i = 0; i < units[u]->child_count; i++) {
+            if (units[u]->children[i]->type == NODE_FUNCTION) total++;
+        }
+    }
+
+    prog->functions = calloc(total ? total : 1, sizeof(BytecodeFunction));
+    prog->pending = malloc((total ? total : 1) * sizeof(size_t));
+    prog->function_slot_count = 16;
+    while (prog->function_slot_count < total * 2) prog->function_slot_count *= 2;
+    prog->function_slots = malloc(prog->function_slot_count * sizeof(int));
+    if (!prog->functions || !prog->pending || !prog->function_slots) {
+        fprintf(stderr, "Memory allocation failed in declare_functions\n");
+        exit(EXIT_FAILURE);
+    }
+    memset(prog->function_slots, 0xff, prog->function_slot_count * sizeof(int));
+
+    for (size_t u = 0; u < unit_count; u++) {
+        for (size_t i = 0; i < units[u]->child_count; i++) {
+            const ASTNode *fn = units[u]->children[i];
+            if (fn->type != NODE_FUNCTION) continue;
+
+            const char *name = fn->children[0]->token.lexeme;
+            const size_t slot = function_slot(prog, name);
+            if (prog->function_slots[slot] != -1) {
+                lowering_error(prog, fn, "Multiple definitions of function '%s'", name);
+                continue;
+            }
+
+            prog->function_slots[slot] = (int) prog->function_count;
+            BytecodeFunction *func = &prog->functions[prog->function_count++];
+            func->name = name;
+            func->module = unit_paths ? unit_paths[u] : "";
+            func->node = fn;
+            func->symbols = unit_symbols[u];
+            func->unit = u;
+            func->index = i;
+            for (size_t c = 1; c < fn->child_count; c++) {
+                if (fn->children[c]->type == NODE_TYPE_PARAM) func->param_count++;
+            }
+        }
+    }
+}
+
+/* Run the program from the entry function until it returns */
+static int execute(const Program *prog, const BytecodeFunction *entry, int *exit_status) {
+    int32_t *stack = malloc(VALUE_STACK_SIZE * sizeof(int32_t));
+    Frame *frames = malloc(CALL_STACK_SIZE * sizeof(Frame));
+    if (!stack || !frames) {
+        fprintf(stderr, "Memory allocation failed in execute\n");
+        exit(EXIT_FAILURE);
+    }
+
+    const int32_t *const stack_end = stack + VALUE_STACK_SIZE;
+    int32_t *base = stack;
+    int32_t *sp = stack;
+    size_t depth = 0;
+    int status = 0;
+    const BytecodeFunction *callee = entry;
+    const int32_t *ip = prog->code + entry->entry;
+
+    if (base + entry->local_count + entry->max_stack > stack_end) goto stack_overflow;
+    memset(sp, 0, entry->local_count * sizeof(int32_t));
+    sp += entry->local_count;
+
+#ifdef USE_COMPUTED_GOTO
+    static void *const dispatch_table[OP_COUNT] = {
+        [OP_CONST] = &&L_OP_CONST,
+        [OP_LOAD] = &&L_OP_LOAD,
+        [OP_STORE] = &&L_OP_STORE,
+        [OP_ADD] = &&L_OP_ADD,
+        [OP_CALL] = &&L_OP_CALL,
+        [OP_CALL_PROFILED] = &&L_OP_CALL_PROFILED,
+        [OP_NATIVE] = &&L_OP_NATIVE,
+        [OP_POP] = &&L_OP_POP,
+        [OP_RET] = &&L_OP_RET
+    };
+#define VM_CASE(op) L_##op:
+#define VM_DISPATCH() goto *dispatch_table[*ip++]
+    VM_DISPATCH();
+#else
+#define VM_CASE(op) case op:
+#define VM_DISPATCH() goto dispatch
+dispatch:
+    switch ((Opcode) *ip++) {
+#endif
+
+    VM_CASE(OP_CONST) {
+        *sp++ = *ip++;
+        VM_DISPATCH();
+    }
+    VM_CASE(OP_LOAD) {
+        *sp++ = base[*ip++];
+        VM_DISPATCH();
+    }
+    VM_CASE(OP_STORE) {
+        base[*ip++] = *--sp;
+        VM_DISPATCH();
+    }
+    VM_CASE(OP_ADD) {
+        --sp;
+        sp[-1] = (int32_t) ((uint32_t) sp[-1] + (uint32_t) sp[0]);
+        VM_DISPATCH();
+    }
+    VM_CASE(OP_CALL_PROFILED) {
+        prog->functions[*ip].calls++;
+    }
+    /* fall through */
+    VM_CASE(OP_CALL) {
+        callee = &prog->functions[*ip++];
+        int32_t *new_base = sp - callee->param_count;
+        if (depth >= CALL_STACK_SIZE ||
+            new_base + callee->local_count + callee->max_stack > stack_end) {
+            goto stack_overflow;
+        }
+        frames[depth++] = (Frame){.return_ip = ip, .base = base};
+        base = new_base;
+        memset(sp, 0, (callee->local_count - callee->param_count) * sizeof(int32_t));
+        sp = base + callee->local_count;
+        ip = prog->code + callee->entry;
+        VM_DISPATCH();
+    }
+    VM_CASE(OP_NATIVE) {
+        const NativeShim *shim = &native_shims[*ip++];
+        sp -= shim->arity;
+        *sp = shim->fn(sp);
+        sp++;
+        VM_DISPATCH();
+    }
+    VM_CASE(OP_POP) {
+        --sp;
+        VM_DISPATCH();
+    }
+    VM_CASE(OP_RET) {
+        const int32_t result = sp[-1];
+        sp = base;
+        if (depth == 0) {
+            *exit_status = result;
+            goto done;
+        }
+        --depth;
+        ip = frames[depth].return_ip;
+        base = frames[depth].base;
+        *sp++ = result;
+        VM_DISPATCH();
+    }
+
+#ifndef USE_COMPUTED_GOTO
+    default:
+        fprintf(stderr, "Runtime error: invalid opcode %d\n", ip[-1]);
+        status = 1;
+        goto done;
+    }
+#endif
+#undef VM_CASE
+#undef VM_DISPATCH
+
+stack_overflow:
+    fprintf(stderr, "Runtime error: stack overflow in call to '%s'\n", callee->name);
+    status = 1;
+
+done:
+    fflush(stdout);
+    free(frames);
+    free(stack);
+    return status;
+}
+
+/* Append the entry counts in the format of runtime/bcc_profile.c */
+static void write_profile(const Program *prog, const char *path) {
+    FILE *out = fopen(path, "a");
+    if (!out) {
+        fprintf(stderr, "Cannot write profile '%s'\n", path);
+        return;
+    }
+    for (size_t i = 0; i < prog->function_count; i++) {
+        const BytecodeFunction *func = &prog->functions[i];
+        fprintf(out, "%s\t%s\t%d\t%llu\t-\n", func->module, func->name,
+                func->node->children[0]->token.line, (unsigned long long) func->calls);
+    }
+    fclose(out);
+}
+
+int interpret(const ASTNode *const *units, const SymbolTable *const *unit_symbols,
+              const char *const *unit_paths, const size_t unit_count,
+              const char *const *libraries, const size_t library_count,
+              FunctionBodyLoader load_body, void *loader_context,
+              const char *profile_output, int *exit_status) {
+    Program prog = {
+        .libraries = libraries,
+        .library_count = library_count,
+        .load_body = load_body,
+        .loader_context = loader_context,
+        .profile = profile_output != NULL
+    };
+
+    declare_functions(&prog, units, unit_symbols, unit_paths, unit_count);
+
+    // Lower what main can reach; lowering a call queues its callee
+    const int main_index = find_function(&prog, "main");
+    if (main_index == -1) {
+        lowering_error(&prog, NULL, "Undefined reference to function '%s'", "main");
+    } else {
+        request_lowering(&prog, main_index);
+    }
+    for (size_t i = 0; i < prog.pending_count; i++) {
+        lower_function(&prog, &prog.functions[prog.pending[i]]);
+    }
+
+    int status = 1;
+    if (prog.error_count == 0) {
+        prog.functions[main_index].calls = 1;
+        status = execute(&prog, &prog.functions[main_index], exit_status);
+        if (profile_output) write_profile(&prog, profile_output);
+    }
+
+    free(prog.pending);
+    free(prog.function_slots);
+    free(prog.functions);
+    free(prog.code);
+    return status;
+}
@@ -0,0 +1,400 @@
+/**
+ * @file ipa.c
+ * @brief Interprocedural constant propagation and purity analysis for BasicCodeCompiler.
+ *
+ * Runs in four steps over the module's functions, indexed by symbol ID:
+ *  1. record, for every parameter, whether all calls pass the same literal;
+ *  2. clone the functions with constant parameters and redirect the calls;
+ *  3. compute purity, depth first over the call graph (a function reached
+ *     again while its own purity is being computed is on a cycle, and
+ *     treated as impure since the calls may never return);
+ *  4. delete dead statements, last to first, so that deleting a statement
+ *     can make the declarations it reads dead in turn.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "../include/ipa.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum {
+    PURITY_UNKNOWN,
+    PURITY_VISITING,
+    PURITY_PURE,
+    PURITY_IMPURE
+} Purity;
+
+/**
+ * @brief What the calls of a module pass for one parameter.
+ */
+typedef enum {
+    ARG_UNSEEN,   ///< No call seen yet
+    ARG_CONSTANT, ///< The same literal in every call so far
+    ARG_VARYING   ///< Anything else
+} ArgState;
+
+typedef struct {
+    ArgState state;
+    int64_t value;
+} ArgConstancy;
+
+/**
+ * @brief State of one run over a module.
+ */
+typedef struct {
+    ASTNode *root;
+    SymbolTable *symbols;
+    const ModuleInterface *const *imports;
+    size_t import_count;
+
+    ASTNode **functions;    ///< Function node of each symbol ID, NULL for other symbols
+    size_t function_span;   ///< Number of entries in functions
+    ArgConstancy **args;    ///< Per function symbol, constancy of each parameter
+    int *clone_of;          ///< Per function symbol, ID of its clone or SYMBOL_NONE
+    unsigned char *purity;  ///< Per function symbol, a Purity
+    int *reads;             ///< Per symbol, identifiers reading it
+} Ipa;
+
+static void *checked_calloc(const size_t count, const size_t size) {
+    void *p = calloc(count ? count : 1, size);
+    if (!p) {
+        fprintf(stderr, "Memory allocation failed in ipa_optimize\n");
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+static size_t param_count(const ASTNode *fn) {
+    size_t count = 0;
+    for (size_t i = 1; i < fn->child_count; i++) {
+        if (fn->children[i]->type == NODE_TYPE_PARAM) count++;
+    }
+    return count;
+}
+
+/* Statements start after the name, the parameters and the return type */
+static bool is_statement(const ASTNode *node) {
+    return node->type != NODE_TYPE_PARAM && node->type != NODE_RETURN_INT_TYPE;
+}
+
+/* Index every function of the module by its symbol ID */
+static void index_functions(Ipa *ipa) {
+    free(ipa->functions);
+    ipa->function_span = ipa->symbols->symbol_count;
+    ipa->functions = checked_calloc(ipa->function_span, sizeof(ASTNode *));
+    for (size_t i = 0; i < ipa->root->child_count; i++) {
+        ASTNode *fn = ipa->root->children[i];
+        if (fn->type == NODE_FUNCTION && fn->symbol_id != SYMBOL_NONE) ipa->functions[fn->symbol_id] = fn;
+    }
+}
+
+/* Function defined in the module that a call targets, or NULL */
+static ASTNode *local_callee(const Ipa *ipa, const ASTNode *call) {
+    const int id = call->symbol_id;
+    return id >= 0 && (size_t) id < ipa->function_span ? ipa->functions[id] : NULL;
+}
+
+static ASTNode *copy_tree(const ASTNode *node) {
+    ASTNode *copy = ast_create_node(node->type, node->token);
+    copy->symbol_id = node->symbol_id;
+    copy->scope_depth = node->scope_depth;
+    for (size_t i = 0; i < node->child_count; i++) ast_add_child(copy, copy_tree(node->children[i]));
+    return copy;
+}
+
+/* ---- Step 1: argument constancy ---- */
+
+static void record_call_arguments(Ipa *ipa, const ASTNode *node) {
+    for (size_t i = 0; i < node->child_count; i++) record_call_arguments(ipa, node->children[i]);
+    if (node->type != NODE_FUNCTION_CALL) return;
+
+    const ASTNode *callee = local_callee(ipa, node);
+    if (!callee) return;
+    ArgConstancy *args = ipa->args[callee->symbol_id];
+    const size_t count = param_count(callee);
+    for (size_t i = 0; i < count; i++) {
+        const ASTNode *arg = i < node->child_count ? node->children[i] : NULL;
+        if (!arg || node->child_count != count || arg->type != NODE_INT_LITERAL) {
+            args[i].state = ARG_VARYING;
+        } else if (args[i].state == ARG_UNSEEN) {
+            args[i] = (ArgConstancy){.state = ARG_CONSTANT, .value = arg->token.literal.int_value};
+        } else if (args[i].state == ARG_CONSTANT && args[i].value != arg->token.literal.int_value) {
+            args[i].state = ARG_VARYING;
+        }
+    }
+}
+
+/* ---- Step 2: clones ---- */
+
+/* `let <param><int> = <value>;` in place of a constant parameter */
+static ASTNode *constant_local(const ASTNode *param, const int64_t value) {
+    ASTNode *decl = ast_create_node(NODE_VAR_DECL, param->token);
+    ast_add_child(decl, ast_create_node(NODE_IDENTIFIER, param->token));
+    ast_add_child(decl, param->child_count > 0 ? copy_tree(param->children[0])
+                                               : ast_create_node(NODE_VAR_INT_TYPE, param->token));
+    Token literal = param->token;
+    literal.type = TOKEN_INTEGER;
+    literal.literal.int_value = value;
+    ast_add_child(decl, ast_create_node(NODE_INT_LITERAL, literal));
+    return decl;
+}
+
+/* Copy of fn without its constant parameters, which become locals; NULL if it cannot be declared */
+static ASTNode *clone_function(Ipa *ipa, const ASTNode *fn) {
+    const ArgConstancy *args = ipa->args[fn->symbol_id];
+    const Symbol *original = symbol_get(ipa->symbols, fn->symbol_id);
+    const int scope = original->scope;
+    const int line = original->line;
+
+    const size_t name_len = strlen(original->name) + sizeof(IPA_CLONE_SUFFIX);
+    char *name = checked_calloc(name_len, 1);
+    snprintf(name, name_len, "%s" IPA_CLONE_SUFFIX, original->name);
+    const int enclosing = ipa->symbols->current_scope;
+    ipa->symbols->current_scope = scope;
+    const int id = symbol_declare(ipa->symbols, name, SYMBOL_FUNCTION, line);
+    ipa->symbols->current_scope = enclosing;
+    free(name);
+    if (id == SYMBOL_NONE) return NULL;
+
+    ASTNode *clone = ast_create_node(NODE_FUNCTION, fn->token);
+    ASTNode *name_node = copy_tree(fn->children[0]);
+    name_node->token.lexeme = (char *) symbol_get(ipa->symbols, id)->name; // Owned by the symbol table
+    ast_add_child(clone, name_node);
+    clone->symbol_id = name_node->symbol_id = id;
+
+    bool locals_added = false;
+    size_t param = 0;
+    for (size_t i = 1; i <= fn->child_count; i++) {
+        const ASTNode *child = i < fn->child_count ? fn->children[i] : NULL;
+        if (child && child->type == NODE_TYPE_PARAM) {
+            if (args[param++].state != ARG_CONSTANT) ast_add_child(clone, copy_tree(child));
+            continue;
+        }
+        if (child && child->type == NODE_RETURN_INT_TYPE) {
+            ast_add_child(clone, copy_tree(child));
+            continue;
+        }
+        if (!locals_added) {
+            param = 0;
+            for (size_t p = 1; p < fn->child_count; p++) {
+                const ASTNode *par = fn->children[p];
+                if (par->type != NODE_TYPE_PARAM) continue;
+                if (args[param].state == ARG_CONSTANT) ast_add_child(clone, constant_local(par, args[param].value));
+                param++;
+            }
+            locals_added = true;
+        }
+        if (child) ast_add_child(clone, copy_tree(child));
+    }
+
+    symbol_resolve_function(ipa->symbols, clone);
+    return clone;
+}
+
+/* Point calls of cloned functions at the clone, dropping the constant arguments */
+static void redirect_calls(Ipa *ipa, ASTNode *node) {
+    for (size_t i = 0; i < node->child_count; i++) redirect_calls(ipa, node->children[i]);
+    if (node->type != NODE_FUNCTION_CALL) return;
+
+    const ASTNode *callee = local_callee(ipa, node);
+    if (!callee || ipa->clone_of[callee->symbol_id] == SYMBOL_NONE) return;
+    const ArgConstancy *args = ipa->args[callee->symbol_id];
+
+    size_t kept = 0;
+    for (size_t i = 0; i < node->child_count; i++) {
+        if (args[i].state == ARG_CONSTANT) {
+            free_ast(node->children[i]);
+        } else {
+            node->children[kept++] = node->children[i];
+        }
+    }
+    node->child_count = kept;
+    node->symbol_id = ipa->clone_of[callee->symbol_id];
+    node->token.lexeme = (char *) symbol_get(ipa->symbols, node->symbol_id)->name;
+}
+
+static size_t specialize_constant_arguments(Ipa *ipa) {
+    const size_t span = ipa->function_span;
+    ipa->args = checked_calloc(span, sizeof(ArgConstancy *));
+    ipa->clone_of = checked_calloc(span, sizeof(int));
+    for (size_t id = 0; id < span; id++) {
+        ipa->clone_of[id] = SYMBOL_NONE;
+        if (ipa->functions[id]) ipa->args[id] = checked_calloc(param_count(ipa->functions[id]), sizeof(ArgConstancy));
+    }
+    record_call_arguments(ipa, ipa->root);
+
+    ASTNode **clones = checked_calloc(ipa->root->child_count, sizeof(ASTNode *));
+    size_t clone_count = 0;
+    for (size_t i = 0; i < ipa->root->child_count; i++) {
+        const ASTNode *fn = ipa->root->children[i];
+        if (fn->type != NODE_FUNCTION || fn->symbol_id == SYMBOL_NONE) continue;
+        const size_t count = param_count(fn);
+        bool constant = false;
+        for (size_t p = 0; p < count; p++) {
+            if (ipa->args[fn->symbol_id][p].state == ARG_CONSTANT) constant = true;
+        }
+        if (!constant) continue;
+        clones[i] = clone_function(ipa, fn);
+        if (clones[i]) {
+            ipa->clone_of[fn->symbol_id] = clones[i]->symbol_id;
+            clone_count++;
+        }
+    }
+    if (clone_count > 0) redirect_calls(ipa, ipa->root);
+    for (size_t i = 0; i < ipa->root->child_count; i++) {
+        if (clones[i]) redirect_calls(ipa, clones[i]);
+    }
+
+    // Each clone follows its original
+    const size_t old_count = ipa->root->child_count;
+    ASTNode **old_children = ipa->root->children;
+    ipa->root->children = NULL;
+    ipa->root->child_count = 0;
+    for (size_t i = 0; i < old_count; i++) {
+        ast_add_child(ipa->root, old_children[i]);
+        ast_add_child(ipa->root, clones[i]);
+    }
+    free(old_children);
+    free(clones);
+
+    for (size_t id = 0; id < span; id++) free(ipa->args[id]);
+    free(ipa->args);
+    free(ipa->clone_of);
+    ipa->args = NULL;
+    ipa->clone_of = NULL;
+    return clone_count;
+}
+
+/* ---- Step 3: purity ---- */
+
+static bool function_is_pure(Ipa *ipa, const ASTNode *fn);
+
+/* True if evaluating the expression has no side effect and always finishes */
+static bool expr_is_pure(Ipa *ipa, const ASTNode *node) {
+    if (node->type == NODE_FUNCTION_CALL) {
+        const ASTNode *callee = local_callee(ipa, node);
+        if (callee) {
+            if (!function_is_pure(ipa, callee)) return false;
+        } else {
+            const FunctionSignature *signature = NULL;
+            for (size_t i = 0; i < ipa->import_count && !signature; i++) {
+                if (ipa->imports[i]) signature = module_interface_find(ipa->imports[i], node->token.lexeme);
+            }
+            if (!signature || !signature->pure) return false;
+        }
+    }
+    for (size_t i = 0; i < node->child_count; i++) {
+        if (!expr_is_pure(ipa, node->children[i])) return false;
+    }
+    return true;
+}
+
+static bool function_is_pure(Ipa *ipa, const ASTNode *fn) {
+    unsigned char *purity = &ipa->purity[fn->symbol_id];
+    if (*purity == PURITY_VISITING) return false;
+    if (*purity != PURITY_UNKNOWN) return *purity == PURITY_PURE;
+
+    *purity = PURITY_VISITING;
+    bool pure = true;
+    for (size_t i = 1; i < fn->child_count && pure; i++) {
+        if (is_statement(fn->children[i])) pure = expr_is_pure(ipa, fn->children[i]);
+    }
+    ipa->purity[fn->symbol_id] = pure ? PURITY_PURE : PURITY_IMPURE;
+    return pure;
+}
+
+/* ---- Step 4: dead statements ---- */
+
+static void count_reads(Ipa *ipa, const ASTNode *node, const int delta) {
+    if (node->type == NODE_IDENTIFIER && node->symbol_id != SYMBOL_NONE) ipa->reads[node->symbol_id] += delta;
+    for (size_t i = 0; i < node->child_count; i++) count_reads(ipa, node->children[i], delta);
+}
+
+/* The expression a statement evaluates, or NULL for statements that are not values */
+static const ASTNode *statement_value(const ASTNode *stmt) {
+    switch (stmt->type) {
+        case NODE_VAR_DECL:
+            return stmt->children[2];
+        case NODE_ASSIGNMENT:
+            return stmt->children[1];
+        case NODE_EXPRESSION:
+        case NODE_RETURN:
+            return stmt->child_count > 0 ? stmt->children[0] : NULL;
+        default:
+            return NULL;
+    }
+}
+
+static bool is_dead(Ipa *ipa, const ASTNode *stmt) {
+    const ASTNode *value = statement_value(stmt);
+    if (!value) return false;
+    switch (stmt->type) {
+        case NODE_EXPRESSION:
+            return expr_is_pure(ipa, value);
+        case NODE_VAR_DECL:
+        case NODE_ASSIGNMENT:
+            return stmt->symbol_id != SYMBOL_NONE && ipa->reads[stmt->symbol_id] == 0 && expr_is_pure(ipa, value);
+        default:
+            return false;
+    }
+}
+
+static size_t remove_dead_statements(Ipa *ipa, ASTNode *fn) {
+    for (size_t i = 1; i < fn->child_count; i++) {
+        const ASTNode *value = statement_value(fn->children[i]);
+        if (value) count_reads(ipa, value, 1);
+    }
+
+    size_t removed = 0;
+    for (size_t i = fn->child_count; i-- > 1;) {
+        ASTNode *stmt = fn->children[i];
+        if (!is_dead(ipa, stmt)) continue;
+        count_reads(ipa, statement_value(stmt), -1);
+        free_ast(stmt);
+        memmove(&fn->children[i], &fn->children[i + 1], (fn->child_count - i - 1) * sizeof(ASTNode *));
+        fn->child_count--;
+        removed++;
+    }
+    return removed;
+}
+
+void ipa_optimize(ASTNode *root, SymbolTable *symbols, const ModuleInterface *const *imports,
+                  const size_t import_count, const bool transform, IpaSummary *summary) {
+    *summary = (IpaSummary){0};
+    Ipa ipa = {.root = root, .symbols = symbols, .imports = imports, .import_count = import_count};
+    index_functions(&ipa);
+
+    if (transform) {
+        summary->clones = specialize_constant_arguments(&ipa);
+        if (summary->clones > 0) index_functions(&ipa);
+    }
+
+    ipa.purity = checked_calloc(ipa.function_span, 1);
+    ipa.reads = checked_calloc(ipa.function_span, sizeof(int));
+    for (size_t i = 0; i < root->child_count; i++) {
+        ASTNode *fn = root->children[i];
+        if (fn->type != NODE_FUNCTION || fn->symbol_id == SYMBOL_NONE) continue;
+        if (transform) summary->removed += remove_dead_statements(&ipa, fn);
+    }
+
+    for (size_t i = 0; i < root->child_count; i++) {
+        if (root->children[i]->type == NODE_FUNCTION) summary->function_count++;
+    }
+    summary->pure = checked_calloc(summary->function_count, sizeof(bool));
+    size_t f = 0;
+    for (size_t i = 0; i < root->child_count; i++) {
+        const ASTNode *fn = root->children[i];
+        if (fn->type != NODE_FUNCTION) continue;
+        summary->pure[f++] = fn->symbol_id != SYMBOL_NONE && function_is_pure(&ipa, fn);
+    }
+
+    free(ipa.functions);
+    free(ipa.purity);
+    free(ipa.reads);
+}
+
+void ipa_summary_free(IpaSummary *summary) {
+    free(summary->pure);
+    *summary = (IpaSummary){0};
+}
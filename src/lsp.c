@@ -0,0 +1,1160 @@
+/**
+ * @file lsp.c
+ * @brief Language server: JSON-RPC over stdio, incremental relexing and reparsing.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "../include/lsp.h"
+#include "../include/lexer.h"
+#include "../include/parser.h"
+#include "../include/symbol_table.h"
+#include <stdbool.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#define SERVER_NAME "bcc"
+#define MAX_DIAGNOSTICS 200
+#define MAX_MESSAGE_SIZE (64 * 1024 * 1024) ///< Largest message body accepted, like the compiler's input limit
+
+static void *checked_realloc(void *p, const size_t size) {
+    void *grown = realloc(p, size ? size : 1);
+    if (!grown) {
+        fprintf(stderr, "Memory allocation failed in language server\n");
+        exit(EXIT_FAILURE);
+    }
+    return grown;
+}
+
+/* Grow an array to hold at least need elements */
+#define RESERVE(array, cap, need) do { \
+        if ((need) > (cap)) { \
+            size_t grown_ = (cap) ? (cap) : 16; \
+            while (grown_ < (need)) grown_ *= 2; \
+            (array) = checked_realloc((array), grown_ * sizeof(*(array))); \
+            (cap) = grown_; \
+        } \
+    } while (0)
+
+/* ---------------------------------------------------------------- JSON --- */
+
+typedef enum {
+    JSON_NULL,
+    JSON_BOOL,
+    JSON_NUMBER,
+    JSON_STRING,
+    JSON_ARRAY,
+    JSON_OBJECT
+} JsonType;
+
+/**
+ * @brief A parsed JSON value; arrays and objects own their elements.
+ */
+typedef struct JsonValue {
+    JsonType type;
+    bool boolean;
+    double number;
+    char *string;             ///< JSON_STRING, NUL-terminated (length in string_length)
+    size_t string_length;
+    struct JsonValue *items;  ///< Array elements or object member values
+    char **keys;              ///< Object member names
+    size_t count;
+    size_t cap;
+} JsonValue;
+
+typedef struct {
+    const char *p;
+    const char *end;
+    bool failed;
+} JsonReader;
+
+static void json_free(JsonValue *v) {
+    free(v->string);
+    for (size_t i = 0; i < v->count; i++) {
+        json_free(&v->items[i]);
+        if (v->keys) free(v->keys[i]);
+    }
+    free(v->items);
+    free(v->keys);
+}
+
+static void json_skip_space(JsonReader *r) {
+    while (r->p < r->end && (*r->p == ' ' || *r->p == '\t' || *r->p == '\n' || *r->p == '\r')) r->p++;
+}
+
+static void put_utf8(char **buf, size_t *len, size_t *cap, const uint32_t c) {
+    RESERVE(*buf, *cap, *len + 5);
+    char *o = *buf + *len;
+    if (c < 0x80) {
+        o[0] = (char) c;
+        *len += 1;
+    } else if (c < 0x800) {
+        o[0] = (char) (0xC0 | c >> 6);
+        o[1] = (char) (0x80 | (c & 0x3F));
+        *len += 2;
+    } else if (c < 0x10000) {
+        o[0] = (char) (0xE0 | c >> 12);
+        o[1] = (char) (0x80 | (c >> 6 & 0x3F));
+        o[2] = (char) (0x80 | (c & 0x3F));
+        *len += 3;
+    } else {
+        o[0] = (char) (0xF0 | c >> 18);
+        o[1] = (char) (0x80 | (c >> 12 & 0x3F));
+        o[2] = (char) (0x80 | (c >> 6 & 0x3F));
+        o[3] = (char) (0x80 | (c & 0x3F));
+        *len += 4;
+    }
+}
+
+static bool json_hex4(JsonReader *r, uint32_t *out) {
+    if (r->end - r->p < 4) return false;
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++) {
+        const char c = *r->p++;
+        v <<= 4;
+        if (c >= '0' && c <= '9') v |= (uint32_t) (c - '0');
+        else if (c >= 'a' && c <= 'f') v |= (uint32_t) (c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') v |= (uint32_t) (c - 'A' + 10);
+        else return false;
+    }
+    *out = v;
+    return true;
+}
+
+/* Parse a string literal, the reader being on its opening quote */
+static char *json_parse_string(JsonReader *r, size_t *length) {
+    r->p++;
+    char *buf = NULL;
+    size_t len = 0, cap = 0;
+    RESERVE(buf, cap, 16);
+    while (r->p < r->end && *r->p != '"') {
+        char c = *r->p++;
+        if (c != '\\') {
+            RESERVE(buf, cap, len + 2);
+            buf[len++] = c;
+            continue;
+        }
+        if (r->p >= r->end) break;
+        c = *r->p++;
+        uint32_t code = 0;
+        switch (c) {
+            case 'b': code = '\b'; break;
+            case 'f': code = '\f'; break;
+            case 'n': code = '\n'; break;
+            case 'r': code = '\r'; break;
+            case 't': code = '\t'; break;
+            case 'u':
+                if (!json_hex4(r, &code)) {
+                    r->failed = true;
+                    break;
+                }
+                // Surrogate pair
+                if (code >= 0xD800 && code < 0xDC00 && r->end - r->p >= 6 && r->p[0] == '\\' && r->p[1] == 'u') {
+                    uint32_t low;
+                    r->p += 2;
+                    if (!json_hex4(r, &low)) {
+                        r->failed = true;
+                        break;
+                    }
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                }
+                break;
+            default: code = (unsigned char) c; break;
+        }
+        put_utf8(&buf, &len, &cap, code);
+    }
+    if (r->p >= r->end) r->failed = true;
+    else r->p++; // closing quote
+    buf[len] = '\0';
+    *length = len;
+    return buf;
+}
+
+static void json_parse_value(JsonReader *r, JsonValue *v, int depth);
+
+static void json_append(JsonReader *r, JsonValue *v, char *key, const int depth) {
+    RESERVE(v->items, v->cap, v->count + 1);
+    if (v->type == JSON_OBJECT) {
+        v->keys = checked_realloc(v->keys, v->cap * sizeof(char *));
+        v->keys[v->count] = key;
+    }
+    JsonValue *item = &v->items[v->count++];
+    *item = (JsonValue){0};
+    json_parse_value(r, item, depth + 1);
+}
+
+static void json_parse_value(JsonReader *r, JsonValue *v, const int depth) {
+    json_skip_space(r);
+    if (r->p >= r->end || depth > 64) {
+        r->failed = true;
+        return;
+    }
+    switch (*r->p) {
+        case '"':
+            v->type = JSON_STRING;
+            v->string = json_parse_string(r, &v->string_length);
+            return;
+        case '{':
+        case '[': {
+            const char close = *r->p == '{' ? '}' : ']';
+            v->type = *r->p == '{' ? JSON_OBJECT : JSON_ARRAY;
+            r->p++;
+            json_skip_space(r);
+            if (r->p < r->end && *r->p == close) {
+                r->p++;
+                return;
+            }
+            while (!r->failed) {
+                char *key = NULL;
+                if (v->type == JSON_OBJECT) {
+                    json_skip_space(r);
+                    size_t key_length;
+                    if (r->p >= r->end || *r->p != '"') {
+                        r->failed = true;
+                        return;
+                    }
+                    key = json_parse_string(r, &key_length);
+                    json_skip_space(r);
+                    if (r->p >= r->end || *r->p != ':') {
+                        free(key);
+                        r->failed = true;
+                        return;
+                    }
+                    r->p++;
+                }
+                json_append(r, v, key, depth);
+                json_skip_space(r);
+                if (r->p < r->end && *r->p == ',') {
+                    r->p++;
+                } else if (r->p < r->end && *r->p == close) {
+                    r->p++;
+                    return;
+                } else {
+                    r->failed = true;
+                }
+            }
+            return;
+        }
+        case 't':
+        case 'f':
+        case 'n': {
+            static const struct { const char *word; JsonType type; bool value; } words[] = {
+                {"true", JSON_BOOL, true}, {"false", JSON_BOOL, false}, {"null", JSON_NULL, false}
+            };
+            for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++) {
+                const size_t n = strlen(words[i].word);
+                if ((size_t) (r->end - r->p) >= n && memcmp(r->p, words[i].word, n) == 0) {
+                    v->type = words[i].type;
+                    v->boolean = words[i].value;
+                    r->p += n;
+                    return;
+                }
+            }
+            r->failed = true;
+            return;
+        }
+        default: {
+            char *end;
+            v->type = JSON_NUMBER;
+            v->number = strtod(r->p, &end);
+            if (end == r->p || end > r->end) r->failed = true;
+            r->p = end;
+        }
+    }
+}
+
+static const JsonValue *json_get(const JsonValue *object, const char *key) {
+    if (!object || object->type != JSON_OBJECT) return NULL;
+    for (size_t i = 0; i < object->count; i++) {
+        if (strcmp(object->keys[i], key) == 0) return &object->items[i];
+    }
+    return NULL;
+}
+
+static const char *json_string(const JsonValue *v) {
+    return v && v->type == JSON_STRING ? v->string : NULL;
+}
+
+static long json_long(const JsonValue *v, const long fallback) {
+    return v && v->type == JSON_NUMBER ? (long) v->number : fallback;
+}
+
+static void json_write_string(FILE *out, const char *s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        const unsigned char c = (unsigned char) *s;
+        switch (c) {
+            case '"': fputs("\\\"", out); break;
+            case '\\': fputs("\\\\", out); break;
+            case '\n': fputs("\\n", out); break;
+            case '\r': fputs("\\r", out); break;
+            case '\t': fputs("\\t", out); break;
+            default:
+                if (c < 0x20) fprintf(out, "\\u%04x", c);
+                else fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+/* Request IDs are echoed back as they came: integer or string */
+static void json_write_id(FILE *out, const JsonValue *id) {
+    if (id && id->type == JSON_STRING) json_write_string(out, id->string);
+    else if (id && id->type == JSON_NUMBER) fprintf(out, "%.0f", id->number);
+    else fputs("null", out);
+}
+
+/* ------------------------------------------------------------ Documents --- */
+
+/**
+ * @brief Byte range of a token in the document text.
+ */
+typedef struct {
+    size_t start;
+    size_t end;
+} Span;
+
+/**
+ * @brief An error found by name resolution.
+ */
+typedef struct {
+    size_t token;              ///< Token, relative to the first of the declaration
+    char *message;
+} SemanticError;
+
+/**
+ * @brief A top-level declaration and the tokens it was parsed from.
+ */
+typedef struct {
+    ASTNode *node;             ///< Function or import, NULL after a syntax error
+    size_t first;              ///< First token
+    size_t end;                ///< One past the last token
+    size_t error_token;        ///< Token of the syntax error
+    const char *error_message; ///< Syntax error, NULL if none
+    SemanticError *errors;     ///< Name resolution errors
+    size_t error_count;
+    size_t error_cap;
+} Declaration;
+
+/**
+ * @brief An open text document.
+ */
+typedef struct {
+    char *uri;
+    long version;
+
+    char *text;                ///< NUL-terminated contents
+    size_t length;
+    size_t capacity;
+    size_t *line_starts;       ///< Offset of the first byte of every line
+    size_t line_count;
+    size_t line_cap;
+
+    TokenStream tokens;        ///< Ends with TOKEN_EOF
+    Span *spans;               ///< Byte range of every token (capacity of tokens)
+
+    Declaration *decls;        ///< In source order, covering the whole token stream
+    size_t decl_count;
+    size_t decl_cap;
+
+    SymbolTable symbols;       ///< Names of every function, resolved again one function at a time
+    size_t live_symbols;       ///< Symbols after the last full resolution
+    ASTNode **functions;       ///< Children of the root handed to name resolution
+    size_t function_cap;
+    size_t resolve_cursor;     ///< Declaration searched first for the function of an error
+    size_t fresh_first;        ///< Declarations produced by the last reparse
+    size_t fresh_count;
+    bool same_functions;       ///< The last reparse replaced functions by functions of the same names
+} Document;
+
+/**
+ * @brief Server state.
+ */
+typedef struct {
+    FILE *out;
+    FILE *log;
+    Document **docs;
+    size_t doc_count;
+    size_t doc_cap;
+    bool shutdown;
+    bool exit;
+    size_t relexed;            ///< Tokens produced by the last edit
+    size_t reparsed;           ///< Declarations parsed by the last edit
+} Server;
+
+static void rebuild_lines(Document *doc) {
+    doc->line_count = 0;
+    RESERVE(doc->line_starts, doc->line_cap, 1);
+    doc->line_starts[doc->line_count++] = 0;
+    for (const char *p = doc->text; (p = memchr(p, '\n', doc->text + doc->length - p)); p++) {
+        RESERVE(doc->line_starts, doc->line_cap, doc->line_count + 1);
+        doc->line_starts[doc->line_count++] = (size_t) (p - doc->text) + 1;
+    }
+}
+
+/* Zero-based line holding a byte offset */
+static size_t line_of(const Document *doc, const size_t offset) {
+    size_t lo = 0, hi = doc->line_count;
+    while (hi - lo > 1) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (doc->line_starts[mid] <= offset) lo = mid;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/* Length of the UTF-8 sequence starting with a byte */
+static size_t utf8_length(const unsigned char c) {
+    return c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+}
+
+/* Byte offset of an LSP position; characters are UTF-16 code units */
+static size_t offset_of(const Document *doc, const long line, const long character) {
+    if (line < 0) return 0;
+    if ((size_t) line >= doc->line_count) return doc->length;
+    size_t pos = doc->line_starts[line];
+    for (long units = 0; units < character && pos < doc->length && doc->text[pos] != '\n';) {
+        const size_t n = utf8_length((unsigned char) doc->text[pos]);
+        units += n == 4 ? 2 : 1;
+        pos += n;
+    }
+    return pos < doc->length ? pos : doc->length;
+}
+
+static void write_position(FILE *out, const Document *doc, const size_t offset) {
+    const size_t line = line_of(doc, offset);
+    long character = 0;
+    for (size_t pos = doc->line_starts[line]; pos < offset;) {
+        const size_t n = utf8_length((unsigned char) doc->text[pos]);
+        character += n == 4 ? 2 : 1;
+        pos += n;
+    }
+    fprintf(out, "{\"line\":%zu,\"character\":%ld}", line, character);
+}
+
+static void write_range(FILE *out, const Document *doc, const Span span) {
+    fputs("{\"start\":", out);
+    write_position(out, doc, span.start);
+    fputs(",\"end\":", out);
+    write_position(out, doc, span.end);
+    fputc('}', out);
+}
+
+static void clear_errors(Declaration *decl) {
+    for (size_t i = 0; i < decl->error_count; i++) free(decl->errors[i].message);
+    decl->error_count = 0;
+}
+
+static void declaration_free(Declaration *decl) {
+    clear_errors(decl);
+    free(decl->errors);
+    free_declaration(decl->node);
+}
+
+static void document_free(Document *doc) {
+    for (size_t i = 0; i < doc->decl_count; i++) declaration_free(&doc->decls[i]);
+    for (size_t i = 0; i < doc->tokens.count; i++) token_cleanup(&doc->tokens.tokens[i]);
+    symbol_table_free(&doc->symbols);
+    free(doc->decls);
+    free(doc->tokens.tokens);
+    free(doc->spans);
+    free(doc->line_starts);
+    free(doc->functions);
+    free(doc->text);
+    free(doc->uri);
+    free(doc);
+}
+
+/* Replace the bytes [from, to) of the text */
+static void replace_text(Document *doc, const size_t from, const size_t to, const char *text, const size_t n) {
+    const size_t length = doc->length - (to - from) + n;
+    RESERVE(doc->text, doc->capacity, length + 1);
+    memmove(doc->text + from + n, doc->text + to, doc->length - to + 1);
+    memcpy(doc->text + from, text, n);
+    doc->length = length;
+}
+
+/* First token ending at or after an offset */
+static size_t token_ending_at(const Document *doc, const size_t offset) {
+    size_t lo = 0, hi = doc->tokens.count;
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (doc->spans[mid].end < offset) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/*
+ * Relex after the bytes [from, to) of the old text were replaced by inserted
+ * bytes.  Lexing restarts at the end of the token before the edit, where the
+ * lexer is between tokens, and stops at the first token past the edit that
+ * starts where an old token (shifted by the edit) did: from there on the text,
+ * and so the tokens, are the same.  The old tokens in between are replaced.
+ * Sets *first, *old_end and *new_end to the replaced token range.
+ */
+static void relex(Document *doc, const size_t from, const size_t to, const size_t inserted,
+                  size_t *first, size_t *old_end, size_t *new_end) {
+    const size_t count = doc->tokens.count;
+    const size_t i0 = token_ending_at(doc, from);
+    const size_t restart = i0 > 0 ? doc->spans[i0 - 1].end : 0;
+    const size_t edit_end = from + inserted; // End of the edit in the new text
+
+    Lexer lexer = {
+        .source = doc->text,
+        .source_len = doc->length,
+        .current = restart,
+        .line = (int) line_of(doc, restart) + 1
+    };
+    Token *fresh = NULL;
+    Span *fresh_spans = NULL;
+    size_t fresh_count = 0, fresh_cap = 0, fresh_span_cap = 0;
+    size_t j = i0;
+
+    while (true) {
+        const Token token = lexer_next_token(&lexer);
+        const Span span = {lexer.start, lexer.current};
+
+        // Old tokens past the edit keep their text; their new start is shifted
+        while (j < count && (doc->spans[j].start < to || doc->spans[j].start - to + edit_end < span.start)) j++;
+        if (span.start >= edit_end && j < count && doc->spans[j].start - to + edit_end == span.start) {
+            token_cleanup(&token);
+            break;
+        }
+        RESERVE(fresh, fresh_cap, fresh_count + 1);
+        RESERVE(fresh_spans, fresh_span_cap, fresh_count + 1);
+        fresh[fresh_count] = token;
+        fresh_spans[fresh_count++] = span;
+        if (token.type == TOKEN_EOF) {
+            j = count;
+            break;
+        }
+    }
+
+    for (size_t i = i0; i < j; i++) token_cleanup(&doc->tokens.tokens[i]);
+    const size_t new_count = count - (j - i0) + fresh_count;
+    if (new_count > doc->tokens.capacity) {
+        RESERVE(doc->tokens.tokens, doc->tokens.capacity, new_count);
+        doc->spans = checked_realloc(doc->spans, doc->tokens.capacity * sizeof(Span));
+    }
+    if (j - i0 != fresh_count) {
+        memmove(&doc->tokens.tokens[i0 + fresh_count], &doc->tokens.tokens[j], (count - j) * sizeof(Token));
+        memmove(&doc->spans[i0 + fresh_count], &doc->spans[j], (count - j) * sizeof(Span));
+    }
+    if (fresh_count) {
+        memcpy(&doc->tokens.tokens[i0], fresh, fresh_count * sizeof(Token));
+        memcpy(&doc->spans[i0], fresh_spans, fresh_count * sizeof(Span));
+    }
+    doc->tokens.count = new_count;
+    for (size_t i = i0 + fresh_count; edit_end != to && i < new_count; i++) {
+        doc->spans[i].start = doc->spans[i].start - to + edit_end;
+        doc->spans[i].end = doc->spans[i].end - to + edit_end;
+    }
+    free(fresh);
+    free(fresh_spans);
+
+    *first = i0;
+    *old_end = j;
+    *new_end = i0 + fresh_count;
+}
+
+/*
+ * Whether the declarations [d0, k) are replaced by functions of the same
+ * names; if so the new functions take over the symbols of the old ones.
+ */
+static bool keep_function_symbols(const Document *doc, const size_t d0, const size_t k,
+                                  const Declaration *fresh, const size_t fresh_count) {
+    size_t i = d0, f = 0;
+    while (true) {
+        while (i < k && !(doc->decls[i].node && doc->decls[i].node->type == NODE_FUNCTION)) i++;
+        while (f < fresh_count && !(fresh[f].node && fresh[f].node->type == NODE_FUNCTION)) f++;
+        if (i == k || f == fresh_count) break;
+        const ASTNode *old_fn = doc->decls[i++].node;
+        const ASTNode *new_fn = fresh[f++].node;
+        // The old function's tokens are already freed; its name lives on in the symbol table
+        if (old_fn->symbol_id == SYMBOL_NONE ||
+            strcmp(symbol_get(&doc->symbols, old_fn->symbol_id)->name, new_fn->children[0]->token.lexeme) != 0) {
+            return false;
+        }
+    }
+    if (i != k || f != fresh_count) return false;
+
+    for (i = d0, f = 0; f < fresh_count; f++) {
+        ASTNode *new_fn = fresh[f].node;
+        if (!new_fn || new_fn->type != NODE_FUNCTION) continue;
+        while (!doc->decls[i].node || doc->decls[i].node->type != NODE_FUNCTION) i++;
+        new_fn->symbol_id = new_fn->children[0]->symbol_id = doc->decls[i++].node->symbol_id;
+    }
+    return true;
+}
+
+/*
+ * Reparse after the tokens [first, old_end) were replaced by [first, new_end).
+ * Parsing restarts at the declaration ending at or after the first replaced
+ * token (an erroneous declaration extends to the next one, so the one just
+ * before the edit may grow) and stops as soon as a declaration would start
+ * where an old declaration past the replaced tokens starts.
+ */
+static void reparse(Server *server, Document *doc, const size_t first, const size_t old_end, const size_t new_end) {
+    size_t d0 = 0;
+    while (d0 < doc->decl_count && doc->decls[d0].end < first) d0++;
+    size_t k = d0;
+    const size_t start = d0 < doc->decl_count ? doc->decls[d0].first
+                         : doc->decl_count ? doc->decls[doc->decl_count - 1].end : 0;
+
+    Parser parser = parser_create(&doc->tokens);
+    parser.recover = true;
+    parser.current = start;
+
+    Declaration *fresh = NULL;
+    size_t fresh_count = 0, fresh_cap = 0;
+    while (doc->tokens.tokens[parser.current].type != TOKEN_EOF) {
+        if (parser.current >= new_end) {
+            while (k < doc->decl_count && (doc->decls[k].first < old_end ||
+                                           doc->decls[k].first - old_end + new_end < parser.current)) k++;
+            if (k < doc->decl_count && doc->decls[k].first - old_end + new_end == parser.current) break;
+        }
+        parser.error_count = 0;
+        const size_t decl_first = parser.current;
+        ASTNode *node = parse_declaration(&parser);
+        RESERVE(fresh, fresh_cap, fresh_count + 1);
+        fresh[fresh_count++] = (Declaration){
+            .node = node,
+            .first = decl_first,
+            .end = parser.current,
+            .error_token = parser.error_token,
+            .error_message = parser.error_count ? parser.error_message : NULL
+        };
+    }
+    while (k < doc->decl_count && (doc->decls[k].first < old_end ||
+                                   doc->decls[k].first - old_end + new_end < parser.current)) k++;
+
+    for (size_t i = 0; i < parser.import_count; i++) free(parser.import_paths[i]);
+    free(parser.import_paths);
+
+    doc->same_functions = keep_function_symbols(doc, d0, k, fresh, fresh_count);
+    for (size_t i = d0; i < k; i++) declaration_free(&doc->decls[i]);
+    const size_t kept = doc->decl_count - k;
+    RESERVE(doc->decls, doc->decl_cap, d0 + fresh_count + kept);
+    memmove(&doc->decls[d0 + fresh_count], &doc->decls[k], kept * sizeof(Declaration));
+    if (fresh_count) memcpy(&doc->decls[d0], fresh, fresh_count * sizeof(Declaration));
+    doc->decl_count = d0 + fresh_count + kept;
+    for (size_t i = d0 + fresh_count; i < doc->decl_count; i++) {
+        Declaration *decl = &doc->decls[i];
+        decl->first = decl->first - old_end + new_end;
+        decl->end = decl->end - old_end + new_end;
+        decl->error_token = decl->error_token - old_end + new_end;
+    }
+    free(fresh);
+    doc->fresh_first = d0;
+    doc->fresh_count = fresh_count;
+    server->reparsed = fresh_count;
+}
+
+/* Token of a node within a declaration: nodes share the lexeme of the token they copy */
+static size_t token_of(const Document *doc, const Declaration *decl, const ASTNode *node) {
+    for (size_t i = decl->first; i < decl->end; i++) {
+        if (doc->tokens.tokens[i].lexeme == node->token.lexeme) return i;
+    }
+    return decl->first;
+}
+
+static Declaration *declaration_of_function(Document *doc, const ASTNode *fn) {
+    for (size_t n = 0; n < doc->decl_count; n++) {
+        const size_t i = (doc->resolve_cursor + n) % doc->decl_count;
+        if (doc->decls[i].node == fn) {
+            doc->resolve_cursor = i;
+            return &doc->decls[i];
+        }
+    }
+    return NULL;
+}
+
+static void record_error(void *context, const ASTNode *fn, const ASTNode *node, const char *message) {
+    Document *doc = context;
+    Declaration *decl = declaration_of_function(doc, fn);
+    if (!decl) return;
+    RESERVE(decl->errors, decl->error_cap, decl->error_count + 1);
+    decl->errors[decl->error_count++] = (SemanticError){token_of(doc, decl, node) - decl->first, strdup(message)};
+}
+
+/*
+ * Resolve names after a reparse.  When the reparsed declarations are
+ * functions with the same names as before, every other function still sees
+ * the same global scope and only the reparsed ones are resolved again; the
+ * table is rebuilt from scratch otherwise, or once stale symbols of earlier
+ * resolutions outnumber the live ones.
+ */
+static void resolve(Document *doc) {
+    if (doc->same_functions && doc->symbols.symbol_count < 2 * doc->live_symbols + 4096) {
+        for (size_t i = doc->fresh_first; i < doc->fresh_first + doc->fresh_count; i++) {
+            if (doc->decls[i].node && doc->decls[i].node->type == NODE_FUNCTION) {
+                doc->resolve_cursor = i;
+                symbol_resolve_function(&doc->symbols, doc->decls[i].node);
+            }
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < doc->decl_count; i++) clear_errors(&doc->decls[i]);
+    symbol_table_free(&doc->symbols);
+    doc->symbols.on_error = record_error;
+    doc->symbols.error_context = doc;
+    doc->resolve_cursor = 0;
+
+    size_t count = 0;
+    RESERVE(doc->functions, doc->function_cap, doc->decl_count);
+    for (size_t i = 0; i < doc->decl_count; i++) {
+        ASTNode *node = doc->decls[i].node;
+        if (node && node->type == NODE_FUNCTION) doc->functions[count++] = node;
+    }
+    ASTNode root = {.type = NODE_COMPILATION_UNIT, .children = doc->functions, .child_count = count};
+    symbol_resolve_ast(&doc->symbols, &root);
+    doc->live_symbols = doc->symbols.symbol_count;
+}
+
+/* Replace the whole text */
+static void document_load(Server *server, Document *doc, const char *text, const size_t length) {
+    size_t first, old_end, new_end;
+    replace_text(doc, 0, doc->length, text, length);
+    rebuild_lines(doc);
+    relex(doc, 0, doc->tokens.count ? doc->spans[doc->tokens.count - 1].end : 0, length,
+          &first, &old_end, &new_end);
+    reparse(server, doc, first, old_end, new_end);
+    server->relexed = new_end - first;
+    resolve(doc);
+}
+
+/* Apply one incremental change */
+static void document_edit(Server *server, Document *doc, const JsonValue *range, const char *text, const size_t length) {
+    const JsonValue *start = json_get(range, "start");
+    const JsonValue *end = json_get(range, "end");
+    size_t from = offset_of(doc, json_long(json_get(start, "line"), 0), json_long(json_get(start, "character"), 0));
+    size_t to = offset_of(doc, json_long(json_get(end, "line"), 0), json_long(json_get(end, "character"), 0));
+    if (to < from) to = from;
+
+    size_t first, old_end, new_end;
+    replace_text(doc, from, to, text, length);
+    rebuild_lines(doc);
+    relex(doc, from, to, length, &first, &old_end, &new_end);
+    server->relexed = new_end - first;
+    // Edits in whitespace and comments leave the tokens, and so the trees, as they were
+    if (first != old_end || first != new_end) {
+        reparse(server, doc, first, old_end, new_end);
+        resolve(doc);
+    }
+}
+
+static Document *find_document(const Server *server, const char *uri) {
+    for (size_t i = 0; uri && i < server->doc_count; i++) {
+        if (strcmp(server->docs[i]->uri, uri) == 0) return server->docs[i];
+    }
+    return NULL;
+}
+
+/* ------------------------------------------------------------- Protocol --- */
+
+/* Send one framed message */
+static void send_message(const Server *server, char *body, const size_t length) {
+    fprintf(server->out, "Content-Length: %zu\r\n\r\n", length);
+    fwrite(body, 1, length, server->out);
+    fflush(server->out);
+    free(body);
+}
+
+static void write_diagnostic(FILE *out, const Document *doc, const size_t token, const char *message,
+                             const size_t index) {
+    fputs(index ? ",{\"range\":" : "{\"range\":", out);
+    write_range(out, doc, doc->spans[token]);
+    fputs(",\"severity\":1,\"source\":\"" SERVER_NAME "\",\"message\":", out);
+    json_write_string(out, message);
+    fputc('}', out);
+}
+
+static void send_diagnostics(const Server *server, const Document *doc, const bool closed) {
+    char *body;
+    size_t length;
+    FILE *out = open_memstream(&body, &length);
+    fputs("{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/publishDiagnostics\",\"params\":{\"uri\":", out);
+    json_write_string(out, doc->uri);
+    fputs(",\"diagnostics\":[", out);
+    size_t written = 0;
+
+    for (size_t i = 0; !closed && i < doc->decl_count && written < MAX_DIAGNOSTICS; i++) {
+        const Declaration *decl = &doc->decls[i];
+        if (decl->error_message) {
+            const Token *token = &doc->tokens.tokens[decl->error_token];
+            write_diagnostic(out, doc, decl->error_token,
+                             token->type == TOKEN_ERROR ? token->literal.error_message : decl->error_message,
+                             written++);
+        }
+        for (size_t e = 0; e < decl->error_count && written < MAX_DIAGNOSTICS; e++) {
+            write_diagnostic(out, doc, decl->first + decl->errors[e].token, decl->errors[e].message, written++);
+        }
+    }
+    fputs("]}}", out);
+    fclose(out);
+    send_message(server, body, length);
+}
+
+/* Begin a response to a request; the caller writes the result and closes it */
+static FILE *begin_result(const JsonValue *id, char **body, size_t *length) {
+    FILE *out = open_memstream(body, length);
+    fputs("{\"jsonrpc\":\"2.0\",\"id\":", out);
+    json_write_id(out, id);
+    fputs(",\"result\":", out);
+    return out;
+}
+
+static void end_result(const Server *server, FILE *out, char **body, size_t *length) {
+    fputc('}', out);
+    fclose(out);
+    send_message(server, *body, *length);
+}
+
+static void send_error(const Server *server, const JsonValue *id, const int code, const char *message) {
+    char *body;
+    size_t length;
+    FILE *out = open_memstream(&body, &length);
+    fputs("{\"jsonrpc\":\"2.0\",\"id\":", out);
+    json_write_id(out, id);
+    fprintf(out, ",\"error\":{\"code\":%d,\"message\":", code);
+    json_write_string(out, message);
+    fputs("}}", out);
+    fclose(out);
+    send_message(server, body, length);
+}
+
+static void send_null_result(const Server *server, const JsonValue *id) {
+    char *body;
+    size_t length;
+    FILE *out = begin_result(id, &body, &length);
+    fputs("null", out);
+    end_result(server, out, &body, &length);
+}
+
+static void handle_initialize(const Server *server, const JsonValue *id) {
+    char *body;
+    size_t length;
+    FILE *out = begin_result(id, &body, &length);
+    fputs("{\"capabilities\":{"
+          "\"textDocumentSync\":{\"openClose\":true,\"change\":2},"
+          "\"definitionProvider\":true,"
+          "\"hoverProvider\":true},"
+          "\"serverInfo\":{\"name\":\"" SERVER_NAME "\"}}", out);
+    end_result(server, out, &body, &length);
+}
+
+static void handle_did_open(Server *server, const JsonValue *params) {
+    const JsonValue *item = json_get(params, "textDocument");
+    const char *uri = json_string(json_get(item, "uri"));
+    const JsonValue *text = json_get(item, "text");
+    if (!uri || !text || text->type != JSON_STRING) return;
+
+    Document *doc = find_document(server, uri);
+    if (!doc) {
+        doc = checked_realloc(NULL, sizeof(Document));
+        *doc = (Document){0};
+        RESERVE(doc->text, doc->capacity, 1);
+        doc->text[0] = '\0';
+        symbol_table_init(&doc->symbols);
+        doc->uri = strdup(uri);
+        RESERVE(server->docs, server->doc_cap, server->doc_count + 1);
+        server->docs[server->doc_count++] = doc;
+    }
+    doc->version = json_long(json_get(item, "version"), 0);
+    document_load(server, doc, text->string, text->string_length);
+    send_diagnostics(server, doc, false);
+}
+
+static void handle_did_change(Server *server, const JsonValue *params) {
+    const JsonValue *item = json_get(params, "textDocument");
+    Document *doc = find_document(server, json_string(json_get(item, "uri")));
+    const JsonValue *changes = json_get(params, "contentChanges");
+    if (!doc || !changes || changes->type != JSON_ARRAY) return;
+
+    doc->version = json_long(json_get(item, "version"), doc->version);
+    for (size_t i = 0; i < changes->count; i++) {
+        const JsonValue *change = &changes->items[i];
+        const JsonValue *text = json_get(change, "text");
+        const JsonValue *range = json_get(change, "range");
+        if (!text || text->type != JSON_STRING) continue;
+        if (range) {
+            document_edit(server, doc, range, text->string, text->string_length);
+        } else {
+            document_load(server, doc, text->string, text->string_length);
+        }
+    }
+    send_diagnostics(server, doc, false);
+}
+
+static void handle_did_close(Server *server, const JsonValue *params) {
+    const char *uri = json_string(json_get(json_get(params, "textDocument"), "uri"));
+    for (size_t i = 0; uri && i < server->doc_count; i++) {
+        Document *doc = server->docs[i];
+        if (strcmp(doc->uri, uri) != 0) continue;
+        send_diagnostics(server, doc, true);
+        document_free(doc);
+        server->docs[i] = server->docs[--server->doc_count];
+        return;
+    }
+}
+
+/* Node naming a symbol whose token is the given one */
+static const ASTNode *find_named_node(const ASTNode *node, const char *lexeme) {
+    if ((node->type == NODE_IDENTIFIER || node->type == NODE_FUNCTION_CALL || node->type == NODE_TYPE_PARAM) &&
+        node->token.lexeme == lexeme && node->symbol_id != SYMBOL_NONE) {
+        return node;
+    }
+    for (size_t i = 0; i < node->child_count; i++) {
+        const ASTNode *found = find_named_node(node->children[i], lexeme);
+        if (found) return found;
+    }
+    return NULL;
+}
+
+/* Node declaring a symbol */
+static const ASTNode *find_declaring_node(const ASTNode *fn, const int id) {
+    if (fn->symbol_id == id) return fn->children[0];
+    for (size_t i = 1; i < fn->child_count; i++) {
+        const ASTNode *stmt = fn->children[i];
+        if (stmt->type == NODE_TYPE_PARAM && stmt->symbol_id == id) return stmt;
+        if (stmt->type == NODE_VAR_DECL && stmt->children[0]->symbol_id == id) return stmt->children[0];
+    }
+    return NULL;
+}
+
+/* Declaration of the function whose symbol is the given one */
+static const Declaration *function_declaration(const Document *doc, const int function_id) {
+    for (size_t i = 0; i < doc->decl_count; i++) {
+        const ASTNode *node = doc->decls[i].node;
+        if (node && node->type == NODE_FUNCTION && node->symbol_id == function_id) return &doc->decls[i];
+    }
+    return NULL;
+}
+
+/*
+ * Symbol under a position.  Sets *decl to the declaration of the function
+ * declaring it and *declaring to the node that declares it.
+ */
+static const Symbol *symbol_at(const Document *doc, const JsonValue *position,
+                               const Declaration **decl, const ASTNode **declaring) {
+    const size_t offset = offset_of(doc, json_long(json_get(position, "line"), 0),
+                                    json_long(json_get(position, "character"), 0));
+    // Last token starting at or before the offset; a cursor right after a name still names it
+    size_t lo = 0, hi = doc->tokens.count;
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (doc->spans[mid].start <= offset) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == 0) return NULL;
+    size_t t = lo - 1;
+    if (t > 0 && doc->tokens.tokens[t].type != TOKEN_IDENTIFIER && doc->spans[t - 1].end == offset) t--;
+    if (offset > doc->spans[t].end || !doc->tokens.tokens[t].lexeme) return NULL;
+
+    size_t d = 0;
+    while (d < doc->decl_count && doc->decls[d].end <= t) d++;
+    if (d == doc->decl_count || !doc->decls[d].node || doc->decls[d].node->type != NODE_FUNCTION) return NULL;
+
+    const ASTNode *node = find_named_node(doc->decls[d].node, doc->tokens.tokens[t].lexeme);
+    const Symbol *symbol = node ? symbol_get(&doc->symbols, node->symbol_id) : NULL;
+    if (!symbol) return NULL;
+
+    const int function_id = symbol->kind == SYMBOL_FUNCTION
+                            ? node->symbol_id
+                            : doc->symbols.scopes[symbol->scope].owner;
+    *decl = function_declaration(doc, function_id);
+    *declaring = *decl ? find_declaring_node((*decl)->node, node->symbol_id) : NULL;
+    return *declaring ? symbol : NULL;
+}
+
+static void handle_definition(const Server *server, const JsonValue *id, const JsonValue *params) {
+    const Document *doc = find_document(server, json_string(json_get(json_get(params, "textDocument"), "uri")));
+    const Declaration *decl;
+    const ASTNode *declaring;
+    if (!doc || !symbol_at(doc, json_get(params, "position"), &decl, &declaring)) {
+        send_null_result(server, id);
+        return;
+    }
+    char *body;
+    size_t length;
+    FILE *out = begin_result(id, &body, &length);
+    fputs("{\"uri\":", out);
+    json_write_string(out, doc->uri);
+    fputs(",\"range\":", out);
+    write_range(out, doc, doc->spans[token_of(doc, decl, declaring)]);
+    fputc('}', out);
+    end_result(server, out, &body, &length);
+}
+
+static void handle_hover(const Server *server, const JsonValue *id, const JsonValue *params) {
+    const Document *doc = find_document(server, json_string(json_get(json_get(params, "textDocument"), "uri")));
+    const Declaration *decl;
+    const ASTNode *declaring;
+    const Symbol *symbol = doc ? symbol_at(doc, json_get(params, "position"), &decl, &declaring) : NULL;
+    if (!symbol) {
+        send_null_result(server, id);
+        return;
+    }
+
+    char *text;
+    size_t text_length;
+    FILE *md = open_memstream(&text, &text_length);
+    const size_t line = line_of(doc, doc->spans[token_of(doc, decl, declaring)].start) + 1;
+    if (symbol->kind == SYMBOL_FUNCTION) {
+        const ASTNode *fn = decl->node;
+        bool returns = false;
+        fprintf(md, "```\nfun %s<", symbol->name);
+        for (size_t i = 1, params = 0; i < fn->child_count; i++) {
+            if (fn->children[i]->type == NODE_TYPE_PARAM) {
+                fprintf(md, "%s%s: int", params++ ? ", " : "", fn->children[i]->token.lexeme);
+            }
+            if (fn->children[i]->type == NODE_RETURN_INT_TYPE) returns = true;
+        }
+        fprintf(md, ">()%s\n```\nFunction, line %zu: %d parameters and locals", returns ? ": int" : "", line,
+                symbol->local_count);
+    } else {
+        fprintf(md, "```\n%s: int\n```\n%s of `%s`, line %zu, slot %d",
+                symbol->name, symbol->kind == SYMBOL_PARAMETER ? "Parameter" : "Local variable",
+                doc->symbols.symbols[doc->symbols.scopes[symbol->scope].owner].name, line, symbol->slot);
+    }
+    fclose(md);
+
+    char *body;
+    size_t length;
+    FILE *out = begin_result(id, &body, &length);
+    fputs("{\"contents\":{\"kind\":\"markdown\",\"value\":", out);
+    json_write_string(out, text);
+    fputs("}}", out);
+    end_result(server, out, &body, &length);
+    free(text);
+}
+
+static void dispatch(Server *server, const JsonValue *message, const char **method_out) {
+    const char *method = json_string(json_get(message, "method"));
+    const JsonValue *id = json_get(message, "id");
+    const JsonValue *params = json_get(message, "params");
+    *method_out = method ? method : "(response)";
+    if (!method) return;
+
+    if (strcmp(method, "initialize") == 0) {
+        handle_initialize(server, id);
+    } else if (strcmp(method, "shutdown") == 0) {
+        server->shutdown = true;
+        send_null_result(server, id);
+    } else if (strcmp(method, "exit") == 0) {
+        server->exit = true;
+    } else if (strcmp(method, "textDocument/didOpen") == 0) {
+        handle_did_open(server, params);
+    } else if (strcmp(method, "textDocument/didChange") == 0) {
+        handle_did_change(server, params);
+    } else if (strcmp(method, "textDocument/didClose") == 0) {
+        handle_did_close(server, params);
+    } else if (strcmp(method, "textDocument/definition") == 0) {
+        handle_definition(server, id, params);
+    } else if (strcmp(method, "textDocument/hover") == 0) {
+        handle_hover(server, id, params);
+    } else if (id) {
+        send_error(server, id, -32601, "Method not found");
+    }
+}
+
+/* Parse a Content-Length value; -1 if it is not a number in [0, MAX_MESSAGE_SIZE] */
+static long parse_content_length(const char *text, long *requested) {
+    char *end;
+    errno = 0;
+    const long value = strtol(text, &end, 10);
+    while (*end == ' ' || *end == '\t' || *end == '\r' || *end == '\n') end++;
+    *requested = end != text && *end == '\0' && errno == 0 ? value : -1;
+    return *requested >= 0 && *requested <= MAX_MESSAGE_SIZE ? *requested : -1;
+}
+
+/* Discard n bytes of input; false at end of input */
+static bool skip_bytes(FILE *in, long n) {
+    char buf[4096];
+    while (n > 0) {
+        const size_t chunk = n < (long) sizeof(buf) ? (size_t) n : sizeof(buf);
+        if (fread(buf, 1, chunk, in) != chunk) return false;
+        n -= (long) chunk;
+    }
+    return true;
+}
+
+/*
+ * Read one framed message; NULL at end of input.  A message whose length is
+ * over MAX_MESSAGE_SIZE is skipped; one whose length is not a number cannot
+ * be skipped reliably, so only its header is dropped.
+ */
+static char *read_message(FILE *in, FILE *log, size_t *length) {
+    char *line = NULL;
+    size_t line_cap = 0;
+    long content_length = -1;
+    long requested = -1;
+    bool has_length = false;
+    while (getline(&line, &line_cap, in) != -1) {
+        if (strcmp(line, "\r\n") == 0 || strcmp(line, "\n") == 0) {
+            if (!has_length) continue;
+            if (content_length < 0) {
+                if (log) fprintf(log, "lsp: dropping message with Content-Length over %d or invalid\n", MAX_MESSAGE_SIZE);
+                if (requested > MAX_MESSAGE_SIZE && !skip_bytes(in, requested)) break;
+                has_length = false;
+                continue;
+            }
+            free(line);
+            char *body = checked_realloc(NULL, (size_t) content_length + 1);
+            if (fread(body, 1, (size_t) content_length, in) != (size_t) content_length) {
+                free(body);
+                return NULL;
+            }
+            body[content_length] = '\0';
+            *length = (size_t) content_length;
+            return body;
+        }
+        if (strncasecmp(line, "Content-Length:", 15) == 0) {
+            content_length = parse_content_length(line + 15, &requested);
+            has_length = true;
+        }
+    }
+    free(line);
+    return NULL;
+}
+
+int lsp_serve(FILE *in, FILE *out, FILE *log) {
+    Server server = {.out = out, .log = log};
+    char *body;
+    size_t length;
+
+    while (!server.exit && (body = read_message(in, log, &length))) {
+        struct timespec started, stopped;
+        clock_gettime(CLOCK_MONOTONIC, &started);
+        server.relexed = server.reparsed = 0;
+
+        JsonReader reader = {body, body + length, false};
+        JsonValue message = {0};
+        json_parse_value(&reader, &message, 0);
+        const char *method = "(invalid)";
+        if (reader.failed || message.type != JSON_OBJECT) {
+            send_error(&server, NULL, -32700, "Parse error");
+        } else {
+            dispatch(&server, &message, &method);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &stopped);
+        if (log) {
+            fprintf(log, "lsp: %-28s %8.3f ms  %zu tokens relexed, %zu declarations reparsed\n", method,
+                    (double) (stopped.tv_sec - started.tv_sec) * 1e3 +
+                    (double) (stopped.tv_nsec - started.tv_nsec) / 1e6,
+                    server.relexed, server.reparsed);
+        }
+        json_free(&message);
+        free(body);
+    }
+
+    for (size_t i = 0; i < server.doc_count; i++) document_free(server.docs[i]);
+    free(server.docs);
+    return server.shutdown && server.exit ? 0 : 1;
+}
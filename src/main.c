@@ -8,6 +8,9 @@
  *  - Call into compile_file() for the actual compilation work
  */
 
+#define _XOPEN_SOURCE 700
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -18,10 +21,14 @@
 #include <libgen.h>
 
 #include "../include/compile.h"
+#include "../include/lsp.h"
+#include "../include/profile_report.h"
 #include "../include/shell_command_runner.h"
+#include "../include/work_queue.h"
 
-#define _POSIX_C_SOURCE 200809L
+#ifndef PATH_MAX
 #define PATH_MAX 4096
+#endif
 
 /* Compiler identity */
 #define COMPILER_NAME "BasicCodeCompiler (bcc)"
@@ -29,6 +36,23 @@
 #define VERSION_MINOR 3
 #define VERSION_PATCH 1
 
+/* Long-only options */
+enum {
+    OPT_RUN = 256,
+    OPT_TIME_REPORT,
+    OPT_PROFILE_REPORT,
+    OPT_STATS,
+    OPT_REGALLOC_REPORT,
+    OPT_MODULE_CACHE,
+    OPT_EMIT_AST_BIN,
+    OPT_LSP,
+    OPT_GC_SECTIONS,
+    OPT_ORDER_FUNCTIONS
+};
+
+/** Default directory of precompiled module interfaces, relative to the working directory */
+#define DEFAULT_MODULE_CACHE ".bcc-cache"
+
 /**
  * @brief Prints the version of the compiler.
  */
@@ -54,7 +78,43 @@ static void print_usage(const char *program_name) {
             "  -g, --show-registers  Show register allocation details\n"
             "  -r, --arch=<arch>     Specify target architecture (ARM)\n"
             "  -s, --save-assembly   Save the generated assembly file\n"
-            "  -o <output>           Specify output executable name\n",
+            "  -c, --no-link         Generate assembly in tmp/ without assembling or linking\n"
+            "  -o <output>           Specify output executable name\n"
+            "  -j, --jobs=<n>        Threads allocating registers and generating code for the\n"
+            "                        functions of a module (default: cores)\n"
+            "      --run             Interpret the program on the host instead of compiling\n"
+            "      --time-report     Print time and lines/sec of each compiler phase\n"
+            "      --stats[=text|json]\n"
+            "                        Print instruction count and mix, spills, frame size and\n"
+            "                        registers of every function and module\n"
+            "      --regalloc-report=<file>\n"
+            "                        Write live intervals, spills and register pressure as JSON\n"
+            "      --module-cache=<dir>\n"
+            "                        Directory of precompiled module interfaces (default: " DEFAULT_MODULE_CACHE "),\n"
+            "                        empty to always compile imports from source\n"
+            "  -fno-inline-imports   Do not inline small functions from imported modules\n"
+            "  -fno-ipa              Do not specialize functions on constant arguments or\n"
+            "                        delete statements without side effects\n"
+            "      --gc-sections     Emit every function in its own section and link with\n"
+            "                        --gc-sections, dropping functions main cannot reach\n"
+            "      --order-functions Place callers next to their callees (from the call graph, or the\n"
+            "                        -fprofile-use profile), within and across modules\n"
+            "      --emit-ast-bin[=<file>]\n"
+            "                        Write the AST in the binary format (default: <output>.bast) and exit;\n"
+            "                        a .bast file can be compiled in place of its source\n"
+            "  -finstrument-functions\n"
+            "                        Count calls of every function, dumped to " PROFILE_OUTPUT " at exit\n"
+            "  -finstrument-cycles=<pmccntr|dwt>\n"
+            "                        Also accumulate cycles per function from the given counter\n"
+            "  -fprofile-generate    Same as -finstrument-functions: first stage of profile-guided optimization\n"
+            "  -fprofile-use[=<file>]\n"
+            "                        Optimize with a profile dump (default: " PROFILE_OUTPUT "): functions\n"
+            "                        that ran go to .text.hot, functions that never ran to .text.unlikely\n"
+            "                        and do not inline imports\n"
+            "      --profile-report=<file>\n"
+            "                        Print the hottest functions of a profile dump and exit\n"
+            "      --lsp             Run as a language server on stdin/stdout (no input file);\n"
+            "                        with --time-report, log the time of every message on stderr\n",
             program_name);
 }
 
@@ -66,12 +126,56 @@ static void strip_extension(const char *filename) {
     if (dot) *dot = '\0';
 }
 
+/**
+ * @brief Applies a -f<flag> code generation option.
+ *
+ * @return false if the flag is unknown.
+ */
+static bool parse_f_flag(const char *flag, CompilerOptions *opts) {
+    if (strcmp(flag, "instrument-functions") == 0) {
+        if (opts->instrument == INSTRUMENT_NONE) opts->instrument = INSTRUMENT_CALLS;
+        return true;
+    }
+    if (strcmp(flag, "no-inline-imports") == 0) {
+        opts->no_inline_imports = true;
+        return true;
+    }
+    if (strcmp(flag, "profile-generate") == 0) {
+        if (opts->instrument == INSTRUMENT_NONE) opts->instrument = INSTRUMENT_CALLS;
+        return true;
+    }
+    if (strcmp(flag, "profile-use") == 0) {
+        opts->profile_use = PROFILE_OUTPUT;
+        return true;
+    }
+    if (strncmp(flag, "profile-use=", strlen("profile-use=")) == 0) {
+        opts->profile_use = flag + strlen("profile-use=");
+        return true;
+    }
+    if (strcmp(flag, "no-ipa") == 0) {
+        opts->no_ipa = true;
+        return true;
+    }
+    if (strcmp(flag, "instrument-cycles=pmccntr") == 0) {
+        opts->instrument = INSTRUMENT_PMCCNTR;
+        return true;
+    }
+    if (strcmp(flag, "instrument-cycles=dwt") == 0) {
+        opts->instrument = INSTRUMENT_DWT;
+        return true;
+    }
+    fprintf(stderr, "Unknown option: -f%s\n", flag);
+    return false;
+}
+
 /**
  * @brief Parses command-line options into a CompilerOptions struct.
  */
 static CompilerOptions parse_options(int argc, char *argv[], ErrorCode *err) {
     CompilerOptions opts = {0};
     opts.target_arch = ARCH_ARM;
+    opts.jobs = work_queue_default_jobs();
+    opts.module_cache = DEFAULT_MODULE_CACHE;
     *err = ERR_OK;
 
     static struct option long_opts[] = {
@@ -82,11 +186,24 @@ static CompilerOptions parse_options(int argc, char *argv[], ErrorCode *err) {
         {"show-registers",  no_argument,       0, 'g'},
         {"arch",            required_argument, 0, 'r'},
         {"save-assembly",   no_argument,       0, 's'},
+        {"no-link",         no_argument,       0, 'c'},
+        {"jobs",            required_argument, 0, 'j'},
+        {"run",             no_argument,       0, OPT_RUN},
+        {"time-report",     no_argument,       0, OPT_TIME_REPORT},
+        {"profile-report",  required_argument, 0, OPT_PROFILE_REPORT},
+        {"stats",           optional_argument, 0, OPT_STATS},
+        {"regalloc-report", required_argument, 0, OPT_REGALLOC_REPORT},
+        {"module-cache",    required_argument, 0, OPT_MODULE_CACHE},
+        {"emit-ast-bin",    optional_argument, 0, OPT_EMIT_AST_BIN},
+        {"lsp",             no_argument,       0, OPT_LSP},
+        {"gc-sections",     no_argument,       0, OPT_GC_SECTIONS},
+        {"order-functions", no_argument,       0, OPT_ORDER_FUNCTIONS},
         {0,0,0,0}
     };
 
+    bool no_link = false;
     int opt;
-    while ((opt = getopt_long(argc, argv, "hvtagr:so:", long_opts, NULL)) != -1) {
+    while ((opt = getopt_long(argc, argv, "hvtagr:sco:f:j:", long_opts, NULL)) != -1) {
         switch (opt) {
             case 'h': print_usage(argv[0]);  exit(EXIT_SUCCESS);
             case 'v': print_version();       exit(EXIT_SUCCESS);
@@ -94,6 +211,34 @@ static CompilerOptions parse_options(int argc, char *argv[], ErrorCode *err) {
             case 'a': opts.show_ast = true;         break;
             case 'g': opts.show_registers = true;   break;
             case 's': opts.save_asm = true;         break;
+            case 'c': no_link = true;               break;
+            case 'j': opts.jobs = atoi(optarg);     break;
+            case OPT_RUN: opts.run = true;          break;
+            case OPT_TIME_REPORT: opts.time_report = true; break;
+            case OPT_PROFILE_REPORT: opts.profile_report = optarg; break;
+            case OPT_REGALLOC_REPORT: opts.regalloc_report = optarg; break;
+            case OPT_MODULE_CACHE: opts.module_cache = optarg[0] ? optarg : NULL; break;
+            case OPT_EMIT_AST_BIN: opts.emit_ast_bin = optarg ? optarg : ""; break;
+            case OPT_LSP: opts.lsp = true;          break;
+            case OPT_GC_SECTIONS: opts.gc_sections = true; break;
+            case OPT_ORDER_FUNCTIONS: opts.order_functions = true; break;
+            case OPT_STATS:
+                if (!optarg || strcmp(optarg, "text") == 0) {
+                    opts.stats = STATS_TEXT;
+                } else if (strcmp(optarg, "json") == 0) {
+                    opts.stats = STATS_JSON;
+                } else {
+                    fprintf(stderr, "Unknown stats format: %s\n", optarg);
+                    *err = ERR_UNKNOWN_OPTION;
+                    return opts;
+                }
+                break;
+            case 'f':
+                if (!parse_f_flag(optarg, &opts)) {
+                    *err = ERR_UNKNOWN_OPTION;
+                    return opts;
+                }
+                break;
             case 'r':
                 if (strcasecmp(optarg, "ARM") == 0) {
                     opts.target_arch = ARCH_ARM;
@@ -135,6 +280,13 @@ static CompilerOptions parse_options(int argc, char *argv[], ErrorCode *err) {
         }
         strip_extension(opts.output_name);
 
+        // The binary AST defaults to the output name
+        if (opts.emit_ast_bin && opts.emit_ast_bin[0] == '\0') {
+            static char ast_bin_path[PATH_MAX];
+            snprintf(ast_bin_path, sizeof(ast_bin_path), "%s.bast", opts.output_name);
+            opts.emit_ast_bin = ast_bin_path;
+        }
+
         // Get absolute directory path of the input file
         static char abs_path[PATH_MAX];
         static char dir_path[PATH_MAX];
@@ -145,11 +297,11 @@ static CompilerOptions parse_options(int argc, char *argv[], ErrorCode *err) {
         } else {
             opts.file_directory_path = NULL;
         }
-    } else {
+    } else if (!opts.profile_report && !opts.lsp) {
         *err = ERR_NO_INPUT_FILE;
     }
 
-    opts.is_executable = true; // Default to generating an executable
+    opts.is_executable = !no_link; // Default to generating an executable
     return opts;
 }
 
@@ -158,16 +310,49 @@ static CompilerOptions parse_options(int argc, char *argv[], ErrorCode *err) {
  */
 int main(const int argc, char *argv[]) {
     ErrorCode err;
-    const CompilerOptions opts = parse_options(argc, argv, &err);
+    CompilerOptions opts = parse_options(argc, argv, &err);
+
+    if (err == ERR_OK && opts.lsp) {
+        return lsp_serve(stdin, stdout, opts.time_report ? stderr : NULL);
+    }
+
+    if (err == ERR_OK && opts.profile_report && !opts.filename) {
+        return profile_report(opts.profile_report, stdout) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
     if (err != ERR_OK || !opts.filename) {
         print_usage(argv[0]);
         return EXIT_FAILURE;
     }
 
+    if (opts.emit_ast_bin) {
+        return emit_ast_binary(&opts) == ERR_OK ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (opts.run) {
+        int status = 0;
+        if (run_file(&opts, &status) != ERR_OK) return EXIT_FAILURE;
+        return status;
+    }
+
     run_command("rm -rf tmp"); // Clean up old tmp directory
 
-    return compile_file(&opts) == 0
+    // Modules append to the report, so start it empty
+    if (opts.regalloc_report) {
+        FILE *report = fopen(opts.regalloc_report, "w");
+        if (report) fclose(report);
+    }
+
+    // Loaded once, for the module and all its imports
+    ProfileData profile = {0};
+    if (opts.profile_use) {
+        if (profile_load(opts.profile_use, &profile) != 0) return EXIT_FAILURE;
+        opts.profile = &profile;
+    }
+
+    const ErrorCode result = compile_file(&opts);
+    profile_free(&profile);
+    return result == 0
            ? EXIT_SUCCESS
            : EXIT_FAILURE;
 }
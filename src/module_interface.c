@@ -0,0 +1,582 @@
+/**
+ * @file module_interface.c
+ * @brief Reading, writing and applying precompiled module interfaces (.bci).
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "../include/module_interface.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BCI_HEADER_SIZE 60
+
+static const unsigned char bci_magic[4] = {'B', 'C', 'I', '\0'};
+
+/**
+ * @brief Growable byte buffer used to serialize an interface.
+ */
+typedef struct {
+    unsigned char *data;
+    size_t len;
+    size_t cap;
+} ByteBuffer;
+
+/**
+ * @brief Bounds-checked reader over a loaded file.
+ */
+typedef struct {
+    const unsigned char *data;
+    size_t len;
+    size_t pos;
+    bool failed;
+} ByteReader;
+
+static void *checked_malloc(const size_t size) {
+    void *p = calloc(1, size ? size : 1);
+    if (!p) {
+        fprintf(stderr, "Memory allocation failed in module interface\n");
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+static void buffer_put(ByteBuffer *buf, const void *bytes, const size_t n) {
+    if (buf->len + n > buf->cap) {
+        size_t new_cap = buf->cap ? buf->cap : 256;
+        while (new_cap < buf->len + n) new_cap *= 2;
+        unsigned char *grown = realloc(buf->data, new_cap);
+        if (!grown) {
+            fprintf(stderr, "Memory allocation failed in buffer_put\n");
+            exit(EXIT_FAILURE);
+        }
+        buf->data = grown;
+        buf->cap = new_cap;
+    }
+    memcpy(buf->data + buf->len, bytes, n);
+    buf->len += n;
+}
+
+static void put_u16(ByteBuffer *buf, const uint16_t v) {
+    const unsigned char b[2] = {(unsigned char) v, (unsigned char) (v >> 8)};
+    buffer_put(buf, b, 2);
+}
+
+static void put_u32(ByteBuffer *buf, const uint32_t v) {
+    const unsigned char b[4] = {
+        (unsigned char) v, (unsigned char) (v >> 8), (unsigned char) (v >> 16), (unsigned char) (v >> 24)
+    };
+    buffer_put(buf, b, 4);
+}
+
+static void put_u64(ByteBuffer *buf, const uint64_t v) {
+    put_u32(buf, (uint32_t) v);
+    put_u32(buf, (uint32_t) (v >> 32));
+}
+
+/* Append a string to the string table and return its offset */
+static uint32_t put_string(ByteBuffer *strings, const char *s) {
+    const uint32_t offset = (uint32_t) strings->len;
+    buffer_put(strings, s, strlen(s) + 1);
+    return offset;
+}
+
+static const unsigned char *take(ByteReader *r, const size_t n) {
+    if (r->failed || r->len - r->pos < n) {
+        r->failed = true;
+        return NULL;
+    }
+    const unsigned char *p = r->data + r->pos;
+    r->pos += n;
+    return p;
+}
+
+static uint16_t get_u16(ByteReader *r) {
+    const unsigned char *b = take(r, 2);
+    return b ? (uint16_t) (b[0] | b[1] << 8) : 0;
+}
+
+static uint32_t get_u32(ByteReader *r) {
+    const unsigned char *b = take(r, 4);
+    return b ? (uint32_t) b[0] | (uint32_t) b[1] << 8 | (uint32_t) b[2] << 16 | (uint32_t) b[3] << 24 : 0;
+}
+
+static uint64_t get_u64(ByteReader *r) {
+    const uint64_t lo = get_u32(r);
+    const uint64_t hi = get_u32(r);
+    return lo | hi << 32;
+}
+
+/* Copy string `offset` of the string table, which must be NUL-terminated in bounds */
+static char *get_string(ByteReader *r, const unsigned char *strings, const size_t strings_len, const uint32_t offset) {
+    if (offset >= strings_len || !memchr(strings + offset, '\0', strings_len - offset)) {
+        r->failed = true;
+        return NULL;
+    }
+    return strdup((const char *) strings + offset);
+}
+
+/* FNV-1a, used to detect interface changes */
+static uint32_t hash_bytes(uint32_t hash, const void *data, const size_t n) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < n; i++) {
+        hash ^= p[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+uint32_t module_interface_compiler_id(void) {
+    static uint32_t id;
+    static bool computed;
+    if (computed) return id;
+
+    // Hash the running compiler itself, so any rebuild invalidates the cache
+    id = 2166136261u;
+    FILE *exe = fopen("/proc/self/exe", "rb");
+    if (exe) {
+        unsigned char buf[65536];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), exe)) > 0) id = hash_bytes(id, buf, n);
+        fclose(exe);
+    } else {
+        static const char build[] = __DATE__ " " __TIME__;
+        id = hash_bytes(id, build, sizeof(build));
+    }
+    computed = true;
+    return id;
+}
+
+static uint32_t compute_interface_hash(const ModuleInterface *iface) {
+    uint32_t hash = 2166136261u;
+    for (size_t f = 0; f < iface->function_count; f++) {
+        const FunctionSignature *fn = &iface->functions[f];
+        hash = hash_bytes(hash, fn->name, strlen(fn->name) + 1);
+        const uint32_t counts[3] = {(uint32_t) fn->param_count, (uint32_t) fn->body_length, fn->pure};
+        hash = hash_bytes(hash, counts, sizeof(counts));
+        for (size_t p = 0; p < fn->param_count; p++) {
+            hash = hash_bytes(hash, fn->params[p], strlen(fn->params[p]) + 1);
+        }
+        for (size_t n = 0; n < fn->body_length; n++) {
+            const InlineNode *node = &fn->body[n];
+            const int32_t fields[3] = {node->type, node->child_count, node->value};
+            hash = hash_bytes(hash, fields, sizeof(fields));
+        }
+    }
+    return hash;
+}
+
+static int param_index(const FunctionSignature *fn, const char *name) {
+    for (size_t i = 0; i < fn->param_count; i++) {
+        if (strcmp(fn->params[i], name) == 0) return (int) i;
+    }
+    return -1;
+}
+
+/* Flatten an expression made of +, parameters and literals; false if it has anything else */
+static bool flatten_body(const ASTNode *expr, const FunctionSignature *fn, InlineNode *out, size_t *len) {
+    if (*len >= BCI_MAX_INLINE_NODES) return false;
+    InlineNode *node = &out[(*len)++];
+    node->type = (uint16_t) expr->type;
+    node->child_count = 0;
+    node->value = 0;
+
+    switch (expr->type) {
+        case NODE_INT_LITERAL:
+            node->value = (int32_t) expr->token.literal.int_value;
+            return true;
+        case NODE_IDENTIFIER:
+            node->value = param_index(fn, expr->token.lexeme);
+            return node->value != -1;
+        case NODE_ADD:
+            node->child_count = 2;
+            return flatten_body(expr->children[0], fn, out, len) &&
+                   flatten_body(expr->children[1], fn, out, len);
+        default:
+            return false;
+    }
+}
+
+/* Record the body of `fun f<...>(): int { return <expr>; }` if it is small and pure */
+static void extract_inline_body(const ASTNode *fn_node, FunctionSignature *fn) {
+    const ASTNode *ret = NULL;
+    for (size_t i = 1; i < fn_node->child_count; i++) {
+        const ASTNode *child = fn_node->children[i];
+        if (child->type == NODE_TYPE_PARAM || child->type == NODE_RETURN_INT_TYPE) continue;
+        if (ret || child->type != NODE_RETURN || child->child_count != 1) return;
+        ret = child;
+    }
+    if (!ret) return;
+
+    InlineNode nodes[BCI_MAX_INLINE_NODES];
+    size_t len = 0;
+    if (!flatten_body(ret->children[0], fn, nodes, &len)) return;
+
+    fn->body = checked_malloc(len * sizeof(InlineNode));
+    memcpy(fn->body, nodes, len * sizeof(InlineNode));
+    fn->body_length = len;
+}
+
+ModuleInterface *module_interface_from_ast(const ASTNode *root, const bool *pure) {
+    ModuleInterface *iface = checked_malloc(sizeof(ModuleInterface));
+
+    size_t count = 0;
+    for (size_t i = 0; i < root->child_count; i++) {
+        if (root->children[i]->type == NODE_FUNCTION) count++;
+    }
+    iface->functions = checked_malloc(count * sizeof(FunctionSignature));
+
+    for (size_t i = 0; i < root->child_count; i++) {
+        const ASTNode *fn_node = root->children[i];
+        if (fn_node->type != NODE_FUNCTION) continue;
+
+        FunctionSignature *fn = &iface->functions[iface->function_count];
+        fn->pure = pure && pure[iface->function_count];
+        iface->function_count++;
+        fn->name = strdup(fn_node->children[0]->token.lexeme);
+        fn->line = fn_node->children[0]->token.line;
+        for (size_t c = 1; c < fn_node->child_count; c++) {
+            if (fn_node->children[c]->type == NODE_TYPE_PARAM) fn->param_count++;
+        }
+        fn->params = checked_malloc(fn->param_count * sizeof(char *));
+        size_t p = 0;
+        for (size_t c = 1; c < fn_node->child_count; c++) {
+            if (fn_node->children[c]->type == NODE_TYPE_PARAM) {
+                fn->params[p++] = strdup(fn_node->children[c]->token.lexeme);
+            }
+        }
+        extract_inline_body(fn_node, fn);
+    }
+
+    iface->interface_hash = compute_interface_hash(iface);
+    return iface;
+}
+
+void module_interface_add_import(ModuleInterface *iface, const char *path, const uint32_t hash) {
+    if (iface->import_count >= iface->import_cap) {
+        iface->import_cap = iface->import_cap ? iface->import_cap * 2 : 8;
+        iface->imports = realloc(iface->imports, iface->import_cap * sizeof(InterfaceImport));
+        if (!iface->imports) {
+            fprintf(stderr, "Memory allocation failed in module_interface_add_import\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    iface->imports[iface->import_count++] = (InterfaceImport){.path = strdup(path), .interface_hash = hash};
+}
+
+bool module_interface_write(const ModuleInterface *iface, const char *path) {
+    ByteBuffer strings = {0}, body = {0}, params = {0}, nodes = {0};
+    size_t param_total = 0, node_total = 0;
+
+    for (size_t i = 0; i < iface->import_count; i++) {
+        put_u32(&body, put_string(&strings, iface->imports[i].path));
+        put_u32(&body, iface->imports[i].interface_hash);
+    }
+    for (size_t f = 0; f < iface->function_count; f++) {
+        const FunctionSignature *fn = &iface->functions[f];
+        put_u32(&body, put_string(&strings, fn->name));
+        put_u32(&body, (uint32_t) fn->line);
+        put_u32(&body, (uint32_t) fn->param_count);
+        put_u32(&body, (uint32_t) fn->body_length);
+        put_u32(&body, fn->pure ? BCI_FUNCTION_PURE : 0);
+        for (size_t p = 0; p < fn->param_count; p++) {
+            put_u32(&params, put_string(&strings, fn->params[p]));
+            param_total++;
+        }
+        for (size_t n = 0; n < fn->body_length; n++) {
+            put_u16(&nodes, fn->body[n].type);
+            put_u16(&nodes, fn->body[n].child_count);
+            put_u32(&nodes, (uint32_t) fn->body[n].value);
+            node_total++;
+        }
+    }
+
+    ByteBuffer header = {0};
+    buffer_put(&header, bci_magic, sizeof(bci_magic));
+    put_u32(&header, BCI_VERSION);
+    put_u32(&header, module_interface_compiler_id());
+    put_u32(&header, iface->flags);
+    put_u32(&header, iface->interface_hash);
+    put_u64(&header, iface->source_size);
+    put_u64(&header, (uint64_t) iface->source_mtime_ns);
+    put_u32(&header, (uint32_t) strings.len);
+    put_u32(&header, (uint32_t) iface->import_count);
+    put_u32(&header, (uint32_t) iface->function_count);
+    put_u32(&header, (uint32_t) param_total);
+    put_u32(&header, (uint32_t) node_total);
+    put_u32(&header, (uint32_t) iface->assembly_size);
+
+    // Write to a temporary name and rename, so readers never see a partial file
+    char tmp_path[4096];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE *out = fopen(tmp_path, "wb");
+    bool ok = out != NULL;
+    if (ok) {
+        const ByteBuffer *sections[] = {&header, &strings, &body, &params, &nodes};
+        for (size_t i = 0; i < sizeof(sections) / sizeof(sections[0]); i++) {
+            if (sections[i]->len && fwrite(sections[i]->data, 1, sections[i]->len, out) != sections[i]->len) ok = false;
+        }
+        if (iface->assembly_size &&
+            fwrite(iface->assembly, 1, iface->assembly_size, out) != iface->assembly_size) ok = false;
+        if (fclose(out) != 0) ok = false;
+        ok = ok && rename(tmp_path, path) == 0;
+        if (!ok) remove(tmp_path);
+    }
+
+    free(strings.data);
+    free(body.data);
+    free(params.data);
+    free(nodes.data);
+    free(header.data);
+    return ok;
+}
+
+/* Check one subtree of an inline body read from disk; advances *pos past it */
+static bool valid_body_node(const FunctionSignature *fn, size_t *pos) {
+    if (*pos >= fn->body_length) return false;
+    const InlineNode *node = &fn->body[(*pos)++];
+    switch (node->type) {
+        case NODE_INT_LITERAL:
+            return node->child_count == 0;
+        case NODE_IDENTIFIER:
+            return node->child_count == 0 && node->value >= 0 && (size_t) node->value < fn->param_count;
+        case NODE_ADD:
+            return node->child_count == 2 && valid_body_node(fn, pos) && valid_body_node(fn, pos);
+        default:
+            return false;
+    }
+}
+
+/* An inline body must be a single expression tree using exactly body_length nodes */
+static bool valid_body(const FunctionSignature *fn) {
+    size_t pos = 0;
+    return valid_body_node(fn, &pos) && pos == fn->body_length;
+}
+
+/* Parse the sections after the header; sets r->failed on any inconsistency */
+static void read_sections(ByteReader *r, ModuleInterface *iface, const uint32_t strings_len,
+                          const uint32_t param_total, const uint32_t node_total) {
+    const unsigned char *strings = take(r, strings_len);
+    if (!strings) return;
+
+    for (size_t i = 0; i < iface->import_count && !r->failed; i++) {
+        iface->imports[i].path = get_string(r, strings, strings_len, get_u32(r));
+        iface->imports[i].interface_hash = get_u32(r);
+    }
+
+    size_t params_needed = 0, nodes_needed = 0;
+    for (size_t f = 0; f < iface->function_count && !r->failed; f++) {
+        FunctionSignature *fn = &iface->functions[f];
+        fn->name = get_string(r, strings, strings_len, get_u32(r));
+        fn->line = (int) get_u32(r);
+        fn->param_count = get_u32(r);
+        fn->body_length = get_u32(r);
+        fn->pure = (get_u32(r) & BCI_FUNCTION_PURE) != 0;
+        params_needed += fn->param_count;
+        nodes_needed += fn->body_length;
+        if (fn->param_count > param_total || fn->body_length > BCI_MAX_INLINE_NODES) r->failed = true;
+    }
+    if (r->failed || params_needed != param_total || nodes_needed != node_total) {
+        r->failed = true;
+        return;
+    }
+
+    for (size_t f = 0; f < iface->function_count && !r->failed; f++) {
+        FunctionSignature *fn = &iface->functions[f];
+        fn->params = checked_malloc(fn->param_count * sizeof(char *));
+        for (size_t p = 0; p < fn->param_count && !r->failed; p++) {
+            fn->params[p] = get_string(r, strings, strings_len, get_u32(r));
+        }
+    }
+    for (size_t f = 0; f < iface->function_count && !r->failed; f++) {
+        FunctionSignature *fn = &iface->functions[f];
+        if (fn->body_length == 0) continue;
+        fn->body = checked_malloc(fn->body_length * sizeof(InlineNode));
+        for (size_t n = 0; n < fn->body_length; n++) {
+            fn->body[n].type = get_u16(r);
+            fn->body[n].child_count = get_u16(r);
+            fn->body[n].value = (int32_t) get_u32(r);
+        }
+        if (!r->failed && !valid_body(fn)) r->failed = true;
+    }
+
+    const unsigned char *assembly = take(r, iface->assembly_size);
+    if (assembly) {
+        iface->assembly = checked_malloc(iface->assembly_size + 1);
+        memcpy(iface->assembly, assembly, iface->assembly_size);
+    }
+    if (!r->failed && r->pos != r->len) r->failed = true;
+}
+
+ModuleInterface *module_interface_read(const char *path) {
+    FILE *in = fopen(path, "rb");
+    if (!in) return NULL;
+
+    unsigned char *data = NULL;
+    size_t len = 0, cap = 0;
+    for (;;) {
+        if (len == cap) {
+            cap = cap ? cap * 2 : 4096;
+            unsigned char *grown = realloc(data, cap);
+            if (!grown) {
+                free(data);
+                fclose(in);
+                return NULL;
+            }
+            data = grown;
+        }
+        const size_t n = fread(data + len, 1, cap - len, in);
+        if (n == 0) break;
+        len += n;
+    }
+    fclose(in);
+
+    ByteReader r = {.data = data, .len = len};
+    const unsigned char *magic = take(&r, sizeof(bci_magic));
+    if (!magic || memcmp(magic, bci_magic, sizeof(bci_magic)) != 0 || get_u32(&r) != BCI_VERSION ||
+        get_u32(&r) != module_interface_compiler_id()) {
+        free(data);
+        return NULL;
+    }
+
+    ModuleInterface *iface = checked_malloc(sizeof(ModuleInterface));
+    iface->flags = get_u32(&r);
+    iface->interface_hash = get_u32(&r);
+    iface->source_size = get_u64(&r);
+    iface->source_mtime_ns = (int64_t) get_u64(&r);
+    const uint32_t strings_len = get_u32(&r);
+    iface->import_count = iface->import_cap = get_u32(&r);
+    iface->function_count = get_u32(&r);
+    const uint32_t param_total = get_u32(&r);
+    const uint32_t node_total = get_u32(&r);
+    iface->assembly_size = get_u32(&r);
+
+    // Counts come from the file: bound them by its size before allocating
+    if (!r.failed && iface->import_count <= len / 8 && iface->function_count <= len / 16) {
+        iface->imports = checked_malloc(iface->import_count * sizeof(InterfaceImport));
+        iface->functions = checked_malloc(iface->function_count * sizeof(FunctionSignature));
+        read_sections(&r, iface, strings_len, param_total, node_total);
+    } else {
+        r.failed = true;
+    }
+
+    free(data);
+    if (r.failed) {
+        module_interface_free(iface);
+        return NULL;
+    }
+    return iface;
+}
+
+const FunctionSignature *module_interface_find(const ModuleInterface *iface, const char *name) {
+    for (size_t i = 0; i < iface->function_count; i++) {
+        if (iface->functions[i].name && strcmp(iface->functions[i].name, name) == 0) return &iface->functions[i];
+    }
+    return NULL;
+}
+
+/* Rebuild an inline body as an AST, substituting the call's arguments for the parameters */
+static ASTNode *instantiate_body(const FunctionSignature *fn, size_t *pos, const ASTNode *call) {
+    const InlineNode *node = &fn->body[(*pos)++];
+    switch (node->type) {
+        case NODE_IDENTIFIER: {
+            const ASTNode *arg = call->children[node->value];
+            ASTNode *copy = ast_create_node(arg->type, arg->token);
+            copy->symbol_id = arg->symbol_id;
+            copy->scope_depth = arg->scope_depth;
+            return copy;
+        }
+        case NODE_INT_LITERAL: {
+            Token token = call->token;
+            token.type = TOKEN_INTEGER;
+            token.literal.int_value = node->value;
+            return ast_create_node(NODE_INT_LITERAL, token);
+        }
+        case NODE_ADD: {
+            ASTNode *add = ast_create_node(NODE_ADD, call->token);
+            ast_add_child(add, instantiate_body(fn, pos, call));
+            ast_add_child(add, instantiate_body(fn, pos, call));
+            return add;
+        }
+        default:
+            // Bodies are checked when they are read, so this is a bug
+            fprintf(stderr, "Invalid node type %u in the inline body of '%s'\n", node->type, fn->name);
+            abort();
+    }
+}
+
+static bool is_local_function(const ASTNode *root, const char *name) {
+    for (size_t i = 0; i < root->child_count; i++) {
+        const ASTNode *fn = root->children[i];
+        if (fn->type == NODE_FUNCTION && strcmp(fn->children[0]->token.lexeme, name) == 0) return true;
+    }
+    return false;
+}
+
+static size_t apply_calls(const ASTNode *root, ASTNode *node, const ModuleInterface *const *imports,
+                          const size_t import_count, const bool inline_bodies) {
+    size_t errors = 0;
+    for (size_t i = 0; i < node->child_count; i++) {
+        errors += apply_calls(root, node->children[i], imports, import_count, inline_bodies);
+    }
+    if (node->type != NODE_FUNCTION_CALL || is_local_function(root, node->token.lexeme)) return errors;
+
+    const FunctionSignature *fn = NULL;
+    for (size_t i = 0; i < import_count && !fn; i++) {
+        if (imports[i]) fn = module_interface_find(imports[i], node->token.lexeme);
+    }
+    if (!fn) return errors;
+
+    if (node->child_count != fn->param_count) {
+        fprintf(stderr, "Error (Line %d): Wrong number of arguments in call to '%s' (expected %zu, got %zu)\n",
+                node->token.line, fn->name, fn->param_count, node->child_count);
+        return errors + 1;
+    }
+    if (!inline_bodies || !fn->body) return errors;
+    for (size_t i = 0; i < node->child_count; i++) {
+        const NodeType arg = node->children[i]->type;
+        if (arg != NODE_IDENTIFIER && arg != NODE_INT_LITERAL) return errors;
+    }
+
+    size_t pos = 0;
+    ASTNode *body = instantiate_body(fn, &pos, node);
+    for (size_t i = 0; i < node->child_count; i++) free_ast(node->children[i]);
+    free(node->children);
+    *node = *body;
+    free(body);
+    return errors;
+}
+
+size_t module_interface_apply(ASTNode *root, const ModuleInterface *const *imports,
+                              const size_t import_count, const bool inline_bodies, const FunctionHeat *heat) {
+    if (!root || import_count == 0) return 0;
+    size_t errors = 0;
+    size_t f = 0;
+    for (size_t i = 0; i < root->child_count; i++) {
+        ASTNode *node = root->children[i];
+        if (node->type != NODE_FUNCTION) {
+            errors += apply_calls(root, node, imports, import_count, inline_bodies);
+            continue;
+        }
+        // Code that never ran is kept compact: its calls stay calls
+        const bool cold = heat && heat[f++] == HEAT_COLD;
+        errors += apply_calls(root, node, imports, import_count, inline_bodies && !cold);
+    }
+    return errors;
+}
+
+void module_interface_free(ModuleInterface *iface) {
+    if (!iface) return;
+    for (size_t i = 0; i < iface->import_count; i++) free(iface->imports[i].path);
+    free(iface->imports);
+    for (size_t f = 0; f < iface->function_count; f++) {
+        FunctionSignature *fn = &iface->functions[f];
+        free(fn->name);
+        for (size_t p = 0; p < fn->param_count && fn->params; p++) free(fn->params[p]);
+        free(fn->params);
+        free(fn->body);
+    }
+    free(iface->functions);
+    free(iface->assembly);
+    free(iface);
+}
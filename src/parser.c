@@ -18,6 +18,8 @@
 static ASTNode *parse_expression(Parser *parser);
 
 static ASTNode *parse_statement(Parser *parser);
+static bool parse_body_statements(Parser *parser, ASTNode *func_node);
+static bool skip_function_body(Parser *parser, ASTNode *func_node);
 
 /* Helper to check end of token stream */
 static bool is_at_end(const Parser *parser) {
@@ -46,12 +48,18 @@ static ASTNode *create_node(const NodeType type, const Token token) {
         exit(EXIT_FAILURE);
     }
     node->type = type;
+    node->body_start = 0;
     node->token = token;
     node->children = NULL;
     node->child_count = 0;
     node->register_assigned = -1;
     node->source_register = -1;
     node->scope_depth = 0;
+    node->symbol_id = -1;
+    node->requires_load = false;
+    node->requires_store = false;
+    node->stack_slot = -1;
+    node->rematerialize = NULL;
     return node;
 }
 
@@ -68,6 +76,20 @@ static void add_child_node(ASTNode *parent, ASTNode *child) {
     parent->child_count++;
 }
 
+ASTNode *ast_create_node(const NodeType type, const Token token) {
+    return create_node(type, token);
+}
+
+void ast_add_child(ASTNode *parent, ASTNode *child) {
+    add_child_node(parent, child);
+}
+
+/* Free a declaration; an import owns the copy of its path */
+void free_declaration(ASTNode *node) {
+    if (node && node->type == NODE_IMPORT) free(node->children[0]->token.lexeme);
+    free_ast(node);
+}
+
 /* Recursively free an AST node and its children */
 void free_ast(ASTNode *node) {
     if (!node) return;
@@ -78,8 +100,15 @@ void free_ast(ASTNode *node) {
     free(node);
 }
 
-/* Report a syntax error and increment error count */
+/* Report a syntax error and increment error count; recovering parsers only record the first */
 static void parse_error(Parser *parser, const char *message) {
+    if (parser->recover) {
+        if (parser->error_count++ == 0) {
+            parser->error_token = parser->current;
+            parser->error_message = message;
+        }
+        return;
+    }
     fprintf(stderr, "Syntax Error (Line %d): %s\n", CURRENT_TOKEN.line, message);
     parser->error_count++;
     exit(EXIT_FAILURE);
@@ -127,10 +156,7 @@ static void parse_generic_params(Parser *parser, ASTNode *parent) {
         add_child_node(parent, param_node);
 
         ASTNode *type_node = parse_type(parser);
-        if (!type_node) {
-            free_ast(param_node);
-            break;
-        }
+        if (!type_node) break; // param_node is owned by parent already
         add_child_node(param_node, type_node);
 
         if (!match(parser, TOKEN_COMMA))
@@ -200,6 +226,7 @@ static ASTNode *parse_return_type(Parser *parser) {
 
 /* Parse a function definition */
 static ASTNode *parse_function(Parser *parser) {
+    const size_t errors_before = parser->error_count;
     const Token fun_token = CURRENT_TOKEN;
     ADVANCE_TOKEN;
 
@@ -215,6 +242,10 @@ static ASTNode *parse_function(Parser *parser) {
 
     if (CURRENT_TOKEN.type == TOKEN_LANGLE) {
         parse_generic_params(parser, func_node);
+        if (parser->error_count > errors_before) {
+            free_ast(func_node);
+            return NULL;
+        }
     }
 
     if (!expect_token(parser, TOKEN_LPAREN, "Expected '(' after function name")) {
@@ -241,17 +272,49 @@ static ASTNode *parse_function(Parser *parser) {
         return NULL;
     }
 
-    while (CURRENT_TOKEN.type != TOKEN_RBRACE && !is_at_end(parser)) {
-        ASTNode *stmt = parse_statement(parser);
-        if (stmt) {
-            add_child_node(func_node, stmt);
+    if (parser->lazy_bodies) {
+        if (!skip_function_body(parser, func_node)) {
+            free_ast(func_node);
+            return NULL;
         }
+        return func_node;
     }
 
-    expect_token(parser, TOKEN_RBRACE, "Unclosed function body");
+    if (!parse_body_statements(parser, func_node)) {
+        free_ast(func_node);
+        return NULL;
+    }
     return func_node;
 }
 
+/* Parse statements up to and including the closing brace of a body */
+static bool parse_body_statements(Parser *parser, ASTNode *func_node) {
+    while (CURRENT_TOKEN.type != TOKEN_RBRACE && !is_at_end(parser)) {
+        ASTNode *stmt = parse_statement(parser);
+        if (!stmt) return false;
+        add_child_node(func_node, stmt);
+    }
+    return expect_token(parser, TOKEN_RBRACE, "Unclosed function body");
+}
+
+/* Record where a body starts and move past its matching closing brace */
+static bool skip_function_body(Parser *parser, ASTNode *func_node) {
+    const size_t body_start = parser->current;
+    size_t depth = 1;
+    while (!is_at_end(parser) && !peek(parser, TOKEN_EOF)) {
+        if (CURRENT_TOKEN.type == TOKEN_LBRACE) {
+            depth++;
+        } else if (CURRENT_TOKEN.type == TOKEN_RBRACE && --depth == 0) {
+            ADVANCE_TOKEN;
+            func_node->body_start = (int) body_start;
+            return true;
+        }
+        ADVANCE_TOKEN;
+    }
+    parse_error(parser, "Unclosed function body");
+    return false;
+}
+
 /* Parse primary expressions: integer literals, identifiers or function calls */
 static ASTNode *parse_primary(Parser *parser) {
     if (peek(parser, TOKEN_INTEGER)) {
@@ -313,12 +376,17 @@ static ASTNode *parse_primary(Parser *parser) {
 /* Parse left-associative addition expressions */
 static ASTNode *parse_expression(Parser *parser) {
     ASTNode *left = parse_primary(parser);
+    if (!left) return NULL;
 
     while (peek(parser, TOKEN_PLUS)) {
         Token plus_token = CURRENT_TOKEN;
         ADVANCE_TOKEN;
 
         ASTNode *right = parse_primary(parser);
+        if (!right) {
+            free_ast(left);
+            return NULL;
+        }
         ASTNode *add_node = create_node(NODE_ADD, plus_token);
 
         add_child_node(add_node, left);
@@ -341,9 +409,11 @@ static ASTNode *parse_statement(Parser *parser) {
         ADVANCE_TOKEN;
 
         ASTNode *expr = parse_expression(parser);
-        if (expr) {
-            add_child_node(return_node, expr);
+        if (!expr) {
+            free_ast(return_node);
+            return NULL;
         }
+        add_child_node(return_node, expr);
 
         if (!expect_token(parser, TOKEN_SEMI, "Expected ';' after return statement")) {
             free_ast(return_node);
@@ -361,14 +431,12 @@ static ASTNode *parse_statement(Parser *parser) {
             ADVANCE_TOKEN; // consume '='
 
             ASTNode *assign_node = create_node(NODE_ASSIGNMENT, id_token);
-            ASTNode *lhs = create_node(NODE_IDENTIFIER, id_token);
+            add_child_node(assign_node, create_node(NODE_IDENTIFIER, id_token));
             ASTNode *rhs = parse_expression(parser);
             if (!rhs) {
                 free_ast(assign_node);
                 return NULL;
             }
-
-            add_child_node(assign_node, lhs);
             add_child_node(assign_node, rhs);
 
             if (!expect_token(parser, TOKEN_SEMI, "Expected ';' after assignment")) {
@@ -388,6 +456,7 @@ static ASTNode *parse_statement(Parser *parser) {
         add_child_node(expr_stmt, expr);
         return expr_stmt;
     }
+    free_ast(expr);
 
     parse_error(parser, "Unexpected statement");
     return NULL;
@@ -458,14 +527,14 @@ static void add_import_path(Parser *parser, const char *path) {
 }
 
 /* Parse an import statement: 'import "path" Or import <stdlib_file>' */
-static void parse_import(Parser *parser) {
+static ASTNode *parse_import(Parser *parser) {
     ADVANCE_TOKEN; // consume 'import'
     bool is_library_import = true;
     if (peek(parser, TOKEN_QUOTATION)) {
         is_library_import = false;
     } else if (!peek(parser, TOKEN_LANGLE)) {
         parse_error(parser, "Expected '<' or '\"' after 'import'");
-        return;
+        return NULL;
     }
 
     // Build the import path
@@ -473,7 +542,7 @@ static void parse_import(Parser *parser) {
     char *path = malloc(path_cap);
     if (!path) {
         parse_error(parser, "Out of memory while parsing import path");
-        return;
+        return NULL;
     }
     path[0] = '\0';
     if (is_library_import) {
@@ -490,7 +559,7 @@ static void parse_import(Parser *parser) {
                     if (!new_path) {
                         free(path);
                         parse_error(parser, "Out of memory while parsing import path");
-                        return;
+                        return NULL;
                     }
                     path = new_path;
                 }
@@ -501,14 +570,14 @@ static void parse_import(Parser *parser) {
             } else {
                 free(path);
                 parse_error(parser, "Expected '>' after import");
-                return;
+                return NULL;
             }
         }
 
         if (first) {
             free(path);
             parse_error(parser, "Expected file path after 'import <'");
-            return;
+            return NULL;
         }
 
         char final_path[path_cap];
@@ -528,39 +597,64 @@ static void parse_import(Parser *parser) {
     const Token id_token = {.type = TOKEN_IDENTIFIER, .lexeme = strdup(path), .line = CURRENT_TOKEN.line};
     ASTNode *id_node = create_node(NODE_IDENTIFIER, id_token);
     add_child_node(import_node, id_node);
-    add_child_node(parser->ast_root, import_node);
 
     free(path);
     if (is_library_import) {
-        if (!expect_token(parser, TOKEN_RANGLE, "Expected '>' after import path")) return;
+        if (!expect_token(parser, TOKEN_RANGLE, "Expected '>' after import path")) {
+            free_declaration(import_node);
+            return NULL;
+        }
     } else {
         ADVANCE_TOKEN;
     }
+    return import_node;
+}
+
+ASTNode *parse_declaration(Parser *parser) {
+    const size_t start = parser->current;
+    const size_t errors_before = parser->error_count;
+    ASTNode *decl = NULL;
+
+    if (peek(parser, TOKEN_IMPORT)) {
+        decl = parse_import(parser);
+    } else if (peek(parser, TOKEN_FUN)) {
+        decl = parse_function(parser);
+    } else {
+        parse_error(parser, "Top-level declaration must be a function or import");
+        ADVANCE_TOKEN;
+    }
+
+    // Resume at the next declaration, having consumed at least one token
+    if (parser->error_count > errors_before) {
+        if (parser->current == start) ADVANCE_TOKEN;
+        while (!is_at_end(parser) && !peek(parser, TOKEN_FUN) && !peek(parser, TOKEN_IMPORT) &&
+               !peek(parser, TOKEN_EOF)) {
+            ADVANCE_TOKEN;
+        }
+    }
+    return decl;
 }
 
 /* Top-level parse function: expects imports and/or functions */
 size_t parse(Parser *parser) {
     parser->ast_root = create_node(NODE_COMPILATION_UNIT, (Token){0});
 
-    while (!is_at_end(parser)) {
-        if (peek(parser, TOKEN_IMPORT)) {
-            parse_import(parser);
-        } else if (peek(parser, TOKEN_FUN)) {
-            ASTNode *func = parse_function(parser);
-            if (func) {
-                add_child_node(parser->ast_root, func);
-            }
-        } else if (peek(parser, TOKEN_EOF)) {
-            break;
-        } else {
-            parse_error(parser, "Top-level declaration must be a function or import");
-            ADVANCE_TOKEN;
-        }
+    while (!is_at_end(parser) && !peek(parser, TOKEN_EOF)) {
+        add_child_node(parser->ast_root, parse_declaration(parser));
     }
 
     return parser->error_count;
 }
 
+size_t parse_function_body(TokenStream *tokens, ASTNode *fn) {
+    if (fn->body_start == 0) return 0;
+    Parser parser = parser_create(tokens);
+    parser.current = (size_t) fn->body_start;
+    fn->body_start = 0;
+    parse_body_statements(&parser, fn);
+    return parser.error_count;
+}
+
 /* Initialize parser state */
 Parser parser_create(TokenStream *tokens) {
     return (Parser){
@@ -0,0 +1,84 @@
+/**
+ * @file phase_timer.c
+ * @brief Per-phase wall-clock timing for BasicCodeCompiler.
+ */
+
+#define _GNU_SOURCE
+#include "../include/phase_timer.h"
+#include <dlfcn.h>
+#include <stdbool.h>
+#include <sys/resource.h>
+
+static const char *phase_names[PHASE_COUNT] = {
+    [PHASE_READ] = "read",
+    [PHASE_LEX] = "lex",
+    [PHASE_PARSE] = "parse",
+    [PHASE_REGALLOC] = "regalloc",
+    [PHASE_CODEGEN] = "codegen"
+};
+
+typedef unsigned long (*AllocCountFn)(void);
+
+/* bcc_alloc_count() from the preloaded shim, or NULL when it is not loaded */
+static AllocCountFn alloc_counter(void) {
+    static bool resolved = false;
+    static AllocCountFn counter = NULL;
+    if (!resolved) {
+        *(void **) &counter = dlsym(RTLD_DEFAULT, "bcc_alloc_count");
+        resolved = true;
+    }
+    return counter;
+}
+
+static unsigned long current_allocations(void) {
+    const AllocCountFn counter = alloc_counter();
+    return counter ? counter() : 0;
+}
+
+static double elapsed_seconds(const struct timespec *from, const struct timespec *to) {
+    return (double) (to->tv_sec - from->tv_sec) + (double) (to->tv_nsec - from->tv_nsec) / 1e9;
+}
+
+void phase_timer_start(PhaseTimer *timer, const CompilerPhase phase) {
+    timer->current = phase;
+    timer->allocations_started = current_allocations();
+    clock_gettime(CLOCK_MONOTONIC, &timer->started);
+}
+
+void phase_timer_stop(PhaseTimer *timer) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    timer->seconds[timer->current] += elapsed_seconds(&timer->started, &now);
+    timer->allocations[timer->current] += current_allocations() - timer->allocations_started;
+}
+
+static void report_line(FILE *out, const char *name, const double seconds, const int lines,
+                        const unsigned long allocations) {
+    const double rate = seconds > 0 ? (double) lines / seconds : 0.0;
+    fprintf(out, "  %-10s %12.6f s %14.0f lines/s", name, seconds, rate);
+    if (alloc_counter()) fprintf(out, " %12lu allocs", allocations);
+    fprintf(out, "\n");
+}
+
+/* Peak resident set size of the process in KiB */
+static long peak_rss_kib(void) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024; // bytes on macOS
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+void phase_timer_report(const PhaseTimer *timer, const char *filename, const int lines, FILE *out) {
+    double total = 0;
+    unsigned long total_allocations = 0;
+    fprintf(out, "Time report for %s (%d lines, peak RSS %ld KiB):\n", filename, lines, peak_rss_kib());
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        report_line(out, phase_names[i], timer->seconds[i], lines, timer->allocations[i]);
+        total += timer->seconds[i];
+        total_allocations += timer->allocations[i];
+    }
+    report_line(out, "total", total, lines, total_allocations);
+}
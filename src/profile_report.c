@@ -0,0 +1,197 @@
+/**
+ * @file profile_report.c
+ * @brief Reading and summary of function-level profiles for BasicCodeCompiler.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "../include/profile_report.h"
+#include "../include/ipa.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_PROFILE_LINE 8192
+
+static ProfileEntry *find_or_add_entry(ProfileData *profile, const char *module, const char *name, const int line) {
+    for (size_t i = 0; i < profile->count; i++) {
+        ProfileEntry *e = &profile->entries[i];
+        if (e->line == line && strcmp(e->name, name) == 0 && strcmp(e->module, module) == 0) return e;
+    }
+    if (profile->count >= profile->cap) {
+        profile->cap = profile->cap ? profile->cap * 2 : 64;
+        profile->entries = realloc(profile->entries, profile->cap * sizeof(ProfileEntry));
+        if (!profile->entries) {
+            fprintf(stderr, "Memory allocation failed in find_or_add_entry\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    ProfileEntry *e = &profile->entries[profile->count++];
+    *e = (ProfileEntry){.module = strdup(module), .name = strdup(name), .line = line};
+    return e;
+}
+
+static bool parse_profile(FILE *in, const char *path, ProfileData *profile) {
+    char buf[MAX_PROFILE_LINE];
+    int line_number = 0;
+    while (fgets(buf, sizeof(buf), in)) {
+        line_number++;
+        buf[strcspn(buf, "\r\n")] = '\0';
+        if (buf[0] == '\0' || buf[0] == '#') continue;
+
+        char *fields[5];
+        int field_count = 0;
+        char *cursor = buf;
+        while (field_count < 5) {
+            fields[field_count++] = cursor;
+            char *tab = strchr(cursor, '\t');
+            if (!tab) break;
+            *tab = '\0';
+            cursor = tab + 1;
+        }
+        if (field_count != 5) {
+            fprintf(stderr, "%s:%d: malformed profile line\n", path, line_number);
+            return false;
+        }
+
+        ProfileEntry *e = find_or_add_entry(profile, fields[0], fields[1], atoi(fields[2]));
+        e->calls += strtoull(fields[3], NULL, 10);
+        if (strcmp(fields[4], "-") != 0) {
+            e->cycles += strtoull(fields[4], NULL, 10);
+            profile->has_cycles = true;
+        }
+    }
+    return true;
+}
+
+static bool rank_by_cycles;
+
+static int compare_entries(const void *a, const void *b) {
+    const ProfileEntry *x = a;
+    const ProfileEntry *y = b;
+    const unsigned long long kx = rank_by_cycles ? x->cycles : x->calls;
+    const unsigned long long ky = rank_by_cycles ? y->cycles : y->calls;
+    if (kx != ky) return kx < ky ? 1 : -1;
+    return strcmp(x->name, y->name);
+}
+
+/* Print source line `line` of `path`, if the file can still be read */
+static void print_source_line(FILE *out, const char *path, const int line) {
+    FILE *src = fopen(path, "r");
+    if (!src) return;
+    char buf[MAX_PROFILE_LINE];
+    for (int n = 1; fgets(buf, sizeof(buf), src); n++) {
+        if (n != line) continue;
+        buf[strcspn(buf, "\r\n")] = '\0';
+        const char *text = buf + strspn(buf, " \t");
+        fprintf(out, "%44s| %s\n", "", text);
+        break;
+    }
+    fclose(src);
+}
+
+static double percent(const unsigned long long part, const unsigned long long total) {
+    return total > 0 ? 100.0 * (double) part / (double) total : 0.0;
+}
+
+/* Order of the lookup index: module, then function */
+static int compare_keys(const void *a, const void *b) {
+    const ProfileEntry *x = *(const ProfileEntry *const *) a;
+    const ProfileEntry *y = *(const ProfileEntry *const *) b;
+    const int by_module = strcmp(x->module, y->module);
+    return by_module != 0 ? by_module : strcmp(x->name, y->name);
+}
+
+int profile_load(const char *path, ProfileData *profile) {
+    *profile = (ProfileData){0};
+    FILE *in = fopen(path, "r");
+    if (!in) {
+        fprintf(stderr, "Cannot open profile '%s'\n", path);
+        return 1;
+    }
+    const bool ok = parse_profile(in, path, profile);
+    fclose(in);
+    if (!ok) {
+        profile_free(profile);
+        return 1;
+    }
+
+    profile->index = malloc((profile->count ? profile->count : 1) * sizeof(ProfileEntry *));
+    if (!profile->index) {
+        fprintf(stderr, "Memory allocation failed in profile_load\n");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < profile->count; i++) profile->index[i] = &profile->entries[i];
+    qsort(profile->index, profile->count, sizeof(ProfileEntry *), compare_keys);
+    return 0;
+}
+
+const ProfileEntry *profile_find(const ProfileData *profile, const char *module, const char *name) {
+    if (!profile || !profile->index) return NULL;
+    const ProfileEntry key = {.module = (char *) module, .name = (char *) name};
+    const ProfileEntry *key_ptr = &key;
+    const ProfileEntry *const *found = bsearch(&key_ptr, profile->index, profile->count, sizeof(ProfileEntry *),
+                                               compare_keys);
+    if (found) return *found;
+
+    // A profile of the program before constant propagation counts a clone's calls under its original
+    const size_t len = strlen(name);
+    const size_t suffix_len = strlen(IPA_CLONE_SUFFIX);
+    if (len <= suffix_len || strcmp(name + len - suffix_len, IPA_CLONE_SUFFIX) != 0) return NULL;
+    char *original = strndup(name, len - suffix_len);
+    if (!original) {
+        fprintf(stderr, "Memory allocation failed in profile_find\n");
+        exit(EXIT_FAILURE);
+    }
+    const ProfileEntry *entry = profile_find(profile, module, original);
+    free(original);
+    return entry;
+}
+
+FunctionHeat profile_function_heat(const ProfileData *profile, const char *module, const char *name) {
+    const ProfileEntry *entry = profile_find(profile, module, name);
+    if (!entry) return HEAT_UNKNOWN;
+    return entry->calls > 0 ? HEAT_HOT : HEAT_COLD;
+}
+
+void profile_free(ProfileData *profile) {
+    for (size_t i = 0; i < profile->count; i++) {
+        free(profile->entries[i].module);
+        free(profile->entries[i].name);
+    }
+    free(profile->entries);
+    free(profile->index);
+    *profile = (ProfileData){0};
+}
+
+int profile_report(const char *path, FILE *out) {
+    ProfileData profile;
+    if (profile_load(path, &profile) != 0) return 1;
+
+    unsigned long long total_calls = 0, total_cycles = 0;
+    for (size_t i = 0; i < profile.count; i++) {
+        total_calls += profile.entries[i].calls;
+        total_cycles += profile.entries[i].cycles;
+    }
+    rank_by_cycles = profile.has_cycles;
+    qsort(profile.entries, profile.count, sizeof(ProfileEntry), compare_entries);
+
+    fprintf(out, "Profile report for %s (%zu functions, %llu calls", path, profile.count, total_calls);
+    if (profile.has_cycles) fprintf(out, ", %llu cycles", total_cycles);
+    fprintf(out, "):\n");
+    fprintf(out, "%12s %7s %14s %7s  %s\n", "calls", "calls%", "cycles", "cycles%", "function");
+
+    for (size_t i = 0; i < profile.count; i++) {
+        const ProfileEntry *e = &profile.entries[i];
+        fprintf(out, "%12llu %6.2f%% ", e->calls, percent(e->calls, total_calls));
+        if (profile.has_cycles) {
+            fprintf(out, "%14llu %6.2f%% ", e->cycles, percent(e->cycles, total_cycles));
+        } else {
+            fprintf(out, "%14s %7s ", "-", "-");
+        }
+        fprintf(out, " %s (%s:%d)\n", e->name, e->module, e->line);
+        if (e->calls > 0) print_source_line(out, e->module, e->line);
+    }
+
+    profile_free(&profile);
+    return 0;
+}
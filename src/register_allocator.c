@@ -4,206 +4,728 @@
  *
  * This file implements a register allocator using a simple linear scan strategy.
  * Each function has its own isolated register and stack context to prevent cross-function interference.
+ * Contexts are sized to the function and bump-allocated from an arena owned by
+ * the top-level function being allocated, which releases them all at once.
  * Live ranges of variables are tracked and registers are assigned accordingly, with spilling support.
  * Parameters are always loaded from the stack when used (for now).
  *
+ * Names were resolved before allocation: a variable is its slot in the
+ * symbol table (parameters first, then locals in declaration order), which
+ * indexes the per-function arrays directly.
+ *
+ * A variable holding a literal is rematerializable: when r4-r10 are full,
+ * such a variable loses its register first, without a stack slot, and its
+ * next use recomputes the literal with mov (or a literal pool load) instead
+ * of reloading it.
+ *
+ * Before a function is allocated, its sums are reordered to evaluate the
+ * operand needing the most registers first (see order_expr()).  When every
+ * register holds an operand still to be used, the oldest temporary is
+ * stored to a stack slot and its user reloads it; when all of them hold
+ * variables, one goes to its own slot the same way.
+ *
+ * Registers are freed before each statement when the value they hold is
+ * dead (past the end of its live interval, or a temporary of an earlier
+ * statement), so r4-r10 only run out when more values are live.
+ *
+ * Once a function is allocated, its stack slots are colored: a slot lives
+ * from the first to the last statement that accesses it, and slots whose
+ * intervals do not overlap share a frame word (a function body has no
+ * branches, so statement order is execution order).  Parameters that are
+ * never read get no slot.  The function node's stack_slot receives the
+ * number of words in its frame.
+ *
+ * When a report stream is given, the decisions of each function are also
+ * recorded (spills with their reason, pressure per statement) and written
+ * as JSON once the function is done.
+ *
+ * Functions are allocated independently, on several threads when
+ * RegallocOptions.jobs allows it: the per-function state below is
+ * thread-local and each function's report is written in source order.
  */
 
 #include "../include/register_allocator.h"
+#include "../include/work_queue.h"
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
-#include <string.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
-#define CONTEXT_STACK_MAX_DEPTH 32
-#define MAX_VARIABLES_PER_FUNCTION 64
+#define NO_VALUE        (-1) ///< Register owner: the register holds nothing
+#define TEMPORARY_VALUE (-2) ///< Register owner: the register holds an intermediate result
 
 /**
  * @brief Live range metadata for a variable.
  */
 typedef struct {
-    const char *var_name;
+    const char *var_name;      // Interned name, for reports
+    bool is_param;
     int start_idx, end_idx;
     int assigned_reg;          // Register allocated to this variable
     int current_value_reg;     // Register currently holding the variable's value (-1 if not in register)
     int stack_slot;
     bool is_spilled;
+    bool in_memory;            // The stack slot holds the current value
+    ASTNode *def_node;         // Declaration or assignment that computed the value in its register
+    const ASTNode *constant;   // Literal the variable currently holds, NULL if not rematerializable
+    int *uses;                 // Program points reading the variable, ascending
+    int use_count, use_cap;
+    int next_use;              // Index in uses of the next read to allocate
 } VariableLiveRange;
 
-/**
- * @brief Stack slot mapping for variables.
- */
-typedef struct {
-    const char *var_name;
-    int stack_slot;
-} StackSlot;
-
 /**
  * @brief Complete context for a function (registers + stack).
  */
 typedef struct {
-    // Register state
-    const char *reg_variable_map[MAX_REGISTERS];
+    // Register state: variable slot held by each register, NO_VALUE or TEMPORARY_VALUE
+    int reg_owner[MAX_REGISTERS];
     int reg_usage[MAX_REGISTERS];
+    int operand_pins[MAX_REGISTERS]; // Pending reads of each register by the statement being allocated
+    ASTNode *reg_node[MAX_REGISTERS]; // Expression whose temporary result is in each register, or NULL
+    int reg_serial[MAX_REGISTERS];    // Order in which those temporaries were computed
+    int temporary_serial;
+    ASTNode **pending_reads;          // Variable reads of the statement not consumed yet
+    int pending_read_count, pending_read_cap;
 
-    // Stack state
-    StackSlot stack_map[MAX_VARIABLES_PER_FUNCTION];
-    int stack_map_count;
+    // Stack state: stack slot of each variable slot, -1 if it has none
+    int *stack_map;
     int stack_slot_counter;
 
-    // Live ranges for this function
-    VariableLiveRange live_ranges[MAX_VARIABLES_PER_FUNCTION];
+    // Live ranges for this function, indexed by variable slot
+    VariableLiveRange *live_ranges;
     int live_range_count;
 } FunctionContext;
 
-static FunctionContext context_stack[CONTEXT_STACK_MAX_DEPTH];
-static int context_stack_top = 0;
+/**
+ * @brief A register taken from a live value because r4-r10 were all busy.
+ */
+typedef struct {
+    int point;                ///< Program point of the statement being allocated
+    int reg;                  ///< Register that was freed
+    int victim;               ///< Value that lost the register (variable slot or TEMPORARY_VALUE)
+    int requested_by;         ///< Value the register was given to
+    int stack_slot;           ///< Slot the victim lives in afterwards, -1 if it has none
+    bool already_in_memory;   ///< Victim was spilled before, nothing new was stored
+    bool rematerialized;      ///< Victim holds a literal, recomputed at its next use
+    bool operand;             ///< Victim is a variable the statement still reads, reloaded by its users
+} SpillEvent;
+
+/**
+ * @brief Register pressure after allocating one statement.
+ */
+typedef struct {
+    int point;    ///< Program point of the statement
+    int line;     ///< Source line of the statement
+    int live;     ///< Variables whose live interval overlaps the statement
+    int occupied; ///< Registers r4-r10 holding a value afterwards
+} PressurePoint;
+
+/**
+ * @brief Statements accessing one stack slot, before coloring.
+ */
+typedef struct {
+    int slot;  ///< Slot index as assigned during allocation
+    int first; ///< First program point accessing it, -1 if none does
+    int last;  ///< Last program point accessing it
+} SlotInterval;
+
+/**
+ * @brief Decisions recorded for the function being allocated.
+ */
+typedef struct {
+    SpillEvent *spills;
+    size_t spill_count;
+    size_t spill_cap;
+    PressurePoint *pressure;
+    size_t pressure_count;
+    size_t pressure_cap;
+    int current_point; ///< Program point of the statement being allocated
+
+    // Live interval bounds in ascending order, swept once by record_pressure
+    int *starts;
+    int *ends;
+    int interval_count;
+    int started;       ///< Intervals starting before the next statement ends
+    int ended;         ///< Intervals ending before the next statement starts
+} FunctionReport;
+
+/**
+ * @brief Block of a ContextArena.
+ */
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t size;          ///< Bytes available in data
+    size_t used;
+    max_align_t data[];
+} ArenaBlock;
+
+/**
+ * @brief Bump allocator for the contexts of one function and the functions nested in it.
+ *
+ * Everything is released at once when the function is done, so contexts
+ * are handed around by pointer and never copied or freed one by one.
+ */
+typedef struct {
+    ArenaBlock *head;     ///< Block being filled, linked to the full ones
+} ContextArena;
+
+#define ARENA_BLOCK_SIZE 16384
+
+static _Thread_local ContextArena *context_arena; ///< Arena of the function being allocated
 
-static void push_function_context(const FunctionContext *current) {
-    if (context_stack_top >= CONTEXT_STACK_MAX_DEPTH) {
-        fprintf(stderr, "Function context stack overflow\n");
+static const RegallocOptions *alloc_options;
+static _Thread_local FunctionReport function_report;
+static _Thread_local FILE *report_out;          ///< Receives the report of the function being allocated
+static _Thread_local bool first_reported_function;
+
+static void *grow_array(void *items, size_t *cap, const size_t item_size) {
+    *cap = *cap ? *cap * 2 : 16;
+    void *grown = realloc(items, *cap * item_size);
+    if (!grown) {
+        fprintf(stderr, "Memory allocation failed in register allocation\n");
         abort();
     }
-    context_stack[context_stack_top++] = *current;
+    return grown;
 }
 
-static void pop_function_context(FunctionContext *current) {
-    if (context_stack_top <= 0) {
-        fprintf(stderr, "Function context stack underflow\n");
-        abort();
+static void record_spill(const SpillEvent *event) {
+    if (!alloc_options->report) return;
+    FunctionReport *r = &function_report;
+    if (r->spill_count >= r->spill_cap) {
+        r->spills = grow_array(r->spills, &r->spill_cap, sizeof(SpillEvent));
     }
-    *current = context_stack[--context_stack_top];
+    r->spills[r->spill_count++] = *event;
 }
 
-static int find_live_range(const FunctionContext *ctx, const char *var_name) {
-    for (int i = 0; i < ctx->live_range_count; i++) {
-        if (strcmp(ctx->live_ranges[i].var_name, var_name) == 0)
-            return i;
+static void *arena_alloc(const size_t size) {
+    const size_t align = _Alignof(max_align_t);
+    const size_t rounded = (size + align - 1) / align * align;
+    ArenaBlock *block = context_arena->head;
+    if (!block || block->size - block->used < rounded) {
+        const size_t block_size = rounded > ARENA_BLOCK_SIZE ? rounded : ARENA_BLOCK_SIZE;
+        block = malloc(sizeof(ArenaBlock) + block_size);
+        if (!block) {
+            fprintf(stderr, "Memory allocation failed in register allocation\n");
+            abort();
+        }
+        *block = (ArenaBlock){.next = context_arena->head, .size = block_size};
+        context_arena->head = block;
     }
-    return -1;
+    void *item = (char *) block->data + block->used;
+    block->used += rounded;
+    return item;
 }
 
-static int add_live_range(FunctionContext *ctx, const char *var_name) {
-    // Check for duplicate variable in current function
-    if (find_live_range(ctx, var_name) != -1) {
-        fprintf(stderr, "Error: Redeclaration of variable '%s'\n", var_name);
-        abort();
+static void arena_free(ContextArena *arena) {
+    while (arena->head) {
+        ArenaBlock *next = arena->head->next;
+        free(arena->head);
+        arena->head = next;
     }
+}
 
-    const int idx = ctx->live_range_count++;
-    ctx->live_ranges[idx] = (VariableLiveRange){
-        .var_name = var_name,
-        .start_idx = -1,
-        .end_idx = -1,
-        .assigned_reg = -1,
-        .current_value_reg = -1,
-        .stack_slot = -1,
-        .is_spilled = false
-    };
-    return idx;
+/* Variable slot of a resolved identifier or declaration */
+static int variable_of(const ASTNode *node) {
+    return symbol_get(alloc_options->symbols, node->symbol_id)->slot;
 }
 
-static int find_stack_slot(const FunctionContext *ctx, const char *var_name) {
-    for (int i = 0; i < ctx->stack_map_count; i++) {
-        if (strcmp(ctx->stack_map[i].var_name, var_name) == 0) {
-            return ctx->stack_map[i].stack_slot;
-        }
-    }
-    return -1;
+/* Name of a register owner, as written in reports */
+static const char *value_name(const FunctionContext *ctx, const int owner) {
+    return owner >= 0 ? ctx->live_ranges[owner].var_name : "add_result";
 }
 
-static void add_stack_slot(FunctionContext *ctx, const char *var_name) {
-    // Check for duplicate variable in stack
-    if (find_stack_slot(ctx, var_name) != -1) {
-        fprintf(stderr, "Error: Redeclaration of variable '%s'\n", var_name);
-        abort();
-    }
+/* An empty context for a function's parameters and locals, from the arena */
+static FunctionContext *new_function_context(const ASTNode *fn) {
+    const SymbolTable *symbols = alloc_options->symbols;
+    const Symbol *function = symbol_get(symbols, fn->symbol_id);
 
-    const int slot = ctx->stack_slot_counter++;
-    ctx->stack_map[ctx->stack_map_count++] = (StackSlot){
-        .var_name = var_name,
-        .stack_slot = slot
+    FunctionContext *ctx = arena_alloc(sizeof(FunctionContext));
+    *ctx = (FunctionContext){
+        .stack_map = arena_alloc(function->local_count * sizeof(int)),
+        .live_ranges = arena_alloc(function->local_count * sizeof(VariableLiveRange))
     };
+    for (int r = 0; r < MAX_REGISTERS; r++) ctx->reg_owner[r] = NO_VALUE;
+    ctx->live_range_count = function->local_count;
+    for (int i = 0; i < function->local_count; i++) {
+        const Symbol *var = symbol_get(symbols, function->first_local + i);
+        ctx->stack_map[i] = -1;
+        ctx->live_ranges[i] = (VariableLiveRange){
+            .var_name = var->name,
+            .is_param = var->kind == SYMBOL_PARAMETER,
+            .start_idx = -1,
+            .end_idx = -1,
+            .assigned_reg = -1,
+            .current_value_reg = -1,
+            .stack_slot = -1,
+            .is_spilled = false
+        };
+    }
+    return ctx;
+}
+
+static void add_stack_slot(FunctionContext *ctx, const int var) {
+    ctx->stack_map[var] = ctx->stack_slot_counter++;
 }
 
 /**
  * @brief Update the current register holding a variable's value
  *
  * @param ctx Function context
- * @param var_name Variable name
+ * @param var Variable slot
  * @param reg Register currently holding the value (-1 if not in register)
  */
-static void update_variable_location(FunctionContext *ctx, const char *var_name, const int reg) {
-    const int lr = find_live_range(ctx, var_name);
-    if (lr != -1) {
-        ctx->live_ranges[lr].current_value_reg = reg;
+static void update_variable_location(FunctionContext *ctx, const int var, const int reg) {
+    ctx->live_ranges[var].current_value_reg = reg;
+}
+
+/* Record a read of a variable at a program point (points arrive in ascending order) */
+static void add_use(VariableLiveRange *lr, const int point) {
+    if (lr->use_count >= lr->use_cap) {
+        // Outgrown arrays stay in the arena: at most as many bytes as the final one
+        lr->use_cap = lr->use_cap ? lr->use_cap * 2 : 4;
+        int *grown = arena_alloc(lr->use_cap * sizeof(int));
+        if (lr->use_count) memcpy(grown, lr->uses, lr->use_count * sizeof(int));
+        lr->uses = grown;
     }
+    lr->uses[lr->use_count++] = point;
 }
 
-static void annotate_live_ranges(ASTNode *node, int *idx, FunctionContext *ctx) {
+/* Remember a variable read of the current statement until its user consumes it */
+static void add_pending_read(FunctionContext *ctx, ASTNode *node) {
+    if (ctx->pending_read_count >= ctx->pending_read_cap) {
+        ctx->pending_read_cap = ctx->pending_read_cap ? ctx->pending_read_cap * 2 : 8;
+        ASTNode **grown = arena_alloc(ctx->pending_read_cap * sizeof(ASTNode *));
+        if (ctx->pending_read_count) memcpy(grown, ctx->pending_reads, ctx->pending_read_count * sizeof(ASTNode *));
+        ctx->pending_reads = grown;
+    }
+    ctx->pending_reads[ctx->pending_read_count++] = node;
+}
+
+static void remove_pending_read(FunctionContext *ctx, const ASTNode *node) {
+    for (int i = ctx->pending_read_count - 1; i >= 0; i--) {
+        if (ctx->pending_reads[i] != node) continue;
+        ctx->pending_reads[i] = ctx->pending_reads[--ctx->pending_read_count];
+        return;
+    }
+}
+
+static void annotate_live_ranges(ASTNode *node, int *idx, FunctionContext *ctx, const bool is_read) {
     if (!node) return;
 
+    if (node->type == NODE_FUNCTION) {
+        // The function's own name (children[0]) is not a variable
+        *idx += 2;
+        for (size_t i = 1; i < node->child_count; i++) {
+            annotate_live_ranges(node->children[i], idx, ctx, true);
+        }
+        return;
+    }
+
     if (node->type == NODE_VAR_DECL) {
-        const char *var = node->children[0]->token.lexeme;
-        int lr = find_live_range(ctx, var);
-        if (lr == -1) lr = add_live_range(ctx, var);
+        const int lr = variable_of(node->children[0]);
         ctx->live_ranges[lr].start_idx = *idx;
         ctx->live_ranges[lr].end_idx = *idx;
     }
 
     if (node->type == NODE_IDENTIFIER) {
-        const char *var = node->token.lexeme;
-        int lr = find_live_range(ctx, var);
-        if (lr == -1) lr = add_live_range(ctx, var);
+        const int lr = variable_of(node);
         if (ctx->live_ranges[lr].start_idx == -1)
             ctx->live_ranges[lr].start_idx = *idx;
         if (ctx->live_ranges[lr].end_idx < *idx)
             ctx->live_ranges[lr].end_idx = *idx;
+        if (is_read) add_use(&ctx->live_ranges[lr], *idx);
     }
 
+    // The name a declaration or assignment writes is not a read
+    const bool writes_first = node->type == NODE_VAR_DECL || node->type == NODE_ASSIGNMENT;
     (*idx)++;
     for (size_t i = 0; i < node->child_count; i++) {
-        annotate_live_ranges(node->children[i], idx, ctx);
+        annotate_live_ranges(node->children[i], idx, ctx, !(writes_first && i == 0));
     }
 }
 
-static int find_variable_in_registers(const char *var_name, const FunctionContext *ctx) {
-    for (int i = FIRST_VAR_REGISTER; i <= 11; i++) {
-        if (ctx->reg_variable_map[i] && strcmp(ctx->reg_variable_map[i], var_name) == 0) {
-            return i;
+/* Literal an initializer or assigned value always equals, NULL if it is not a constant */
+static const ASTNode *constant_of(const ASTNode *expr, const FunctionContext *ctx) {
+    if (expr->type == NODE_INT_LITERAL) return expr;
+    if (expr->type == NODE_IDENTIFIER) return ctx->live_ranges[variable_of(expr)].constant;
+    return NULL;
+}
+
+/* Program point of a variable's next read, INT_MAX if it is never read again */
+static int next_use(const VariableLiveRange *lr) {
+    return lr->next_use < lr->use_count ? lr->uses[lr->next_use] : INT_MAX;
+}
+
+static void release_register(FunctionContext *ctx, const int reg) {
+    ctx->reg_owner[reg] = NO_VALUE;
+    ctx->reg_usage[reg] = 0;
+    ctx->operand_pins[reg] = 0;
+    ctx->reg_node[reg] = NULL;
+}
+
+/**
+ * @brief Free the registers of values no statement reads any more.
+ *
+ * Called before each statement: temporaries only live within the
+ * statement that computes them, and a variable is dead once it has no
+ * read left.
+ *
+ * @param ctx Function context
+ */
+static void expire_registers(FunctionContext *ctx) {
+    for (int i = FIRST_VAR_REGISTER; i <= LAST_VAR_REGISTER; i++) {
+        const int owner = ctx->reg_owner[i];
+        if (owner == NO_VALUE) continue;
+        if (owner >= 0) {
+            if (next_use(&ctx->live_ranges[owner]) != INT_MAX) continue;
+            if (ctx->live_ranges[owner].current_value_reg == i) update_variable_location(ctx, owner, -1);
         }
+        release_register(ctx, i);
     }
-    return -1;
 }
 
-static int allocate_register(const char *for_var, FunctionContext *ctx, int *spilled_slot) {
-    for (int i = FIRST_VAR_REGISTER; i <= 11; i++) {
-        if (!ctx->reg_usage[i]) {
-            ctx->reg_usage[i] = 1;
-            ctx->reg_variable_map[i] = for_var;
-            return i;
+/*
+ * Order of eviction candidates: values never read again, then literals
+ * (recomputed for one mov), then the value read furthest in the future
+ * (Belady).  Ties go to a value already in its stack slot (no store),
+ * then to the one with fewer reads left.
+ */
+static bool better_victim(const FunctionContext *ctx, const int reg, const int best) {
+    if (best == -1) return true;
+    const int a = ctx->reg_owner[reg];
+    const int b = ctx->reg_owner[best];
+    const VariableLiveRange *x = a >= 0 ? &ctx->live_ranges[a] : NULL;
+    const VariableLiveRange *y = b >= 0 ? &ctx->live_ranges[b] : NULL;
+
+    const int x_rank = !x || next_use(x) == INT_MAX ? 0 : x->constant ? 1 : 2;
+    const int y_rank = !y || next_use(y) == INT_MAX ? 0 : y->constant ? 1 : 2;
+    if (x_rank != y_rank) return x_rank < y_rank;
+    if (x_rank == 0) return false;
+    if (next_use(x) != next_use(y)) return next_use(x) > next_use(y);
+    if (x->in_memory != y->in_memory) return x->in_memory;
+    return x->use_count - x->next_use < y->use_count - y->next_use;
+}
+
+/**
+ * @brief Take a register from the value in it.
+ *
+ * A variable that is still read later moves to the stack: the declaration
+ * or assignment that computed its value also stores it to the variable's
+ * slot, so the value survives in memory from then on.  Later reads reload
+ * it into a register, where it stays until it is evicted again (its live
+ * range is split at each eviction).
+ *
+ * A variable the statement still reads from the register is put in its
+ * slot as well, if it is not there yet, and those reads are reloaded from
+ * the slot by their users, like stored temporaries.
+ */
+static void evict_register(FunctionContext *ctx, const int reg, const int for_var) {
+    const int victim = ctx->reg_owner[reg];
+    if (victim >= 0 && ctx->operand_pins[reg]) {
+        VariableLiveRange *lr = &ctx->live_ranges[victim];
+        const bool store = !lr->in_memory;
+        if (store) {
+            if (!lr->def_node) {
+                fprintf(stderr, "Register allocation failed: '%s' has no value to store\n", lr->var_name);
+                abort();
+            }
+            if (ctx->stack_map[victim] == -1) add_stack_slot(ctx, victim);
+            lr->def_node->requires_store = true;
+            lr->def_node->stack_slot = ctx->stack_map[victim];
+            lr->in_memory = true;
+            lr->is_spilled = true;
+            lr->stack_slot = ctx->stack_map[victim];
+        }
+        for (int i = ctx->pending_read_count - 1; i >= 0; i--) {
+            ASTNode *read = ctx->pending_reads[i];
+            if (read->register_assigned != reg) continue;
+            read->requires_store = true;
+            read->stack_slot = ctx->stack_map[victim];
+            ctx->pending_reads[i] = ctx->pending_reads[--ctx->pending_read_count];
+        }
+        record_spill(&(SpillEvent){
+            .point = function_report.current_point,
+            .reg = reg,
+            .victim = victim,
+            .requested_by = for_var,
+            .stack_slot = ctx->stack_map[victim],
+            .already_in_memory = !store,
+            .operand = true
+        });
+        if (lr->current_value_reg == reg) update_variable_location(ctx, victim, -1);
+    } else if (victim >= 0) {
+        VariableLiveRange *lr = &ctx->live_ranges[victim];
+        if (next_use(lr) != INT_MAX) {
+            const bool store = !lr->constant && !lr->in_memory && lr->def_node;
+            if (store) {
+                if (ctx->stack_map[victim] == -1) add_stack_slot(ctx, victim);
+                lr->def_node->requires_store = true;
+                lr->def_node->stack_slot = ctx->stack_map[victim];
+                lr->in_memory = true;
+                lr->is_spilled = true;
+                lr->stack_slot = ctx->stack_map[victim];
+            }
+            record_spill(&(SpillEvent){
+                .point = function_report.current_point,
+                .reg = reg,
+                .victim = victim,
+                .requested_by = for_var,
+                .stack_slot = lr->constant ? -1 : ctx->stack_map[victim],
+                .already_in_memory = !store && !lr->constant,
+                .rematerialized = lr->constant != NULL
+            });
         }
+        if (lr->current_value_reg == reg) update_variable_location(ctx, victim, -1);
+    } else if (ctx->reg_node[reg]) {
+        // The user of the temporary reloads it into its own destination register
+        ASTNode *temporary = ctx->reg_node[reg];
+        temporary->requires_store = true;
+        temporary->stack_slot = ctx->stack_slot_counter++;
+        record_spill(&(SpillEvent){
+            .point = function_report.current_point,
+            .reg = reg,
+            .victim = victim,
+            .requested_by = for_var,
+            .stack_slot = temporary->stack_slot
+        });
     }
+    release_register(ctx, reg);
+}
 
-    for (int i = FIRST_VAR_REGISTER; i <= 11; i++) {
-        const char *spilled_var = ctx->reg_variable_map[i];
-        if (spilled_var) {
-            const int lr = find_live_range(ctx, spilled_var);
-            if (lr != -1 && !ctx->live_ranges[lr].is_spilled) {
-                ctx->live_ranges[lr].is_spilled = true;
-                ctx->live_ranges[lr].stack_slot = ctx->stack_slot_counter;
-                add_stack_slot(ctx, spilled_var);
-                if (spilled_slot) *spilled_slot = ctx->live_ranges[lr].stack_slot;
+static int allocate_register(const int for_var, FunctionContext *ctx) {
+    int reg = -1;
+    for (int i = FIRST_VAR_REGISTER; i <= LAST_VAR_REGISTER && reg == -1; i++) {
+        if (!ctx->reg_usage[i]) reg = i;
+    }
+
+    if (reg == -1) {
+        // Operands of the statement being allocated are read from their registers
+        for (int i = FIRST_VAR_REGISTER; i <= LAST_VAR_REGISTER; i++) {
+            if (!ctx->operand_pins[i] && better_victim(ctx, i, reg)) reg = i;
+        }
+        // Every register holds an operand: the oldest temporary, used last, goes to the stack
+        if (reg == -1) {
+            for (int i = FIRST_VAR_REGISTER; i <= LAST_VAR_REGISTER; i++) {
+                if (ctx->reg_node[i] && (reg == -1 || ctx->reg_serial[i] < ctx->reg_serial[reg])) reg = i;
             }
-            ctx->reg_usage[i] = 0;
-            ctx->reg_variable_map[i] = NULL;
-            ctx->reg_usage[i] = 1;
-            ctx->reg_variable_map[i] = for_var;
-            return i;
         }
+        // Only variables: one of them goes to its slot and its reads are reloaded
+        if (reg == -1) {
+            for (int i = FIRST_VAR_REGISTER; i <= LAST_VAR_REGISTER; i++) {
+                if (better_victim(ctx, i, reg)) reg = i;
+            }
+        }
+        evict_register(ctx, reg, for_var);
+    }
+
+    ctx->reg_usage[reg] = 1;
+    ctx->reg_owner[reg] = for_var;
+    return reg;
+}
+
+/* Free the register of a temporary once the node consuming it is allocated */
+static void consume_operand(FunctionContext *ctx, const ASTNode *operand) {
+    const int reg = operand->register_assigned;
+    if (reg < FIRST_VAR_REGISTER || operand->requires_store) return; // A stored operand gave its register up
+    if (operand->type == NODE_IDENTIFIER) remove_pending_read(ctx, operand);
+    if (ctx->reg_owner[reg] == TEMPORARY_VALUE) {
+        release_register(ctx, reg);
+    } else if (ctx->operand_pins[reg] > 0) {
+        ctx->operand_pins[reg]--;
     }
+}
 
-    return FIRST_VAR_REGISTER;
+/* Whether a subtree contains a call, whose side effects fix its place among the operands of a sum */
+static bool has_call(const ASTNode *node) {
+    if (node->type == NODE_FUNCTION_CALL) return true;
+    for (size_t i = 0; i < node->child_count; i++) {
+        if (has_call(node->children[i])) return true;
+    }
+    return false;
+}
+
+/* Collect the operands and the additions of a chain of `+`, left to right */
+static void flatten_sum(ASTNode *node, ASTNode **operands, int *operand_count, ASTNode **adds, int *add_count) {
+    if (node->type != NODE_ADD) {
+        operands[(*operand_count)++] = node;
+        return;
+    }
+    adds[(*add_count)++] = node;
+    flatten_sum(node->children[0], operands, operand_count, adds, add_count);
+    flatten_sum(node->children[1], operands, operand_count, adds, add_count);
+}
+
+static pthread_mutex_t intern_lock = PTHREAD_MUTEX_INITIALIZER; ///< Functions are allocated on several threads
+
+/* Lexeme of a folded literal, interned in the symbol table, which outlives the AST */
+static char *literal_lexeme(const int32_t value) {
+    char text[16];
+    snprintf(text, sizeof(text), "%" PRId32, value);
+    pthread_mutex_lock(&intern_lock);
+    const char *lexeme = symbol_intern(alloc_options->symbols, text);
+    pthread_mutex_unlock(&intern_lock);
+    return (char *) lexeme;
+}
+
+static _Thread_local const int *sort_needs; ///< Needs of the operands sorted by compare_needs
+
+/* Decreasing need, then source order */
+static int compare_needs(const void *a, const void *b) {
+    const int x = *(const int *) a;
+    const int y = *(const int *) b;
+    if (sort_needs[x] != sort_needs[y]) return sort_needs[x] > sort_needs[y] ? -1 : 1;
+    return (x > y) - (x < y);
+}
+
+static int count_adds(const ASTNode *node) {
+    if (node->type != NODE_ADD) return 0;
+    return 1 + count_adds(node->children[0]) + count_adds(node->children[1]);
+}
+
+/**
+ * @brief Reorder an expression to need as few registers as possible.
+ *
+ * Each chain of `+` is flattened into its operands, which are ordered by
+ * their Sethi-Ullman (Ershov) number, the registers needed to evaluate
+ * them: the hungriest operand goes first, while no register is held yet,
+ * and every other one is evaluated with only the running sum held.  Calls
+ * keep their relative order, since they may have side effects; a variable
+ * read commutes with them (callees cannot write the caller's locals).
+ * Literal operands are folded into one, added last as an immediate.  The
+ * chain is rebuilt left-deep from its own nodes, so only the running sum
+ * is ever held however long the chain is.  A balanced tree would shorten
+ * the chain of dependent additions, but holds one more temporary per level,
+ * which r4-r10 pay for in spills.
+ *
+ * @param node Expression to reorder.
+ * @param need Receives the registers needed by the result.
+ * @return     The reordered expression, which replaces node in its parent.
+ */
+static ASTNode *order_expr(ASTNode *node, int *need) {
+    switch (node->type) {
+        case NODE_INT_LITERAL:
+            *need = 0;
+            return node;
+        case NODE_IDENTIFIER:
+            *need = 1;
+            return node;
+        case NODE_FUNCTION_CALL: {
+            // Arguments are evaluated in order and held until the call
+            int held = 0;
+            *need = 1;
+            for (size_t i = 0; i < node->child_count; i++) {
+                int arg_need;
+                node->children[i] = order_expr(node->children[i], &arg_need);
+                if (arg_need == 0) continue;
+                if (arg_need + held > *need) *need = arg_need + held;
+                held++;
+            }
+            return node;
+        }
+        case NODE_ADD:
+            break;
+        default:
+            *need = 0;
+            return node;
+    }
+
+    const int add_count = count_adds(node);
+    ASTNode **adds = arena_alloc((size_t) add_count * sizeof(ASTNode *));
+    ASTNode **operands = arena_alloc((size_t) (add_count + 1) * sizeof(ASTNode *));
+    int *needs = arena_alloc((size_t) (add_count + 1) * sizeof(int));
+    int operand_count = 0;
+    int flattened_adds = 0;
+    flatten_sum(node, operands, &operand_count, adds, &flattened_adds);
+
+    // Fold the literals into the first one, with the target's 32-bit wraparound
+    ASTNode *literal = NULL;
+    uint32_t sum = 0;
+    int kept = 0;
+    for (int i = 0; i < operand_count; i++) {
+        ASTNode *operand = operands[i];
+        if (operand->type == NODE_INT_LITERAL) {
+            sum += (uint32_t) operand->token.literal.int_value;
+            if (literal) free_ast(operand);
+            else literal = operand;
+            continue;
+        }
+        operands[kept] = order_expr(operand, &needs[kept]);
+        kept++;
+    }
+    if (literal) {
+        literal->token.literal.int_value = (int32_t) sum;
+        literal->token.lexeme = literal_lexeme((int32_t) sum);
+    }
+
+    // Operands with calls keep their order; the others are sorted by decreasing need
+    int *calls = arena_alloc((size_t) (kept + 1) * sizeof(int));
+    int *others = arena_alloc((size_t) (kept + 1) * sizeof(int));
+    int call_count = 0;
+    int other_count = 0;
+    for (int i = 0; i < kept; i++) {
+        if (has_call(operands[i])) calls[call_count++] = i;
+        else others[other_count++] = i;
+    }
+    sort_needs = needs;
+    qsort(others, (size_t) other_count, sizeof(int), compare_needs);
+
+    // Merge by decreasing need; on a tie the call goes first, its result is the running sum
+    ASTNode **ordered = arena_alloc((size_t) (kept + 1) * sizeof(ASTNode *));
+    int *ordered_needs = arena_alloc((size_t) (kept + 1) * sizeof(int));
+    int ordered_count = 0;
+    for (int c = 0, o = 0; c < call_count || o < other_count;) {
+        const bool take_call = o == other_count || (c < call_count && needs[calls[c]] >= needs[others[o]]);
+        const int i = take_call ? calls[c++] : others[o++];
+        ordered[ordered_count] = operands[i];
+        ordered_needs[ordered_count++] = needs[i];
+    }
+    if (literal && (sum != 0 || ordered_count == 0)) {
+        ordered[ordered_count] = literal;
+        ordered_needs[ordered_count++] = 0;
+    } else if (literal) {
+        free_ast(literal);
+    }
+
+    // Rebuild left-deep, reusing the chain's additions; the spare ones are freed
+    ASTNode *root = ordered[0];
+    *need = ordered_needs[0];
+    for (int i = 1; i < ordered_count; i++) {
+        ASTNode *add = adds[i - 1];
+        add->children[0] = root;
+        add->children[1] = ordered[i];
+        root = add;
+        if (ordered_needs[i] + 1 > *need) *need = ordered_needs[i] + 1;
+    }
+    for (int i = ordered_count - 1; i < add_count; i++) {
+        adds[i]->child_count = 0;
+        free_ast(adds[i]);
+    }
+    return root;
+}
+
+/* Reorder the expression a statement evaluates */
+static void order_statement(ASTNode *stmt) {
+    size_t value;
+    switch (stmt->type) {
+        case NODE_VAR_DECL: value = 2; break;
+        case NODE_ASSIGNMENT: value = 1; break;
+        case NODE_RETURN:
+        case NODE_EXPRESSION: value = 0; break;
+        default: return;
+    }
+    if (stmt->child_count <= value) return;
+    int need;
+    stmt->children[value] = order_expr(stmt->children[value], &need);
+}
+
+static void hold_temporary(FunctionContext *ctx, ASTNode *node) {
+    ctx->reg_node[node->register_assigned] = node;
+    ctx->reg_serial[node->register_assigned] = ctx->temporary_serial++;
 }
 
 static void allocate_expr(ASTNode *node, FunctionContext *ctx) {
@@ -214,12 +736,11 @@ static void allocate_expr(ASTNode *node, FunctionContext *ctx) {
             node->register_assigned = -1;
             break;
         case NODE_IDENTIFIER: {
-            const char *var = node->token.lexeme;
-            int reg = find_variable_in_registers(var, ctx);
-            int lr = find_live_range(ctx, var);
-            if (lr == -1) lr = add_live_range(ctx, var);
+            const int var = variable_of(node);
+            VariableLiveRange *lr = &ctx->live_ranges[var];
+            lr->next_use++;
 
-            const int current_reg = ctx->live_ranges[lr].current_value_reg;
+            const int current_reg = lr->current_value_reg;
             if (current_reg != -1) {
                 node->register_assigned = current_reg;
                 node->source_register = current_reg;
@@ -227,66 +748,369 @@ static void allocate_expr(ASTNode *node, FunctionContext *ctx) {
                 break;
             }
 
-            const int stack_slot = find_stack_slot(ctx, var);
-            if (stack_slot != -1) {
-                if (reg == -1) {
-                    reg = allocate_register(var, ctx, NULL);
-                }
-                node->register_assigned = reg;
+            // Not in a register: recompute a literal, reload anything else
+            const int reg = allocate_register(var, ctx);
+            node->register_assigned = reg;
+            node->source_register = -1;
+            if (lr->constant) {
+                node->rematerialize = lr->constant;
+            } else if (ctx->stack_map[var] != -1) {
                 node->requires_load = true;
-                node->stack_slot = stack_slot;
-                node->source_register = -1;
-                update_variable_location(ctx, var, reg);
-            } else if (reg != -1) {
-                node->register_assigned = reg;
-                node->requires_load = ctx->live_ranges[lr].is_spilled;
-                node->stack_slot = ctx->live_ranges[lr].is_spilled ?
-                                   ctx->live_ranges[lr].stack_slot : -1;
-                node->source_register = node->requires_load ? -1 : reg;
-                if (!node->requires_load) {
-                    update_variable_location(ctx, var, reg);
-                }
-            } else {
-                reg = allocate_register(var, ctx, NULL);
-                node->register_assigned = reg;
-                node->requires_load = ctx->live_ranges[lr].is_spilled;
-                node->stack_slot = ctx->live_ranges[lr].is_spilled ?
-                                   ctx->live_ranges[lr].stack_slot : -1;
-                node->source_register = node->requires_load ? -1 : reg;
-                if (!node->requires_load) {
-                    update_variable_location(ctx, var, reg);
-                }
+                node->stack_slot = ctx->stack_map[var];
             }
+            update_variable_location(ctx, var, reg);
             break;
         }
         case NODE_ADD: {
             allocate_expr(node->children[0], ctx);
             allocate_expr(node->children[1], ctx);
+            consume_operand(ctx, node->children[0]);
+            consume_operand(ctx, node->children[1]);
 
             // Allocate register for result
-            int spilled_slot = -1;
-            const char *result_var = "add_result";
-            const int reg = allocate_register(result_var, ctx, &spilled_slot);
-            node->register_assigned = reg;
+            node->register_assigned = allocate_register(TEMPORARY_VALUE, ctx);
+            hold_temporary(ctx, node);
             break;
         }
         case NODE_FUNCTION_CALL:
             for (size_t i = 0; i < node->child_count; i++)
                 allocate_expr(node->children[i], ctx);
-            node->register_assigned = 0;
+            for (size_t i = 0; i < node->child_count; i++)
+                consume_operand(ctx, node->children[i]);
+
+            // The result arrives in r0, which the next call overwrites
+            node->register_assigned = allocate_register(TEMPORARY_VALUE, ctx);
+            hold_temporary(ctx, node);
             break;
         default:
             break;
     }
+
+    // A variable read twice in one expression stays pinned until both reads are consumed
+    if (node->register_assigned >= FIRST_VAR_REGISTER) {
+        ctx->operand_pins[node->register_assigned]++;
+        if (node->type == NODE_IDENTIFIER) add_pending_read(ctx, node);
+    }
+}
+
+/**
+ * @brief Allocate the value a declaration or assignment writes to a variable.
+ *
+ * The value is computed straight into the variable's register, except for
+ * an identifier, which keeps its own register and is copied.
+ */
+static int allocate_definition(ASTNode *node, const int var, ASTNode *expr, FunctionContext *ctx) {
+    allocate_expr(expr, ctx);
+    const ASTNode *constant = constant_of(expr, ctx);
+    consume_operand(ctx, expr);
+
+    VariableLiveRange *lr = &ctx->live_ranges[var];
+    int reg = lr->current_value_reg;
+    if (reg == -1) reg = allocate_register(var, ctx);
+
+    node->register_assigned = reg;
+    node->requires_store = false;
+    if (expr->type != NODE_IDENTIFIER) expr->register_assigned = reg;
+    lr->assigned_reg = reg;
+    lr->in_memory = false;
+    lr->def_node = node;
+    lr->constant = constant;
+    update_variable_location(ctx, var, reg);
+    return reg;
+}
+
+/* Number of nodes in a subtree, i.e. the program points it spans */
+static int count_nodes(const ASTNode *node) {
+    if (!node) return 0;
+    int count = 1;
+    for (size_t i = 0; i < node->child_count; i++) count += count_nodes(node->children[i]);
+    return count;
+}
+
+/* Extend a slot's interval to a program point */
+static void touch_slot(SlotInterval *intervals, const int slot, const int point) {
+    SlotInterval *iv = &intervals[slot];
+    if (iv->first == -1 || point < iv->first) iv->first = point;
+    if (point > iv->last) iv->last = point;
+}
+
+/*
+ * Record the stack accesses of a statement's subtree: loads happen before
+ * the statement's store, so they are placed at its first point and stores at its last.
+ * A temporary stored and reloaded within the statement, or a variable
+ * reloaded by the user of a read, spans all of it.
+ */
+static void collect_slot_accesses(const ASTNode *node, const int first, const int last, SlotInterval *intervals) {
+    if (!node) return;
+    if (node->requires_load) touch_slot(intervals, node->stack_slot, first);
+    if (node->requires_store) touch_slot(intervals, node->stack_slot, last);
+    if (node->requires_store && (node->type == NODE_ADD || node->type == NODE_FUNCTION_CALL ||
+                                 node->type == NODE_IDENTIFIER)) {
+        touch_slot(intervals, node->stack_slot, first);
+    }
+    for (size_t i = 0; i < node->child_count; i++) {
+        collect_slot_accesses(node->children[i], first, last, intervals);
+    }
+}
+
+/* Rename the slots accessed in a subtree */
+static void rename_slots(ASTNode *node, const int *color) {
+    if (!node) return;
+    if (node->requires_load || node->requires_store) node->stack_slot = color[node->stack_slot];
+    for (size_t i = 0; i < node->child_count; i++) rename_slots(node->children[i], color);
+}
+
+static int compare_intervals(const void *a, const void *b) {
+    const SlotInterval *x = a;
+    const SlotInterval *y = b;
+    if (x->first != y->first) return x->first < y->first ? -1 : 1;
+    return (x->slot > y->slot) - (x->slot < y->slot);
+}
+
+/* Min-heap of ints ordered by key[item], or by the items themselves when key is NULL */
+static void heap_push(int *heap, int *count, const int item, const int *key) {
+    int i = (*count)++;
+    while (i > 0) {
+        const int parent = (i - 1) / 2;
+        if ((key ? key[heap[parent]] : heap[parent]) <= (key ? key[item] : item)) break;
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i] = item;
+}
+
+static int heap_pop(int *heap, int *count, const int *key) {
+    const int top = heap[0];
+    const int last = heap[--(*count)];
+    int i = 0;
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= *count) break;
+        if (child + 1 < *count && (key ? key[heap[child + 1]] : heap[child + 1]) < (key ? key[heap[child]] : heap[child])) {
+            child++;
+        }
+        if ((key ? key[last] : last) <= (key ? key[heap[child]] : heap[child])) break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = last;
+    return top;
+}
+
+/**
+ * @brief Pack a function's stack slots by interval coloring.
+ *
+ * Slots are taken in order of their first access and each gets the lowest
+ * frame word whose previous slot is no longer accessed (interval graphs are
+ * colored optimally this way).  Words in use wait in a heap ordered by the
+ * last access of their slot and move to a heap of free words once it is
+ * passed, so each slot is placed in logarithmic time.
+ *
+ * @param fn  Function node, after allocation.
+ * @param ctx Its allocation context.
+ */
+static void color_stack_slots(ASTNode *fn, FunctionContext *ctx) {
+    const int slot_count = ctx->stack_slot_counter;
+    SlotInterval *intervals = malloc((slot_count ? slot_count : 1) * sizeof(SlotInterval));
+    int *color = malloc((slot_count ? slot_count : 1) * sizeof(int));
+    int *word_end = malloc((slot_count ? slot_count : 1) * sizeof(int)); // Last point of each word's current slot
+    int *busy = malloc((slot_count ? slot_count : 1) * sizeof(int));     // Words by word_end
+    int *free_words = malloc((slot_count ? slot_count : 1) * sizeof(int));
+    if (!intervals || !color || !word_end || !busy || !free_words) {
+        fprintf(stderr, "Memory allocation failed in stack slot coloring\n");
+        abort();
+    }
+    for (int i = 0; i < slot_count; i++) intervals[i] = (SlotInterval){.slot = i, .first = -1, .last = -1};
+
+    // Same program points as annotate_live_ranges; parameters are stored on entry, at point 0
+    int point = 1;
+    for (size_t i = 0; i < fn->child_count; i++) {
+        const ASTNode *child = fn->children[i];
+        const int size = count_nodes(child);
+        if (child->type == NODE_TYPE_PARAM) {
+            const int param = variable_of(child);
+            if (ctx->live_ranges[param].start_idx != -1) touch_slot(intervals, ctx->stack_map[param], 0);
+        } else {
+            collect_slot_accesses(child, point, point + size - 1, intervals);
+        }
+        point += size;
+    }
+
+    qsort(intervals, slot_count, sizeof(SlotInterval), compare_intervals);
+    int words = 0;
+    int busy_count = 0;
+    int free_count = 0;
+    for (int i = 0; i < slot_count; i++) {
+        const SlotInterval *iv = &intervals[i];
+        if (iv->first == -1) {
+            color[iv->slot] = -1;
+            continue;
+        }
+        while (busy_count > 0 && word_end[busy[0]] < iv->first) {
+            heap_push(free_words, &free_count, heap_pop(busy, &busy_count, word_end), NULL);
+        }
+        const int word = free_count > 0 ? heap_pop(free_words, &free_count, NULL) : words++;
+        word_end[word] = iv->last;
+        heap_push(busy, &busy_count, word, word_end);
+        color[iv->slot] = word;
+    }
+
+    for (size_t i = 0; i < fn->child_count; i++) {
+        ASTNode *child = fn->children[i];
+        if (child->type == NODE_TYPE_PARAM) {
+            child->stack_slot = color[ctx->stack_map[variable_of(child)]];
+        } else {
+            rename_slots(child, color);
+        }
+    }
+    for (int i = 0; i < ctx->live_range_count; i++) {
+        if (ctx->stack_map[i] != -1) ctx->stack_map[i] = color[ctx->stack_map[i]];
+        if (ctx->live_ranges[i].stack_slot != -1) ctx->live_ranges[i].stack_slot = color[ctx->live_ranges[i].stack_slot];
+    }
+    for (size_t i = 0; i < function_report.spill_count; i++) {
+        SpillEvent *e = &function_report.spills[i];
+        if (e->stack_slot != -1) e->stack_slot = color[e->stack_slot];
+    }
+    fn->stack_slot = words;
+
+    free(intervals);
+    free(color);
+    free(word_end);
+    free(busy);
+    free(free_words);
+}
+
+static int compare_points(const void *a, const void *b) {
+    const int x = *(const int *) a;
+    const int y = *(const int *) b;
+    return (x > y) - (x < y);
+}
+
+/* Sort the bounds of the function's live intervals for record_pressure */
+static void prepare_pressure(const FunctionContext *ctx) {
+    if (!alloc_options->report) return;
+
+    FunctionReport *report = &function_report;
+    const size_t count = ctx->live_range_count ? (size_t) ctx->live_range_count : 1;
+    report->starts = malloc(count * sizeof(int));
+    report->ends = malloc(count * sizeof(int));
+    if (!report->starts || !report->ends) {
+        fprintf(stderr, "Memory allocation failed in register allocation\n");
+        abort();
+    }
+    for (int i = 0; i < ctx->live_range_count; i++) {
+        const VariableLiveRange *lr = &ctx->live_ranges[i];
+        if (lr->start_idx == -1) continue;
+        report->starts[report->interval_count] = lr->start_idx;
+        report->ends[report->interval_count++] = lr->end_idx;
+    }
+    qsort(report->starts, report->interval_count, sizeof(int), compare_points);
+    qsort(report->ends, report->interval_count, sizeof(int), compare_points);
+}
+
+/*
+ * Statements are recorded in order, so the intervals overlapping one (those
+ * started by its last point minus those ended before its first) are counted
+ * by advancing two cursors over the sorted bounds.
+ */
+static void record_pressure(const FunctionContext *ctx, const ASTNode *stmt, const int first, const int last) {
+    if (!alloc_options->report) return;
+
+    FunctionReport *report = &function_report;
+    while (report->started < report->interval_count && report->starts[report->started] <= last) report->started++;
+    while (report->ended < report->interval_count && report->ends[report->ended] < first) report->ended++;
+
+    PressurePoint p = {.point = first, .line = stmt->token.line, .live = report->started - report->ended};
+    for (int r = FIRST_VAR_REGISTER; r <= LAST_VAR_REGISTER; r++) {
+        if (ctx->reg_usage[r]) p.occupied++;
+    }
+
+    if (report->pressure_count >= report->pressure_cap) {
+        report->pressure = grow_array(report->pressure, &report->pressure_cap, sizeof(PressurePoint));
+    }
+    report->pressure[report->pressure_count++] = p;
+}
+
+/* Why a variable lives in memory, or NULL if it stays in registers */
+static const char *memory_reason(const VariableLiveRange *lr, const bool is_param) {
+    if (is_param) return "parameter: kept in its stack slot and reloaded on every use";
+    if (lr->is_spilled) {
+        return "evicted: no free register in r4-r10 and its next read was the furthest away; stored where it is defined";
+    }
+    return NULL;
+}
+
+static void write_function_report(const ASTNode *fn, const FunctionContext *ctx) {
+    FILE *out = report_out;
+    FunctionReport *report = &function_report;
+
+    fprintf(out, "%s{\"name\":\"%s\",\"frame_words\":%d,\"variables\":[", first_reported_function ? "" : ",",
+            fn->children[0]->token.lexeme, fn->stack_slot);
+    first_reported_function = false;
+
+    bool first_variable = true;
+    for (int i = 0; i < ctx->live_range_count; i++) {
+        const VariableLiveRange *lr = &ctx->live_ranges[i];
+        if (lr->start_idx == -1) continue; // Parameter never used
+        const bool is_param = lr->is_param;
+        const int slot = is_param ? ctx->stack_map[i] : (lr->is_spilled ? lr->stack_slot : -1);
+        const char *reason = memory_reason(lr, is_param);
+
+        fprintf(out, "%s{\"name\":\"%s\",\"kind\":\"%s\",\"interval\":[%d,%d],\"register\":",
+                first_variable ? "" : ",", lr->var_name, is_param ? "parameter" : "local", lr->start_idx, lr->end_idx);
+        first_variable = false;
+        if (lr->assigned_reg >= 0) fprintf(out, "\"r%d\"", lr->assigned_reg);
+        else fprintf(out, "null");
+        fprintf(out, ",\"spilled\":%s,\"stack_slot\":", lr->is_spilled ? "true" : "false");
+        if (slot >= 0) fprintf(out, "%d", slot);
+        else fprintf(out, "null");
+        fprintf(out, ",\"reason\":");
+        if (reason) fprintf(out, "\"%s\"}", reason);
+        else fprintf(out, "null}");
+    }
+
+    fprintf(out, "],\"spills\":[");
+    for (size_t i = 0; i < report->spill_count; i++) {
+        const SpillEvent *e = &report->spills[i];
+        const bool temporary = e->victim < 0;
+        fprintf(out, "%s{\"point\":%d,\"register\":\"r%d\",\"victim\":\"%s\",\"temporary\":%s,"
+                "\"requested_by\":\"%s\",\"stack_slot\":",
+                i ? "," : "", e->point, e->reg, value_name(ctx, e->victim), temporary ? "true" : "false",
+                value_name(ctx, e->requested_by));
+        if (e->stack_slot >= 0) fprintf(out, "%d", e->stack_slot);
+        else fprintf(out, "null");
+        fprintf(out, ",\"reason\":\"%s\"}",
+                temporary ? "every register in r4-r10 holds an operand; the oldest temporary is stored and reloaded by its user"
+                : e->operand ? "every register in r4-r10 holds a variable being read; the variable is stored if needed and its reads are reloaded by their users"
+                : e->rematerialized ? "no free register in r4-r10; a register holding a literal is freed, the literal is recomputed at its next use"
+                : e->already_in_memory ? "no free register in r4-r10; the value read furthest away is already in its stack slot"
+                : "no free register in r4-r10; the value read furthest away is stored to its stack slot");
+    }
+
+    fprintf(out, "],\"pressure\":[");
+    for (size_t i = 0; i < report->pressure_count; i++) {
+        const PressurePoint *p = &report->pressure[i];
+        fprintf(out, "%s{\"point\":%d,\"line\":%d,\"live\":%d,\"occupied\":%d}",
+                i ? "," : "", p->point, p->line, p->live, p->occupied);
+    }
+    fprintf(out, "]}");
+
+    free(report->spills);
+    free(report->pressure);
+    free(report->starts);
+    free(report->ends);
+    *report = (FunctionReport){0};
 }
 
 static void allocate_registers(ASTNode *node, int *idx, FunctionContext *ctx, const bool show_registers) {
     if (!node) return;
 
     if (node->type == NODE_FUNCTION) {
-        // Save parent context
-        push_function_context(ctx);
-        FunctionContext child_ctx = {0};
+        // A nested function gets its own context; the enclosing one is left as is
+        FunctionContext *fn_ctx = new_function_context(node);
+
+        // Expressions are put in evaluation order before their program points are numbered
+        for (size_t i = 0; i < node->child_count; ++i) order_statement(node->children[i]);
 
         // Process parameters first
         int param_count = 0;
@@ -294,29 +1118,45 @@ static void allocate_registers(ASTNode *node, int *idx, FunctionContext *ctx, co
             const ASTNode *child = node->children[i];
             if (child->type == NODE_TYPE_PARAM) {
                 param_count++;
-                const char *param_name = child->token.lexeme;
-                // Allocate stack slot for parameter
-                add_stack_slot(&child_ctx, param_name);
+                const int param = variable_of(child);
+                // Allocate stack slot for parameter: the prologue stores it there
+                add_stack_slot(fn_ctx, param);
+                fn_ctx->live_ranges[param].in_memory = true;
                 if (show_registers) {
                     printf("Parameter '%s' assigned to stack slot %d\n",
-                           param_name, child_ctx.stack_map[child_ctx.stack_map_count-1].stack_slot);
+                           child->token.lexeme, fn_ctx->stack_map[param]);
                 }
             }
         }
-        child_ctx.stack_slot_counter = param_count;
+        fn_ctx->stack_slot_counter = param_count;
 
         // Annotate live ranges for this function
         int func_idx = 0;
-        annotate_live_ranges(node, &func_idx, &child_ctx);
+        annotate_live_ranges(node, &func_idx, fn_ctx, true);
+        prepare_pressure(fn_ctx);
 
         // Allocate registers for function body
         func_idx = 0;
+        int point = 1; // Preorder index of the current child, as numbered by annotate_live_ranges
         for (size_t i = 0; i < node->child_count; ++i) {
-            allocate_registers(node->children[i], &func_idx, &child_ctx, show_registers);
+            const int size = count_nodes(node->children[i]);
+            function_report.current_point = point;
+            memset(fn_ctx->operand_pins, 0, sizeof(fn_ctx->operand_pins));
+            fn_ctx->pending_read_count = 0;
+            expire_registers(fn_ctx);
+            allocate_registers(node->children[i], &func_idx, fn_ctx, show_registers);
+            if (i > 0 && node->children[i]->type != NODE_TYPE_PARAM &&
+                node->children[i]->type != NODE_RETURN_INT_TYPE) {
+                record_pressure(fn_ctx, node->children[i], point, point + size - 1);
+            }
+            point += size;
         }
 
-        // Restore parent context
-        pop_function_context(ctx);
+        color_stack_slots(node, fn_ctx);
+
+        if (alloc_options->report) {
+            write_function_report(node, fn_ctx);
+        }
         return;
     }
 
@@ -325,77 +1165,22 @@ static void allocate_registers(ASTNode *node, int *idx, FunctionContext *ctx, co
             // Parameters are handled in NODE_FUNCTION case
             break;
         case NODE_VAR_DECL: {
-            const char *var = node->children[0]->token.lexeme;
-            const int lr = find_live_range(ctx, var);
-            ASTNode *expr = node->children[2];
-            allocate_expr(expr, ctx);
-
-            int spilled_slot = -1;
-            const int reg = allocate_register(var, ctx, &spilled_slot);
-            node->register_assigned = reg;
-            ctx->reg_variable_map[reg] = var;
-            ctx->reg_usage[reg] = 1;
-            if (lr != -1) {
-                ctx->live_ranges[lr].assigned_reg = reg;
-                ctx->live_ranges[lr].current_value_reg = reg;
-            }
-
-            expr->register_assigned = reg;
-
-            if (spilled_slot != -1) {
-                node->requires_store = true;
-                node->stack_slot = spilled_slot;
-                ctx->live_ranges[lr].is_spilled = true;
-                ctx->live_ranges[lr].stack_slot = spilled_slot;
-                update_variable_location(ctx, var, -1); // Value not in register after store
-            } else {
-                node->requires_store = false;
-                update_variable_location(ctx, var, reg);
-            }
-
+            const int var = variable_of(node->children[0]);
+            const int reg = allocate_definition(node, var, node->children[2], ctx);
             if (show_registers) {
-                const char *loc_type = "register r";
-                int loc = reg;
-                if (node->requires_store) {
-                    loc_type = "stack slot ";
-                    loc = node->stack_slot;
-                }
-                printf("Variable '%s' assigned to %s%d\n", var, loc_type, loc);
+                printf("Variable '%s' assigned to register r%d\n", ctx->live_ranges[var].var_name, reg);
             }
             break;
         }
+        case NODE_ASSIGNMENT:
+            allocate_definition(node, variable_of(node->children[0]), node->children[1], ctx);
+            break;
         case NODE_RETURN:
+        case NODE_EXPRESSION:
             if (node->child_count > 0) {
                 allocate_expr(node->children[0], ctx);
             }
             break;
-        case NODE_FUNCTION_CALL:
-            for (size_t i = 0; i < node->child_count; i++) {
-                allocate_expr(node->children[i], ctx);
-            }
-            node->register_assigned = 0;
-            break;
-        case NODE_ASSIGNMENT: {
-            const char *var = node->children[0]->token.lexeme;
-            ASTNode *expr = node->children[1];
-            allocate_expr(expr, ctx);
-
-            int reg = find_variable_in_registers(var, ctx);
-            const int lr = find_live_range(ctx, var);
-            if (lr == -1) {
-                fprintf(stderr, "Error: Assignment to undeclared variable '%s'\n", var);
-                abort();
-            }
-
-            if (reg == -1) {
-                reg = allocate_register(var, ctx, NULL);
-            }
-
-            node->register_assigned = reg;
-            expr->register_assigned = reg;
-            update_variable_location(ctx, var, reg);
-            break;
-        }
         default:
             for (size_t i = 0; i < node->child_count; i++) {
                 allocate_registers(node->children[i], idx, ctx, show_registers);
@@ -406,8 +1191,55 @@ static void allocate_registers(ASTNode *node, int *idx, FunctionContext *ctx, co
     (*idx)++;
 }
 
-void register_allocate_ast(ASTNode *node, const bool show_registers) {
-    FunctionContext root_ctx = {0};
+/**
+ * @brief The functions of a module, allocated as the items of a work queue.
+ */
+typedef struct {
+    ASTNode **functions;
+    bool show_registers;
+} ModuleFunctions;
+
+static void allocate_function_item(void *context, const size_t index, FILE *out) {
+    const ModuleFunctions *module = context;
+    ContextArena arena = {0};
     int idx = 0;
-    allocate_registers(node, &idx, &root_ctx, show_registers);
+    report_out = out;
+    first_reported_function = index == 0;
+    context_arena = &arena;
+    allocate_registers(module->functions[index], &idx, NULL, module->show_registers);
+    context_arena = NULL;
+    arena_free(&arena);
+}
+
+void register_allocate_ast(ASTNode *node, const RegallocOptions *options) {
+    alloc_options = options;
+
+    ModuleFunctions module = {
+        .functions = malloc((node->child_count ? node->child_count : 1) * sizeof(ASTNode *)),
+        .show_registers = options->show_registers
+    };
+    if (!module.functions) {
+        fprintf(stderr, "Memory allocation failed in register_allocate_ast\n");
+        abort();
+    }
+    size_t function_count = 0;
+    for (size_t i = 0; i < node->child_count; i++) {
+        if (node->children[i]->type == NODE_FUNCTION) module.functions[function_count++] = node->children[i];
+    }
+
+    if (options->report) {
+        fprintf(options->report, "{\"module\":\"");
+        for (const char *c = options->module ? options->module : ""; *c; c++) {
+            if (*c == '"' || *c == '\\') fputc('\\', options->report);
+            fputc(*c, options->report);
+        }
+        fprintf(options->report, "\",\"functions\":[");
+    }
+    // The --show-registers trace goes to stdout as it is made, so it keeps one thread
+    const int jobs = options->show_registers ? 1 : options->jobs;
+    work_queue_run(function_count, jobs, allocate_function_item, &module, options->report);
+    free(module.functions);
+    if (options->report) {
+        fprintf(options->report, "]}\n");
+    }
 }
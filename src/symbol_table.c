@@ -0,0 +1,340 @@
+/**
+ * @file symbol_table.c
+ * @brief Interned names, hashed scopes and name resolution for BasicCodeCompiler.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "../include/symbol_table.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_SLOTS 16
+
+static void *checked_calloc(const size_t count, const size_t size) {
+    void *p = calloc(count ? count : 1, size);
+    if (!p) {
+        fprintf(stderr, "Memory allocation failed in symbol table\n");
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+static void *checked_realloc(void *p, const size_t size) {
+    void *grown = realloc(p, size);
+    if (!grown) {
+        fprintf(stderr, "Memory allocation failed in symbol table\n");
+        exit(EXIT_FAILURE);
+    }
+    return grown;
+}
+
+static size_t hash_string(const char *s) {
+    uint32_t hash = 2166136261u;
+    for (; *s; s++) {
+        hash ^= (unsigned char) *s;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* Interned names are unique, so scopes hash their address */
+static size_t hash_pointer(const char *p) {
+    uintptr_t v = (uintptr_t) p;
+    v ^= v >> 17;
+    v *= 0xed5ad4bbu;
+    v ^= v >> 11;
+    return (size_t) v;
+}
+
+/* Slot of name in the intern table: where it is, or the empty slot it would go in */
+static size_t intern_slot(const InternTable *names, const char *name) {
+    size_t slot = hash_string(name) & (names->slot_count - 1);
+    while (names->slots[slot] && strcmp(names->slots[slot], name) != 0) {
+        slot = (slot + 1) & (names->slot_count - 1);
+    }
+    return slot;
+}
+
+static void intern_grow(InternTable *names) {
+    char **old = names->slots;
+    const size_t old_count = names->slot_count;
+    names->slot_count = old_count ? old_count * 2 : 64;
+    names->slots = checked_calloc(names->slot_count, sizeof(char *));
+    for (size_t i = 0; i < old_count; i++) {
+        if (old[i]) names->slots[intern_slot(names, old[i])] = old[i];
+    }
+    free(old);
+}
+
+/* Canonical copy of name, or NULL if it was never interned */
+static const char *find_interned(const InternTable *names, const char *name) {
+    if (names->slot_count == 0) return NULL;
+    return names->slots[intern_slot(names, name)];
+}
+
+const char *symbol_intern(SymbolTable *table, const char *name) {
+    InternTable *names = &table->names;
+    if ((names->used + 1) * 2 > names->slot_count) intern_grow(names);
+    const size_t slot = intern_slot(names, name);
+    if (!names->slots[slot]) {
+        names->slots[slot] = strdup(name);
+        if (!names->slots[slot]) {
+            fprintf(stderr, "Memory allocation failed in symbol_intern\n");
+            exit(EXIT_FAILURE);
+        }
+        names->used++;
+    }
+    return names->slots[slot];
+}
+
+/* Slot of an interned name in a scope: where its symbol is, or the empty slot it would go in */
+static size_t scope_slot(const SymbolTable *table, const Scope *scope, const char *name) {
+    size_t slot = hash_pointer(name) & (scope->slot_count - 1);
+    while (scope->slots[slot] != SYMBOL_NONE && table->symbols[scope->slots[slot]].name != name) {
+        slot = (slot + 1) & (scope->slot_count - 1);
+    }
+    return slot;
+}
+
+static void scope_grow(const SymbolTable *table, Scope *scope) {
+    int *old = scope->slots;
+    const size_t old_count = scope->slot_count;
+    scope->slot_count = old_count * 2;
+    scope->slots = checked_calloc(scope->slot_count, sizeof(int));
+    memset(scope->slots, 0xff, scope->slot_count * sizeof(int)); // SYMBOL_NONE
+    for (size_t i = 0; i < old_count; i++) {
+        if (old[i] != SYMBOL_NONE) {
+            scope->slots[scope_slot(table, scope, table->symbols[old[i]].name)] = old[i];
+        }
+    }
+    free(old);
+}
+
+void symbol_table_init(SymbolTable *table) {
+    memset(table, 0, sizeof(*table));
+    table->current_scope = -1;
+}
+
+void symbol_table_free(SymbolTable *table) {
+    for (size_t i = 0; i < table->names.slot_count; i++) free(table->names.slots[i]);
+    free(table->names.slots);
+    for (size_t i = 0; i < table->scope_count; i++) free(table->scopes[i].slots);
+    free(table->scopes);
+    free(table->symbols);
+    symbol_table_init(table);
+}
+
+int symbol_scope_push(SymbolTable *table, const int owner) {
+    if (table->scope_count >= table->scope_cap) {
+        table->scope_cap = table->scope_cap ? table->scope_cap * 2 : 16;
+        table->scopes = checked_realloc(table->scopes, table->scope_cap * sizeof(Scope));
+    }
+    const int index = (int) table->scope_count++;
+    Scope *scope = &table->scopes[index];
+    *scope = (Scope){
+        .parent = table->current_scope,
+        .depth = table->current_scope == -1 ? 0 : table->scopes[table->current_scope].depth + 1,
+        .owner = owner,
+        .slots = checked_calloc(INITIAL_SLOTS, sizeof(int)),
+        .slot_count = INITIAL_SLOTS
+    };
+    memset(scope->slots, 0xff, INITIAL_SLOTS * sizeof(int)); // SYMBOL_NONE
+    table->current_scope = index;
+    return index;
+}
+
+void symbol_scope_pop(SymbolTable *table) {
+    if (table->current_scope != -1) {
+        table->current_scope = table->scopes[table->current_scope].parent;
+    }
+}
+
+int symbol_declare(SymbolTable *table, const char *name, const SymbolKind kind, const int line) {
+    const char *interned = symbol_intern(table, name);
+    Scope *scope = &table->scopes[table->current_scope];
+    if ((scope->used + 1) * 2 > scope->slot_count) scope_grow(table, scope);
+
+    const size_t slot = scope_slot(table, scope, interned);
+    if (scope->slots[slot] != SYMBOL_NONE) return SYMBOL_NONE;
+
+    if (table->symbol_count >= table->symbol_cap) {
+        table->symbol_cap = table->symbol_cap ? table->symbol_cap * 2 : 64;
+        table->symbols = checked_realloc(table->symbols, table->symbol_cap * sizeof(Symbol));
+    }
+    const int id = (int) table->symbol_count++;
+    Symbol *symbol = &table->symbols[id];
+    *symbol = (Symbol){
+        .name = interned,
+        .kind = kind,
+        .line = line,
+        .scope = table->current_scope,
+        .slot = -1,
+        .first_local = SYMBOL_NONE
+    };
+
+    // Parameters and locals are numbered within the function owning the scope
+    if (kind != SYMBOL_FUNCTION && scope->owner != SYMBOL_NONE) {
+        Symbol *function = &table->symbols[scope->owner];
+        if (function->first_local == SYMBOL_NONE) function->first_local = id;
+        symbol->slot = function->local_count++;
+    }
+
+    scope->slots[slot] = id;
+    scope->used++;
+    return id;
+}
+
+int symbol_lookup(const SymbolTable *table, const char *name) {
+    const char *interned = find_interned(&table->names, name);
+    if (!interned) return SYMBOL_NONE;
+    for (int s = table->current_scope; s != -1; s = table->scopes[s].parent) {
+        const Scope *scope = &table->scopes[s];
+        const int id = scope->slots[scope_slot(table, scope, interned)];
+        if (id != SYMBOL_NONE) return id;
+    }
+    return SYMBOL_NONE;
+}
+
+const Symbol *symbol_get(const SymbolTable *table, const int id) {
+    return id >= 0 && (size_t) id < table->symbol_count ? &table->symbols[id] : NULL;
+}
+
+static void resolution_error(const SymbolTable *table, const ASTNode *fn, const ASTNode *node,
+                             const char *fmt, const char *name) {
+    char message[256];
+    snprintf(message, sizeof(message), fmt, name);
+    if (table->on_error) {
+        table->on_error(table->error_context, fn, node, message);
+    } else {
+        fprintf(stderr, "Error (Line %d): %s\n", node->token.line, message);
+    }
+}
+
+static int current_depth(const SymbolTable *table) {
+    return table->scopes[table->current_scope].depth;
+}
+
+/* Resolve the variables used by an expression */
+static size_t resolve_expr(SymbolTable *table, const ASTNode *fn, ASTNode *node) {
+    size_t errors = 0;
+    node->scope_depth = current_depth(table);
+
+    switch (node->type) {
+        case NODE_IDENTIFIER: {
+            const int id = symbol_lookup(table, node->token.lexeme);
+            if (id == SYMBOL_NONE || table->symbols[id].kind == SYMBOL_FUNCTION) {
+                resolution_error(table, fn, node, "Use of undeclared variable '%s'", node->token.lexeme);
+                return 1;
+            }
+            node->symbol_id = id;
+            return 0;
+        }
+        case NODE_FUNCTION_CALL: {
+            const int id = symbol_lookup(table, node->token.lexeme);
+            node->symbol_id = id != SYMBOL_NONE && table->symbols[id].kind == SYMBOL_FUNCTION ? id : SYMBOL_NONE;
+            break;
+        }
+        default:
+            break;
+    }
+    for (size_t i = 0; i < node->child_count; i++) {
+        errors += resolve_expr(table, fn, node->children[i]);
+    }
+    return errors;
+}
+
+/* Declare the variable named by a declaring node; false on redeclaration */
+static bool declare_variable(SymbolTable *table, const ASTNode *fn, ASTNode *node, const SymbolKind kind) {
+    const int id = symbol_declare(table, node->token.lexeme, kind, node->token.line);
+    if (id == SYMBOL_NONE) {
+        resolution_error(table, fn, node, "Redeclaration of variable '%s'", node->token.lexeme);
+        return false;
+    }
+    node->symbol_id = id;
+    node->scope_depth = current_depth(table);
+    return true;
+}
+
+size_t symbol_resolve_function(SymbolTable *table, ASTNode *fn) {
+    size_t errors = 0;
+    Symbol *function = &table->symbols[fn->symbol_id];
+    const int enclosing = table->current_scope;
+    function->first_local = SYMBOL_NONE;
+    function->local_count = 0;
+    table->current_scope = function->scope;
+    symbol_scope_push(table, fn->symbol_id);
+
+    for (size_t i = 1; i < fn->child_count; i++) {
+        ASTNode *stmt = fn->children[i];
+        stmt->scope_depth = current_depth(table);
+
+        switch (stmt->type) {
+            case NODE_TYPE_PARAM:
+                if (!declare_variable(table, fn, stmt, SYMBOL_PARAMETER)) errors++;
+                break;
+            case NODE_VAR_DECL:
+                // The initializer cannot see the variable it initializes
+                errors += resolve_expr(table, fn, stmt->children[2]);
+                stmt->children[1]->scope_depth = current_depth(table);
+                if (declare_variable(table, fn, stmt->children[0], SYMBOL_LOCAL)) {
+                    stmt->symbol_id = stmt->children[0]->symbol_id;
+                } else {
+                    errors++;
+                }
+                break;
+            case NODE_ASSIGNMENT: {
+                errors += resolve_expr(table, fn, stmt->children[1]);
+                ASTNode *target = stmt->children[0];
+                const int id = symbol_lookup(table, target->token.lexeme);
+                target->scope_depth = current_depth(table);
+                if (id == SYMBOL_NONE || table->symbols[id].kind == SYMBOL_FUNCTION) {
+                    resolution_error(table, fn, target, "Assignment to undeclared variable '%s'", target->token.lexeme);
+                    errors++;
+                } else {
+                    target->symbol_id = stmt->symbol_id = id;
+                }
+                break;
+            }
+            default:
+                for (size_t c = 0; c < stmt->child_count; c++) {
+                    errors += resolve_expr(table, fn, stmt->children[c]);
+                }
+                break;
+        }
+    }
+
+    table->current_scope = enclosing;
+    return errors;
+}
+
+size_t symbol_resolve_ast(SymbolTable *table, ASTNode *root) {
+    size_t errors = 0;
+    symbol_scope_push(table, SYMBOL_NONE);
+
+    // Functions are visible from every function, whatever the order of definition
+    for (size_t i = 0; i < root->child_count; i++) {
+        ASTNode *fn = root->children[i];
+        if (fn->type != NODE_FUNCTION) continue;
+
+        ASTNode *name = fn->children[0];
+        const int id = symbol_declare(table, name->token.lexeme, SYMBOL_FUNCTION, name->token.line);
+        if (id == SYMBOL_NONE) {
+            resolution_error(table, fn, name, "Multiple definitions of function '%s'", name->token.lexeme);
+            errors++;
+            continue;
+        }
+        fn->symbol_id = name->symbol_id = id;
+    }
+
+    for (size_t i = 0; i < root->child_count; i++) {
+        ASTNode *fn = root->children[i];
+        if (fn->type == NODE_FUNCTION && fn->symbol_id != SYMBOL_NONE) {
+            errors += symbol_resolve_function(table, fn);
+        }
+    }
+
+    symbol_scope_pop(table);
+    return errors;
+}
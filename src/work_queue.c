@@ -0,0 +1,115 @@
+/**
+ * @file work_queue.c
+ * @brief Ordered parallel work queue for BasicCodeCompiler.
+ *
+ * Threads take the next item index under a mutex.  A finished item's buffer
+ * is kept until every earlier item is written; whichever thread completes
+ * the oldest pending item writes it and every finished item after it.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "../include/work_queue.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/**
+ * @brief Output of one item, held until it can be written in order.
+ */
+typedef struct {
+    char *text;
+    size_t length;
+    bool done;
+} ItemOutput;
+
+/**
+ * @brief State shared by the threads of one run.
+ */
+typedef struct {
+    WorkItemFn work;
+    void *context;
+    FILE *out;
+    size_t count;
+    ItemOutput *outputs;   ///< One per item, when there is an output stream
+    size_t next_item;      ///< Next item to hand out
+    size_t next_written;   ///< Oldest item not written yet
+    pthread_mutex_t lock;
+} WorkQueue;
+
+int work_queue_default_jobs(void) {
+    const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (int) cores : 1;
+}
+
+/* Store a finished item and write every finished item that is next in order */
+static void finish_item(WorkQueue *queue, const size_t index, char *text, const size_t length) {
+    pthread_mutex_lock(&queue->lock);
+    queue->outputs[index] = (ItemOutput){.text = text, .length = length, .done = true};
+    while (queue->next_written < queue->count && queue->outputs[queue->next_written].done) {
+        ItemOutput *ready = &queue->outputs[queue->next_written++];
+        fwrite(ready->text, 1, ready->length, queue->out);
+        free(ready->text);
+        ready->text = NULL;
+    }
+    pthread_mutex_unlock(&queue->lock);
+}
+
+static void *work_loop(void *arg) {
+    WorkQueue *queue = arg;
+    while (true) {
+        pthread_mutex_lock(&queue->lock);
+        const size_t index = queue->next_item++;
+        pthread_mutex_unlock(&queue->lock);
+        if (index >= queue->count) return NULL;
+
+        if (!queue->out) {
+            queue->work(queue->context, index, NULL);
+            continue;
+        }
+
+        char *text = NULL;
+        size_t length = 0;
+        FILE *buffer = open_memstream(&text, &length);
+        if (!buffer) {
+            fprintf(stderr, "Memory allocation failed in work_loop\n");
+            exit(EXIT_FAILURE);
+        }
+        queue->work(queue->context, index, buffer);
+        fclose(buffer);
+        finish_item(queue, index, text, length);
+    }
+}
+
+void work_queue_run(const size_t count, int jobs, const WorkItemFn work, void *context, FILE *out) {
+    if (jobs > 1 && (size_t) jobs > count) jobs = (int) count;
+    if (jobs <= 1) {
+        for (size_t i = 0; i < count; i++) work(context, i, out);
+        return;
+    }
+
+    WorkQueue queue = {.work = work, .context = context, .out = out, .count = count};
+    if (out) {
+        queue.outputs = calloc(count, sizeof(ItemOutput));
+        if (!queue.outputs) {
+            fprintf(stderr, "Memory allocation failed in work_queue_run\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    pthread_mutex_init(&queue.lock, NULL);
+
+    // The caller is one of the workers; a thread that fails to start leaves its share to the others
+    pthread_t *threads = malloc((size_t) (jobs - 1) * sizeof(pthread_t));
+    int started = 0;
+    if (threads) {
+        while (started < jobs - 1 && pthread_create(&threads[started], NULL, work_loop, &queue) == 0) {
+            started++;
+        }
+    }
+    work_loop(&queue);
+    for (int i = 0; i < started; i++) pthread_join(threads[i], NULL);
+
+    free(threads);
+    pthread_mutex_destroy(&queue.lock);
+    free(queue.outputs);
+}
@@ -0,0 +1,41 @@
+/**
+ * @file alloc_counter.c
+ * @brief Allocation counting shim for the complexity benchmark (liballoc_counter.so).
+ *
+ * Loaded with LD_PRELOAD, it interposes malloc, calloc and realloc and
+ * counts every call.  bcc looks up bcc_alloc_count() at run time and, when
+ * present, reports the number of allocations made by each compiler phase in
+ * `--time-report`.  Requires glibc, whose allocator entry points are
+ * reachable as __libc_malloc and friends.
+ */
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static atomic_ulong allocation_count;
+
+/**
+ * @brief Number of malloc, calloc and realloc calls made by the process so far.
+ */
+unsigned long bcc_alloc_count(void) {
+    return atomic_load_explicit(&allocation_count, memory_order_relaxed);
+}
+
+void *malloc(const size_t size) {
+    atomic_fetch_add_explicit(&allocation_count, 1, memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(const size_t count, const size_t size) {
+    atomic_fetch_add_explicit(&allocation_count, 1, memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, const size_t size) {
+    atomic_fetch_add_explicit(&allocation_count, 1, memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
@@ -0,0 +1,324 @@
+/**
+ * @file bcgen.c
+ * @brief Seeded generator of large valid .bc programs (bcgen).
+ *
+ * Used by the scaling report to find where bcc stops scaling linearly.
+ * Every dimension that stresses a different part of the compiler can be
+ * set independently: number of functions, locals per function, expression
+ * depth, import fan-out and target file size.
+ *
+ * Generated programs are valid and terminate: functions only call "leaf"
+ * functions (the first eighth of the main module, and every function of an
+ * imported module), and leaves call nothing, so a run costs linear time.
+ * main calls every function of the main module and prints the sum, which
+ * makes the output usable as a differential test between `bcc --run` and
+ * the ARM backend.
+ */
+
+#include <getopt.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_PARAMS 4
+
+/**
+ * @brief Generator settings from the command line.
+ */
+typedef struct {
+    uint64_t seed;
+    int functions;        ///< Functions per module
+    int locals;           ///< `let` declarations per function
+    int expr_depth;       ///< Nesting depth of generated expressions
+    int imports;          ///< Number of imported modules
+    long target_size;     ///< Minimum size in bytes of the main module, 0 to ignore
+    const char *out_dir;  ///< Output directory, NULL for stdout
+} GeneratorOptions;
+
+/**
+ * @brief A callable function known to the generator.
+ */
+typedef struct {
+    char name[32];
+    int param_count;
+} Callee;
+
+/**
+ * @brief Growable list of functions.
+ */
+typedef struct {
+    Callee *items;
+    int count;
+    int cap;
+} CalleeList;
+
+/**
+ * @brief Generation state for one output file.
+ */
+typedef struct {
+    FILE *out;
+    long bytes;              ///< Bytes written so far
+    uint64_t rng;
+    const GeneratorOptions *opts;
+
+    CalleeList callees;      ///< Leaf functions callable from the module being generated
+    CalleeList defined;      ///< Every function defined in the module
+
+    int param_count;         ///< Parameters of the current function
+    int local_count;         ///< Locals declared so far in the current function
+    bool allow_calls;        ///< False while generating a leaf function
+} Generator;
+
+/* xorshift64*: small, fast and identical on every platform */
+static uint64_t next_random(Generator *gen) {
+    gen->rng ^= gen->rng >> 12;
+    gen->rng ^= gen->rng << 25;
+    gen->rng ^= gen->rng >> 27;
+    return gen->rng * 2685821657736338717ULL;
+}
+
+static int random_below(Generator *gen, const int bound) {
+    return bound > 0 ? (int) (next_random(gen) % (uint64_t) bound) : 0;
+}
+
+static void emit(Generator *gen, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    const int n = vfprintf(gen->out, fmt, args);
+    va_end(args);
+    if (n > 0) gen->bytes += n;
+}
+
+static void add_callee(CalleeList *list, const char *name, const int param_count) {
+    if (list->count >= list->cap) {
+        list->cap = list->cap ? list->cap * 2 : 64;
+        list->items = realloc(list->items, list->cap * sizeof(Callee));
+        if (!list->items) {
+            fprintf(stderr, "Memory allocation failed in add_callee\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    Callee *c = &list->items[list->count++];
+    snprintf(c->name, sizeof(c->name), "%s", name);
+    c->param_count = param_count;
+}
+
+/* Emit a variable visible in the current function, or a literal if none is */
+static void emit_operand(Generator *gen) {
+    const int visible = gen->param_count + gen->local_count;
+    if (visible == 0 || random_below(gen, 4) == 0) {
+        emit(gen, "%d", random_below(gen, 100));
+        return;
+    }
+    const int pick = random_below(gen, visible);
+    if (pick < gen->param_count) {
+        emit(gen, "p%d", pick);
+    } else {
+        emit(gen, "v%d", pick - gen->param_count);
+    }
+}
+
+/*
+ * Emit an expression nested depth levels deep.  The grammar has no
+ * parentheses, so nesting comes from call arguments; each level is a
+ * two-term addition chain whose terms are one level shallower.
+ */
+static void emit_expression(Generator *gen, const int depth) {
+    if (depth <= 0) {
+        emit_operand(gen);
+        return;
+    }
+    for (int term = 0; term < 2; term++) {
+        if (term > 0) emit(gen, " + ");
+        if (gen->allow_calls && gen->callees.count > 0 && random_below(gen, 2) == 0) {
+            const Callee *callee = &gen->callees.items[random_below(gen, gen->callees.count)];
+            emit(gen, "%s(", callee->name);
+            for (int a = 0; a < callee->param_count; a++) {
+                if (a > 0) emit(gen, ", ");
+                emit_expression(gen, depth - 1);
+            }
+            emit(gen, ")");
+        } else {
+            emit_expression(gen, depth - 1);
+        }
+    }
+}
+
+static void emit_function(Generator *gen, const char *name, const int param_count, const bool leaf) {
+    gen->param_count = param_count;
+    gen->local_count = 0;
+    gen->allow_calls = !leaf;
+
+    emit(gen, "fun %s", name);
+    if (param_count > 0) {
+        emit(gen, "<");
+        for (int p = 0; p < param_count; p++) {
+            emit(gen, "%sp%d: int", p > 0 ? ", " : "", p);
+        }
+        emit(gen, ">");
+    }
+    emit(gen, "(): int {\n");
+
+    for (int i = 0; i < gen->opts->locals; i++) {
+        emit(gen, "    let v%d<int> = ", i);
+        emit_expression(gen, gen->opts->expr_depth);
+        emit(gen, ";\n");
+        gen->local_count++;
+
+        // Occasionally reassign an earlier local
+        if (i > 0 && random_below(gen, 8) == 0) {
+            emit(gen, "    v%d = ", random_below(gen, i));
+            emit_expression(gen, gen->opts->expr_depth);
+            emit(gen, ";\n");
+        }
+    }
+
+    emit(gen, "    return ");
+    emit_expression(gen, gen->opts->expr_depth);
+    emit(gen, ";\n}\n\n");
+}
+
+/*
+ * Emit the functions of a module.  The first eighth are leaves, which the
+ * rest (and importers) may call.
+ */
+static void emit_module_functions(Generator *gen, const char *prefix, const bool is_main) {
+    const int leaves = gen->opts->functions / 8 > 0 ? gen->opts->functions / 8 : 1;
+    int count = 0;
+    while (count < gen->opts->functions ||
+           (is_main && gen->opts->target_size > 0 && gen->bytes < gen->opts->target_size)) {
+        char name[32];
+        snprintf(name, sizeof(name), "%sf%d", prefix, count);
+        const int param_count = random_below(gen, MAX_PARAMS + 1);
+        const bool leaf = !is_main || count < leaves;
+        emit_function(gen, name, param_count, leaf);
+        if (leaf) add_callee(&gen->callees, name, param_count);
+        add_callee(&gen->defined, name, param_count);
+        count++;
+    }
+}
+
+static FILE *open_output(const GeneratorOptions *opts, const char *file_name) {
+    if (!opts->out_dir) return stdout;
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", opts->out_dir, file_name);
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        fprintf(stderr, "Cannot write %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    return out;
+}
+
+static void print_usage(const char *program_name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "Options:\n"
+            "  -h, --help              Show this help message\n"
+            "  -s, --seed=<n>          Random seed (default: 1)\n"
+            "  -f, --functions=<n>     Functions per module (default: 16)\n"
+            "  -l, --locals=<n>        Locals per function (default: 8)\n"
+            "  -d, --expr-depth=<n>    Expression nesting depth (default: 2)\n"
+            "  -i, --imports=<n>       Number of imported modules (default: 0)\n"
+            "  -b, --size=<bytes>      Keep adding functions until main.bc reaches this size\n"
+            "  -o, --output-dir=<dir>  Write main.bc and mod_<k>.bc into <dir>\n"
+            "                          (default: main module on stdout, requires --imports=0)\n",
+            program_name);
+}
+
+int main(const int argc, char *argv[]) {
+    GeneratorOptions opts = {
+        .seed = 1,
+        .functions = 16,
+        .locals = 8,
+        .expr_depth = 2,
+    };
+
+    static struct option long_opts[] = {
+        {"help",       no_argument,       0, 'h'},
+        {"seed",       required_argument, 0, 's'},
+        {"functions",  required_argument, 0, 'f'},
+        {"locals",     required_argument, 0, 'l'},
+        {"expr-depth", required_argument, 0, 'd'},
+        {"imports",    required_argument, 0, 'i'},
+        {"size",       required_argument, 0, 'b'},
+        {"output-dir", required_argument, 0, 'o'},
+        {0,0,0,0}
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "hs:f:l:d:i:b:o:", long_opts, NULL)) != -1) {
+        switch (opt) {
+            case 'h': print_usage(argv[0]); return EXIT_SUCCESS;
+            case 's': opts.seed = strtoull(optarg, NULL, 10);     break;
+            case 'f': opts.functions = atoi(optarg);              break;
+            case 'l': opts.locals = atoi(optarg);                 break;
+            case 'd': opts.expr_depth = atoi(optarg);             break;
+            case 'i': opts.imports = atoi(optarg);                break;
+            case 'b': opts.target_size = strtol(optarg, NULL, 10); break;
+            case 'o': opts.out_dir = optarg;                      break;
+            default: print_usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+    if (opts.functions < 1 || opts.locals < 0 || opts.expr_depth < 0 || opts.imports < 0) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (opts.imports > 0 && !opts.out_dir) {
+        fprintf(stderr, "--imports requires --output-dir\n");
+        return EXIT_FAILURE;
+    }
+
+    // The main module may call every function exported by the imports
+    Generator main_gen = {.rng = opts.seed ? opts.seed : 1, .opts = &opts};
+
+    for (int k = 0; k < opts.imports; k++) {
+        char file_name[64];
+        char prefix[32];
+        snprintf(file_name, sizeof(file_name), "mod_%d.bc", k);
+        snprintf(prefix, sizeof(prefix), "m%d_", k);
+
+        Generator mod_gen = {
+            .out = open_output(&opts, file_name),
+            .rng = (opts.seed ? opts.seed : 1) + (uint64_t) k + 1,
+            .opts = &opts
+        };
+        emit_module_functions(&mod_gen, prefix, false);
+        fclose(mod_gen.out);
+
+        for (int i = 0; i < mod_gen.defined.count; i++) {
+            add_callee(&main_gen.callees, mod_gen.defined.items[i].name, mod_gen.defined.items[i].param_count);
+        }
+        free(mod_gen.callees.items);
+        free(mod_gen.defined.items);
+    }
+
+    main_gen.out = open_output(&opts, "main.bc");
+    emit(&main_gen, "import <stdio.s>\n");
+    for (int k = 0; k < opts.imports; k++) {
+        emit(&main_gen, "import \"mod_%d.bc\"\n", k);
+    }
+    emit(&main_gen, "\n");
+
+    emit_module_functions(&main_gen, "", true);
+
+    // main sums every function of the module, called with fixed arguments
+    emit(&main_gen, "fun main(): int {\n    let sum<int> = 0;\n");
+    for (int c = 0; c < main_gen.defined.count; c++) {
+        const Callee *callee = &main_gen.defined.items[c];
+        emit(&main_gen, "    sum = sum + %s(", callee->name);
+        for (int a = 0; a < callee->param_count; a++) {
+            emit(&main_gen, "%s%d", a > 0 ? ", " : "", a + 1);
+        }
+        emit(&main_gen, ");\n");
+    }
+    emit(&main_gen, "    print(sum);\n    return 0;\n}\n");
+
+    if (main_gen.out != stdout) fclose(main_gen.out);
+    free(main_gen.callees.items);
+    free(main_gen.defined.items);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,699 @@
+/**
+ * @file test_runner.c
+ * @brief Parallel test runner for BasicCodeCompiler (bcc-test).
+ *
+ * Every test in tests/test_files/ is compiled and executed in its own
+ * scratch directory, so tests never share tmp/ or executables and can run
+ * concurrently.  Up to one test per core runs at a time.  Each phase has a
+ * timeout, and the compile and run times of every test are recorded in an
+ * optional TAP or JUnit report.
+ *
+ * A test may come with a <name>.flags file next to its source: the
+ * compiler options it is built with, one line separated by spaces.  Modules
+ * the tests import live in tests/test_files/modules/ and are not tests
+ * themselves.
+ *
+ * With --differential, every test is also run with `bcc --run` and the two
+ * outputs must agree with each other as well as with the expected result.
+ * The compiled half is skipped, with a note, when the ARM toolchain is not
+ * on the PATH.
+ *
+ * A test is a supervisor process forked by the runner.  It forks the
+ * compiler and the program under test in their own process groups so a
+ * timeout can kill everything they spawned, then writes its result into a
+ * shared memory slot read by the runner once the supervisor exits.
+ */
+
+#define _XOPEN_SOURCE 700
+#define _DEFAULT_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <getopt.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+#define DEFAULT_TIMEOUT 10.0   ///< Seconds allowed per phase
+#define POLL_INTERVAL_NS 1000000L
+#define MAX_TEST_FLAGS 16      ///< Options read from a .flags file
+#define TOOLCHAIN_PROBE "arm-none-eabi-gcc"
+
+/**
+ * @brief Outcome of a single test.
+ */
+typedef enum {
+    TEST_PASS,
+    TEST_COMPILE_FAILED,
+    TEST_COMPILE_TIMEOUT,
+    TEST_RUN_TIMEOUT,
+    TEST_INTERPRETER_FAILED,
+    TEST_OUTPUT_MISMATCH,
+    TEST_NO_EXPECTED,
+    TEST_DIVERGED,
+    TEST_INTERNAL_ERROR
+} TestStatus;
+
+/**
+ * @brief Result slot shared between the runner and a test supervisor.
+ */
+typedef struct {
+    TestStatus status;
+    double compile_seconds;
+    double run_seconds;
+} TestResult;
+
+/**
+ * @brief A discovered test and its scratch directory.
+ */
+typedef struct {
+    char name[NAME_MAX + 1];      ///< Test name (file name without .bc)
+    char source[PATH_MAX];        ///< Absolute path of the .bc file
+    char expected[PATH_MAX];      ///< Absolute path of the .expected file
+    char scratch[PATH_MAX];       ///< Private working directory
+    char flags[256];              ///< Compiler options from <name>.flags
+    pid_t pid;                    ///< Supervisor process, 0 when not running
+} TestCase;
+
+/**
+ * @brief Runner configuration from the command line.
+ */
+typedef struct {
+    char root[PATH_MAX];          ///< Repository root
+    char bcc[PATH_MAX];           ///< Compiler binary
+    const char *tap_path;         ///< TAP report path or NULL
+    const char *junit_path;       ///< JUnit report path or NULL
+    double timeout;               ///< Seconds allowed per phase
+    long jobs;                    ///< Maximum concurrent tests
+    bool interpreter;             ///< Run tests with `bcc --run`
+    bool differential;            ///< Run tests both ways and compare the outputs
+    bool keep;                    ///< Keep scratch directories of passing tests
+} RunnerOptions;
+
+static const char *status_message(const TestStatus status) {
+    switch (status) {
+        case TEST_PASS:            return "passed";
+        case TEST_COMPILE_FAILED:  return "compilation failed";
+        case TEST_COMPILE_TIMEOUT: return "compilation timed out";
+        case TEST_RUN_TIMEOUT:     return "execution timed out";
+        case TEST_INTERPRETER_FAILED: return "interpreter failed";
+        case TEST_OUTPUT_MISMATCH: return "output mismatch";
+        case TEST_NO_EXPECTED:     return "missing expected result";
+        case TEST_DIVERGED:        return "interpreter and compiled outputs differ";
+        default:                   return "internal error";
+    }
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+static void print_usage(const char *program_name) {
+    fprintf(stderr,
+            "Usage: %s [options] [test.bc...]\n"
+            "Options:\n"
+            "  -h, --help            Show this help message\n"
+            "  -j, --jobs=<n>        Number of tests run concurrently (default: cores)\n"
+            "  -t, --timeout=<sec>   Timeout per compile and run phase (default: %.0f)\n"
+            "  -i, --interpreter     Run tests with 'bcc --run' instead of the ARM toolchain\n"
+            "  -d, --differential    Run tests both ways and compare the outputs\n"
+            "  -k, --keep            Keep scratch directories of passing tests\n"
+            "  -C, --root=<dir>      Repository root (default: .)\n"
+            "      --bcc=<path>      Compiler binary (default: <root>/build/bcc)\n"
+            "      --tap=<file>      Write a TAP report\n"
+            "      --junit=<file>    Write a JUnit XML report\n",
+            program_name, DEFAULT_TIMEOUT);
+}
+
+/**
+ * @brief Run a command in dir with stdout and stderr sent to log_path.
+ *
+ * The child gets its own process group; on timeout the whole group is
+ * killed.
+ *
+ * @return Exit status of the command, -1 if it could not be run, or -2 on timeout.
+ */
+static int run_with_timeout(char *const argv[], const char *dir, const char *log_path,
+                            const double timeout, double *elapsed) {
+    const double start = now_seconds();
+    const pid_t pid = fork();
+    if (pid < 0) return -1;
+
+    if (pid == 0) {
+        setpgid(0, 0);
+        const int fd = open(log_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0 || chdir(dir) != 0) _exit(127);
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+        close(fd);
+        execv(argv[0], argv);
+        _exit(127);
+    }
+    setpgid(pid, pid);
+
+    const struct timespec interval = {0, POLL_INTERVAL_NS};
+    int status = 0;
+    while (true) {
+        const pid_t done = waitpid(pid, &status, WNOHANG);
+        if (done == pid) break;
+        if (done < 0 && errno != EINTR) return -1;
+        if (now_seconds() - start > timeout) {
+            kill(-pid, SIGKILL);
+            waitpid(pid, &status, 0);
+            *elapsed = now_seconds() - start;
+            return -2;
+        }
+        nanosleep(&interval, NULL);
+    }
+    *elapsed = now_seconds() - start;
+
+    // Reap anything the command left behind in its group
+    kill(-pid, SIGKILL);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+/**
+ * @brief snprintf for paths that reports truncation instead of silently cutting.
+ */
+static bool format_path(char *out, const size_t size, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    const int n = vsnprintf(out, size, fmt, args);
+    va_end(args);
+    if (n < 0 || (size_t) n >= size) {
+        fprintf(stderr, "Path too long: %s\n", out);
+        return false;
+    }
+    return true;
+}
+
+static bool files_equal(const char *a, const char *b) {
+    FILE *fa = fopen(a, "rb");
+    FILE *fb = fopen(b, "rb");
+    bool equal = fa && fb;
+    while (equal) {
+        const int ca = fgetc(fa);
+        const int cb = fgetc(fb);
+        if (ca != cb) equal = false;
+        if (ca == EOF || cb == EOF) break;
+    }
+    if (fa) fclose(fa);
+    if (fb) fclose(fb);
+    return equal;
+}
+
+static int remove_entry(const char *path, const struct stat *sb, const int flag, struct FTW *ftw) {
+    (void) sb;
+    (void) flag;
+    (void) ftw;
+    return remove(path);
+}
+
+static void remove_tree(const char *path) {
+    nftw(path, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+/**
+ * @brief Link a repository directory (scripts/, lib/) into the scratch directory.
+ *
+ * The compiler resolves both relative to its working directory.
+ */
+static void link_repo_dir(const RunnerOptions *opts, const char *scratch, const char *name) {
+    char target[PATH_MAX];
+    char link_path[PATH_MAX];
+    format_path(target, sizeof(target), "%s/%s", opts->root, name);
+    format_path(link_path, sizeof(link_path), "%s/%s", scratch, name);
+    if (access(target, F_OK) == 0) {
+        if (symlink(target, link_path) != 0) {
+            fprintf(stderr, "Failed to link %s into %s\n", name, scratch);
+        }
+    }
+}
+
+/**
+ * @brief Build the compiler command line of a test: bcc, its flags, then extra.
+ */
+static void build_command(const RunnerOptions *opts, const TestCase *test, char *flags_copy,
+                          char **argv, const char *extra) {
+    size_t argc = 0;
+    argv[argc++] = (char *) opts->bcc;
+    strcpy(flags_copy, test->flags);
+    for (char *tok = strtok(flags_copy, " \t"); tok && argc < MAX_TEST_FLAGS + 1; tok = strtok(NULL, " \t")) {
+        argv[argc++] = tok;
+    }
+    argv[argc++] = (char *) extra;
+    argv[argc++] = (char *) test->source;
+    argv[argc] = NULL;
+}
+
+/**
+ * @brief Run a test with `bcc --run`, writing its output to output_path.
+ *
+ * bcc exits with the status of main, and tests return 0, so any other
+ * status is a program bcc could not load or run.
+ */
+static TestStatus interpret_test(const RunnerOptions *opts, const TestCase *test, const char *output_path,
+                                 TestResult *result) {
+    char flags[sizeof(test->flags)];
+    char *argv[MAX_TEST_FLAGS + 4];
+    build_command(opts, test, flags, argv, "--run");
+    const int rc = run_with_timeout(argv, test->scratch, output_path, opts->timeout, &result->run_seconds);
+    if (rc == -2) return TEST_RUN_TIMEOUT;
+    return rc == 0 ? TEST_PASS : TEST_INTERPRETER_FAILED;
+}
+
+/**
+ * @brief Compile a test with the ARM toolchain and run it, writing its output to output_path.
+ */
+static TestStatus compile_and_run_test(const RunnerOptions *opts, const TestCase *test, const char *output_path,
+                                       TestResult *result) {
+    char log_path[PATH_MAX];
+    format_path(log_path, sizeof(log_path), "%s/compile.log", test->scratch);
+
+    char flags[sizeof(test->flags)];
+    char *compile_argv[MAX_TEST_FLAGS + 4];
+    build_command(opts, test, flags, compile_argv, "-s");
+    const int rc = run_with_timeout(compile_argv, test->scratch, log_path, opts->timeout, &result->compile_seconds);
+    if (rc == -2) return TEST_COMPILE_TIMEOUT;
+
+    char exe_path[PATH_MAX];
+    format_path(exe_path, sizeof(exe_path), "%s/%s", test->scratch, test->name);
+    if (rc != 0 || access(exe_path, X_OK) != 0) return TEST_COMPILE_FAILED;
+
+    char *const run_argv[] = {exe_path, NULL};
+    if (run_with_timeout(run_argv, test->scratch, output_path, opts->timeout, &result->run_seconds) == -2) {
+        return TEST_RUN_TIMEOUT;
+    }
+    return TEST_PASS;
+}
+
+/**
+ * @brief Body of a test supervisor: compile, run and compare one test.
+ */
+static TestResult run_test(const RunnerOptions *opts, const TestCase *test) {
+    TestResult result = {.status = TEST_INTERNAL_ERROR};
+    char output_path[PATH_MAX];
+    char reference_path[PATH_MAX];
+    format_path(output_path, sizeof(output_path), "%s/output.txt", test->scratch);
+    format_path(reference_path, sizeof(reference_path), "%s/run-output.txt", test->scratch);
+
+    if (access(test->expected, R_OK) != 0) {
+        result.status = TEST_NO_EXPECTED;
+        return result;
+    }
+
+    link_repo_dir(opts, test->scratch, "scripts");
+    link_repo_dir(opts, test->scratch, "lib");
+
+    if (opts->interpreter) {
+        result.status = interpret_test(opts, test, output_path, &result);
+        if (result.status != TEST_PASS) return result;
+    } else if (opts->differential) {
+        result.status = interpret_test(opts, test, reference_path, &result);
+        if (result.status != TEST_PASS) return result;
+        const double reference_seconds = result.run_seconds;
+        result.status = compile_and_run_test(opts, test, output_path, &result);
+        result.run_seconds += reference_seconds;
+        if (result.status != TEST_PASS) return result;
+        if (!files_equal(output_path, reference_path)) {
+            result.status = TEST_DIVERGED;
+            return result;
+        }
+    } else {
+        result.status = compile_and_run_test(opts, test, output_path, &result);
+        if (result.status != TEST_PASS) return result;
+    }
+
+    result.status = files_equal(output_path, test->expected) ? TEST_PASS : TEST_OUTPUT_MISMATCH;
+    return result;
+}
+
+/**
+ * @brief Whether an executable named program is found on the PATH.
+ */
+static bool on_path(const char *program) {
+    const char *path = getenv("PATH");
+    if (!path) return false;
+    char *dirs = strdup(path);
+    bool found = false;
+    for (char *dir = strtok(dirs, ":"); dir && !found; dir = strtok(NULL, ":")) {
+        char candidate[PATH_MAX];
+        if (snprintf(candidate, sizeof(candidate), "%s/%s", *dir ? dir : ".", program) < (int) sizeof(candidate)) {
+            found = access(candidate, X_OK) == 0;
+        }
+    }
+    free(dirs);
+    return found;
+}
+
+/**
+ * @brief Read the compiler options of a test from its .flags file, if any.
+ */
+static void read_flags(TestCase *test) {
+    char path[PATH_MAX];
+    const char *dot = strrchr(test->source, '.');
+    const int stem = dot ? (int) (dot - test->source) : (int) strlen(test->source);
+    if (!format_path(path, sizeof(path), "%.*s.flags", stem, test->source)) return;
+    FILE *in = fopen(path, "r");
+    if (!in) return;
+    if (fgets(test->flags, sizeof(test->flags), in)) {
+        test->flags[strcspn(test->flags, "\r\n")] = '\0';
+    }
+    fclose(in);
+}
+
+static void add_test(TestCase **tests, size_t *count, size_t *cap, const RunnerOptions *opts, const char *path) {
+    char source[PATH_MAX];
+    if (!realpath(path, source)) {
+        fprintf(stderr, "Test file not found: %s\n", path);
+        return;
+    }
+    if (*count >= *cap) {
+        *cap = *cap ? *cap * 2 : 64;
+        *tests = realloc(*tests, *cap * sizeof(TestCase));
+        if (!*tests) {
+            fprintf(stderr, "Memory allocation failed in add_test\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    TestCase *test = &(*tests)[(*count)++];
+    memset(test, 0, sizeof(*test));
+    strncpy(test->source, source, sizeof(test->source) - 1);
+
+    const char *base = strrchr(source, '/');
+    base = base ? base + 1 : source;
+    strncpy(test->name, base, sizeof(test->name) - 1);
+    char *dot = strrchr(test->name, '.');
+    if (dot) *dot = '\0';
+
+    format_path(test->expected, sizeof(test->expected), "%s/tests/expected_results/%s.expected",
+             opts->root, test->name);
+    read_flags(test);
+}
+
+static int compare_tests(const void *a, const void *b) {
+    return strcmp(((const TestCase *) a)->name, ((const TestCase *) b)->name);
+}
+
+/**
+ * @brief Collect every .bc file in tests/test_files/, sorted by name.
+ */
+static void discover_tests(TestCase **tests, size_t *count, size_t *cap, const RunnerOptions *opts) {
+    char dir_path[PATH_MAX];
+    format_path(dir_path, sizeof(dir_path), "%s/tests/test_files", opts->root);
+    DIR *dir = opendir(dir_path);
+    if (!dir) return;
+
+    const struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        const size_t len = strlen(entry->d_name);
+        if (len > 3 && strcmp(entry->d_name + len - 3, ".bc") == 0) {
+            char path[PATH_MAX];
+            format_path(path, sizeof(path), "%s/%s", dir_path, entry->d_name);
+            add_test(tests, count, cap, opts, path);
+        }
+    }
+    closedir(dir);
+    qsort(*tests, *count, sizeof(TestCase), compare_tests);
+}
+
+/**
+ * @brief Keep the assembly of a failed test in tests/failed_assemblies/.
+ */
+static void save_failed_assembly(const RunnerOptions *opts, const TestCase *test) {
+    char tmp_dir[PATH_MAX];
+    format_path(tmp_dir, sizeof(tmp_dir), "%s/tmp", test->scratch);
+    DIR *dir = opendir(tmp_dir);
+    if (!dir) return;
+
+    char suffix[NAME_MAX + 4];
+    format_path(suffix, sizeof(suffix), "_%s.s", test->name);
+    const size_t suffix_len = strlen(suffix);
+
+    const struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        const size_t len = strlen(entry->d_name);
+        if (len < suffix_len || strcmp(entry->d_name + len - suffix_len, suffix) != 0) continue;
+
+        char from[PATH_MAX * 2];
+        char to[PATH_MAX * 2];
+        format_path(from, sizeof(from), "%s/%s", tmp_dir, entry->d_name);
+        format_path(to, sizeof(to), "%s/tests/failed_assemblies/%s.s", opts->root, test->name);
+        FILE *in = fopen(from, "rb");
+        FILE *out = fopen(to, "wb");
+        if (in && out) {
+            char buf[4096];
+            size_t n;
+            while ((n = fread(buf, 1, sizeof(buf), in)) > 0) fwrite(buf, 1, n, out);
+        }
+        if (in) fclose(in);
+        if (out) fclose(out);
+        break;
+    }
+    closedir(dir);
+}
+
+static void write_tap(const char *path, const TestCase *tests, const TestResult *results, const size_t count) {
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        fprintf(stderr, "Failed to write TAP report %s\n", path);
+        return;
+    }
+    fprintf(out, "TAP version 13\n1..%zu\n", count);
+    for (size_t i = 0; i < count; i++) {
+        const TestResult *r = &results[i];
+        fprintf(out, "%s %zu - %s\n", r->status == TEST_PASS ? "ok" : "not ok", i + 1, tests[i].name);
+        fprintf(out, "  ---\n");
+        if (r->status != TEST_PASS) {
+            fprintf(out, "  message: '%s'\n", status_message(r->status));
+        }
+        fprintf(out, "  compile_time: %.6f\n  run_time: %.6f\n  ...\n", r->compile_seconds, r->run_seconds);
+    }
+    fclose(out);
+}
+
+static void write_xml_escaped(FILE *out, const char *text) {
+    for (; *text; text++) {
+        switch (*text) {
+            case '<':  fputs("&lt;", out); break;
+            case '>':  fputs("&gt;", out); break;
+            case '&':  fputs("&amp;", out); break;
+            case '"':  fputs("&quot;", out); break;
+            default:   fputc(*text, out); break;
+        }
+    }
+}
+
+static void write_junit(const char *path, const TestCase *tests, const TestResult *results,
+                        const size_t count, const double total_seconds) {
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        fprintf(stderr, "Failed to write JUnit report %s\n", path);
+        return;
+    }
+    size_t failures = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (results[i].status != TEST_PASS) failures++;
+    }
+    fprintf(out, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+    fprintf(out, "<testsuite name=\"bcc\" tests=\"%zu\" failures=\"%zu\" time=\"%.6f\">\n",
+            count, failures, total_seconds);
+    for (size_t i = 0; i < count; i++) {
+        const TestResult *r = &results[i];
+        fprintf(out, "  <testcase classname=\"bcc.tests\" name=\"");
+        write_xml_escaped(out, tests[i].name);
+        fprintf(out, "\" time=\"%.6f\">\n", r->compile_seconds + r->run_seconds);
+        if (r->status != TEST_PASS) {
+            fprintf(out, "    <failure message=\"%s\"/>\n", status_message(r->status));
+        }
+        fprintf(out, "    <system-out>compile_time=%.6f run_time=%.6f</system-out>\n",
+                r->compile_seconds, r->run_seconds);
+        fprintf(out, "  </testcase>\n");
+    }
+    fprintf(out, "</testsuite>\n");
+    fclose(out);
+}
+
+static bool parse_options(const int argc, char *argv[], RunnerOptions *opts, int *first_test) {
+    enum { OPT_BCC = 256, OPT_TAP, OPT_JUNIT };
+    static struct option long_opts[] = {
+        {"help",        no_argument,       0, 'h'},
+        {"jobs",        required_argument, 0, 'j'},
+        {"timeout",     required_argument, 0, 't'},
+        {"interpreter", no_argument,       0, 'i'},
+        {"differential", no_argument,      0, 'd'},
+        {"keep",        no_argument,       0, 'k'},
+        {"root",        required_argument, 0, 'C'},
+        {"bcc",         required_argument, 0, OPT_BCC},
+        {"tap",         required_argument, 0, OPT_TAP},
+        {"junit",       required_argument, 0, OPT_JUNIT},
+        {0,0,0,0}
+    };
+
+    const char *root = ".";
+    const char *bcc = NULL;
+    opts->timeout = DEFAULT_TIMEOUT;
+    opts->jobs = sysconf(_SC_NPROCESSORS_ONLN);
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "hj:t:idkC:", long_opts, NULL)) != -1) {
+        switch (opt) {
+            case 'h': print_usage(argv[0]); exit(EXIT_SUCCESS);
+            case 'j': opts->jobs = strtol(optarg, NULL, 10); break;
+            case 't': opts->timeout = strtod(optarg, NULL);   break;
+            case 'i': opts->interpreter = true;               break;
+            case 'd': opts->differential = true;              break;
+            case 'k': opts->keep = true;                      break;
+            case 'C': root = optarg;                          break;
+            case OPT_BCC: bcc = optarg;                       break;
+            case OPT_TAP: opts->tap_path = optarg;            break;
+            case OPT_JUNIT: opts->junit_path = optarg;        break;
+            default: return false;
+        }
+    }
+    if (opts->jobs < 1) opts->jobs = 1;
+    if (opts->timeout <= 0) opts->timeout = DEFAULT_TIMEOUT;
+
+    if (!realpath(root, opts->root)) {
+        fprintf(stderr, "Repository root not found: %s\n", root);
+        return false;
+    }
+    if (bcc) {
+        if (!realpath(bcc, opts->bcc)) {
+            fprintf(stderr, "Compiler not found: %s\n", bcc);
+            return false;
+        }
+    } else {
+        format_path(opts->bcc, sizeof(opts->bcc), "%s/build/bcc", opts->root);
+    }
+    *first_test = optind;
+    return true;
+}
+
+int main(const int argc, char *argv[]) {
+    RunnerOptions opts = {0};
+    int first_test = argc;
+    if (!parse_options(argc, argv, &opts, &first_test)) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (opts.differential && !opts.interpreter && !on_path(TOOLCHAIN_PROBE)) {
+        printf("Note: %s not found, comparing interpreter results only\n", TOOLCHAIN_PROBE);
+        opts.interpreter = true;
+    }
+
+    TestCase *tests = NULL;
+    size_t count = 0, cap = 0;
+    if (first_test < argc) {
+        for (int i = first_test; i < argc; i++) add_test(&tests, &count, &cap, &opts, argv[i]);
+    } else {
+        discover_tests(&tests, &count, &cap, &opts);
+    }
+
+    if (count == 0) {
+        printf("No test files found in %s/tests/test_files.\n", opts.root);
+        printf("==============================\n");
+        printf("Total: 0, Passed: 0, Failed: 0\n");
+        free(tests);
+        return EXIT_SUCCESS;
+    }
+
+    char failed_dir[PATH_MAX];
+    format_path(failed_dir, sizeof(failed_dir), "%s/tests/failed_assemblies", opts.root);
+    mkdir(failed_dir, 0755);
+
+    TestResult *results = mmap(NULL, count * sizeof(TestResult), PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (results == MAP_FAILED) {
+        fprintf(stderr, "Failed to map result table\n");
+        free(tests);
+        return EXIT_FAILURE;
+    }
+
+    const char *tmpdir = getenv("TMPDIR");
+    if (!tmpdir || !*tmpdir) tmpdir = "/tmp";
+
+    const double start = now_seconds();
+    size_t next = 0, running = 0, passed = 0, failed = 0;
+    while (next < count || running > 0) {
+        // Start tests until every job slot is busy
+        while (next < count && running < (size_t) opts.jobs) {
+            TestCase *test = &tests[next];
+            results[next] = (TestResult){.status = TEST_INTERNAL_ERROR};
+            format_path(test->scratch, sizeof(test->scratch), "%s/bcc-test-%s-XXXXXX", tmpdir, test->name);
+            if (!mkdtemp(test->scratch)) {
+                fprintf(stderr, "Failed to create scratch directory for %s\n", test->name);
+                next++;
+                continue;
+            }
+            fflush(stdout);
+            const pid_t pid = fork();
+            if (pid == 0) {
+                results[next] = run_test(&opts, test);
+                _exit(0);
+            }
+            if (pid < 0) {
+                fprintf(stderr, "Failed to start test %s\n", test->name);
+                next++;
+                continue;
+            }
+            test->pid = pid;
+            running++;
+            next++;
+        }
+
+        const pid_t done = wait(NULL);
+        if (done < 0) break;
+        for (size_t i = 0; i < next; i++) {
+            TestCase *test = &tests[i];
+            if (test->pid != done) continue;
+            test->pid = 0;
+            running--;
+
+            const TestResult *r = &results[i];
+            if (r->status == TEST_PASS) {
+                printf("[PASS] %s (compile %.3fs, run %.3fs)\n", test->name, r->compile_seconds, r->run_seconds);
+                passed++;
+                if (!opts.keep) remove_tree(test->scratch);
+            } else {
+                printf("[FAIL] %s (%s) scratch: %s\n", test->name, status_message(r->status), test->scratch);
+                save_failed_assembly(&opts, test);
+                failed++;
+            }
+            break;
+        }
+    }
+    const double total_seconds = now_seconds() - start;
+
+    // Tests that never started (setup failures) count as failures
+    failed = count - passed;
+
+    if (opts.tap_path) write_tap(opts.tap_path, tests, results, count);
+    if (opts.junit_path) write_junit(opts.junit_path, tests, results, count, total_seconds);
+
+    printf("==============================\n");
+    printf("Total: %zu, Passed: %zu, Failed: %zu (%.2fs, %ld jobs)\n",
+           count, passed, failed, total_seconds, opts.jobs);
+
+    munmap(results, count * sizeof(TestResult));
+    free(tests);
+    return failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}